@@ -51,6 +51,7 @@
 #include "UI/SplashWindow.h"
 #include "UI/TextEditor/TextLanguage.h"
 #include "UI/TextEditor/TextStyle.h"
+#include "Utility/ParallelJob.h"
 #include "Utility/Tokenizer.h"
 #include <wx/button.h>
 #include <wx/clipbrd.h>
@@ -120,6 +121,7 @@ CVAR(String, temp_location_custom, "", CVAR_SAVE)
 CVAR(Bool, setup_wizard_run, false, CVAR_SAVE)
 CVAR(Bool, update_check, true, CVAR_SAVE)
 CVAR(Bool, update_check_beta, false, CVAR_SAVE)
+CVAR(Int, startup_threads, 0, CVAR_SAVE)
 
 
 /*******************************************************************
@@ -319,6 +321,106 @@ public:
 };
 
 
+/* StartupJob class
+ * Runs startup tasks that only read configuration (from slade.pk3
+ * and the user directory) and don't touch the UI concurrently. A
+ * task can depend on an earlier task, and waits for it to finish
+ * before running. The time each task took is kept for the startup
+ * timing report
+ *******************************************************************/
+class StartupJob : public ParallelJob
+{
+public:
+	struct task_t
+	{
+		string	name;
+		void	(*func)();
+		int		depends;	// Index of the task this one depends on (-1 for none)
+		bool	done;
+		long	time;
+	};
+
+private:
+	vector<task_t>	tasks;
+	wxMutex			mutex;
+	wxCondition		task_done;
+
+public:
+	StartupJob() : task_done(mutex) {}
+	~StartupJob() {}
+
+	unsigned	nTasks() { return tasks.size(); }
+	task_t&		getTask(unsigned index) { return tasks[index]; }
+
+	void addTask(string name, void (*func)(), string depends = "")
+	{
+		task_t task;
+		task.name = name;
+		task.func = func;
+		task.depends = -1;
+		task.done = false;
+		task.time = 0;
+
+		// Tasks can only depend on tasks added before them, so that a
+		// dependency has always been started when a task waits for it
+		for (unsigned a = 0; a < tasks.size(); a++)
+		{
+			if (tasks[a].name == depends)
+				task.depends = a;
+		}
+
+		tasks.push_back(task);
+	}
+
+	void process(unsigned index)
+	{
+		task_t& task = tasks[index];
+
+		// Wait for the task this one depends on
+		if (task.depends >= 0)
+		{
+			wxMutexLocker lock(mutex);
+			while (!tasks[task.depends].done)
+				task_done.Wait();
+		}
+
+		// Run task
+		wxStopWatch sw;
+		task.func();
+		task.time = sw.Time();
+
+		// Let any waiting tasks know it's done
+		wxMutexLocker lock(mutex);
+		task.done = true;
+		task_done.Broadcast();
+	}
+};
+
+/* StartupThread class
+ * A joinable thread that runs a StartupJob in the background while
+ * the startup tasks that need the UI are run on the main thread
+ *******************************************************************/
+class StartupThread : public wxThread
+{
+private:
+	StartupJob*	job;
+	unsigned	threads;
+
+public:
+	StartupThread(StartupJob* job, unsigned threads) : wxThread(wxTHREAD_JOINABLE)
+	{
+		this->job = job;
+		this->threads = threads;
+	}
+
+	ExitCode Entry()
+	{
+		job->run(job->nTasks(), threads, 1);
+		return 0;
+	}
+};
+
+
 /*******************************************************************
  * FUNCTIONS
  *******************************************************************/
@@ -377,6 +479,27 @@ string appPath(string filename, int dir)
 }
 
 
+/* Startup task functions
+ * Run by StartupJob in MainApp::OnInit
+ *******************************************************************/
+void startupEntryFormats()	{ EntryDataFormat::initBuiltinFormats(); }
+void startupEntryTypes()	{ EntryType::loadEntryTypes(); }
+void startupTextLanguages()	{ TextLanguage::loadLanguages(); }
+void startupColours()		{ ColourConfiguration::init(); }
+void startupNodeBuilders()	{ NodeBuilders::init(); }
+void startupExecutables()	{ Executables::init(); }
+
+/* addStartupTime
+ * Adds the time taken by startup [phase] (measured by [timer], which
+ * is then restarted) to the startup timing [report]
+ *******************************************************************/
+void addStartupTime(string& report, string phase, wxStopWatch& timer, string indent = "  ")
+{
+	report += S_FMT("\n%s%s: %ldms", indent, phase, timer.Time());
+	timer.Start();
+}
+
+
 /*******************************************************************
  * SLADELOG CLASS FUNCTIONS
  *******************************************************************/
@@ -818,6 +941,9 @@ bool MainApp::OnInit()
 	if (!singleInstanceCheck())
 		return false;
 
+	wxStopWatch phase_timer;
+	startup_timing = "Startup timing:";
+
 	// Set locale to C so that the tokenizer will work properly
 	// even in locales where the decimal separator is a comma.
 	setlocale(LC_ALL, "C");
@@ -889,76 +1015,105 @@ bool MainApp::OnInit()
 	wxMemoryDC dc;
 	Global::ppi_scale = (double)(dc.GetPPI().x) / 96.0;
 
+	addStartupTime(startup_timing, "Configuration", phase_timer);
+
 	// Show splash screen
 	theSplashWindow->init();
 	theSplashWindow->show("Starting up...");
 
+	// Load all configuration data from slade.pk3 before starting any
+	// concurrent tasks (entry data can't be loaded from the same archive
+	// on multiple threads at once). The config directories' name indices
+	// are also built here, since they would otherwise be built by the
+	// first lookup (getDir/entryAtPath) on whichever thread does it
+	vector<ArchiveEntry*> config_entries;
+	Archive* res_archive = theArchiveManager->programResourceArchive();
+	ArchiveTreeNode* config_dir = res_archive->getDir("config");
+	if (config_dir)
+	{
+		res_archive->getEntryTreeAsList(config_entries, config_dir);
+		config_dir->buildNameIndices(true);
+	}
+	for (unsigned a = 0; a < config_entries.size(); a++)
+		config_entries[a]->getMCData();
+	addStartupTime(startup_timing, "Read slade.pk3 configuration", phase_timer);
+
+	// Start loading entry types, text languages, colours, nodebuilders
+	// and executables in the background
+	wxLogMessage("Loading entry types, text languages and configuration");
+	StartupJob job;
+	job.addTask("Entry data formats", startupEntryFormats);
+	job.addTask("Entry types", startupEntryTypes, "Entry data formats");
+	job.addTask("Text languages", startupTextLanguages);
+	job.addTask("Colour configuration", startupColours);
+	job.addTask("Nodebuilders", startupNodeBuilders);
+	job.addTask("Executables", startupExecutables);
+	StartupThread* thread = new StartupThread(&job, ParallelJob::numThreads(startup_threads));
+	if (thread->Create() != wxTHREAD_NO_ERROR || thread->Run() != wxTHREAD_NO_ERROR)
+	{
+		// Couldn't start the thread, run the tasks here later instead
+		delete thread;
+		thread = NULL;
+	}
+
+	// Meanwhile, do anything that needs the UI or OpenGL on this thread
+	wxStopWatch task_timer;
+	string ui_timing;
+
 	// Init SImage formats
 	SIFormat::initFormats();
+	addStartupTime(ui_timing, "SImage formats", task_timer, "    ");
 
 	// Load program icons
 	wxLogMessage("Loading icons");
 	Icons::loadIcons();
+	addStartupTime(ui_timing, "Icons", task_timer, "    ");
 
 	// Load program fonts
 	Drawing::initFonts();
-
-	// Load entry types
-	wxLogMessage("Loading entry types");
-	EntryDataFormat::initBuiltinFormats();
-	EntryType::loadEntryTypes();
-
-	// Load text languages
-	wxLogMessage("Loading text languages");
-	TextLanguage::loadLanguages();
+	addStartupTime(ui_timing, "Fonts", task_timer, "    ");
 
 	// Init text stylesets
 	wxLogMessage("Loading text style sets");
 	StyleSet::loadResourceStyles();
 	StyleSet::loadCustomStyles();
+	addStartupTime(ui_timing, "Text style sets", task_timer, "    ");
 
-	// Init colour configuration
-	wxLogMessage("Loading colour configuration");
-	ColourConfiguration::init();
-
-	// Init nodebuilders
-	NodeBuilders::init();
-
-	// Init game executables
-	Executables::init();
+	// Wait for the background tasks to finish
+	if (thread)
+	{
+		thread->Wait();
+		delete thread;
+	}
+	else
+		job.run(job.nTasks(), 1, 1);
+	addStartupTime(startup_timing, "Resources (concurrent)", phase_timer);
+	startup_timing += ui_timing;
+	for (unsigned a = 0; a < job.nTasks(); a++)
+		startup_timing += S_FMT("\n    %s: %ldms", job.getTask(a).name, job.getTask(a).time);
 
 	// Init actions
 	initActions();
 	theMainWindow;
 
-	// Init base resource
-	wxLogMessage("Loading base resource");
-	theArchiveManager->initBaseResource();
-	wxLogMessage("Base resource loaded");
-
 	// Show the main window
 	theMainWindow->Show(true);
 	SetTopWindow(theMainWindow);
-	theSplashWindow->SetParent(theMainWindow);
-	theSplashWindow->CentreOnParent();
-
-	// Open any archives on the command line
-	// argv[0] is normally the executable itself (i.e. Slade.exe)
-	// and opening it as an archive should not be attempted...
-	for (int a = 1; a < argc; a++)
-	{
-		string arg = argv[a];
-		theArchiveManager->openArchive(arg);
-	}
 
 	// Hide splash screen
 	theSplashWindow->hide();
+	addStartupTime(startup_timing, "Main window", phase_timer);
+
+	// Open the base resource and any archives on the command line once
+	// the main window is up
+	CallAfter(&MainApp::openStartupArchives);
 
 	init_ok = true;
 	wxLogMessage("SLADE Initialisation OK");
 
 	// Init game configuration
 	theGameConfiguration->init();
+	addStartupTime(startup_timing, "Game configuration", phase_timer);
 
 	// Show Setup Wizard if needed
 	if (!setup_wizard_run)
@@ -985,6 +1140,36 @@ bool MainApp::OnInit()
 	return true;
 }
 
+/* MainApp::openStartupArchives
+ * Opens the base resource archive and any archives given on the
+ * command line, then logs the startup timing report. Called once the
+ * main window has been shown
+ *******************************************************************/
+void MainApp::openStartupArchives()
+{
+	wxStopWatch phase_timer;
+
+	// Init base resource
+	wxLogMessage("Loading base resource");
+	theArchiveManager->initBaseResource();
+	wxLogMessage("Base resource loaded");
+	addStartupTime(startup_timing, "Base resource", phase_timer);
+
+	// Open any archives on the command line
+	// argv[0] is normally the executable itself (i.e. Slade.exe)
+	// and opening it as an archive should not be attempted...
+	for (int a = 1; a < argc; a++)
+	{
+		string arg = argv[a];
+		theArchiveManager->openArchive(arg);
+	}
+	addStartupTime(startup_timing, "Command line archives", phase_timer);
+
+	// Log startup timing report
+	LOG_MESSAGE(1, "%s", startup_timing);
+	startup_timing.Clear();
+}
+
 /* MainApp::OnExit
  * Application shutdown, run when program is closed
  *******************************************************************/
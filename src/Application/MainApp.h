@@ -41,6 +41,7 @@ private:
 	wxSingleInstanceChecker*	single_instance_checker;
 	MainAppFileListener*		file_listener;
 	bool						save_config;
+	string						startup_timing;
 
 public:
 	MainApp();
@@ -60,6 +61,7 @@ public:
 	bool	initDirectories();
 	void	initLogFile();
 	void	initActions();
+	void	openStartupArchives();
 	void	readConfigFile();
 	void	saveConfigFile();
 	bool	isInitialised() { return init_ok; }
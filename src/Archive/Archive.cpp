@@ -33,6 +33,7 @@
 #include "General/Misc.h"
 #include "General/UndoRedo.h"
 #include "General/Clipboard.h"
+#include "Utility/MappedFile.h"
 #include <wx/filename.h>
 #include <wx/dir.h>
 
@@ -58,6 +59,38 @@
  * VARIABLES
  *******************************************************************/
 CVAR(Bool, archive_load_data, false, CVAR_SAVE)
+CVAR(Bool, archive_map_files, true, CVAR_SAVE)
+const unsigned NAME_INDEX_MIN_ENTRIES = 64;	// Directories smaller than this are searched without an index
+
+
+/*******************************************************************
+ * FUNCTIONS
+ *******************************************************************/
+
+/* entryNameKey
+ * Returns the key for an entry [name] in an ArchiveTreeNode name
+ * index. This is the lowercase name, with its extension cut off
+ * (the same way ArchiveEntry::getName does) if [cut_ext] is true
+ *******************************************************************/
+string entryNameKey(string name, bool cut_ext)
+{
+	if (cut_ext)
+	{
+		wxFileName fn(Misc::lumpNameToFileName(name));
+		name = Misc::fileNameToLumpName(fn.GetName());
+	}
+
+	return name.Lower();
+}
+
+/* hasWildcards
+ * Returns true if [name] contains any wildcard characters used by
+ * wxString::Matches
+ *******************************************************************/
+bool hasWildcards(string name)
+{
+	return name.find_first_of("*?") != wxString::npos;
+}
 bool Archive::save_backup = true;
 
 
@@ -77,6 +110,8 @@ ArchiveTreeNode::ArchiveTreeNode(ArchiveTreeNode* parent) : STreeNode(parent)
 
 	// Init variables
 	archive = NULL;
+	name_index_built = false;
+	name_index_noext_built = false;
 }
 
 /* ArchiveTreeNode::~ArchiveTreeNode
@@ -173,6 +208,17 @@ ArchiveEntry* ArchiveTreeNode::getEntry(string name, bool cut_ext)
 	if (name == "")
 		return NULL;
 
+	// Use the name index if the directory has one
+	EntryNameMap* index = nameIndex(cut_ext);
+	if (index)
+	{
+		EntryNameMap::iterator i = index->find(name.Lower());
+		if (i == index->end() || i->second.empty())
+			return NULL;
+
+		return i->second.front();
+	}
+
 	// Go through entries
 	for (unsigned a = 0; a < entries.size(); a++)
 	{
@@ -185,6 +231,192 @@ ArchiveEntry* ArchiveTreeNode::getEntry(string name, bool cut_ext)
 	return NULL;
 }
 
+/* ArchiveTreeNode::getLastEntry
+ * Returns the last entry matching [name] in this directory, or NULL
+ * if no entries match
+ *******************************************************************/
+ArchiveEntry* ArchiveTreeNode::getLastEntry(string name, bool cut_ext)
+{
+	// Check name was given
+	if (name == "")
+		return NULL;
+
+	// Use the name index if the directory has one
+	EntryNameMap* index = nameIndex(cut_ext);
+	if (index)
+	{
+		EntryNameMap::iterator i = index->find(name.Lower());
+		if (i == index->end() || i->second.empty())
+			return NULL;
+
+		return i->second.back();
+	}
+
+	// Go through entries (backwards)
+	for (int a = entries.size() - 1; a >= 0; a--)
+	{
+		// Check for (non-case-sensitive) name match
+		if (S_CMPNOCASE(entries[a]->getName(cut_ext), name))
+			return entries[a];
+	}
+
+	// Not found
+	return NULL;
+}
+
+/* ArchiveTreeNode::getEntriesNamed
+ * Adds all entries matching [name] in this directory to [list], in
+ * directory order. This only works for directories large enough to
+ * have a name index, and returns false (without changing [list]) if
+ * there is no index or [name] contains wildcards, in which case the
+ * caller should search the entries itself
+ *******************************************************************/
+bool ArchiveTreeNode::getEntriesNamed(string name, vector<ArchiveEntry*>& list, bool cut_ext)
+{
+	// Check name can be looked up
+	if (name == "" || hasWildcards(name))
+		return false;
+
+	// Get index
+	EntryNameMap* index = nameIndex(cut_ext);
+	if (!index)
+		return false;
+
+	// Add matching entries
+	EntryNameMap::iterator i = index->find(name.Lower());
+	if (i != index->end())
+		list.insert(list.end(), i->second.begin(), i->second.end());
+
+	return true;
+}
+
+/* ArchiveTreeNode::nameIndex
+ * Returns the name index for this directory (names without extension
+ * if [cut_ext] is true), building it if needed. Returns NULL if the
+ * directory is too small to bother with an index
+ *******************************************************************/
+EntryNameMap* ArchiveTreeNode::nameIndex(bool cut_ext)
+{
+	bool& built = cut_ext ? name_index_noext_built : name_index_built;
+	EntryNameMap& index = cut_ext ? name_index_noext : name_index;
+
+	if (!built)
+	{
+		// Small directories are quick enough to search as-is
+		if (entries.size() < NAME_INDEX_MIN_ENTRIES)
+			return NULL;
+
+		// Build index
+		index.clear();
+		for (unsigned a = 0; a < entries.size(); a++)
+			index[entryNameKey(entries[a]->getName(), cut_ext)].push_back(entries[a]);
+		built = true;
+	}
+
+	return &index;
+}
+
+/* ArchiveTreeNode::buildNameIndices
+ * Builds the name indices for this directory (and all subdirectories
+ * if [subdirs] is true) now rather than on the first name lookup.
+ * Name lookups don't modify the directory after this (directories too
+ * small to be indexed never do), so it can be searched from multiple
+ * threads at once as long as it isn't changed
+ *******************************************************************/
+void ArchiveTreeNode::buildNameIndices(bool subdirs)
+{
+	nameIndex(false);
+	nameIndex(true);
+
+	if (subdirs)
+	{
+		for (unsigned a = 0; a < nChildren(); a++)
+			((ArchiveTreeNode*)getChild(a))->buildNameIndices(true);
+	}
+}
+
+/* ArchiveTreeNode::indexEntry
+ * Adds [entry] (at [index] in this directory, or -1 if unknown) to the
+ * name indices that have been built, keeping entries with the same
+ * name in directory order
+ *******************************************************************/
+void ArchiveTreeNode::indexEntry(ArchiveEntry* entry, int index)
+{
+	for (unsigned i = 0; i < 2; i++)
+	{
+		bool cut_ext = (i == 1);
+		if (!(cut_ext ? name_index_noext_built : name_index_built))
+			continue;
+
+		vector<ArchiveEntry*>& list = (cut_ext ? name_index_noext : name_index)[entryNameKey(entry->getName(), cut_ext)];
+
+		// Add to end if it's the only entry with the name or it was added to the end of the directory
+		if (list.empty() || (index >= 0 && (unsigned)index == entries.size() - 1))
+		{
+			list.push_back(entry);
+			continue;
+		}
+
+		// Otherwise insert it before the first entry with the same name that comes after it
+		// (duplicate names are rare, so the index lookups here shouldn't matter)
+		if (index < 0)
+			index = entryIndex(entry);
+		unsigned pos = 0;
+		while (pos < list.size() && entryIndex(list[pos]) < index)
+			pos++;
+		list.insert(list.begin() + pos, entry);
+	}
+}
+
+/* ArchiveTreeNode::unindexEntry
+ * Removes [entry] from the name indices that have been built, using
+ * [name] as its name (as it may have just been renamed)
+ *******************************************************************/
+void ArchiveTreeNode::unindexEntry(ArchiveEntry* entry, string name)
+{
+	for (unsigned i = 0; i < 2; i++)
+	{
+		bool cut_ext = (i == 1);
+		if (!(cut_ext ? name_index_noext_built : name_index_built))
+			continue;
+
+		EntryNameMap& index = cut_ext ? name_index_noext : name_index;
+		EntryNameMap::iterator found = index.find(entryNameKey(name, cut_ext));
+		if (found == index.end())
+			continue;
+
+		vector<ArchiveEntry*>& list = found->second;
+		for (unsigned a = 0; a < list.size(); a++)
+		{
+			if (list[a] == entry)
+			{
+				list.erase(list.begin() + a);
+				break;
+			}
+		}
+
+		if (list.empty())
+			index.erase(found);
+	}
+}
+
+/* ArchiveTreeNode::entryRenamed
+ * Called when an [entry] in this directory has been renamed from
+ * [old_name], updates the name indices
+ *******************************************************************/
+void ArchiveTreeNode::entryRenamed(ArchiveEntry* entry, string old_name)
+{
+	if (!name_index_built && !name_index_noext_built)
+		return;
+
+	// Ignore the directory entry and entries that aren't in this directory
+	if (entry == dir_entry || entryIndex(entry) < 0)
+		return;
+
+	unindexEntry(entry, old_name);
+	indexEntry(entry);
+}
+
 /* ArchiveTreeNode::numEntries
  * Returns the number of entries in this directory
  *******************************************************************/
@@ -255,6 +487,9 @@ bool ArchiveTreeNode::addEntry(ArchiveEntry* entry, unsigned index)
 	// Set entry's parent to this node
 	entry->parent = this;
 
+	// Update name indices
+	indexEntry(entry, MIN(index, entries.size() - 1));
+
 	return true;
 }
 
@@ -268,6 +503,9 @@ bool ArchiveTreeNode::removeEntry(unsigned index)
 	if (index >= entries.size())
 		return false;
 
+	// Update name indices
+	unindexEntry(entries[index], entries[index]->getName());
+
 	// De-parent entry
 	entries[index]->parent = NULL;
 
@@ -308,6 +546,12 @@ bool ArchiveTreeNode::swapEntries(unsigned index1, unsigned index2)
 	linkEntries(getEntry(index2-1), entry1);
 	linkEntries(entry1, getEntry(index2+1));
 
+	// Update name indices (order of entries with the same name may have changed)
+	unindexEntry(entry1, entry1->getName());
+	indexEntry(entry1, index2);
+	unindexEntry(entry2, entry2->getName());
+	indexEntry(entry2, index1);
+
 	return true;
 }
 
@@ -527,6 +771,7 @@ private:
 	ArchiveEntry*	entry_copy;
 	string			path;
 	unsigned		index;
+	unsigned		size;
 
 public:
 	EntryCreateDeleteUS(bool created, ArchiveEntry* entry)
@@ -536,6 +781,7 @@ public:
 		entry_copy = new ArchiveEntry(*entry);
 		path = entry->getPath();
 		index = entry->getParentDir()->entryIndex(entry);
+		size = entry->getSize();
 	}
 
 	~EntryCreateDeleteUS()
@@ -582,6 +828,11 @@ public:
 		else
 			return createEntry();
 	}
+
+	unsigned dataSize()
+	{
+		return size;
+	}
 };
 
 
@@ -723,9 +974,15 @@ string Archive::getFilename(bool full)
  *******************************************************************/
 bool Archive::open(string filename)
 {
-	// Read the file into a MemChunk
+	// Map the file into memory if possible, otherwise read it into a MemChunk
 	MemChunk mc;
-	if (!mc.importFile(filename))
+	MappedFile* mapping = archive_map_files ? MappedFile::open(filename) : NULL;
+	if (mapping)
+	{
+		mc.importMapped(mapping, 0, mapping->getSize());
+		mapping->release();
+	}
+	else if (!mc.importFile(filename))
 	{
 		Global::error = "Unable to open file. Make sure it isn't in use by another program.";
 		return false;
@@ -735,6 +992,10 @@ bool Archive::open(string filename)
 	string backupname = this->filename;
 	this->filename = filename;
 
+	// Keep a view of the mapped file for loading entry data later
+	if (mc.isMapped())
+		mapped_data.importView(mc, 0, mc.getSize());
+
 	// Load from MemChunk
 	sf::Clock timer;
 	if (open(mc))
@@ -746,6 +1007,7 @@ bool Archive::open(string filename)
 	else
 	{
 		this->filename = backupname;
+		mapped_data.clear();
 		return false;
 	}
 }
@@ -756,6 +1018,11 @@ bool Archive::open(string filename)
  *******************************************************************/
 bool Archive::open(ArchiveEntry* entry)
 {
+	// Only top-level archives view their mapped file, so make sure the
+	// entries of an archive within another don't reference its mapping
+	if (entry)
+		entry->getMCData().detach();
+
 	// Load from entry's data
 	if (entry && open(entry->getMCData()))
 	{
@@ -905,10 +1172,15 @@ bool Archive::save(string filename)
 	}
 	else
 	{
+		// Entries can't keep viewing a mapped file that is about to be overwritten
+		vector<ArchiveEntry*> loaded;
+
 		// Otherwise, file stuff
 		if (!filename.IsEmpty())
 		{
 			// New filename is given (ie 'save as'), write to new file and change archive filename accordingly
+			if (isMappedFile(filename))
+				detachMappedEntries(loaded);
 			success = write(filename);
 			if (success) this->filename = filename;
 
@@ -929,11 +1201,17 @@ bool Archive::save(string filename)
 			}
 
 			// Write it to the file
+			if (isMappedFile(this->filename))
+				detachMappedEntries(loaded);
 			success = write(this->filename);
 
 			// Update variables
 			this->on_disk = true;
 		}
+
+		// Entry offsets will have changed, so map the newly written file
+		if (success)
+			remapFile(loaded);
 	}
 
 	// If saving was successful, update variables and announce save
@@ -969,6 +1247,9 @@ void Archive::close()
 	dir_root = new ArchiveTreeNode();
 	dir_root->archive = this;
 
+	// Release the mapped file
+	mapped_data.clear();
+
 	// Unlock parent entry if it exists
 	if (parent)
 		parent->unlock();
@@ -1004,6 +1285,87 @@ void Archive::entryStateChanged(ArchiveEntry* entry)
 	setModified(true);
 }
 
+/* Archive::loadMappedEntryData
+ * Loads [entry]'s data as a view of the mapped archive file starting
+ * at [offset]. Returns false if the archive file isn't mapped or the
+ * entry doesn't fit within it, in which case the data should be read
+ * from the file as usual
+ *******************************************************************/
+bool Archive::loadMappedEntryData(ArchiveEntry* entry, uint32_t offset)
+{
+	// Check the archive file is mapped
+	if (!mapped_data.hasData())
+		return false;
+
+	// Check entry is within the mapped file
+	uint32_t size = entry->getSize();
+	if (offset > mapped_data.getSize() || size > mapped_data.getSize() - offset)
+		return false;
+
+	return entry->importView(mapped_data, offset, size);
+}
+
+/* Archive::isMappedFile
+ * Returns true if [filename] is the file currently mapped as the
+ * archive's backing store
+ *******************************************************************/
+bool Archive::isMappedFile(string filename)
+{
+	if (!mapped_data.isMapped())
+		return false;
+
+	wxFileName fn(filename);
+	return fn.SameAs(wxFileName(mapped_data.getMapping()->getFilename()));
+}
+
+/* Archive::detachMappedEntries
+ * Loads all entry data into memory so nothing references the mapped
+ * archive file any more, and releases the mapping. Entries that
+ * weren't already loaded are added to [loaded]
+ *******************************************************************/
+void Archive::detachMappedEntries(vector<ArchiveEntry*>& loaded)
+{
+	vector<ArchiveEntry*> entries;
+	getEntryTreeAsList(entries);
+	for (unsigned a = 0; a < entries.size(); a++)
+	{
+		if (!entries[a]->isLoaded())
+		{
+			entries[a]->getMCData();
+			loaded.push_back(entries[a]);
+		}
+
+		entries[a]->getMCData(false).detach();
+	}
+
+	mapped_data.clear();
+}
+
+/* Archive::remapFile
+ * Maps the archive file again after it has been written, and unloads
+ * the entries in [loaded] (that were only loaded for the write) if
+ * entry data isn't kept in memory
+ *******************************************************************/
+void Archive::remapFile(vector<ArchiveEntry*>& loaded)
+{
+	// Don't bother if the archive wasn't already mapped
+	if (!archive_map_files || (!mapped_data.isMapped() && loaded.empty()))
+		return;
+
+	mapped_data.clear();
+	MappedFile* mapping = MappedFile::open(filename);
+	if (!mapping)
+		return;
+	mapped_data.importMapped(mapping, 0, mapping->getSize());
+	mapping->release();
+
+	if (!archive_load_data)
+	{
+		for (unsigned a = 0; a < loaded.size(); a++)
+			loaded[a]->unloadData();
+	}
+}
+
 /* Archive::getEntryTreeAsList
  * Adds the directory structure starting from [start] to [list]
  *******************************************************************/
@@ -1133,6 +1495,12 @@ bool Archive::removeDir(string path, ArchiveTreeNode* base)
 	if (UndoRedo::currentlyRecording())
 		UndoRedo::currentManager()->recordUndoStep(new DirCreateDeleteUS(false, dir));
 
+	// Announce (the entries in the directory are deleted along with it)
+	MemChunk mc;
+	wxUIntPtr ptr = wxPtrToUInt(dir);
+	mc.write(&ptr, sizeof(wxUIntPtr));
+	announce("directory_removing", mc);
+
 	// Remove the directory from its parent
 	if (dir->getParent())
 		dir->getParent()->removeChild(dir);
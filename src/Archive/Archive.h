@@ -6,14 +6,30 @@
 #include "Utility/Tree.h"
 #include "General/ListenerAnnouncer.h"
 
+// Lowercase entry name -> entries with that name (in directory order)
+WX_DECLARE_STRING_HASH_MAP(vector<ArchiveEntry*>, EntryNameMap);
+
 class ArchiveTreeNode : public STreeNode
 {
 	friend class Archive;
+	friend class ArchiveEntry;
 private:
 	Archive*				archive;
 	ArchiveEntry*			dir_entry;
 	vector<ArchiveEntry*>	entries;
 
+	// Name lookup indices, only built for large directories when first
+	// needed (or by buildNameIndices)
+	EntryNameMap			name_index;
+	EntryNameMap			name_index_noext;
+	bool					name_index_built;
+	bool					name_index_noext_built;
+
+	EntryNameMap*	nameIndex(bool cut_ext);
+	void			indexEntry(ArchiveEntry* entry, int index = -1);
+	void			unindexEntry(ArchiveEntry* entry, string name);
+	void			entryRenamed(ArchiveEntry* entry, string old_name);
+
 protected:
 	STreeNode* createChild(string name)
 	{
@@ -34,8 +50,11 @@ public:
 	ArchiveEntry*	getDirEntry() { return dir_entry; }
 	ArchiveEntry*	getEntry(unsigned index);
 	ArchiveEntry*	getEntry(string name, bool cut_ext = false);
+	ArchiveEntry*	getLastEntry(string name, bool cut_ext = false);
+	bool			getEntriesNamed(string name, vector<ArchiveEntry*>& list, bool cut_ext = false);
 	unsigned		numEntries(bool inc_subdirs = false);
 	int				entryIndex(ArchiveEntry* entry, size_t startfrom = 0);
+	void			buildNameIndices(bool subdirs = false);
 
 	void	setName(string name) { dir_entry->name = name; }
 
@@ -104,12 +123,19 @@ private:
 	bool				modified;
 	ArchiveTreeNode*	dir_root;
 
+	bool	isMappedFile(string filename);
+	void	detachMappedEntries(vector<ArchiveEntry*>& loaded);
+	void	remapFile(vector<ArchiveEntry*>& loaded);
+
 protected:
 	archive_desc_t		desc;
 	string			filename;
 	ArchiveEntry*	parent;
 	bool			on_disk;	// Specifies whether the archive exists on disk (as opposed to being newly created)
 	bool			read_only;	// If true, the archive cannot be modified
+	MemChunk		mapped_data;	// View of the memory-mapped archive file, if any
+
+	bool	loadMappedEntryData(ArchiveEntry* entry, uint32_t offset);
 
 public:
 	struct mapdesc_t
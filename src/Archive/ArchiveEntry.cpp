@@ -193,6 +193,19 @@ MemChunk& ArchiveEntry::getMCData(bool allow_load)
 	return data;
 }
 
+/* ArchiveEntry::setName
+ * Sets the entry's name (without changing its state), and lets the
+ * parent directory know so it can keep its name index up to date
+ *******************************************************************/
+void ArchiveEntry::setName(string name)
+{
+	string old_name = this->name;
+	this->name = name;
+
+	if (parent)
+		parent->entryRenamed(this, old_name);
+}
+
 /* ArchiveEntry::setState
  * Sets the entry's state. Won't change state if the change would be
  * redundant (eg new->modified, unmodified->unmodified)
@@ -271,7 +284,7 @@ bool ArchiveEntry::rename(string new_name)
 	}
 
 	// Update attributes
-	name = new_name;
+	setName(new_name);
 	setState(1);
 
 	return true;
@@ -441,6 +454,28 @@ bool ArchiveEntry::importFileStream(wxFile& file, uint32_t len)
 	return false;
 }
 
+/* ArchiveEntry::importView
+ * Sets the entry data to [size] bytes at [offset] within [mc]. If
+ * [mc] views a mapped file the entry data will view the same mapping
+ * (no copy is made until the data is modified). Unlike the other
+ * import functions this doesn't change the entry's type or state and
+ * is allowed on locked entries, it is intended for archives loading
+ * unmodified entry data.
+ * Returns false if the range is invalid, true otherwise
+ *******************************************************************/
+bool ArchiveEntry::importView(MemChunk& mc, uint32_t offset, uint32_t size)
+{
+	// Setup the data view
+	if (!data.importView(mc, offset, size))
+		return false;
+
+	// Update attributes
+	this->size = size;
+	setLoaded();
+
+	return true;
+}
+
 /* ArchiveEntry::importEntry
  * Imports data from another entry into this entry, resizing it
  * and clearing any currently existing data.
@@ -66,7 +66,7 @@ public:
 	ArchiveEntry*		prevEntry()			{ return prev; }
 
 	// Modifiers (won't change entry state, except setState of course :P)
-	void		setName(string name) { this->name = name; }
+	void		setName(string name);
 	void		setLoaded(bool loaded = true) { data_loaded = loaded; }
 	void		setType(EntryType* type, int r = 0) { this->type = type; reliability = r; }
 	void		setState(uint8_t state);
@@ -89,6 +89,7 @@ public:
 	bool	importMemChunk(MemChunk& mc);
 	bool	importFile(string filename, uint32_t offset = 0, uint32_t size = 0);
 	bool	importFileStream(wxFile& file, uint32_t len = 0);
+	bool	importView(MemChunk& mc, uint32_t offset, uint32_t size);
 	bool	importEntry(ArchiveEntry* entry);
 
 	// Data export
@@ -106,6 +107,7 @@ public:
 	void	stateChanged();
 	void	setExtensionByType();
 	int		getTypeReliability() { return (type ? (getType()->getReliability() * reliability / 255) : 0); }
+	int		getDetectReliability() { return reliability; }
 	bool	isInNamespace(string ns);
 };
 
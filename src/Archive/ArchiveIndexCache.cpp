@@ -0,0 +1,337 @@
+/*******************************************************************
+ * SLADE - It's a Doom Editor
+ * Copyright (C) 2008-2014 Simon Judd
+ *
+ * Email:       sirjuddington@gmail.com
+ * Web:         http://slade.mancubus.net
+ * Filename:    ArchiveIndexCache.cpp
+ * Description: Functions to save and load the detected entry types
+ *              of archive files, so that large archives (eg. base
+ *              resource IWADs) can be reopened without reading and
+ *              checking every entry, as long as the file and the
+ *              known entry types haven't changed
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *******************************************************************/
+
+
+/*******************************************************************
+ * INCLUDES
+ *******************************************************************/
+#include "Main.h"
+#include "ArchiveIndexCache.h"
+#include "ArchiveEntry.h"
+#include "EntryType/EntryType.h"
+#include "General/Console/Console.h"
+#include <wx/filename.h>
+#include <wx/file.h>
+#include <wx/dir.h>
+
+
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+CVAR(Bool, archive_index_cache, true, CVAR_SAVE)
+CVAR(Int, archive_index_cache_min_size, 1024, CVAR_SAVE)	// In KB
+#define INDEX_MAGIC		"SLIX"
+#define INDEX_VERSION	1
+
+
+/*******************************************************************
+ * ARCHIVEINDEXCACHE NAMESPACE HELPER FUNCTIONS
+ *******************************************************************/
+namespace ArchiveIndexCache
+{
+	/* ArchiveIndexCache::cacheDir
+	 * Returns the directory index cache files are kept in
+	 *******************************************************************/
+	string cacheDir()
+	{
+		return appPath("archive_index", DIR_USER);
+	}
+
+	/* ArchiveIndexCache::fullPath
+	 * Returns the absolute path of [filename]
+	 *******************************************************************/
+	string fullPath(string filename)
+	{
+		wxFileName fn(filename);
+		fn.MakeAbsolute();
+		return fn.GetFullPath();
+	}
+
+	/* ArchiveIndexCache::fileSize
+	 * Returns the size of the file [filename] in bytes
+	 *******************************************************************/
+	uint64_t fileSize(string filename)
+	{
+		wxFile file(filename);
+		return file.IsOpened() ? (uint64_t)file.Length() : 0;
+	}
+
+	/* ArchiveIndexCache::cacheFile
+	 * Returns the index cache filename for archive [filename]
+	 *******************************************************************/
+	string cacheFile(string filename)
+	{
+		return cacheDir() + "/" + S_FMT("%016llx.idx", (unsigned long long)hash(fullPath(filename)));
+	}
+
+	/* ArchiveIndexCache::typesHash
+	 * Returns a hash of all entry type definitions and ids and the
+	 * program version, so cached types are only used if they would be
+	 * detected the same way
+	 *******************************************************************/
+	uint64_t typesHash()
+	{
+		uint64_t h = hash(Global::version);
+		uint64_t definitions = EntryType::definitionsHash();
+		h = hash(&definitions, sizeof(definitions), h);
+		vector<EntryType*> types = EntryType::allTypes();
+		for (unsigned a = 0; a < types.size(); a++)
+			h = hash(types[a]->getId(), h);
+
+		return h;
+	}
+
+	/* ArchiveIndexCache::fileHeader
+	 * Writes the key identifying archive [filename] (path, size,
+	 * modification time, directory hash and entry types) to [mc]
+	 *******************************************************************/
+	void fileHeader(MemChunk& mc, string filename, uint64_t dir_hash)
+	{
+		uint64_t path_hash = hash(fullPath(filename));
+		uint64_t size = fileSize(filename);
+		int64_t modified = (int64_t)wxFileModificationTime(filename);
+		uint64_t types = typesHash();
+		uint32_t version = INDEX_VERSION;
+
+		mc.write(INDEX_MAGIC, 4);
+		mc.write(&version, 4);
+		mc.write(&path_hash, 8);
+		mc.write(&size, 8);
+		mc.write(&modified, 8);
+		mc.write(&dir_hash, 8);
+		mc.write(&types, 8);
+	}
+
+	/* ArchiveIndexCache::writeString
+	 * Writes [str] to [mc] as a 16bit length followed by UTF-8 text
+	 *******************************************************************/
+	void writeString(MemChunk& mc, const string& str)
+	{
+		wxCharBuffer utf8 = str.ToUTF8();
+		uint16_t len = (uint16_t)MIN(strlen(utf8.data()), 65535);
+		mc.write(&len, 2);
+		mc.write(utf8.data(), len);
+	}
+
+	/* ArchiveIndexCache::readString
+	 * Reads a string written by writeString from [mc] into [str]
+	 *******************************************************************/
+	bool readString(MemChunk& mc, string& str)
+	{
+		uint16_t len = 0;
+		if (!mc.read(&len, 2) || mc.currentPos() + len > mc.getSize())
+			return false;
+
+		str = wxString::FromUTF8((const char*)mc.getData() + mc.currentPos(), len);
+		mc.seek(len, SEEK_CUR);
+		return true;
+	}
+}
+
+
+/*******************************************************************
+ * ARCHIVEINDEXCACHE NAMESPACE FUNCTIONS
+ *******************************************************************/
+
+/* ArchiveIndexCache::hash
+ * Returns the 64bit FNV-1a hash of [size] bytes of [data], continuing
+ * from [hash]
+ *******************************************************************/
+uint64_t ArchiveIndexCache::hash(const void* data, unsigned size, uint64_t hash)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (unsigned a = 0; a < size; a++)
+		hash = (hash ^ bytes[a]) * 1099511628211ULL;
+
+	return hash;
+}
+
+/* ArchiveIndexCache::hash
+ * Returns the 64bit FNV-1a hash of [str], continuing from [hash]
+ *******************************************************************/
+uint64_t ArchiveIndexCache::hash(const string& str, uint64_t hash)
+{
+	wxCharBuffer utf8 = str.ToUTF8();
+	return ArchiveIndexCache::hash(utf8.data(), strlen(utf8.data()), hash);
+}
+
+/* ArchiveIndexCache::canCache
+ * Returns true if the entry types of archive file [filename] can be
+ * cached (the file must exist and be at least
+ * archive_index_cache_min_size KB)
+ *******************************************************************/
+bool ArchiveIndexCache::canCache(string filename)
+{
+	if (!archive_index_cache || filename.IsEmpty() || !wxFileExists(filename))
+		return false;
+
+	return fileSize(filename) >= (uint64_t)archive_index_cache_min_size * 1024;
+}
+
+/* ArchiveIndexCache::applyTypes
+ * Sets the types of [entries] (all entries in archive file
+ * [filename], in the order they are in the file) from the index
+ * cache. [dir_hash] should be a hash of the archive's directory.
+ * Returns false (and doesn't change any entries) if there is no
+ * cached index for the archive, or the archive has changed
+ *******************************************************************/
+bool ArchiveIndexCache::applyTypes(string filename, uint64_t dir_hash, vector<ArchiveEntry*>& entries)
+{
+	if (!canCache(filename))
+		return false;
+
+	string cache_file = cacheFile(filename);
+	if (!wxFileExists(cache_file))
+		return false;
+
+	// Read index file
+	MemChunk mc;
+	if (!mc.importFile(cache_file))
+		return false;
+
+	// Check the key matches
+	MemChunk key;
+	fileHeader(key, filename, dir_hash);
+	if (mc.getSize() < key.getSize() || memcmp(mc.getData(), key.getData(), key.getSize()) != 0)
+	{
+		LOG_MESSAGE(2, "Archive index cache for %s is out of date", filename);
+		return false;
+	}
+	mc.seek(key.getSize(), SEEK_SET);
+
+	// Read type ids
+	uint32_t n_types = 0;
+	if (!mc.read(&n_types, 4))
+		return false;
+	vector<EntryType*> types;
+	for (unsigned a = 0; a < n_types; a++)
+	{
+		string id;
+		if (!readString(mc, id))
+			return false;
+		types.push_back(EntryType::getType(id));
+	}
+
+	// Read entries, checking names and sizes match
+	uint32_t n_entries = 0;
+	if (!mc.read(&n_entries, 4) || n_entries != entries.size())
+		return false;
+	vector<uint16_t> entry_types(n_entries);
+	vector<uint8_t> reliability(n_entries);
+	string name;
+	for (unsigned a = 0; a < n_entries; a++)
+	{
+		uint32_t size = 0;
+		if (!readString(mc, name) || !mc.read(&size, 4) || !mc.read(&entry_types[a], 2) || !mc.read(&reliability[a], 1))
+			return false;
+		if (name != entries[a]->getName() || size != entries[a]->getSize() || entry_types[a] >= types.size())
+		{
+			LOG_MESSAGE(2, "Archive index cache for %s doesn't match entry %d", filename, a);
+			return false;
+		}
+	}
+
+	// Apply types
+	for (unsigned a = 0; a < n_entries; a++)
+		entries[a]->setType(types[entry_types[a]], reliability[a]);
+
+	LOG_MESSAGE(2, "Got entry types for %s from index cache", filename);
+
+	return true;
+}
+
+/* ArchiveIndexCache::saveTypes
+ * Writes the names, sizes and types of [entries] (all entries in
+ * archive file [filename], in the order they are in the file) to the
+ * index cache, see applyTypes
+ *******************************************************************/
+bool ArchiveIndexCache::saveTypes(string filename, uint64_t dir_hash, vector<ArchiveEntry*>& entries)
+{
+	if (!canCache(filename))
+		return false;
+
+	// Get all types used
+	vector<EntryType*> types;
+	vector<uint16_t> entry_types;
+	for (unsigned a = 0; a < entries.size(); a++)
+	{
+		EntryType* type = entries[a]->getType();
+		if (!type)
+			type = EntryType::unknownType();
+
+		unsigned index = 0;
+		while (index < types.size() && types[index] != type)
+			index++;
+		if (index == types.size())
+			types.push_back(type);
+		entry_types.push_back(index);
+	}
+
+	// Write index
+	MemChunk mc;
+	fileHeader(mc, filename, dir_hash);
+	uint32_t n_types = types.size();
+	mc.write(&n_types, 4);
+	for (unsigned a = 0; a < types.size(); a++)
+		writeString(mc, types[a]->getId());
+	uint32_t n_entries = entries.size();
+	mc.write(&n_entries, 4);
+	for (unsigned a = 0; a < entries.size(); a++)
+	{
+		uint32_t size = entries[a]->getSize();
+		uint8_t reliability = (uint8_t)entries[a]->getDetectReliability();
+		writeString(mc, entries[a]->getName());
+		mc.write(&size, 4);
+		mc.write(&entry_types[a], 2);
+		mc.write(&reliability, 1);
+	}
+
+	if (!wxDirExists(cacheDir()))
+		wxMkdir(cacheDir());
+
+	return mc.exportFile(cacheFile(filename));
+}
+
+
+/*******************************************************************
+ * CONSOLE COMMANDS
+ *******************************************************************/
+
+/* Console Command - "archive_index_clear"
+ * Deletes all archive index cache files
+ *******************************************************************/
+CONSOLE_COMMAND(archive_index_clear, 0, false)
+{
+	wxArrayString files;
+	if (wxDirExists(ArchiveIndexCache::cacheDir()))
+		wxDir::GetAllFiles(ArchiveIndexCache::cacheDir(), &files, "*.idx", wxDIR_FILES);
+	for (unsigned a = 0; a < files.size(); a++)
+		wxRemoveFile(files[a]);
+
+	theConsole->logMessage(S_FMT("Removed %d archive index cache files", files.size()));
+}
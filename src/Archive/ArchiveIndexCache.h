@@ -0,0 +1,18 @@
+#ifndef __ARCHIVE_INDEX_CACHE_H__
+#define __ARCHIVE_INDEX_CACHE_H__
+
+class ArchiveEntry;
+
+// Caches the detected types of all entries in archive files on disk,
+// so unchanged archives can be reopened without detecting entry types
+namespace ArchiveIndexCache
+{
+	uint64_t	hash(const void* data, unsigned size, uint64_t hash = 14695981039346656037ULL);
+	uint64_t	hash(const string& str, uint64_t hash = 14695981039346656037ULL);
+
+	bool	canCache(string filename);
+	bool	applyTypes(string filename, uint64_t dir_hash, vector<ArchiveEntry*>& entries);
+	bool	saveTypes(string filename, uint64_t dir_hash, vector<ArchiveEntry*>& entries);
+}
+
+#endif//__ARCHIVE_INDEX_CACHE_H__
@@ -27,6 +27,7 @@
  * INCLUDES
  *******************************************************************/
 #include "Main.h"
+#include "MainApp.h"
 #include "MainEditor/MainWindow.h"
 #include "EntryType.h"
 #include "Utility/Tokenizer.h"
@@ -37,6 +38,8 @@
 #include "MainEditor/BinaryControlLump.h"
 #include "Utility/Parser.h"
 #include "General/Console/ConsoleHelpers.h"
+#include "UI/SplashWindow.h"
+#include "Utility/ParallelJob.h"
 #include <wx/dir.h>
 #include <wx/filename.h>
 
@@ -52,6 +55,150 @@ EntryType			etype_unknown;	// The default, 'unknown' entry type
 EntryType			etype_folder;	// Folder entry type
 EntryType			etype_marker;	// Marker entry type
 EntryType			etype_map;		// Map marker type
+uint64_t			etype_definitions_hash = 14695981039346656037ULL;	// Hash of all definitions read
+CVAR(Int, archive_detect_threads, 0, CVAR_SAVE)	// Threads to use for entry type detection (0 = one per CPU)
+
+
+// Detection index, built once all entry types are loaded so that only
+// the types an entry could possibly match are checked against it
+WX_DECLARE_STRING_HASH_MAP(vector<EntryType*>, EntryTypeListMap);
+bool								detect_index_built = false;
+vector<EntryType*>					detect_generic;		// Types that can't be indexed, always checked
+EntryTypeListMap					detect_by_name;		// Types that need a specific (lowercase) entry name
+EntryTypeListMap					detect_by_ext;		// Types that need a specific (lowercase) entry extension
+std::map<unsigned, vector<EntryType*> >	detect_by_size;	// Types that need a specific entry size
+
+
+/*******************************************************************
+ * ENTRY_MATCH_INFO_T STRUCT
+ *******************************************************************
+ * Info about an entry that is needed when matching it against entry
+ * types. Anything that doesn't depend on the type being checked is
+ * worked out once (or on first use) and kept here
+ */
+struct entry_match_info_t
+{
+	ArchiveEntry*				entry;
+	string						name;			// Lowercase name without extension
+	string						ext;			// Lowercase extension
+	bool						has_ext;
+	string						archive_format;
+	string						section;
+	bool						section_checked;
+	int							text;			// -1 = not checked yet
+	std::map<EntryDataFormat*, int>	format_results;
+
+	entry_match_info_t(ArchiveEntry* entry)
+	{
+		this->entry = entry;
+		section_checked = false;
+		text = -1;
+
+		// Get entry name (lowercase), split at the first extension separator
+		string fn = entry->getName().Lower();
+		size_t ext_sep = fn.find_first_of('.', 0);
+		has_ext = (ext_sep != wxString::npos);
+		if (has_ext)
+		{
+			name = fn.Left(ext_sep);
+			ext = fn.Mid(ext_sep+1);
+		}
+		else
+			name = fn;
+
+		if (entry->getParent())
+			archive_format = entry->getParent()->getFormat();
+	}
+
+	// Returns true if the entry data looks like text
+	bool isText()
+	{
+		if (text < 0)
+		{
+			// Hack for identifying ACS script sources despite DB2 apparently appending
+			// two null bytes to them, which make the memchr test fail.
+			size_t end = entry->getSize() - 1;
+			if (end > 3) end -= 2;
+			text = (entry->getSize() > 0 && memchr(entry->getData(), 0, end) != NULL) ? 0 : 1;
+		}
+
+		return text > 0;
+	}
+
+	// Returns the result of checking the entry data against [format]
+	int formatResult(EntryDataFormat* format)
+	{
+		std::map<EntryDataFormat*, int>::iterator i = format_results.find(format);
+		if (i != format_results.end())
+			return i->second;
+
+		int r = format->isThisFormat(entry->getMCData());
+		format_results[format] = r;
+		return r;
+	}
+
+	// Returns the namespace ('section') the entry is in
+	string getSection()
+	{
+		if (!section_checked)
+		{
+			section = entry->getParent()->detectNamespace(entry);
+			section_checked = true;
+		}
+
+		return section;
+	}
+};
+
+
+/*******************************************************************
+ * ENTRYTYPEDETECTOR CLASS
+ *******************************************************************
+ * Detects the types of a list of entries in parallel, storing the
+ * results (NULL where the type should be left as-is) to be applied
+ * afterwards from the main thread
+ */
+class EntryTypeDetector : public ParallelJob
+{
+private:
+	vector<ArchiveEntry*>&	entries;
+	bool					show_progress;
+
+public:
+	vector<EntryType*>	types;
+	vector<int>			reliability;
+
+	EntryTypeDetector(vector<ArchiveEntry*>& entries, bool show_progress) : entries(entries)
+	{
+		this->show_progress = show_progress;
+		types.resize(entries.size(), NULL);
+		reliability.resize(entries.size(), 0);
+	}
+
+	void process(unsigned index)
+	{
+		ArchiveEntry* entry = entries[index];
+
+		// Do nothing if the entry is a folder or a map marker
+		if (!entry || entry->getType() == &etype_folder || entry->getType() == &etype_map)
+			return;
+
+		// If the entry's size is zero, it's a marker
+		if (entry->getSize() == 0)
+		{
+			types[index] = &etype_marker;
+			return;
+		}
+
+		types[index] = EntryType::matchEntryType(entry, reliability[index]);
+	}
+
+	void progress(unsigned done, unsigned total)
+	{
+		if (show_progress)
+			theSplashWindow->setProgress((float)done / (float)total);
+	}
+};
 
 
 /*******************************************************************
@@ -100,6 +247,9 @@ void EntryType::addToList()
 {
 	entry_types.push_back(this);
 	index = entry_types.size() - 1;
+
+	// Detection index needs rebuilding
+	detect_index_built = false;
 }
 
 /* EntryType::dump
@@ -181,6 +331,20 @@ int EntryType::isThisType(ArchiveEntry* entry)
 	if (!entry)
 		return EDF_FALSE;
 
+	entry_match_info_t info(entry);
+	return isThisType(info);
+}
+
+/* EntryType::isThisType
+ * Returns true if the entry in [info] matches the EntryType's
+ * criteria, false otherwise. Anything that only depends on the entry
+ * (its name, namespace and data format checks) is cached in [info],
+ * so it is only worked out once when checking many types
+ *******************************************************************/
+int EntryType::isThisType(entry_match_info_t& info)
+{
+	ArchiveEntry* entry = info.entry;
+
 	// Check type is detectable
 	if (!detectable)
 		return EDF_FALSE;
@@ -199,7 +363,7 @@ int EntryType::isThisType(ArchiveEntry* entry)
 		bool match = false;
 		for (size_t a = 0; a < match_archive.size(); a++)
 		{
-			if (entry->getParent() && entry->getParent()->getFormat() == match_archive[a])
+			if (entry->getParent() && info.archive_format == match_archive[a])
 			{
 				match = true;
 				break;
@@ -230,18 +394,14 @@ int EntryType::isThisType(ArchiveEntry* entry)
 	int r = EDF_TRUE;
 	if (format == EntryDataFormat::textFormat())
 	{
-		// Hack for identifying ACS script sources despite DB2 apparently appending
-		// two null bytes to them, which make the memchr test fail.
-		size_t end = entry->getSize() - 1;
-		if (end > 3) end -= 2;
 		// Text is a special case, as other data formats can sometimes be detected as 'text',
 		// we'll only check for it if text data is specified in the entry type
-		if (entry->getSize() > 0 && memchr(entry->getData(), 0, end) != NULL)
+		if (!info.isText())
 			return EDF_FALSE;
 	}
 	else if (format != EntryDataFormat::anyFormat() && entry->getSize() > 0)
 	{
-		r = format->isThisFormat(entry->getMCData());
+		r = info.formatResult(format);
 		if (r == EDF_FALSE)
 			return EDF_FALSE;
 	}
@@ -273,21 +433,13 @@ int EntryType::isThisType(ArchiveEntry* entry)
 	// Entry name related stuff
 	if (!match_name.empty() || !match_extension.empty())
 	{
-		// Get entry name (lowercase), find extension separator
-		string fn = entry->getName().Lower();
-		size_t ext_sep = fn.find_first_of('.', 0);
-
 		// Check for name match if needed
 		if (!match_name.empty())
 		{
-			string name = fn;
-			if (ext_sep != wxString::npos)
-				name = fn.Left(ext_sep);
-
 			bool match = false;
 			for (size_t a = 0; a < match_name.size(); a++)
 			{
-				if (name.Matches(match_name[a]))
+				if (info.name.Matches(match_name[a]))
 				{
 					match = true;
 					break;
@@ -303,12 +455,11 @@ int EntryType::isThisType(ArchiveEntry* entry)
 		if (!match_extension.empty())
 		{
 			bool match = false;
-			if (ext_sep != wxString::npos)
+			if (info.has_ext)
 			{
-				string ext = fn.Mid(ext_sep+1);
 				for (size_t a = 0; a < match_extension.size(); a++)
 				{
-					if (ext == match_extension[a])
+					if (info.ext == match_extension[a])
 					{
 						match = true;
 						break;
@@ -364,9 +515,7 @@ int EntryType::isThisType(ArchiveEntry* entry)
 		if (!entry->getParent())
 			return EDF_FALSE;
 
-		string e_section = entry->getParent()->detectNamespace(entry);
-
-		if (e_section != section)
+		if (info.getSection() != section)
 			return EDF_FALSE;
 	}
 
@@ -380,6 +529,10 @@ int EntryType::isThisType(ArchiveEntry* entry)
  *******************************************************************/
 bool EntryType::readEntryTypeDefinition(MemChunk& mc)
 {
+	// Add to definitions hash (FNV-1a)
+	for (unsigned a = 0; a < mc.getSize(); a++)
+		etype_definitions_hash = (etype_definitions_hash ^ mc[a]) * 1099511628211ULL;
+
 	// Parse the definition
 	Parser p;
 	p.parseText(mc);
@@ -636,53 +789,218 @@ bool EntryType::loadEntryTypes()
 		files = res_dir.GetNext(&filename);
 	}
 
+	// Build detection index
+	buildDetectionIndex();
+
 	return true;
 }
 
-/* EntryType::detectEntryType
- * Attempts to detect the given entry's type
+/* EntryType::buildDetectionIndex
+ * Builds the index used to find the candidate types for an entry in
+ * matchEntryType. Types that require a specific name, extension or
+ * size are only checked against entries that have it, all other
+ * detectable types are always checked
  *******************************************************************/
-bool EntryType::detectEntryType(ArchiveEntry* entry)
+void EntryType::buildDetectionIndex()
 {
-	// Do nothing if the entry is a folder or a map marker
-	if (!entry || entry->getType() == &etype_folder || entry->getType() == &etype_map)
-		return false;
+	detect_generic.clear();
+	detect_by_name.clear();
+	detect_by_ext.clear();
+	detect_by_size.clear();
 
-	// If the entry's size is zero, set it to marker type
-	if (entry->getSize() == 0)
+	for (size_t a = 0; a < entry_types.size(); a++)
 	{
-		entry->setType(&etype_marker);
-		return true;
+		EntryType* type = entry_types[a];
+		if (!type->detectable)
+			continue;
+
+		// Names can only be indexed if none of them contain wildcards
+		bool names_exact = !type->match_name.empty();
+		for (size_t b = 0; b < type->match_name.size(); b++)
+		{
+			if (type->match_name[b].find_first_of("*?") != wxString::npos)
+			{
+				names_exact = false;
+				break;
+			}
+		}
+
+		if (type->matchextorname && !type->match_name.empty() && !type->match_extension.empty())
+		{
+			// Needs the name OR the extension to match
+			if (names_exact)
+			{
+				for (size_t b = 0; b < type->match_name.size(); b++)
+					detect_by_name[type->match_name[b]].push_back(type);
+				for (size_t b = 0; b < type->match_extension.size(); b++)
+					detect_by_ext[type->match_extension[b]].push_back(type);
+			}
+			else
+				detect_generic.push_back(type);
+		}
+		else if (names_exact)
+		{
+			for (size_t b = 0; b < type->match_name.size(); b++)
+				detect_by_name[type->match_name[b]].push_back(type);
+		}
+		else if (!type->match_extension.empty())
+		{
+			for (size_t b = 0; b < type->match_extension.size(); b++)
+				detect_by_ext[type->match_extension[b]].push_back(type);
+		}
+		else if (!type->match_size.empty())
+		{
+			for (size_t b = 0; b < type->match_size.size(); b++)
+				detect_by_size[type->match_size[b]].push_back(type);
+		}
+		else
+			detect_generic.push_back(type);
 	}
 
-	// Reset entry type
-	entry->setType(&etype_unknown);
+	detect_index_built = true;
+	LOG_MESSAGE(2, "Entry type detection index: %d generic, %d names, %d extensions, %d sizes",
+	            (int)detect_generic.size(), (int)detect_by_name.size(), (int)detect_by_ext.size(), (int)detect_by_size.size());
+}
 
-	// Go through all registered types
-	for (size_t a = 0; a < entry_types.size(); a++)
+/* etypeIndexLess
+ * Sort function for entry types, orders by index (ie. the order
+ * they were defined in)
+ *******************************************************************/
+bool etypeIndexLess(EntryType* left, EntryType* right)
+{
+	return left->getIndex() < right->getIndex();
+}
+
+/* EntryType::matchEntryType
+ * Finds the most reliable entry type matching [entry], without
+ * modifying the entry. The match reliability is written to
+ * [reliability], returns etype_unknown if no type matched
+ *******************************************************************/
+EntryType* EntryType::matchEntryType(ArchiveEntry* entry, int& reliability)
+{
+	entry_match_info_t info(entry);
+
+	// Without the index, check against all types
+	if (!detect_index_built)
+		return matchEntryType(info, entry_types, reliability);
+
+	// Get candidate types from the index
+	vector<EntryType*> candidates = detect_generic;
+	bool merged = false;
+	EntryTypeListMap::iterator n = detect_by_name.find(info.name);
+	if (n != detect_by_name.end())
 	{
-		// If the current type is more 'reliable' than this one, skip it
-		if (entry->getTypeReliability() >= entry_types[a]->getReliability())
+		candidates.insert(candidates.end(), n->second.begin(), n->second.end());
+		merged = true;
+	}
+	if (info.has_ext)
+	{
+		EntryTypeListMap::iterator e = detect_by_ext.find(info.ext);
+		if (e != detect_by_ext.end())
+		{
+			candidates.insert(candidates.end(), e->second.begin(), e->second.end());
+			merged = true;
+		}
+	}
+	std::map<unsigned, vector<EntryType*> >::iterator sz = detect_by_size.find(entry->getSize());
+	if (sz != detect_by_size.end())
+	{
+		candidates.insert(candidates.end(), sz->second.begin(), sz->second.end());
+		merged = true;
+	}
+
+	// Candidates must be checked in the order the types were defined, so
+	// that ties in reliability are resolved the same way as a full check
+	if (merged)
+	{
+		std::sort(candidates.begin(), candidates.end(), etypeIndexLess);
+		candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+	}
+
+	return matchEntryType(info, candidates, reliability);
+}
+
+/* EntryType::matchEntryType
+ * Finds the most reliable type in [types] matching the entry in
+ * [info]. The match reliability is written to [reliability], returns
+ * etype_unknown if no type matched
+ *******************************************************************/
+EntryType* EntryType::matchEntryType(entry_match_info_t& info, vector<EntryType*>& types, int& reliability)
+{
+	EntryType* match = &etype_unknown;
+	int match_r = 0;
+	reliability = 0;
+
+	// Go through all given types
+	for (size_t a = 0; a < types.size(); a++)
+	{
+		// If the current match is more 'reliable' than this type, skip it
+		if (match_r >= types[a]->getReliability())
 			continue;
 
 		// Check for possible type match
-		int r = entry_types[a]->isThisType(entry);
+		int r = types[a]->isThisType(info);
 		if (r > 0)
 		{
-			// Type matches, set it
-			entry->setType(entry_types[a], r);
+			// Type matches
+			match = types[a];
+			reliability = r;
+			match_r = match->getReliability() * r / 255;
 
 			// No need to continue if the identification is 100% reliable
-			if (entry->getTypeReliability() >= 255)
-				return true;
+			if (match_r >= 255)
+				break;
 		}
 	}
 
-	// Return t/f depending on if a matching type was found
-	if (entry->getType() == &etype_unknown)
+	return match;
+}
+
+/* EntryType::detectEntryType
+ * Attempts to detect the given entry's type
+ *******************************************************************/
+bool EntryType::detectEntryType(ArchiveEntry* entry)
+{
+	// Do nothing if the entry is a folder or a map marker
+	if (!entry || entry->getType() == &etype_folder || entry->getType() == &etype_map)
 		return false;
-	else
+
+	// If the entry's size is zero, set it to marker type
+	if (entry->getSize() == 0)
+	{
+		entry->setType(&etype_marker);
 		return true;
+	}
+
+	// Find matching type
+	int r = 0;
+	EntryType* type = matchEntryType(entry, r);
+	entry->setType(type, r);
+
+	// Return t/f depending on if a matching type was found
+	return (type != &etype_unknown);
+}
+
+/* EntryType::detectEntryTypes
+ * Detects the types of all [entries], spreading the work over a
+ * number of threads (see archive_detect_threads). Entry data should
+ * already be loaded, since loading isn't thread-safe. Detection itself
+ * doesn't modify the entries, the results are applied on the calling
+ * thread once all entries have been checked. If [show_progress] is
+ * true, the splash window progress bar is updated as it goes
+ *******************************************************************/
+void EntryType::detectEntryTypes(vector<ArchiveEntry*>& entries, bool show_progress)
+{
+	// Detect types
+	EntryTypeDetector detector(entries, show_progress);
+	detector.run(entries.size(), ParallelJob::numThreads(archive_detect_threads), 32);
+
+	// Apply results
+	for (unsigned a = 0; a < entries.size(); a++)
+	{
+		if (detector.types[a])
+			entries[a]->setType(detector.types[a], detector.reliability[a]);
+	}
 }
 
 /* EntryType::getType
@@ -749,6 +1067,13 @@ void EntryType::cleanupEntryTypes()
 		if (e != &etype_unknown && e != &etype_folder && e != &etype_marker && e != &etype_map)
 			delete entry_types[a];
 	}
+
+	// Clear detection index
+	detect_index_built = false;
+	detect_generic.clear();
+	detect_by_name.clear();
+	detect_by_ext.clear();
+	detect_by_size.clear();
 }
 
 /* EntryType::allTypes
@@ -759,6 +1084,15 @@ vector<EntryType*> EntryType::allTypes()
 	return entry_types;
 }
 
+/* EntryType::definitionsHash
+ * Returns a hash of all entry type definitions that have been read,
+ * which changes if any built-in or custom definition changes
+ *******************************************************************/
+uint64_t EntryType::definitionsHash()
+{
+	return etype_definitions_hash;
+}
+
 /* EntryType::allCategories
  * Returns a list of all entry type categories
  *******************************************************************/
@@ -869,3 +1203,101 @@ CONSOLE_COMMAND (size, 0, true)
 	}
 	wxLogMessage("%s: %i bytes", meep->getName().mb_str(), meep->getSize());
 }
+
+// Benchmarks entry type detection over all archives in a directory,
+// comparing a full check against every type with the indexed check
+CONSOLE_COMMAND (bench_detect, 1, false)
+{
+	long passes = 1;
+	if (args.size() > 1)
+		args[1].ToLong(&passes);
+	if (passes < 1)
+		passes = 1;
+
+	// Open all archives in the directory
+	vector<Archive*> archives;
+	vector<ArchiveEntry*> entries;
+	wxArrayString files;
+	wxDir::GetAllFiles(args[0], &files, wxEmptyString, wxDIR_FILES);
+	for (unsigned a = 0; a < files.size(); a++)
+	{
+		Archive* archive = theArchiveManager->openArchive(files[a], false, true);
+
+		// Ignore archives that are already open in the editor
+		if (!archive || theArchiveManager->archiveIndex(archive) >= 0)
+			continue;
+		archives.push_back(archive);
+
+		// Get all entries with data, and make sure the data is loaded
+		vector<ArchiveEntry*> list;
+		archive->getEntryTreeAsList(list);
+		for (unsigned b = 0; b < list.size(); b++)
+		{
+			if (list[b]->getSize() == 0 || list[b]->getType() == &etype_folder || list[b]->getType() == &etype_map)
+				continue;
+
+			list[b]->getMCData();
+			entries.push_back(list[b]);
+		}
+	}
+
+	if (entries.empty())
+	{
+		wxLogMessage("No archive entries found in %s", args[0]);
+		return;
+	}
+
+	// Full check, every type is checked against every entry
+	vector<EntryType*> full_types(entries.size());
+	long start = theApp->runTimer();
+	for (long pass = 0; pass < passes; pass++)
+	{
+		for (unsigned a = 0; a < entries.size(); a++)
+		{
+			EntryType* match = &etype_unknown;
+			int match_r = 0;
+			for (size_t t = 0; t < entry_types.size(); t++)
+			{
+				if (match_r >= entry_types[t]->getReliability())
+					continue;
+
+				int r = entry_types[t]->isThisType(entries[a]);
+				if (r > 0)
+				{
+					match = entry_types[t];
+					match_r = match->getReliability() * r / 255;
+					if (match_r >= 255)
+						break;
+				}
+			}
+			full_types[a] = match;
+		}
+	}
+	long time_full = MAX(theApp->runTimer() - start, 1l);
+
+	// Indexed check
+	unsigned mismatches = 0;
+	start = theApp->runTimer();
+	for (long pass = 0; pass < passes; pass++)
+	{
+		for (unsigned a = 0; a < entries.size(); a++)
+		{
+			int r;
+			if (EntryType::matchEntryType(entries[a], r) != full_types[a] && pass == 0)
+				mismatches++;
+		}
+	}
+	long time_indexed = MAX(theApp->runTimer() - start, 1l);
+
+	// Report
+	double count = (double)entries.size() * passes;
+	wxLogMessage("Detected %d entries from %d archives x%ld", (int)entries.size(), (int)archives.size(), passes);
+	wxLogMessage("Full check: %ldms (%1.0f detections/sec)", time_full, count * 1000.0 / time_full);
+	wxLogMessage("Indexed: %ldms (%1.0f detections/sec)", time_indexed, count * 1000.0 / time_indexed);
+	if (mismatches > 0)
+		wxLogMessage("Warning: %d entries were detected differently", mismatches);
+
+	// Clean up
+	for (unsigned a = 0; a < archives.size(); a++)
+		delete archives[a];
+}
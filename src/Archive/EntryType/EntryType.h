@@ -5,6 +5,7 @@
 #include "Utility/PropertyList/PropertyList.h"
 #include "EntryDataFormat.h"
 class ArchiveEntry;
+struct entry_match_info_t;
 
 class EntryType
 {
@@ -65,11 +66,16 @@ public:
 
 	// Magic goes here
 	int		isThisType(ArchiveEntry* entry);
+	int		isThisType(entry_match_info_t& info);
 
 	// Static functions
 	static bool 				readEntryTypeDefinition(MemChunk& mc);
 	static bool 				loadEntryTypes();
+	static void					buildDetectionIndex();
+	static EntryType*			matchEntryType(ArchiveEntry* entry, int& reliability);
+	static EntryType*			matchEntryType(entry_match_info_t& info, vector<EntryType*>& types, int& reliability);
 	static bool 				detectEntryType(ArchiveEntry* entry);
+	static void					detectEntryTypes(vector<ArchiveEntry*>& entries, bool show_progress = true);
 	static EntryType*			getType(string id);
 	static EntryType*			unknownType();
 	static EntryType*			folderType();
@@ -77,6 +83,7 @@ public:
 	static wxArrayString		getIconList();
 	static void					cleanupEntryTypes();
 	static vector<EntryType*>	allTypes();
+	static uint64_t				definitionsHash();
 	static vector<string>		allCategories();
 };
 
@@ -190,30 +190,30 @@ bool DatArchive::open(MemChunk& mc)
 		getRoot()->addEntry(nlump);
 	}
 
-	// Detect all entry types
-	MemChunk edata;
-	theSplashWindow->setProgressMessage("Detecting entry types");
+	// Read all entry data
+	vector<ArchiveEntry*> all_entries;
 	for (size_t a = 0; a < numEntries(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_lumps)));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
+		all_entries.push_back(entry);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
 		{
 			// Read the entry data
-			mc.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
-			entry->importMemChunk(edata);
+			entry->importView(mc, getEntryOffset(entry), entry->getSize());
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	theSplashWindow->setProgressMessage("Detecting entry types");
+	EntryType::detectEntryTypes(all_entries);
 
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
 		// Set entry to unchanged
-		entry->setState(0);
+		all_entries[a]->setState(0);
 	}
 
 	// Detect maps (will detect map entry types)
@@ -581,6 +581,10 @@ bool DatArchive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
+	// Use the mapped archive file if possible
+	if (loadMappedEntryData(entry, getEntryOffset(entry)))
+		return true;
+
 	// Open wadfile
 	wxFile file(filename);
 
@@ -189,34 +189,34 @@ bool LfdArchive::open(MemChunk& mc)
 	if (num_lumps != numEntries())
 		wxLogMessage("Warning: computed %i lumps, but actually %i entries", num_lumps, numEntries());
 
-	// Detect all entry types
-	MemChunk edata;
-	theSplashWindow->setProgressMessage("Detecting entry types");
+	// Read all entry data
+	vector<ArchiveEntry*> all_entries;
 	for (size_t a = 0; a < numEntries(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_lumps)));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
+		all_entries.push_back(entry);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
 		{
 			// Read the entry data
-			mc.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
-			entry->importMemChunk(edata);
+			entry->importView(mc, getEntryOffset(entry), entry->getSize());
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	theSplashWindow->setProgressMessage("Detecting entry types");
+	EntryType::detectEntryTypes(all_entries);
 
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
 		// Unload entry data if needed
 		if (!archive_load_data)
-			entry->unloadData();
+			all_entries[a]->unloadData();
 
 		// Set entry to unchanged
-		entry->setState(0);
+		all_entries[a]->setState(0);
 	}
 
 	// Setup variables
@@ -326,6 +326,10 @@ bool LfdArchive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
+	// Use the mapped archive file if possible
+	if (loadMappedEntryData(entry, getEntryOffset(entry)))
+		return true;
+
 	// Open lfdfile
 	wxFile file(filename);
 
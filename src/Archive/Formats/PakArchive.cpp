@@ -151,16 +151,12 @@ bool PakArchive::open(MemChunk& mc)
 		dir->addEntry(entry);
 	}
 
-	// Detect all entry types
+	// Read all entry data
 	MemChunk edata;
 	vector<ArchiveEntry*> all_entries;
 	getEntryTreeAsList(all_entries);
-	theSplashWindow->setProgressMessage("Detecting entry types");
 	for (size_t a = 0; a < all_entries.size(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_entries)));
-
 		// Get entry
 		ArchiveEntry* entry = all_entries[a];
 
@@ -171,16 +167,20 @@ bool PakArchive::open(MemChunk& mc)
 			mc.exportMemChunk(edata, (int)entry->exProp("Offset"), entry->getSize());
 			entry->importMemChunk(edata);
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	theSplashWindow->setProgressMessage("Detecting entry types");
+	EntryType::detectEntryTypes(all_entries);
 
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
 		// Unload entry data if needed
 		if (!archive_load_data)
-			entry->unloadData();
+			all_entries[a]->unloadData();
 
 		// Set entry to unchanged
-		entry->setState(0);
+		all_entries[a]->setState(0);
 	}
 
 	// Setup variables
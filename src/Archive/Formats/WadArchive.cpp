@@ -33,7 +33,11 @@
 #include "UI/SplashWindow.h"
 #include "General/Misc.h"
 #include "Utility/Tokenizer.h"
+#include "MainApp.h"
+#include "General/Console/Console.h"
+#include "Archive/ArchiveIndexCache.h"
 #include <wx/filename.h>
+#include <set>
 
 bool JaguarDecode(MemChunk& mc);
 
@@ -345,24 +349,36 @@ bool WadArchive::open(MemChunk& mc)
 	// Stop announcements (don't want to be announcing modification due to entries being added etc)
 	setMuted(true);
 
-	vector<uint32_t> offsets;
+	// Check the directory is within the data
+	if ((uint64_t)dir_offset + (uint64_t)num_lumps * 16 > mc.getSize())
+	{
+		wxLogMessage("WadArchive::open: Wad archive is invalid or corrupt");
+		Global::error = "Archive is invalid and/or corrupt (directory goes past end of file)";
+		setMuted(false);
+		return false;
+	}
 
-	// Read the directory
-	mc.seek(dir_offset, SEEK_SET);
+	// Offsets of lumps read so far, to catch entries that are clones of previous ones
+	std::set<uint32_t> offsets;
+
+	// Read the directory (straight from the data, each entry is 16 bytes)
+	const uint8_t* dir_data = mc.getData() + dir_offset;
 	theSplashWindow->setProgressMessage("Reading wad archive data");
 	for (uint32_t d = 0; d < num_lumps; d++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress(((float)d / (float)num_lumps));
+		// Update splash window progress (every so often, wads can have a *lot* of lumps)
+		if ((d & 1023) == 0)
+			theSplashWindow->setProgress(((float)d / (float)num_lumps));
 
 		// Read lump info
 		char name[9] = "";
 		uint32_t offset = 0;
 		uint32_t size = 0;
 
-		mc.read(&offset, 4);	// Offset
-		mc.read(&size, 4);		// Size
-		mc.read(name, 8);		// Name
+		const uint8_t* dir_entry = dir_data + d * 16;
+		memcpy(&offset, dir_entry, 4);		// Offset
+		memcpy(&size, dir_entry + 4, 4);	// Size
+		memcpy(name, dir_entry + 8, 8);		// Name
 		name[8] = '\0';
 
 		// Byteswap values for big endian if needed
@@ -377,12 +393,11 @@ bool WadArchive::open(MemChunk& mc)
 				LOG_MESSAGE(2, "No.");
 				continue;
 			}
-			if (VECTOR_EXISTS(offsets, offset))
+			if (!offsets.insert(offset).second)
 			{
 				LOG_MESSAGE(1, "Ignoring entry %d: %s, is a clone of a previous entry", d, name);
 				continue;
 			}
-			offsets.push_back(offset);
 		}
 
 		// Hack to open Operation: Rheingold WAD files
@@ -399,17 +414,15 @@ bool WadArchive::open(MemChunk& mc)
 		{
 			if (d < num_lumps - 1)
 			{
-				size_t pos = mc.currentPos();
+				// Find the offset of the next lump with data
 				uint32_t nextoffset = 0;
-				for (int i = 0; i + d < num_lumps; ++i)
+				for (uint32_t n = d + 1; n < num_lumps; ++n)
 				{
-					mc.read(&nextoffset, 4);
+					memcpy(&nextoffset, dir_data + n * 16, 4);
 					if (nextoffset != 0) break;
-					mc.seek(12, SEEK_CUR);
 				}
 				nextoffset = wxINT32_SWAP_ON_BE(nextoffset);
 				if (nextoffset == 0) nextoffset = dir_offset;
-				mc.seek(pos, SEEK_SET);
 				actualsize = nextoffset - offset;
 			}
 			else
@@ -455,42 +468,66 @@ bool WadArchive::open(MemChunk& mc)
 	// rely on being within certain namespaces)
 	updateNamespaces();
 
-	// Detect all entry types
+	// Read all entry data
 	MemChunk edata;
-	theSplashWindow->setProgressMessage("Detecting entry types");
+	vector<ArchiveEntry*> all_entries;
+	theSplashWindow->setProgressMessage("Reading entry data");
 	for (size_t a = 0; a < numEntries(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)numEntries())));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
+		all_entries.push_back(entry);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
 		{
-			// Read the entry data
-			mc.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
 			if (entry->isEncrypted())
 			{
+				// Update splash window progress (decoding can be slow)
+				theSplashWindow->setProgress((((float)a / (float)numEntries())));
+
+				// Read and decode the entry data
+				mc.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
 				if (entry->exProps().propertyExists("FullSize")
 				        && (unsigned)(int)(entry->exProp("FullSize")) >  entry->getSize())
 					edata.reSize((int)(entry->exProp("FullSize")), true);
 				if (!JaguarDecode(edata))
 					wxLogMessage("%i: %s (following %s), did not decode properly", a, entry->getName(), a>0?getEntry(a-1)->getName():"nothing");
+				entry->importMemChunk(edata);
+			}
+			else
+			{
+				// View the entry data (no copy is made if the wad file is mapped)
+				entry->importView(mc, getEntryOffset(entry), entry->getSize());
 			}
-			entry->importMemChunk(edata);
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Get entry types from the index cache if this wad file hasn't changed since
+	// it was last opened, otherwise detect all entry types
+	bool cache_index = ArchiveIndexCache::canCache(filename);
+	bool cached_types = false;
+	uint64_t dir_hash = 0;
+	if (cache_index)
+	{
+		dir_hash = ArchiveIndexCache::hash(dir_data, num_lumps * 16);
+		dir_hash = ArchiveIndexCache::hash(&num_lumps, 4, dir_hash);
+		cached_types = ArchiveIndexCache::applyTypes(filename, dir_hash, all_entries);
+	}
+	if (!cached_types)
+	{
+		theSplashWindow->setProgressMessage("Detecting entry types");
+		EntryType::detectEntryTypes(all_entries);
+	}
 
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
 		// Unload entry data if needed
 		if (!archive_load_data)
-			entry->unloadData();
+			all_entries[a]->unloadData();
 
 		// Set entry to unchanged
-		entry->setState(0);
+		all_entries[a]->setState(0);
 	}
 
 	// Identify #included lumps (DECORATE, GLDEFS, etc.)
@@ -500,6 +537,10 @@ bool WadArchive::open(MemChunk& mc)
 	theSplashWindow->setProgressMessage("Detecting maps");
 	detectMaps();
 
+	// Save detected entry types to the index cache
+	if (cache_index && !cached_types)
+		ArchiveIndexCache::saveTypes(filename, dir_hash, all_entries);
+
 	// Setup variables
 	setMuted(false);
 	setModified(false);
@@ -679,6 +720,13 @@ bool WadArchive::loadEntryData(ArchiveEntry* entry)
 		return true;
 	}
 
+	// Use the mapped wad file if possible
+	if (loadMappedEntryData(entry, getEntryOffset(entry)))
+	{
+		entry->setState(0);
+		return true;
+	}
+
 	// Open wadfile
 	wxFile file(filename);
 
@@ -1322,6 +1370,31 @@ ArchiveEntry* WadArchive::findFirst(search_options_t& options)
 			return NULL;
 	}
 
+	// If searching for an exact name in the whole wad, only entries with
+	// that name need to be checked (if the name index can be used)
+	vector<ArchiveEntry*> named;
+	if (options.match_namespace.IsEmpty() && getRoot()->getEntriesNamed(options.match_name, named))
+	{
+		for (unsigned a = 0; a < named.size(); a++)
+		{
+			// Check type
+			if (options.match_type)
+			{
+				if (named[a]->getType() == EntryType::unknownType())
+				{
+					if (!options.match_type->isThisType(named[a]))
+						continue;
+				}
+				else if (options.match_type != named[a]->getType())
+					continue;
+			}
+
+			return named[a];
+		}
+
+		return NULL;
+	}
+
 	// Begin search
 	ArchiveEntry* entry = start;
 	while (entry != end)
@@ -1402,6 +1475,31 @@ ArchiveEntry* WadArchive::findLast(search_options_t& options)
 			return NULL;
 	}
 
+	// If searching for an exact name in the whole wad, only entries with
+	// that name need to be checked (if the name index can be used)
+	vector<ArchiveEntry*> named;
+	if (options.match_namespace.IsEmpty() && getRoot()->getEntriesNamed(options.match_name, named))
+	{
+		for (int a = named.size() - 1; a >= 0; a--)
+		{
+			// Check type
+			if (options.match_type)
+			{
+				if (named[a]->getType() == EntryType::unknownType())
+				{
+					if (!options.match_type->isThisType(named[a]))
+						continue;
+				}
+				else if (options.match_type != named[a]->getType())
+					continue;
+			}
+
+			return named[a];
+		}
+
+		return NULL;
+	}
+
 	// Begin search
 	ArchiveEntry* entry = start;
 	while (entry != end)
@@ -1599,3 +1697,61 @@ bool WadArchive::isWadArchive(string filename)
 	// If it's passed to here it's probably a wad file
 	return true;
 }
+
+
+/*******************************************************************
+ * CONSOLE COMMANDS
+ *******************************************************************/
+
+/* Console Command - "bench_wadopen"
+ * Builds a synthetic wad with the given number of lumps (100000 if
+ * not given) in memory, and reports how long it takes to open
+ *******************************************************************/
+CONSOLE_COMMAND (bench_wadopen, 0, false)
+{
+	long num_lumps = 100000;
+	if (args.size() > 0)
+		args[0].ToLong(&num_lumps);
+	if (num_lumps < 1 || num_lumps > 10000000)
+		num_lumps = 100000;
+
+	// Build the wad: header, 4 bytes of data per lump (so each has a
+	// unique offset), then the directory
+	uint32_t count = num_lumps;
+	uint32_t dir_offset = 12 + count * 4;
+	MemChunk mc;
+	mc.reSize(dir_offset + count * 16, false);
+	mc.seek(0, SEEK_SET);
+
+	uint32_t val = wxINT32_SWAP_ON_BE(count);
+	mc.write("PWAD", 4);
+	mc.write(&val, 4);
+	val = wxINT32_SWAP_ON_BE(dir_offset);
+	mc.write(&val, 4);
+	for (uint32_t a = 0; a < count; a++)
+	{
+		val = wxINT32_SWAP_ON_BE(a);
+		mc.write(&val, 4);
+	}
+	for (uint32_t a = 0; a < count; a++)
+	{
+		char name[9];
+		sprintf(name, "L%07u", a);
+		uint32_t offset = wxINT32_SWAP_ON_BE(12 + a * 4);
+		uint32_t size = wxINT32_SWAP_ON_BE(4);
+		mc.write(&offset, 4);
+		mc.write(&size, 4);
+		mc.write(name, 8);
+	}
+
+	// Open it
+	WadArchive archive;
+	long start = theApp->runTimer();
+	bool ok = archive.open(mc);
+	long time = theApp->runTimer() - start;
+
+	if (ok)
+		wxLogMessage("Opened synthetic wad with %d lumps in %ldms", archive.numEntries(), time);
+	else
+		wxLogMessage("Failed to open synthetic wad: %s", Global::error);
+}
@@ -247,47 +247,58 @@ bool WadJArchive::open(MemChunk& mc)
 	// rely on being within certain namespaces)
 	updateNamespaces();
 
-	// Detect all entry types
+	// Read all entry data
 	MemChunk edata;
-	theSplashWindow->setProgressMessage("Detecting entry types");
+	vector<ArchiveEntry*> all_entries;
+	theSplashWindow->setProgressMessage("Reading entry data");
 	for (size_t a = 0; a < numEntries(); a++)
 	{
-		// Update splash window progress
-		theSplashWindow->setProgress((((float)a / (float)num_lumps)));
-
 		// Get entry
 		ArchiveEntry* entry = getEntry(a);
+		all_entries.push_back(entry);
 
 		// Read entry data if it isn't zero-sized
 		if (entry->getSize() > 0)
 		{
-			// Read the entry data
-			edata.clear();
-			mc.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
 			if (entry->isEncrypted())
 			{
+				// Update splash window progress (decoding can be slow)
+				theSplashWindow->setProgress((((float)a / (float)num_lumps)));
+
+				// Read and decode the entry data
+				edata.clear();
+				mc.exportMemChunk(edata, getEntryOffset(entry), entry->getSize());
 				if (entry->exProps().propertyExists("FullSize")
 				        && (unsigned)(int)(entry->exProp("FullSize")) >  entry->getSize())
 					edata.reSize((int)(entry->exProp("FullSize")), true);
 				if (!JaguarDecode(edata))
 					wxLogMessage("%i: %s (following %s), did not decode properly", a, entry->getName(), a>0?getEntry(a-1)->getName():"nothing");
+				entry->importMemChunk(edata);
+			}
+			else
+			{
+				// View the entry data (no copy is made if the wad file is mapped)
+				entry->importView(mc, getEntryOffset(entry), entry->getSize());
 			}
-			entry->importMemChunk(edata);
 		}
+	}
 
-		// Detect entry type
-		EntryType::detectEntryType(entry);
+	// Detect all entry types
+	theSplashWindow->setProgressMessage("Detecting entry types");
+	EntryType::detectEntryTypes(all_entries);
 
+	for (size_t a = 0; a < all_entries.size(); a++)
+	{
 		// Unload entry data if needed
 		if (!archive_load_data)
-			entry->unloadData();
+			all_entries[a]->unloadData();
 
 		// Lock entry if IWAD
 		if (wad_type[0] == 'I' && iwad_lock)
-			entry->lock();
+			all_entries[a]->lock();
 
 		// Set entry to unchanged
-		entry->setState(0);
+		all_entries[a]->setState(0);
 	}
 
 	// Detect maps (will detect map entry types)
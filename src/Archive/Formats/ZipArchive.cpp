@@ -32,12 +32,26 @@
 #include "ZipArchive.h"
 #include "WadArchive.h"
 #include "UI/SplashWindow.h"
+#include "General/Misc.h"
+#include "Utility/Compression.h"
+#include "Utility/ParallelJob.h"
+#include "Archive/ArchiveIndexCache.h"
 #include <wx/wfstream.h>
 #include <wx/zipstrm.h>
 #include <wx/ptr_scpd.h>
 #include <wx/filename.h>
 #include <wx/msgdlg.h>
 #include <algorithm>
+#include <ctime>
+
+
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+CVAR(Bool, zip_open_lazy, true, CVAR_SAVE)
+CVAR(Int, zip_detect_max_size, 1024, CVAR_SAVE)	// In kb, larger entries are detected when first opened (lazy open only)
+CVAR(Int, zip_compress_level, 9, CVAR_SAVE)		// 0 = store modified entries uncompressed
+CVAR(Int, zip_write_threads, 0, CVAR_SAVE)		// 0 = one per CPU
 
 
 /*******************************************************************
@@ -46,6 +60,126 @@
 EXTERN_CVAR(Bool, archive_load_data)
 
 
+/*******************************************************************
+ * ZIPARCHIVE HELPER FUNCTIONS
+ *******************************************************************/
+
+/* detectZipEntryTypes
+ * Detects the types of all (loaded) entries in [entries], unloads
+ * their data if needed and clears the list
+ *******************************************************************/
+void detectZipEntryTypes(vector<ArchiveEntry*>& entries)
+{
+	EntryType::detectEntryTypes(entries, false);
+
+	// Unload data if needed
+	if (!archive_load_data)
+	{
+		for (unsigned a = 0; a < entries.size(); a++)
+			entries[a]->unloadData();
+	}
+
+	entries.clear();
+}
+
+/* writeL16/writeL32
+ * Writes [value] to [buf] at [i] in little-endian byte order
+ *******************************************************************/
+void writeL16(uint8_t* buf, unsigned i, uint16_t value)
+{
+	buf[i] = value & 0xFF;
+	buf[i + 1] = (value >> 8) & 0xFF;
+}
+void writeL32(uint8_t* buf, unsigned i, uint32_t value)
+{
+	writeL16(buf, i, value & 0xFFFF);
+	writeL16(buf, i + 2, value >> 16);
+}
+
+/* writeZipData
+ * Writes [size] bytes of [data] to [out] and advances [offset] by the
+ * number of bytes written. Returns false if the write failed or the
+ * file has grown too large for a (non-zip64) zip
+ *******************************************************************/
+bool writeZipData(wxFile& out, const void* data, uint32_t size, uint64_t& offset)
+{
+	if (size > 0 && out.Write(data, size) != size)
+	{
+		Global::error = "Unable to write to file";
+		return false;
+	}
+
+	offset += size;
+	if (offset > 0xFFFFFFFF)
+	{
+		Global::error = "Zip file would be too large (4GB maximum)";
+		return false;
+	}
+
+	return true;
+}
+
+
+/*******************************************************************
+ * ZIPDEFLATEJOB CLASS
+ *******************************************************************
+ * Calculates the crc of and deflates a number of entry data chunks
+ * in parallel. Each chunk is compressed to its own independent
+ * deflate stream, so the results can be written to the zip in any
+ * order afterwards
+ */
+class ZipDeflateJob : public ParallelJob
+{
+public:
+	vector<MemChunk*>	in;
+	vector<MemChunk*>	out;	// Empty if the data should be stored as-is
+	vector<uint32_t>	crc;
+	int					level;
+
+	ZipDeflateJob(int level)
+	{
+		this->level = level;
+
+		// The crc table is built the first time it's needed, so make
+		// sure that doesn't happen on multiple threads at once
+		Misc::crc(NULL, 0);
+	}
+
+	~ZipDeflateJob()
+	{
+		clear();
+	}
+
+	void add(MemChunk* data)
+	{
+		in.push_back(data);
+		out.push_back(new MemChunk());
+		crc.push_back(0);
+	}
+
+	void clear()
+	{
+		for (unsigned a = 0; a < out.size(); a++)
+			delete out[a];
+		in.clear();
+		out.clear();
+		crc.clear();
+	}
+
+	void process(unsigned index)
+	{
+		MemChunk& data = *in[index];
+		crc[index] = data.crc();
+
+		// Store if compression is disabled or doesn't make the data smaller
+		if (level <= 0 || data.getSize() == 0)
+			return;
+		if (!Compression::ZipDeflate(data, *out[index], level) || out[index]->getSize() >= data.getSize())
+			out[index]->clear();
+	}
+};
+
+
 /*******************************************************************
  * ZIPARCHIVE CLASS FUNCTIONS
  *******************************************************************/
@@ -64,7 +198,8 @@ ZipArchive::ZipArchive() : Archive(ARCHIVE_ZIP)
  *******************************************************************/
 ZipArchive::~ZipArchive()
 {
-	if (wxFileExists(temp_file))
+	zip_file.Close();
+	if (!temp_file.IsEmpty() && wxFileExists(temp_file))
 		wxRemoveFile(temp_file);
 }
 
@@ -90,9 +225,9 @@ string ZipArchive::getFormat()
  *******************************************************************/
 bool ZipArchive::open(string filename)
 {
-	// Copy the zip to a temp file (for use when saving)
-	generateTempFileName(filename);
-	wxCopyFile(filename, temp_file);
+	// Open using only the zip central directory if possible
+	if (zip_open_lazy && openLazy(filename))
+		return true;
 
 	// Open the file
 	wxFFileInputStream in(filename);
@@ -114,7 +249,10 @@ bool ZipArchive::open(string filename)
 	setMuted(true);
 
 	// Go through all zip entries
+	// (entry types are detected in batches, once enough data has been read)
 	int entry_index = 0;
+	vector<ArchiveEntry*> detect_entries;
+	unsigned detect_size = 0;
 	wxZipEntry* entry = zip.GetNextEntry();
 	theSplashWindow->setProgressMessage("Reading zip data");
 	while (entry)
@@ -153,15 +291,17 @@ bool ZipArchive::open(string filename)
 				new_entry->importMem(data, entry->GetSize());
 				new_entry->setLoaded(true);
 
-				// Determine its type
-				EntryType::detectEntryType(new_entry);
-
-				// Unload data if needed
-				if (!archive_load_data)
-					new_entry->unloadData();
-
 				// Clean up
 				delete[] data;
+
+				// Queue it for type detection
+				detect_entries.push_back(new_entry);
+				detect_size += new_entry->getSize();
+				if (detect_size >= 64 * 1024 * 1024)
+				{
+					detectZipEntryTypes(detect_entries);
+					detect_size = 0;
+				}
 			}
 			else
 			{
@@ -184,6 +324,9 @@ bool ZipArchive::open(string filename)
 		entry = zip.GetNextEntry();
 		entry_index++;
 	}
+
+	// Determine remaining entry types
+	detectZipEntryTypes(detect_entries);
 	theSplashWindow->forceRedraw();
 
 	// Set all entries/directories to unmodified
@@ -197,6 +340,7 @@ bool ZipArchive::open(string filename)
 
 	// Setup variables
 	this->filename = filename;
+	zip_source = filename;
 	setModified(false);
 	on_disk = true;
 
@@ -211,17 +355,14 @@ bool ZipArchive::open(string filename)
  *******************************************************************/
 bool ZipArchive::open(MemChunk& mc)
 {
-	// Write the MemChunk to a temp file
-	string tempfile = appPath("slade-temp-open.zip", DIR_TEMP);
-	mc.exportFile(tempfile);
+	// Write the MemChunk to a temp file, which is kept to load entry
+	// data from and copy unmodified entries from when saving
+	if (temp_file.IsEmpty())
+		generateTempFileName("slade-temp-open.zip");
+	mc.exportFile(temp_file);
 
 	// Load the file
-	bool success = open(tempfile);
-
-	// Clean up
-	wxRemoveFile(tempfile);
-
-	return success;
+	return open(temp_file);
 }
 
 /* ZipArchive::write
@@ -230,20 +371,21 @@ bool ZipArchive::open(MemChunk& mc)
  *******************************************************************/
 bool ZipArchive::write(MemChunk& mc, bool update)
 {
-	bool success = false;
-
 	// Write to a temporary file
 	string tempfile = appPath("slade-temp-write.zip", DIR_TEMP);
-	if (write(tempfile, true))
-	{
-		// Load file into MemChunk
-		success = mc.importFile(tempfile);
-	}
+	if (!write(tempfile, true))
+		return false;
 
-	// Clean up
-	wxRemoveFile(tempfile);
+	// Entry zip indices (and the zip source) now refer to the temp file,
+	// so it must be kept. Move it to this archive's own temp file if
+	// possible, otherwise it stays where it is
+	if (temp_file.IsEmpty())
+		generateTempFileName("slade-temp-write.zip");
+	if (wxRenameFile(tempfile, temp_file, true))
+		zip_source = temp_file;
 
-	return success;
+	// Load file into MemChunk
+	return mc.importFile(zip_source);
 }
 
 /* ZipArchive::write
@@ -252,87 +394,77 @@ bool ZipArchive::write(MemChunk& mc, bool update)
  *******************************************************************/
 bool ZipArchive::write(string filename, bool update)
 {
-	// Open the file
-	wxFFileOutputStream out(filename);
-	if (!out.IsOk())
+	// Entry offsets in the file will change, so the central directory
+	// needs to be read again next time entry data is loaded
+	zip_file.Close();
+	zip_dir.clear();
+	zip_dir_file.Clear();
+
+	// Unmodified entries are copied from the zip source file, so if that's the
+	// file being written, write to a temp file and replace it afterwards
+	string out_file = filename;
+	bool replace = false;
+	if (!zip_source.IsEmpty() && wxFileName(filename).SameAs(wxFileName(zip_source)))
 	{
-		Global::error = "Unable to open file for saving. Make sure it isn't in use by another program.";
-		return false;
+		out_file = wxFileName::CreateTempFileName(filename);
+		if (out_file.IsEmpty())
+		{
+			Global::error = "Unable to create temp file for saving";
+			return false;
+		}
+		replace = true;
 	}
 
-	// Open as zip for writing
-	wxZipOutputStream zip(out, 9);
-	if (!zip.IsOk())
+	// Open the file
+	wxFile out(out_file, wxFile::write);
+	if (!out.IsOpened())
 	{
-		Global::error = "Unable to create zip for saving";
+		Global::error = "Unable to open file for saving. Make sure it isn't in use by another program.";
 		return false;
 	}
 
-	// Open old zip for copying, from the temp file that was copied on opening.
-	// This is used to copy any entries that have been previously saved/compressed
-	// and are unmodified, to greatly speed up zip file saving by not having to
-	// recompress unchanged entries
-	wxFFileInputStream in(temp_file);
-	wxZipInputStream inzip(in);
-
-	// Get a list of all entries in the old zip
-	wxZipEntry** c_entries = new wxZipEntry*[inzip.GetTotalEntries()];
-	for (int a = 0; a < inzip.GetTotalEntries(); a++)
-		c_entries[a] = inzip.GetNextEntry();
-
 	// Get a linear list of all entries in the archive
 	vector<ArchiveEntry*> entries;
 	getEntryTreeAsList(entries);
 
-	// Go through all entries
-	for (size_t a = 0; a < entries.size(); a++)
-	{
-		if (entries[a]->getType() == EntryType::folderType())
-		{
-			// If the current entry is a folder, just write a directory entry and continue
-			zip.PutNextDirEntry(entries[a]->getPath(true));
-			if (update) entries[a]->setState(0);
-			continue;
-		}
+	// Write the zip
+	bool ok = writeZip(out, entries);
+	out.Close();
 
-		// Get entry zip index
-		int index = -1;
-		if (entries[a]->exProps().propertyExists("ZipIndex"))
-			index = entries[a]->exProp("ZipIndex");
+	// The zip source may have been opened to load entry data, and it
+	// can't be replaced while open
+	zip_file.Close();
+	zip_dir.clear();
+	zip_dir_file.Clear();
 
-		if (!inzip.IsOk() || entries[a]->getState() > 0 || index < 0 || index >= inzip.GetTotalEntries())
-		{
-			// If the current entry has been changed, or doesn't exist in the old zip,
-			// (re)compress its data and write it to the zip
-			wxZipEntry* zipentry = new wxZipEntry(entries[a]->getPath() + entries[a]->getName());
-			zip.PutNextEntry(zipentry);
-			zip.Write(entries[a]->getData(), entries[a]->getSize());
-		}
-		else
-		{
-			// If the entry is unmodified and exists in the old zip, just copy it over
-			c_entries[index]->SetName(entries[a]->getPath() + entries[a]->getName());
-			zip.CopyEntry(c_entries[index], inzip);
-			inzip.Reset();
-		}
+	if (!ok)
+	{
+		wxRemoveFile(out_file);
+		return false;
+	}
 
-		// Update entry info
+	// Replace the original file if needed
+	if (replace && !wxRenameFile(out_file, filename, true))
+	{
+		wxRemoveFile(out_file);
+		Global::error = "Unable to overwrite file. Make sure it isn't in use by another program.";
+		return false;
+	}
+
+	// Update entry info
+	for (size_t a = 0; a < entries.size(); a++)
+	{
 		if (update)
-		{
 			entries[a]->setState(0);
+
+		// Zip indices always need updating if the zip source was replaced
+		if ((update || replace) && entries[a]->getType() != EntryType::folderType())
 			entries[a]->exProp("ZipIndex") = (int)a;
-		}
 	}
 
-	// Clean up
-	delete[] c_entries;
-	zip.Close();
-	out.Close();
-
-	// Update the temp file
-	if (temp_file.IsEmpty())
-		generateTempFileName(filename);
-	wxCopyFile(filename, temp_file);
+	// Entry zip indices now refer to the written file
+	if (update || replace)
+		zip_source = filename;
 
 	return true;
 }
@@ -369,11 +501,23 @@ bool ZipArchive::loadEntryData(ArchiveEntry* entry)
 		return false;
 	}
 
+	// Read the entry data directly using the central directory if possible
+	MemChunk zip_data;
+	if (zip_index >= 0 && readZipEntryData(zip_index, zip_data))
+	{
+		entry->lockState();
+		entry->importMemChunk(zip_data);
+		entry->setLoaded();
+		entry->unlockState();
+		return true;
+	}
+
+	// Otherwise fall back to reading through the zip with a zip stream
 	// Open the file
-	wxFFileInputStream in(filename);
+	wxFFileInputStream in(zip_source);
 	if (!in.IsOk())
 	{
-		wxLogMessage("ZipArchive::loadEntryData: Unable to open zip file \"%s\"!", filename);
+		wxLogMessage("ZipArchive::loadEntryData: Unable to open zip file \"%s\"!", zip_source);
 		return false;
 	}
 
@@ -381,7 +525,7 @@ bool ZipArchive::loadEntryData(ArchiveEntry* entry)
 	wxZipInputStream zip(in);
 	if (!zip.IsOk())
 	{
-		wxLogMessage("ZipArchive::loadEntryData: Invalid zip file \"%s\"!", filename);
+		wxLogMessage("ZipArchive::loadEntryData: Invalid zip file \"%s\"!", zip_source);
 		return false;
 	}
 
@@ -419,6 +563,537 @@ bool ZipArchive::loadEntryData(ArchiveEntry* entry)
 	return true;
 }
 
+/* ZipArchive::openLazy
+ * Opens the zip [filename] from its central directory alone. Only
+ * entries up to zip_detect_max_size (or in the maps directory) are
+ * read (to detect their types), larger entries are read when their data is first needed and their
+ * types detected when they are first opened. Returns false if the
+ * central directory couldn't be read
+ *******************************************************************/
+bool ZipArchive::openLazy(string filename)
+{
+	// Read the central directory (kept for loading entry data later)
+	wxArrayString names;
+	zip_file.Close();
+	zip_dir_file = filename;
+	if (!zip_file.Open(filename) || !readCentralDirectory(zip_file, zip_dir, &names))
+	{
+		zip_file.Close();
+		zip_dir.clear();
+		zip_dir_file.Clear();
+		return false;
+	}
+
+	// Check compression methods (anything unsupported is reported by the normal open)
+	for (unsigned a = 0; a < zip_dir.size(); a++)
+	{
+		if (zip_dir[a].method != wxZIP_METHOD_DEFLATE && zip_dir[a].method != wxZIP_METHOD_STORE)
+		{
+			zip_file.Close();
+			zip_dir.clear();
+			zip_dir_file.Clear();
+			return false;
+		}
+	}
+
+	// Stop announcements (don't want to be announcing modification due to entries being added etc)
+	setMuted(true);
+	zip_source = filename;
+
+	// Go through all zip entries
+	vector<ArchiveEntry*> zip_entries;
+	bool cache_index = ArchiveIndexCache::canCache(filename);
+	uint64_t dir_hash = ArchiveIndexCache::hash(NULL, 0);
+	theSplashWindow->setProgressMessage("Reading zip data");
+	for (unsigned a = 0; a < zip_dir.size(); a++)
+	{
+		// Get the entry name as a wxFileName (so we can break it up)
+		string name = names[a];
+		name.Replace("\\", "/");
+		wxFileName fn(name, wxPATH_UNIX);
+
+		// Add to directory hash (for the index cache)
+		if (cache_index)
+		{
+			dir_hash = ArchiveIndexCache::hash(name, dir_hash);
+			dir_hash = ArchiveIndexCache::hash(&zip_dir[a].header_offset, sizeof(zip_dir[a].header_offset), dir_hash);
+			dir_hash = ArchiveIndexCache::hash(&zip_dir[a].size, sizeof(zip_dir[a].size), dir_hash);
+			dir_hash = ArchiveIndexCache::hash(&zip_dir[a].crc, sizeof(zip_dir[a].crc), dir_hash);
+		}
+
+		// Zip entry is a directory, add it to the directory tree
+		if (name.EndsWith("/"))
+		{
+			createDir(fn.GetPath(true, wxPATH_UNIX));
+			continue;
+		}
+
+		// Create entry
+		ArchiveEntry* new_entry = new ArchiveEntry(fn.GetFullName(), zip_dir[a].size);
+		new_entry->setLoaded(false);
+		new_entry->exProp("ZipIndex") = (int)a;
+		zip_entries.push_back(new_entry);
+
+		// Add entry and directory to directory tree
+		ArchiveTreeNode* ndir = createDir(fn.GetPath(true, wxPATH_UNIX));
+		ndir->addEntry(new_entry);
+	}
+
+	// Get entry types from the index cache if this zip file hasn't changed since
+	// it was last opened (entry data is then only read when it is needed)
+	bool cached_types = cache_index && ArchiveIndexCache::applyTypes(filename, dir_hash, zip_entries);
+
+	// Otherwise read the data of entries small enough for type detection
+	// (entry types are detected in batches, once enough data has been read)
+	vector<ArchiveEntry*> detect_entries;
+	unsigned detect_size = 0;
+	uint32_t detect_max = zip_detect_max_size > 0 ? zip_detect_max_size * 1024 : 0;
+	for (unsigned a = 0; a < zip_entries.size() && !cached_types; a++)
+	{
+		theSplashWindow->setProgress((float)a / (float)zip_entries.size());
+
+		// Read the data if it's small enough, otherwise type detection is deferred
+		// (entries in the maps directory are always detected, since map wads
+		// need their type to be known for the map list)
+		ArchiveEntry* entry = zip_entries[a];
+		int index = entry->exProp("ZipIndex");
+		bool map_dir = (entry->getParentDir()->getParent() == getRoot() && entry->getParentDir()->getName() == "maps");
+		if (zip_dir[index].size > detect_max && !map_dir)
+			continue;
+		if (zip_dir[index].size > 0)
+		{
+			MemChunk data;
+			if (!readZipEntryData(index, data))
+				continue;
+			entry->importMemChunk(data);
+		}
+		entry->setLoaded(true);
+
+		// Queue it for type detection
+		detect_entries.push_back(entry);
+		detect_size += entry->getSize();
+		if (detect_size >= 64 * 1024 * 1024)
+		{
+			detectZipEntryTypes(detect_entries);
+			detect_size = 0;
+		}
+	}
+
+	// Determine remaining entry types
+	detectZipEntryTypes(detect_entries);
+	theSplashWindow->forceRedraw();
+
+	// Save detected entry types to the index cache
+	if (cache_index && !cached_types)
+		ArchiveIndexCache::saveTypes(filename, dir_hash, zip_entries);
+
+	// Set all entries/directories to unmodified
+	vector<ArchiveEntry*> entry_list;
+	getEntryTreeAsList(entry_list);
+	for (size_t a = 0; a < entry_list.size(); a++)
+		entry_list[a]->setState(0);
+
+	// Enable announcements
+	setMuted(false);
+
+	// Setup variables
+	this->filename = filename;
+	setModified(false);
+	on_disk = true;
+
+	theSplashWindow->setProgressMessage("");
+
+	return true;
+}
+
+/* ZipArchive::readCentralDirectory
+ * Reads the central directory of the zip [file] into [dir] (and the
+ * entry names into [names] if given). Returns
+ * false if it couldn't be read, or uses zip features that aren't
+ * supported for direct reading (zip64)
+ *******************************************************************/
+bool ZipArchive::readCentralDirectory(wxFile& file, vector<zip_dir_entry_t>& dir, wxArrayString* names)
+{
+	dir.clear();
+	if (names)
+		names->clear();
+
+	// Read the end of the file, where the end of central directory record is
+	// (it can be followed by a comment of up to 64kb)
+	wxFileOffset file_size = file.Length();
+	if (file_size < 22 || file_size > 0xFFFFFFFFLL)
+		return false;
+	unsigned tail_size = (unsigned)MIN(file_size, (wxFileOffset)(65535 + 22));
+	vector<uint8_t> tail(tail_size);
+	if (file.Seek(file_size - tail_size) == wxInvalidOffset || file.Read(&tail[0], tail_size) != (ssize_t)tail_size)
+		return false;
+
+	// Find the end of central directory record
+	int eocd = -1;
+	for (int a = tail_size - 22; a >= 0; a--)
+	{
+		if (tail[a] == 'P' && tail[a+1] == 'K' && tail[a+2] == 5 && tail[a+3] == 6)
+		{
+			eocd = a;
+			break;
+		}
+	}
+	if (eocd < 0)
+		return false;
+
+	// Get central directory info
+	uint32_t n_entries = READ_L16(tail, eocd + 10);
+	uint32_t cd_size = READ_L32(tail, eocd + 12);
+	uint32_t cd_offset = READ_L32(tail, eocd + 16);
+	if (n_entries == 0xFFFF || cd_offset == 0xFFFFFFFF)
+		return false;	// Zip64
+	if ((wxFileOffset)cd_offset + cd_size > file_size)
+		return false;
+
+	// Read the central directory
+	vector<uint8_t> cd(cd_size + 1);
+	if (file.Seek(cd_offset) == wxInvalidOffset || file.Read(&cd[0], cd_size) != (ssize_t)cd_size)
+		return false;
+
+	// Read entries
+	uint32_t pos = 0;
+	for (unsigned a = 0; a < n_entries; a++)
+	{
+		// Check header
+		if (pos + 46 > cd_size || cd[pos] != 'P' || cd[pos+1] != 'K' || cd[pos+2] != 1 || cd[pos+3] != 2)
+		{
+			dir.clear();
+			return false;
+		}
+
+		zip_dir_entry_t entry;
+		entry.version = READ_L16(cd, pos + 6);
+		entry.flags = READ_L16(cd, pos + 8);
+		entry.method = READ_L16(cd, pos + 10);
+		entry.time = READ_L16(cd, pos + 12);
+		entry.date = READ_L16(cd, pos + 14);
+		entry.crc = READ_L32(cd, pos + 16);
+		entry.size_compressed = READ_L32(cd, pos + 20);
+		entry.size = READ_L32(cd, pos + 24);
+		entry.header_offset = READ_L32(cd, pos + 42);
+		dir.push_back(entry);
+
+		// Get name (UTF-8 if flagged as such)
+		if (names)
+		{
+			unsigned name_len = READ_L16(cd, pos + 28);
+			if (pos + 46 + name_len > cd_size)
+			{
+				dir.clear();
+				return false;
+			}
+			const char* name = (const char*)&cd[pos + 46];
+			if (entry.flags & 0x800)
+				names->Add(wxString::FromUTF8(name, name_len));
+			else
+				names->Add(wxString(name, wxConvLocal, name_len));
+		}
+
+		// Next entry (after name, extra field and comment)
+		pos += 46 + READ_L16(cd, pos + 28) + READ_L16(cd, pos + 30) + READ_L16(cd, pos + 32);
+	}
+
+	return true;
+}
+
+/* ZipArchive::readZipEntryData
+ * Reads the data of the zip entry at [zip_index] into [mc], seeking
+ * straight to it using the zip central directory (which is read the
+ * first time this is called for the archive's file). The file is
+ * kept open between calls. Returns false if the entry couldn't be
+ * read this way
+ *******************************************************************/
+bool ZipArchive::readZipEntryData(unsigned zip_index, MemChunk& mc)
+{
+	// Open the file and read its central directory if needed
+	if (zip_dir_file != zip_source)
+	{
+		zip_file.Close();
+		zip_dir.clear();
+		zip_dir_file = zip_source;
+		if (zip_source.IsEmpty() || !wxFileExists(zip_source) || !zip_file.Open(zip_source) || !readCentralDirectory(zip_file, zip_dir))
+		{
+			zip_file.Close();
+			LOG_MESSAGE(2, "ZipArchive: Unable to read zip central directory of \"%s\"", zip_source);
+			return false;
+		}
+	}
+
+	// Check zip entry
+	if (!zip_file.IsOpened() || zip_index >= zip_dir.size())
+		return false;
+	zip_dir_entry_t& zentry = zip_dir[zip_index];
+	if (zentry.flags & 1)
+		return false;	// Encrypted
+	if (zentry.method != wxZIP_METHOD_STORE && zentry.method != wxZIP_METHOD_DEFLATE)
+		return false;
+	if (zentry.size_compressed == 0 || zentry.size == 0)
+		return false;
+
+	// Read local header to find where the data starts
+	uint8_t header[30];
+	if (zip_file.Seek(zentry.header_offset) == wxInvalidOffset || zip_file.Read(header, 30) != 30)
+		return false;
+	if (header[0] != 'P' || header[1] != 'K' || header[2] != 3 || header[3] != 4)
+		return false;
+	uint32_t data_offset = zentry.header_offset + 30 + READ_L16(header, 26) + READ_L16(header, 28);
+	if ((wxFileOffset)data_offset + zentry.size_compressed > zip_file.Length())
+		return false;
+
+	// Read (and inflate if needed) the data
+	if (zip_file.Seek(data_offset) == wxInvalidOffset)
+		return false;
+	if (zentry.method == wxZIP_METHOD_STORE)
+	{
+		if (!mc.importFileStream(zip_file, zentry.size_compressed))
+			return false;
+	}
+	else
+	{
+		MemChunk compressed;
+		if (!compressed.importFileStream(zip_file, zentry.size_compressed) ||
+		        !Compression::ZipInflate(compressed, mc, zentry.size))
+			return false;
+	}
+
+	return (mc.getSize() == zentry.size);
+}
+
+/* ZipArchive::writeZip
+ * Writes [entries] to [out] as a zip file. Unmodified entries that
+ * exist in the zip source are copied over as-is, everything else is
+ * compressed in batches across multiple threads (see the
+ * zip_compress_level and zip_write_threads cvars). Returns false and
+ * sets Global::error on failure
+ *******************************************************************/
+bool ZipArchive::writeZip(wxFile& out, vector<ArchiveEntry*>& entries)
+{
+	// Zip64 isn't supported
+	if (entries.size() > 0xFFFF)
+	{
+		Global::error = "Too many entries to write to a zip file (65535 maximum)";
+		return false;
+	}
+
+	// Open the zip source for copying. This is used to copy any entries that
+	// have been previously saved/compressed and are unmodified, to greatly
+	// speed up zip file saving by not having to recompress unchanged entries
+	wxFile in;
+	vector<zip_dir_entry_t> in_dir;
+	if (!zip_source.IsEmpty() && wxFileExists(zip_source) && in.Open(zip_source))
+	{
+		if (!readCentralDirectory(in, in_dir))
+			in_dir.clear();
+	}
+	wxFileOffset in_length = in.IsOpened() ? in.Length() : 0;
+
+	// Get the current time in MS-DOS format, for new/modified entries
+	time_t now = time(NULL);
+	struct tm* local = localtime(&now);
+	uint16_t dos_time = (local->tm_hour << 11) | (local->tm_min << 5) | (local->tm_sec / 2);
+	uint16_t dos_date = ((local->tm_year - 80) << 9) | ((local->tm_mon + 1) << 5) | local->tm_mday;
+
+	ZipDeflateJob job(MIN((int)zip_compress_level, 9));
+	unsigned threads = ParallelJob::numThreads(zip_write_threads);
+	vector<int> copy_index(entries.size(), -1);
+	vector<uint32_t> copy_offset(entries.size(), 0);
+	vector<int> job_index(entries.size(), -1);
+	MemChunk central;
+	uint64_t offset = 0;
+	uint8_t header[46];
+	size_t a = 0;
+	while (a < entries.size())
+	{
+		// Get the next batch of entries, limited by the amount of data
+		// that needs compressing so everything isn't in memory at once
+		size_t batch_start = a;
+		uint64_t batch_size = 0;
+		job.clear();
+		for (; a < entries.size() && batch_size < 64 * 1024 * 1024; a++)
+		{
+			ArchiveEntry* entry = entries[a];
+			if (entry->getType() == EntryType::folderType())
+				continue;
+
+			// If the entry is unmodified and exists in the old zip, it can
+			// be copied over
+			int index = -1;
+			if (entry->exProps().propertyExists("ZipIndex"))
+				index = entry->exProp("ZipIndex");
+			if (entry->getState() == 0 && index >= 0 && index < (int)in_dir.size())
+			{
+				zip_dir_entry_t& zentry = in_dir[index];
+				if (in.Seek(zentry.header_offset) != wxInvalidOffset && in.Read(header, 30) == 30 &&
+				        header[0] == 'P' && header[1] == 'K' && header[2] == 3 && header[3] == 4)
+				{
+					uint32_t data_offset = zentry.header_offset + 30 + READ_L16(header, 26) + READ_L16(header, 28);
+					if ((wxFileOffset)data_offset + zentry.size_compressed <= in_length)
+					{
+						copy_index[a] = index;
+						copy_offset[a] = data_offset;
+						continue;
+					}
+				}
+			}
+
+			// Otherwise it needs (re)compressing
+			job_index[a] = job.in.size();
+			job.add(&entry->getMCData());
+			batch_size += entry->getSize();
+		}
+
+		// Compress the batch
+		if (!job.in.empty())
+			job.run(job.in.size(), threads, 1);
+
+		// Write the batch
+		for (size_t e = batch_start; e < a; e++)
+		{
+			ArchiveEntry* entry = entries[e];
+			zip_dir_entry_t zentry;
+			string name;
+			const void* data = NULL;
+			if (entry->getType() == EntryType::folderType())
+			{
+				// Directory entry
+				name = entry->getPath(true);
+				zentry.method = wxZIP_METHOD_STORE;
+				zentry.version = 10;
+				zentry.flags = 0;
+				zentry.crc = 0;
+				zentry.size = zentry.size_compressed = 0;
+				zentry.time = dos_time;
+				zentry.date = dos_date;
+			}
+			else if (copy_index[e] >= 0)
+			{
+				// Copied entry, sizes are always in the local header now
+				name = entry->getPath() + entry->getName();
+				zentry = in_dir[copy_index[e]];
+				zentry.flags &= ~0x0008;
+			}
+			else
+			{
+				// Compressed (or stored) entry
+				name = entry->getPath() + entry->getName();
+				int j = job_index[e];
+				bool stored = (job.out[j]->getSize() == 0);
+				zentry.method = stored ? wxZIP_METHOD_STORE : wxZIP_METHOD_DEFLATE;
+				zentry.version = stored ? 10 : 20;
+				zentry.flags = 0;
+				zentry.crc = job.crc[j];
+				zentry.size = job.in[j]->getSize();
+				zentry.size_compressed = stored ? zentry.size : job.out[j]->getSize();
+				zentry.time = dos_time;
+				zentry.date = dos_date;
+				data = stored ? job.in[j]->getData() : job.out[j]->getData();
+			}
+			zentry.header_offset = offset;
+
+			// Get name as utf-8 (without the leading /), and flag it if it
+			// isn't plain ascii
+			if (name.StartsWith("/"))
+				name.Remove(0, 1);
+			std::string name_utf8 = name.ToUTF8().data();
+			zentry.flags &= ~0x0800;
+			for (unsigned c = 0; c < name_utf8.size(); c++)
+			{
+				if ((uint8_t)name_utf8[c] >= 0x80)
+				{
+					zentry.flags |= 0x0800;
+					break;
+				}
+			}
+
+			// Write local header
+			writeL32(header, 0, 0x04034b50);
+			writeL16(header, 4, zentry.version);
+			writeL16(header, 6, zentry.flags);
+			writeL16(header, 8, zentry.method);
+			writeL16(header, 10, zentry.time);
+			writeL16(header, 12, zentry.date);
+			writeL32(header, 14, zentry.crc);
+			writeL32(header, 18, zentry.size_compressed);
+			writeL32(header, 22, zentry.size);
+			writeL16(header, 26, name_utf8.size());
+			writeL16(header, 28, 0);
+			if (!writeZipData(out, header, 30, offset) ||
+			        !writeZipData(out, name_utf8.data(), name_utf8.size(), offset))
+				return false;
+
+			// Write data
+			if (copy_index[e] >= 0)
+			{
+				// Copy raw (compressed) data from the zip source
+				MemChunk buffer;
+				uint32_t left = zentry.size_compressed;
+				if (in.Seek(copy_offset[e]) == wxInvalidOffset)
+				{
+					Global::error = "Unable to read from zip file";
+					return false;
+				}
+				while (left > 0)
+				{
+					uint32_t chunk = MIN(left, 1024u * 1024u);
+					if (!buffer.importFileStream(in, chunk))
+					{
+						Global::error = "Unable to read from zip file";
+						return false;
+					}
+					if (!writeZipData(out, buffer.getData(), chunk, offset))
+						return false;
+					left -= chunk;
+				}
+			}
+			else if (!writeZipData(out, data, zentry.size_compressed, offset))
+				return false;
+
+			// Add central directory record
+			writeL32(header, 0, 0x02014b50);
+			writeL16(header, 4, 20);		// Version made by (MS-DOS)
+			writeL16(header, 6, zentry.version);
+			writeL16(header, 8, zentry.flags);
+			writeL16(header, 10, zentry.method);
+			writeL16(header, 12, zentry.time);
+			writeL16(header, 14, zentry.date);
+			writeL32(header, 16, zentry.crc);
+			writeL32(header, 20, zentry.size_compressed);
+			writeL32(header, 24, zentry.size);
+			writeL16(header, 28, name_utf8.size());
+			writeL16(header, 30, 0);		// Extra field length
+			writeL16(header, 32, 0);		// Comment length
+			writeL16(header, 34, 0);		// Disk number
+			writeL16(header, 36, 0);		// Internal attributes
+			writeL32(header, 38, entry->getType() == EntryType::folderType() ? 0x10 : 0);
+			writeL32(header, 42, zentry.header_offset);
+			central.write(header, 46);
+			central.write(name_utf8.data(), name_utf8.size());
+		}
+	}
+	job.clear();
+
+	// Write central directory
+	uint32_t central_offset = offset;
+	if (!writeZipData(out, central.getData(), central.getSize(), offset))
+		return false;
+
+	// Write end of central directory record
+	writeL32(header, 0, 0x06054b50);
+	writeL16(header, 4, 0);		// Disk number
+	writeL16(header, 6, 0);		// Central directory disk
+	writeL16(header, 8, entries.size());
+	writeL16(header, 10, entries.size());
+	writeL32(header, 12, central.getSize());
+	writeL32(header, 16, central_offset);
+	writeL16(header, 20, 0);	// Comment length
+	return writeZipData(out, header, 22, offset);
+}
+
 /* ZipArchive::addEntry
  * Adds [entry] to the end of the namespace matching [add_namespace].
  * If [copy] is true a copy of the entry is added. Returns the added
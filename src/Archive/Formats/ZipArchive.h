@@ -3,6 +3,7 @@
 #define __ZIPARCHIVE_H__
 
 #include "Archive/Archive.h"
+#include <wx/file.h>
 
 class ZipArchive : public Archive
 {
@@ -42,9 +43,31 @@ public:
 	static bool isZipArchive(string filename);
 
 private:
-	string	temp_file;
+	// Central directory info for an entry in the zip file
+	struct zip_dir_entry_t
+	{
+		uint32_t	header_offset;
+		uint32_t	size_compressed;
+		uint32_t	size;
+		uint32_t	crc;
+		uint16_t	method;
+		uint16_t	flags;
+		uint16_t	version;	// Version needed to extract
+		uint16_t	time;		// MS-DOS format modification time/date
+		uint16_t	date;
+	};
+
+	string					temp_file;
+	string					zip_source;		// The zip file that entry ZipIndex values refer to
+	vector<zip_dir_entry_t>	zip_dir;		// Central directory of zip_dir_file, by zip entry index
+	string					zip_dir_file;
+	wxFile					zip_file;		// Kept open for loading entry data
 
 	void	generateTempFileName(string filename);
+	bool	openLazy(string filename);
+	bool	readCentralDirectory(wxFile& file, vector<zip_dir_entry_t>& dir, wxArrayString* names = NULL);
+	bool	readZipEntryData(unsigned zip_index, MemChunk& mc);
+	bool	writeZip(wxFile& out, vector<ArchiveEntry*>& entries);
 };
 
 #endif//__ZIPARCHIVE_H__
@@ -39,6 +39,7 @@
  *******************************************************************/
 EXTERN_CVAR(Bool, close_archive_with_tab)
 EXTERN_CVAR(Bool, archive_load_data)
+EXTERN_CVAR(Bool, archive_map_files)
 EXTERN_CVAR(Bool, auto_open_wads_root)
 EXTERN_CVAR(Bool, update_check)
 EXTERN_CVAR(Bool, update_check_beta)
@@ -67,6 +68,11 @@ GeneralPrefsPanel::GeneralPrefsPanel(wxWindow* parent) : PrefsPanelBase(parent)
 	cb_archive_load = new wxCheckBox(this, -1, "Load all archive entry data to memory when opened");
 	sizer->Add(cb_archive_load, 0, wxEXPAND|wxALL, 4);
 
+	// Memory-map archive files
+	cb_archive_map = new wxCheckBox(this, -1, "Memory-map archive files when opened");
+	cb_archive_map->SetToolTip("Read entry data directly from the archive file on disk rather than copying it into memory (applies to newly opened archives)");
+	sizer->Add(cb_archive_map, 0, wxEXPAND|wxALL, 4);
+
 	// Close archive with tab
 	cb_archive_close_tab = new wxCheckBox(this, -1, "Close archive when its tab is closed");
 	sizer->Add(cb_archive_close_tab, 0, wxEXPAND|wxALL, 4);
@@ -104,6 +110,7 @@ GeneralPrefsPanel::~GeneralPrefsPanel()
 void GeneralPrefsPanel::init()
 {
 	cb_archive_load->SetValue(archive_load_data);
+	cb_archive_map->SetValue(archive_map_files);
 	cb_archive_close_tab->SetValue(close_archive_with_tab);
 	cb_wads_root->SetValue(auto_open_wads_root);
 #ifdef __WXMSW__
@@ -119,6 +126,7 @@ void GeneralPrefsPanel::init()
 void GeneralPrefsPanel::applyPreferences()
 {
 	archive_load_data = cb_archive_load->GetValue();
+	archive_map_files = cb_archive_map->GetValue();
 	close_archive_with_tab = cb_archive_close_tab->GetValue();
 	auto_open_wads_root = cb_wads_root->GetValue();
 #ifdef __WXMSW__
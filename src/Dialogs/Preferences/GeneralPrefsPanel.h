@@ -9,6 +9,7 @@ class GeneralPrefsPanel : public PrefsPanelBase
 private:
 	wxCheckBox*	cb_gl_np2;
 	wxCheckBox*	cb_archive_load;
+	wxCheckBox*	cb_archive_map;
 	wxCheckBox*	cb_archive_close_tab;
 	wxCheckBox*	cb_wads_root;
 	wxCheckBox*	cb_update_check;
@@ -169,6 +169,9 @@ int TextureResource::length()
  *******************************************************************/
 ResourceManager::ResourceManager()
 {
+	// Listen to the archive manager (archive priorities change when
+	// archives are opened or closed)
+	listenTo(theArchiveManager);
 }
 
 /* ResourceManager::~ResourceManager
@@ -187,6 +190,9 @@ void ResourceManager::addArchive(Archive* archive)
 	if (!archive)
 		return;
 
+	// Any resolved resources may change
+	clearResolved();
+
 	// Go through entries
 	vector<ArchiveEntry*> entries;
 	archive->getEntryTreeAsList(entries);
@@ -209,6 +215,9 @@ void ResourceManager::removeArchive(Archive* archive)
 	if (!archive)
 		return;
 
+	// Any resolved resources may change
+	clearResolved();
+
 	// Go through entries
 	vector<ArchiveEntry*> entries;
 	archive->getEntryTreeAsList(entries);
@@ -219,6 +228,56 @@ void ResourceManager::removeArchive(Archive* archive)
 	announce("resources_updated");
 }
 
+/* ResourceManager::archivePriority
+ * Returns the priority of [archive] when resolving resources (its
+ * index in the archive manager, -1 if it isn't open there). Cached
+ * until archives are opened or closed
+ *******************************************************************/
+int ResourceManager::archivePriority(Archive* archive)
+{
+	std::map<Archive*, int>::iterator i = archive_priority.find(archive);
+	if (i != archive_priority.end())
+		return i->second;
+
+	int priority = theArchiveManager->archiveIndex(archive);
+	archive_priority[archive] = priority;
+	return priority;
+}
+
+/* ResourceManager::forgetResolved
+ * Removes all resolved resource entries for resource [name]
+ * (uppercase) from the index, so they are resolved again when next
+ * needed. Since the entries between namespace markers depend on the
+ * markers, the whole index is cleared if [name] is a marker
+ *******************************************************************/
+void ResourceManager::forgetResolved(const string& name)
+{
+	if (name.EndsWith("_START") || name.EndsWith("_END"))
+	{
+		clearResolved();
+		return;
+	}
+
+	ResolvedEntryMap* maps[] = { &resolved_patches, &resolved_flats, &resolved_satextures };
+	for (unsigned a = 0; a < 3; a++)
+	{
+		ResolvedEntryMap::iterator i = maps[a]->lower_bound(resolved_key_t(name, "", NULL));
+		while (i != maps[a]->end() && i->first.name == name)
+			maps[a]->erase(i++);
+	}
+}
+
+/* ResourceManager::clearResolved
+ * Clears the resolved resource index and cached archive priorities
+ *******************************************************************/
+void ResourceManager::clearResolved()
+{
+	resolved_patches.clear();
+	resolved_flats.clear();
+	resolved_satextures.clear();
+	archive_priority.clear();
+}
+
 /* ResourceManager::getTextureHash
  * Returns the Doom64 hash of a given texture name, computed using
  * the same hash algorithm as Doom64 EX itself
@@ -241,9 +300,24 @@ uint16_t ResourceManager::getTextureHash(string name)
  *******************************************************************/
 void ResourceManager::addEntry(ArchiveEntry* entry)
 {
+	// Resources with the entry's name need to be resolved again
+	forgetResolved(entry->getName(true).Upper());
+
 	// Detect type if unknown
 	if (entry->getType() == EntryType::unknownType())
+	{
+		// Entries that haven't been loaded yet (eg. large zip entries, which are
+		// detected when first opened) are only worth loading if they are somewhere
+		// resources can be
+		if (!entry->isLoaded() &&
+		        !entry->isInNamespace("global")		&& !entry->isInNamespace("patches")		&&
+		        !entry->isInNamespace("sprites")	&& !entry->isInNamespace("graphics")	&&
+		        !entry->isInNamespace("hires")		&& !entry->isInNamespace("textures")	&&
+		        !entry->isInNamespace("flats"))
+			return;
+
 		EntryType::detectEntryType(entry);
+	}
 
 	// Get entry type
 	EntryType* type = entry->getType();
@@ -331,6 +405,9 @@ void ResourceManager::removeEntry(ArchiveEntry* entry)
 	// Get resource name (extension cut, uppercase)
 	string name = entry->getName(true).Upper();
 
+	// Resources with the entry's name need to be resolved again
+	forgetResolved(name);
+
 	// Remove from palettes
 	palettes[name].remove(entry);
 
@@ -406,8 +483,8 @@ void ResourceManager::getAllPatchEntries(vector<ArchiveEntry*>& list, Archive* p
 				break;
 
 			// Otherwise, if it's in a 'later' archive than the current resource entry, set it
-			if (theArchiveManager->archiveIndex(entry->getParent()) <=
-			        theArchiveManager->archiveIndex(i->second.entries[a]->getParent()))
+			if (archivePriority(entry->getParent()) <=
+			        archivePriority(i->second.entries[a]->getParent()))
 				entry = i->second.entries[a];
 		}
 
@@ -450,8 +527,8 @@ void ResourceManager::getAllTextures(vector<TextureResource::tex_res_t>& list, A
 				break;
 
 			// Otherwise, if it's in a 'later' archive than the current resource, set it
-			if (theArchiveManager->archiveIndex(res.parent) <=
-			        theArchiveManager->archiveIndex(i->second.textures[a].parent))
+			if (archivePriority(res.parent) <=
+			        archivePriority(i->second.textures[a].parent))
 				res = i->second.textures[a];
 		}
 
@@ -513,8 +590,8 @@ void ResourceManager::getAllFlatEntries(vector<ArchiveEntry*>& list, Archive* pr
 				break;
 
 			// Otherwise, if it's in a 'later' archive than the current resource entry, set it
-			if (theArchiveManager->archiveIndex(entry->getParent()) <=
-			        theArchiveManager->archiveIndex(i->second.entries[a]->getParent()))
+			if (archivePriority(entry->getParent()) <=
+			        archivePriority(i->second.entries[a]->getParent()))
 				entry = i->second.entries[a];
 		}
 
@@ -571,8 +648,8 @@ ArchiveEntry* ResourceManager::getPaletteEntry(string palette, Archive* priority
 			return res.entries[a];
 
 		// Otherwise, if it's in a 'later' archive than the current resource entry, set it
-		if (theArchiveManager->archiveIndex(entry->getParent()) <=
-		        theArchiveManager->archiveIndex(res.entries[a]->getParent()))
+		if (archivePriority(entry->getParent()) <=
+		        archivePriority(res.entries[a]->getParent()))
 			entry = res.entries[a];
 	}
 
@@ -580,24 +657,17 @@ ArchiveEntry* ResourceManager::getPaletteEntry(string palette, Archive* priority
 	return entry;
 }
 
-/* ResourceManager::getPatchEntry
- * Returns the most appropriate managed resource entry for [patch],
- * or NULL if no match found
+/* ResourceManager::resolvePatchEntry
+ * Finds the most appropriate managed resource entry for [patch]
+ * (uppercase) in [nspace], or NULL if no match found
  *******************************************************************/
-ArchiveEntry* ResourceManager::getPatchEntry(string patch, string nspace, Archive* priority)
+ArchiveEntry* ResourceManager::resolvePatchEntry(const string& patch, const string& nspace, Archive* priority)
 {
-	// Are we wanting to use a flat as a patch?
-	if (!nspace.CmpNoCase("flats"))
-		return getFlatEntry(patch, priority);
-
-	// Are we wanting to use a stand-alone texture as a patch?
-	if (!nspace.CmpNoCase("textures"))
-		return getTextureEntry(patch, "textures", priority);
-
 	// Check resource with matching name exists
-	EntryResource& res = patches[patch.Upper()];
-	if (res.entries.size() == 0)
+	EntryResourceMap::iterator i = patches.find(patch);
+	if (i == patches.end() || i->second.entries.size() == 0)
 		return NULL;
+	EntryResource& res = i->second;
 
 	// Go through resource entries
 	ArchiveEntry* entry = res.entries[0];
@@ -620,8 +690,8 @@ ArchiveEntry* ResourceManager::getPatchEntry(string patch, string nspace, Archiv
 				entry = res.entries[a];
 
 			// Otherwise, if it's in a 'later' archive than the current resource entry, set it
-			if (theArchiveManager->archiveIndex(entry->getParent()) <=
-			        theArchiveManager->archiveIndex(res.entries[a]->getParent()))
+			if (archivePriority(entry->getParent()) <=
+			        archivePriority(res.entries[a]->getParent()))
 				entry = res.entries[a];
 		}
 	}
@@ -630,16 +700,17 @@ ArchiveEntry* ResourceManager::getPatchEntry(string patch, string nspace, Archiv
 	return entry;
 }
 
-/* ResourceManager::getFlatEntry
- * Returns the most appropriate managed resource entry for [flat],
- * or NULL if no match found
+/* ResourceManager::resolveFlatEntry
+ * Finds the most appropriate managed resource entry for [flat]
+ * (uppercase), or NULL if no match found
  *******************************************************************/
-ArchiveEntry* ResourceManager::getFlatEntry(string flat, Archive* priority)
+ArchiveEntry* ResourceManager::resolveFlatEntry(const string& flat, Archive* priority)
 {
 	// Check resource with matching name exists
-	EntryResource& res = flats[flat.Upper()];
-	if (res.entries.size() == 0)
+	EntryResourceMap::iterator i = flats.find(flat);
+	if (i == flats.end() || i->second.entries.size() == 0)
 		return NULL;
+	EntryResource& res = i->second;
 
 	// Go through resource entries
 	ArchiveEntry* entry = res.entries[0];
@@ -654,8 +725,8 @@ ArchiveEntry* ResourceManager::getFlatEntry(string flat, Archive* priority)
 			return res.entries[a];
 
 		// Otherwise, if it's in a 'later' archive than the current resource entry, set it
-		if (theArchiveManager->archiveIndex(entry->getParent()) <=
-		        theArchiveManager->archiveIndex(res.entries[a]->getParent()))
+		if (archivePriority(entry->getParent()) <=
+		        archivePriority(res.entries[a]->getParent()))
 			entry = res.entries[a];
 	}
 
@@ -663,16 +734,17 @@ ArchiveEntry* ResourceManager::getFlatEntry(string flat, Archive* priority)
 	return entry;
 }
 
-/* ResourceManager::getTextureEntry
- * Returns the most appropriate managed resource entry for [texture],
- * or NULL if no match found
+/* ResourceManager::resolveTextureEntry
+ * Finds the most appropriate managed resource entry for [texture]
+ * (uppercase) in [nspace], or NULL if no match found
  *******************************************************************/
-ArchiveEntry* ResourceManager::getTextureEntry(string texture, string nspace, Archive* priority)
+ArchiveEntry* ResourceManager::resolveTextureEntry(const string& texture, const string& nspace, Archive* priority)
 {
 	// Check resource with matching name exists
-	EntryResource& res = satextures[texture.Upper()];
-	if (res.entries.size() == 0)
+	EntryResourceMap::iterator i = satextures.find(texture);
+	if (i == satextures.end() || i->second.entries.size() == 0)
 		return NULL;
+	EntryResource& res = i->second;
 
 	// Go through resource entries
 	ArchiveEntry* entry = NULL;
@@ -691,8 +763,8 @@ ArchiveEntry* ResourceManager::getTextureEntry(string texture, string nspace, Ar
 				return res.entries[a];
 
 			// Otherwise, if it's in a 'later' archive than the current resource entry, set it
-			if (!entry || theArchiveManager->archiveIndex(entry->getParent()) <=
-			        theArchiveManager->archiveIndex(res.entries[a]->getParent()))
+			if (!entry || archivePriority(entry->getParent()) <=
+			        archivePriority(res.entries[a]->getParent()))
 				entry = res.entries[a];
 		}
 	}
@@ -701,6 +773,68 @@ ArchiveEntry* ResourceManager::getTextureEntry(string texture, string nspace, Ar
 	return entry;
 }
 
+/* ResourceManager::getPatchEntry
+ * Returns the most appropriate managed resource entry for [patch],
+ * or NULL if no match found
+ *******************************************************************/
+ArchiveEntry* ResourceManager::getPatchEntry(string patch, string nspace, Archive* priority)
+{
+	// Are we wanting to use a flat as a patch?
+	if (!nspace.CmpNoCase("flats"))
+		return getFlatEntry(patch, priority);
+
+	// Are we wanting to use a stand-alone texture as a patch?
+	if (!nspace.CmpNoCase("textures"))
+		return getTextureEntry(patch, "textures", priority);
+
+	// Check the resolved resource index
+	resolved_key_t key(patch.Upper(), nspace, priority);
+	ResolvedEntryMap::iterator i = resolved_patches.find(key);
+	if (i != resolved_patches.end())
+		return i->second;
+
+	// Not resolved yet
+	ArchiveEntry* entry = resolvePatchEntry(key.name, nspace, priority);
+	resolved_patches[key] = entry;
+	return entry;
+}
+
+/* ResourceManager::getFlatEntry
+ * Returns the most appropriate managed resource entry for [flat],
+ * or NULL if no match found
+ *******************************************************************/
+ArchiveEntry* ResourceManager::getFlatEntry(string flat, Archive* priority)
+{
+	// Check the resolved resource index
+	resolved_key_t key(flat.Upper(), "", priority);
+	ResolvedEntryMap::iterator i = resolved_flats.find(key);
+	if (i != resolved_flats.end())
+		return i->second;
+
+	// Not resolved yet
+	ArchiveEntry* entry = resolveFlatEntry(key.name, priority);
+	resolved_flats[key] = entry;
+	return entry;
+}
+
+/* ResourceManager::getTextureEntry
+ * Returns the most appropriate managed resource entry for [texture],
+ * or NULL if no match found
+ *******************************************************************/
+ArchiveEntry* ResourceManager::getTextureEntry(string texture, string nspace, Archive* priority)
+{
+	// Check the resolved resource index
+	resolved_key_t key(texture.Upper(), nspace, priority);
+	ResolvedEntryMap::iterator i = resolved_satextures.find(key);
+	if (i != resolved_satextures.end())
+		return i->second;
+
+	// Not resolved yet
+	ArchiveEntry* entry = resolveTextureEntry(key.name, nspace, priority);
+	resolved_satextures[key] = entry;
+	return entry;
+}
+
 /* ResourceManager::getTexture
  * Returns the most appropriate managed texture for [texture], or
  * NULL if no match found
@@ -726,8 +860,8 @@ CTexture* ResourceManager::getTexture(string texture, Archive* priority, Archive
 			return res.textures[a].tex;
 
 		// Otherwise, if it's in a 'later' archive than the current resource entry, set it
-		if (theArchiveManager->archiveIndex(parent) <=
-		        theArchiveManager->archiveIndex(res.textures[a].parent))
+		if (archivePriority(parent) <=
+		        archivePriority(res.textures[a].parent))
 		{
 			tex = res.textures[a].tex;
 			parent = res.textures[a].parent;
@@ -741,6 +875,89 @@ CTexture* ResourceManager::getTexture(string texture, Archive* priority, Archive
 		return NULL;
 }
 
+/* ResourceManager::checkResolvedIndex
+ * Checks that every resource in the resolved resource index is the
+ * same as resolving it again from scratch would give, for all patch,
+ * flat and stand-alone texture names with no priority archive and
+ * each open archive as priority. Logs any mismatches and returns the
+ * number found
+ *******************************************************************/
+unsigned ResourceManager::checkResolvedIndex()
+{
+	unsigned checked = 0;
+	unsigned errors = 0;
+
+	// Check cached archive priorities
+	vector<Archive*> archives(1, (Archive*)NULL);
+	for (int a = 0; a < theArchiveManager->numArchives(); a++)
+		archives.push_back(theArchiveManager->getArchive(a));
+	archives.push_back(theArchiveManager->baseResourceArchive());
+	for (unsigned a = 0; a < archives.size(); a++)
+	{
+		checked++;
+		if (archivePriority(archives[a]) != theArchiveManager->archiveIndex(archives[a]))
+		{
+			wxLogMessage("Resolved index: wrong priority for archive %d", a);
+			errors++;
+		}
+	}
+	archives.pop_back();
+
+	// Patches (in the namespaces patches are looked up in)
+	const char* nspaces[] = { "patches", "graphics", "sprites", "" };
+	for (EntryResourceMap::iterator i = patches.begin(); i != patches.end(); ++i)
+	{
+		for (unsigned n = 0; n < 4; n++)
+		{
+			for (unsigned a = 0; a < archives.size(); a++)
+			{
+				checked++;
+				if (getPatchEntry(i->first, nspaces[n], archives[a]) != resolvePatchEntry(i->first, nspaces[n], archives[a]))
+				{
+					wxLogMessage("Resolved index: wrong entry for patch %s (namespace \"%s\")", i->first, nspaces[n]);
+					errors++;
+				}
+			}
+		}
+	}
+
+	// Flats
+	for (EntryResourceMap::iterator i = flats.begin(); i != flats.end(); ++i)
+	{
+		for (unsigned a = 0; a < archives.size(); a++)
+		{
+			checked++;
+			if (getFlatEntry(i->first, archives[a]) != resolveFlatEntry(i->first, archives[a]))
+			{
+				wxLogMessage("Resolved index: wrong entry for flat %s", i->first);
+				errors++;
+			}
+		}
+	}
+
+	// Stand-alone textures
+	const char* tx_nspaces[] = { "textures", "hires", "" };
+	for (EntryResourceMap::iterator i = satextures.begin(); i != satextures.end(); ++i)
+	{
+		for (unsigned n = 0; n < 3; n++)
+		{
+			for (unsigned a = 0; a < archives.size(); a++)
+			{
+				checked++;
+				if (getTextureEntry(i->first, tx_nspaces[n], archives[a]) != resolveTextureEntry(i->first, tx_nspaces[n], archives[a]))
+				{
+					wxLogMessage("Resolved index: wrong entry for texture %s (namespace \"%s\")", i->first, tx_nspaces[n]);
+					errors++;
+				}
+			}
+		}
+	}
+
+	wxLogMessage("Resolved index: checked %d lookups, %d mismatches", checked, errors);
+
+	return errors;
+}
+
 /* ResourceManager::onAnnouncement
  * Called when an announcement is recieved from any managed archive
  *******************************************************************/
@@ -748,6 +965,19 @@ void ResourceManager::onAnnouncement(Announcer* announcer, string event_name, Me
 {
 	event_data.seek(0, SEEK_SET);
 
+	// An archive was opened or closed (archive priorities change)
+	if (announcer == theArchiveManager)
+	{
+		if (event_name == "archive_added" || event_name == "archive_closed")
+			clearResolved();
+
+		return;
+	}
+
+	// Entries were moved or directories changed (entry namespaces can change)
+	if (event_name == "entries_swapped" || event_name == "directory_added" || event_name == "directory_modified")
+		clearResolved();
+
 	// An entry is modified
 	if (event_name == "entry_state_changed")
 	{
@@ -769,6 +999,19 @@ void ResourceManager::onAnnouncement(Announcer* announcer, string event_name, Me
 		announce("resources_updated");
 	}
 
+	// A directory is removed (its entries are deleted along with it)
+	if (event_name == "directory_removing")
+	{
+		wxUIntPtr ptr;
+		event_data.read(&ptr, sizeof(wxUIntPtr));
+		vector<ArchiveEntry*> entries;
+		((Archive*)announcer)->getEntryTreeAsList(entries, (ArchiveTreeNode*)wxUIntToPtr(ptr));
+		for (unsigned a = 0; a < entries.size(); a++)
+			removeEntry(entries[a]);
+		clearResolved();
+		announce("resources_updated");
+	}
+
 	// An entry is added
 	if (event_name == "entry_added")
 	{
@@ -788,3 +1031,8 @@ CONSOLE_COMMAND(list_res_patches, 0, false)
 {
 	theResourceManager->listAllPatches();
 }
+
+CONSOLE_COMMAND(res_check_index, 0, false)
+{
+	theResourceManager->checkResolvedIndex();
+}
@@ -67,6 +67,33 @@ typedef std::map<string, TextureResource> TextureResourceMap;
 class ResourceManager : public Listener, public Announcer
 {
 private:
+	// Key for a resolved resource entry: the resource name (uppercase),
+	// namespace and priority archive (and its parent) it was looked up with
+	struct resolved_key_t
+	{
+		string		name;
+		string		nspace;
+		Archive*	priority;
+		Archive*	priority_parent;
+
+		resolved_key_t(const string& name, const string& nspace, Archive* priority)
+		{
+			this->name = name;
+			this->nspace = nspace;
+			this->priority = priority;
+			this->priority_parent = priority ? priority->getParentArchive() : NULL;
+		}
+
+		bool operator<(const resolved_key_t& other) const
+		{
+			if (name != other.name) return name < other.name;
+			if (nspace != other.nspace) return nspace < other.nspace;
+			if (priority != other.priority) return priority < other.priority;
+			return priority_parent < other.priority_parent;
+		}
+	};
+	typedef std::map<resolved_key_t, ArchiveEntry*> ResolvedEntryMap;
+
 	EntryResourceMap	palettes;
 	EntryResourceMap	patches;
 	EntryResourceMap	graphics;
@@ -74,9 +101,22 @@ private:
 	EntryResourceMap	satextures;	// Stand Alone textures (e.g., between TX_ or T_ markers)
 	TextureResourceMap	textures;	// Composite textures (defined in a TEXTUREx/TEXTURES lump)
 
+	// Resolved resource index (the most appropriate entry found for each lookup)
+	ResolvedEntryMap		resolved_patches;
+	ResolvedEntryMap		resolved_flats;
+	ResolvedEntryMap		resolved_satextures;
+	std::map<Archive*, int>	archive_priority;	// Cached ArchiveManager::archiveIndex results
+
 	static ResourceManager*	instance;
 	static string Doom64HashTable[65536];
 
+	int				archivePriority(Archive* archive);
+	void			forgetResolved(const string& name);
+	void			clearResolved();
+	ArchiveEntry*	resolvePatchEntry(const string& patch, const string& nspace, Archive* priority);
+	ArchiveEntry*	resolveFlatEntry(const string& flat, Archive* priority);
+	ArchiveEntry*	resolveTextureEntry(const string& texture, const string& nspace, Archive* priority);
+
 public:
 	ResourceManager();
 	~ResourceManager();
@@ -112,6 +152,8 @@ public:
 	string			getTextureName(uint16_t hash) { return Doom64HashTable[hash]; }
 	uint16_t		getTextureHash(string name);
 
+	unsigned	checkResolvedIndex();
+
 	void	onAnnouncement(Announcer* announcer, string event_name, MemChunk& event_data);
 };
 
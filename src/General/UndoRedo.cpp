@@ -35,6 +35,7 @@
  * VARIABLES
  *******************************************************************/
 UndoManager*	current_undo_manager = NULL;
+CVAR(Int, undo_max_memory, 256, CVAR_SAVE)
 
 
 /*******************************************************************
@@ -49,6 +50,7 @@ UndoLevel::UndoLevel(string name)
 	// Init variables
 	this->name = name;
 	this->timestamp = wxDateTime::Now();
+	this->data_size = 0;
 }
 
 /* UndoLevel::~UndoLevel
@@ -122,6 +124,17 @@ bool UndoLevel::writeFile(string filename)
 	return true;
 }
 
+/* UndoLevel::calculateDataSize
+ * Calculates the approximate memory used by all undo steps in the
+ * level
+ *******************************************************************/
+void UndoLevel::calculateDataSize()
+{
+	data_size = 0;
+	for (unsigned a = 0; a < undo_steps.size(); a++)
+		data_size += undo_steps[a]->dataSize();
+}
+
 /* UndoLevel::createMerged
  * Adds all undo steps from all undo levels in [levels]
  *******************************************************************/
@@ -210,6 +223,7 @@ void UndoManager::endRecord(bool success)
 
 	// Add current level to levels
 	//wxLogMessage("Recording undo level \"%s\" succeeded", current_level->getName());
+	current_level->calculateDataSize();
 	undo_levels.push_back(current_level);
 	current_level = NULL;
 	current_level_index = undo_levels.size() - 1;
@@ -217,6 +231,9 @@ void UndoManager::endRecord(bool success)
 	// Clear current undo manager
 	current_undo_manager = NULL;
 
+	// Remove old levels if over the memory limit
+	limitMemory();
+
 	announce("level_recorded");
 }
 
@@ -329,6 +346,39 @@ void UndoManager::clear()
 	undo_running = false;
 }
 
+/* UndoManager::limitMemory
+ * Removes the oldest undo levels until the memory used by all levels
+ * is within the undo_max_memory limit (in MB, 0 for no limit). The
+ * most recent level is always kept
+ *******************************************************************/
+void UndoManager::limitMemory()
+{
+	if (undo_max_memory <= 0)
+		return;
+
+	// Get total memory used
+	double limit = (double)undo_max_memory * 1024 * 1024;
+	double total = 0;
+	for (unsigned a = 0; a < undo_levels.size(); a++)
+		total += undo_levels[a]->getDataSize();
+
+	// Remove oldest levels while over the limit
+	unsigned removed = 0;
+	while (total > limit && removed + 1 < undo_levels.size() && current_level_index > (int)removed)
+	{
+		total -= undo_levels[removed]->getDataSize();
+		delete undo_levels[removed];
+		removed++;
+	}
+
+	if (removed > 0)
+	{
+		undo_levels.erase(undo_levels.begin(), undo_levels.begin() + removed);
+		current_level_index -= removed;
+		LOG_MESSAGE(2, "Removed %d old undo levels (over %dMB limit)", removed, undo_max_memory.value);
+	}
+}
+
 /* UndoManager::createMergedLevel
  * Creates an undo level from all levels in [manager], called [name]
  *******************************************************************/
@@ -341,11 +391,13 @@ bool UndoManager::createMergedLevel(UndoManager* manager, string name)
 	// Create merged undo level from manager
 	UndoLevel* merged = new UndoLevel(name);
 	merged->createMerged(manager->undo_levels);
+	merged->calculateDataSize();
 
 	// Add undo level
 	undo_levels.push_back(merged);
 	current_level = NULL;
 	current_level_index = undo_levels.size() - 1;
+	limitMemory();
 
 	return true;
 }
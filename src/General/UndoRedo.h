@@ -18,6 +18,9 @@ public:
 	virtual bool	writeFile(MemChunk& mc) { return true; }
 	virtual bool	readFile(MemChunk& mc) { return true; }
 	virtual bool	isOk() { return true; }
+
+	// Approximate memory (in bytes) used by the step's undo/redo data
+	virtual unsigned	dataSize() { return 0; }
 };
 
 class UndoLevel
@@ -26,6 +29,7 @@ private:
 	string				name;
 	vector<UndoStep*>	undo_steps;
 	wxDateTime			timestamp;
+	unsigned			data_size;
 
 public:
 	UndoLevel(string name);
@@ -36,6 +40,8 @@ public:
 	bool	doRedo();
 	void	addStep(UndoStep* step) { undo_steps.push_back(step); }
 	string	getTimeStamp(bool date, bool time);
+	unsigned	getDataSize() { return data_size; }
+	void		calculateDataSize();
 
 	bool	writeFile(string filename);
 	bool	readFile(string filename);
@@ -70,6 +76,7 @@ public:
 	string	redo();
 
 	void	clear();
+	void	limitMemory();
 	bool	createMergedLevel(UndoManager* manager, string name);
 };
 
@@ -35,6 +35,7 @@
 #include "General/Misc.h"
 #include "Graphics/SImage/SImage.h"
 #include "TextureXList.h"
+#include "TextureImageCache.h"
 #include <wx/colour.h>
 
 
@@ -1056,7 +1057,7 @@ bool CTexture::toImage(SImage& image, Archive* parent, Palette8bit* pal, bool fo
 		for (unsigned a = 0; a < patches.size(); a++)
 		{
 			CTPatch* patch = patches[a];
-			if (Misc::loadImageFromEntry(&p_img, patch->getPatchEntry(parent)))
+			if (theTextureImageCache->loadPatch(p_img, patch->getPatchEntry(parent)))
 				image.drawImage(p_img, patch->xOffset(), patch->yOffset(), dp, pal, pal);
 		}
 	}
@@ -1104,7 +1105,7 @@ bool CTexture::loadPatchImage(unsigned pindex, SImage& image, Archive* parent, P
 		// TODO: Something has to be ignored here. The entire archive or just the current list?
 		CTexture* tex = theResourceManager->getTexture(patch->getName(), parent);
 		if (tex)
-			return tex->toImage(image, parent, pal);
+			return theTextureImageCache->loadTexture(image, tex, parent, pal);
 	}
 
 	// Get patch entry
@@ -1112,7 +1113,7 @@ bool CTexture::loadPatchImage(unsigned pindex, SImage& image, Archive* parent, P
 
 	// Load entry to image if valid
 	if (entry)
-		return Misc::loadImageFromEntry(&image, entry);
+		return theTextureImageCache->loadPatch(image, entry);
 	else
 		return false;
 }
@@ -0,0 +1,408 @@
+/*******************************************************************
+ * SLADE - It's a Doom Editor
+ * Copyright (C) 2008-2014 Simon Judd
+ *
+ * Email:       sirjuddington@gmail.com
+ * Web:         http://slade.mancubus.net
+ * Filename:    TextureImageCache.cpp
+ * Description: TextureImageCache class. Keeps decoded patch images
+ *              and composited texture images in memory, so they
+ *              don't need to be re-read every time a texture is
+ *              built or displayed
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *******************************************************************/
+
+
+/*******************************************************************
+ * INCLUDES
+ *******************************************************************/
+#include "Main.h"
+#include "TextureImageCache.h"
+#include "CTexture.h"
+#include "Archive/ArchiveManager.h"
+#include "General/ResourceManager.h"
+#include "General/Misc.h"
+#include "General/Console/Console.h"
+
+
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+TextureImageCache* TextureImageCache::instance = NULL;
+CVAR(Int, texture_cache_size, 64, CVAR_SAVE)
+
+
+/*******************************************************************
+ * TEXTUREIMAGECACHE CLASS FUNCTIONS
+ *******************************************************************/
+
+/* TextureImageCache::TextureImageCache
+ * TextureImageCache class constructor
+ *******************************************************************/
+TextureImageCache::TextureImageCache()
+{
+	use_count = 0;
+
+	// Composite textures depend on all resources (patch lookups etc),
+	// so listen for any resource changes
+	listenTo(theResourceManager);
+}
+
+/* TextureImageCache::~TextureImageCache
+ * TextureImageCache class destructor
+ *******************************************************************/
+TextureImageCache::~TextureImageCache()
+{
+	clear();
+}
+
+/* TextureImageCache::canCache
+ * Returns true if images from [archive] can be cached. Only archives
+ * open in the archive manager are cached, as they always announce
+ * when they are closed
+ *******************************************************************/
+bool TextureImageCache::canCache(Archive* archive)
+{
+	return texture_cache_size > 0 && archive && theArchiveManager->archiveIndex(archive) >= 0;
+}
+
+/* TextureImageCache::addItem
+ * Stores a copy of [image] in [item]
+ *******************************************************************/
+void TextureImageCache::addItem(item_t& item, SImage& image, stats_t& stats)
+{
+	if (item.image)
+	{
+		stats.size -= item.size;
+		stats.count--;
+		delete item.image;
+	}
+
+	item.image = new SImage(image.getType());
+	item.image->copyImage(&image);
+	item.size = image.getWidth() * image.getHeight() * (image.getBpp() + 1) + sizeof(SImage);
+	item.last_used = use_count++;
+	stats.size += item.size;
+	stats.count++;
+
+	limitSize();
+}
+
+/* TextureImageCache::removePatch
+ * Removes the cached image for patch [entry], if any
+ *******************************************************************/
+void TextureImageCache::removePatch(ArchiveEntry* entry)
+{
+	PatchMap::iterator i = patches.find(entry);
+	if (i == patches.end())
+		return;
+
+	patch_stats.size -= i->second.size;
+	patch_stats.count--;
+	delete i->second.image;
+	patches.erase(i);
+}
+
+/* TextureImageCache::removeArchivePatches
+ * Removes all cached patch images from [archive]. Cached entries are
+ * never dereferenced here, since they may already have been deleted
+ *******************************************************************/
+void TextureImageCache::removeArchivePatches(Archive* archive)
+{
+	for (PatchMap::iterator i = patches.begin(); i != patches.end();)
+	{
+		if (i->second.archive == archive)
+		{
+			patch_stats.size -= i->second.size;
+			patch_stats.count--;
+			delete i->second.image;
+			patches.erase(i++);
+		}
+		else
+			++i;
+	}
+}
+
+/* TextureImageCache::clearComposites
+ * Removes all cached composite texture images
+ *******************************************************************/
+void TextureImageCache::clearComposites()
+{
+	for (CompositeMap::iterator i = composites.begin(); i != composites.end(); ++i)
+		delete i->second.image;
+	composites.clear();
+	composite_stats.count = 0;
+	composite_stats.size = 0;
+}
+
+/* TextureImageCache::limitSize
+ * Removes the least recently used images if the cache is bigger than
+ * texture_cache_size (in MB), until it is at 3/4 of that size
+ *******************************************************************/
+void TextureImageCache::limitSize()
+{
+	double limit = (double)texture_cache_size * 1024 * 1024;
+	double size = patch_stats.size + composite_stats.size;
+	if (size <= limit)
+		return;
+
+	// Get all items by when they were last used
+	vector<std::pair<unsigned, unsigned> > items;
+	for (PatchMap::iterator i = patches.begin(); i != patches.end(); ++i)
+		items.push_back(std::make_pair(i->second.last_used, i->second.size));
+	for (CompositeMap::iterator i = composites.begin(); i != composites.end(); ++i)
+		items.push_back(std::make_pair(i->second.last_used, i->second.size));
+	std::sort(items.begin(), items.end());
+
+	// Find the oldest use time to keep
+	unsigned cutoff = 0;
+	for (unsigned a = 0; a < items.size() && size > limit * 0.75; a++)
+	{
+		size -= items[a].second;
+		cutoff = items[a].first + 1;
+	}
+
+	// Remove items used before the cutoff
+	for (PatchMap::iterator i = patches.begin(); i != patches.end();)
+	{
+		if (i->second.last_used < cutoff)
+		{
+			patch_stats.size -= i->second.size;
+			patch_stats.count--;
+			delete i->second.image;
+			patches.erase(i++);
+		}
+		else
+			++i;
+	}
+	for (CompositeMap::iterator i = composites.begin(); i != composites.end();)
+	{
+		if (i->second.last_used < cutoff)
+		{
+			composite_stats.size -= i->second.size;
+			composite_stats.count--;
+			delete i->second.image;
+			composites.erase(i++);
+		}
+		else
+			++i;
+	}
+}
+
+/* TextureImageCache::paletteHash
+ * Returns a hash of the colours in [pal] (0 if no palette is given)
+ *******************************************************************/
+uint32_t TextureImageCache::paletteHash(Palette8bit* pal)
+{
+	if (!pal)
+		return 0;
+
+	// FNV-1a
+	uint32_t hash = 2166136261U;
+	for (unsigned a = 0; a < 256; a++)
+	{
+		rgba_t col = pal->colour(a);
+		uint32_t c = col.r | (col.g << 8) | (col.b << 16) | (col.a << 24);
+		hash = (hash ^ c) * 16777619U;
+	}
+
+	return hash ? hash : 1;
+}
+
+/* TextureImageCache::loadPatch
+ * Loads the image from [entry] into [image], using the cached image
+ * if it has already been loaded. Returns false if the entry isn't a
+ * valid image
+ *******************************************************************/
+bool TextureImageCache::loadPatch(SImage& image, ArchiveEntry* entry)
+{
+	if (!entry)
+		return false;
+
+	// Don't cache entries from archives that aren't open in the archive manager
+	Archive* archive = entry->getParent();
+	if (!canCache(archive))
+		return Misc::loadImageFromEntry(&image, entry);
+
+	// Check the cache
+	{
+		wxMutexLocker lock(mutex);
+		PatchMap::iterator i = patches.find(entry);
+		if (i != patches.end())
+		{
+			patch_stats.hits++;
+			i->second.last_used = use_count++;
+			return image.copyImage(i->second.image);
+		}
+		patch_stats.misses++;
+	}
+
+	// Load it
+	if (!Misc::loadImageFromEntry(&image, entry))
+		return false;
+
+	// Add to cache
+	wxMutexLocker lock(mutex);
+	item_t& item = patches[entry];
+	item.archive = archive;
+	addItem(item, image, patch_stats);
+	if (archives.find(archive) == archives.end())
+	{
+		archives.insert(archive);
+		listenTo(archive);
+	}
+
+	return true;
+}
+
+/* TextureImageCache::loadTexture
+ * Builds [texture] into [image] (see CTexture::toImage), using the
+ * cached image if it has already been built with the same [parent],
+ * palette and [force_rgba]. Only use this for textures from the
+ * resource manager, since the cache is cleared whenever those change
+ *******************************************************************/
+bool TextureImageCache::loadTexture(SImage& image, CTexture* texture, Archive* parent, Palette8bit* pal, bool force_rgba)
+{
+	if (!texture)
+		return false;
+
+	// Don't cache textures built with an archive that isn't open
+	if (texture_cache_size <= 0 || (parent && !canCache(parent)))
+		return texture->toImage(image, parent, pal, force_rgba);
+
+	composite_key_t key;
+	key.texture = texture;
+	key.parent = parent;
+	key.palette = paletteHash(pal);
+	key.rgba = force_rgba;
+
+	// Check the cache
+	{
+		wxMutexLocker lock(mutex);
+		CompositeMap::iterator i = composites.find(key);
+		if (i != composites.end())
+		{
+			composite_stats.hits++;
+			i->second.last_used = use_count++;
+			return image.copyImage(i->second.image);
+		}
+		composite_stats.misses++;
+	}
+
+	// Build it (not locked, as patches may be loaded from the cache)
+	if (!texture->toImage(image, parent, pal, force_rgba))
+		return false;
+
+	// Add to cache
+	wxMutexLocker lock(mutex);
+	addItem(composites[key], image, composite_stats);
+
+	return true;
+}
+
+/* TextureImageCache::clear
+ * Removes all cached images
+ *******************************************************************/
+void TextureImageCache::clear()
+{
+	wxMutexLocker lock(mutex);
+
+	for (PatchMap::iterator i = patches.begin(); i != patches.end(); ++i)
+		delete i->second.image;
+	patches.clear();
+	patch_stats.count = 0;
+	patch_stats.size = 0;
+
+	clearComposites();
+}
+
+/* TextureImageCache::onAnnouncement
+ * Called when an announcement is recieved from the resource manager
+ * or an archive containing cached patches
+ *******************************************************************/
+void TextureImageCache::onAnnouncement(Announcer* announcer, string event_name, MemChunk& event_data)
+{
+	wxMutexLocker lock(mutex);
+	event_data.seek(0, SEEK_SET);
+
+	// Any resource changed
+	if (announcer == theResourceManager)
+	{
+		if (event_name == "resources_updated")
+			clearComposites();
+
+		return;
+	}
+
+	// An entry was modified or removed
+	if (event_name == "entry_state_changed" || event_name == "entry_removing")
+	{
+		wxUIntPtr ptr;
+		event_data.read(&ptr, sizeof(wxUIntPtr), sizeof(int));
+		removePatch((ArchiveEntry*)wxUIntToPtr(ptr));
+		clearComposites();
+	}
+
+	// A directory is being removed (its entries are deleted with it,
+	// without being announced individually)
+	if (event_name == "directory_removing")
+	{
+		wxUIntPtr ptr;
+		event_data.read(&ptr, sizeof(wxUIntPtr));
+		vector<ArchiveEntry*> entries;
+		((Archive*)announcer)->getEntryTreeAsList(entries, (ArchiveTreeNode*)wxUIntToPtr(ptr));
+		for (unsigned a = 0; a < entries.size(); a++)
+			removePatch(entries[a]);
+		clearComposites();
+	}
+
+	// The archive is being closed
+	if (event_name == "closing")
+	{
+		Archive* archive = (Archive*)announcer;
+		removeArchivePatches(archive);
+		archives.erase(archive);
+		clearComposites();
+	}
+}
+
+
+/*******************************************************************
+ * CONSOLE COMMANDS
+ *******************************************************************/
+
+/* Console Command - "texcache_stats"
+ * Shows the number of hits and misses, and the memory used, for
+ * cached patch and composite texture images
+ *******************************************************************/
+CONSOLE_COMMAND(texcache_stats, 0, false)
+{
+	TextureImageCache::stats_t patches = theTextureImageCache->patchStats();
+	TextureImageCache::stats_t composites = theTextureImageCache->compositeStats();
+
+	theConsole->logMessage(S_FMT("Patches: %d hits, %d misses, %d cached (%.2fMB)",
+	                             patches.hits, patches.misses, patches.count, (double)patches.size / 1048576));
+	theConsole->logMessage(S_FMT("Textures: %d hits, %d misses, %d cached (%.2fMB)",
+	                             composites.hits, composites.misses, composites.count, (double)composites.size / 1048576));
+}
+
+/* Console Command - "texcache_clear"
+ * Removes all cached patch and texture images
+ *******************************************************************/
+CONSOLE_COMMAND(texcache_clear, 0, false)
+{
+	theTextureImageCache->clear();
+}
@@ -0,0 +1,102 @@
+#ifndef __TEXTURE_IMAGE_CACHE_H__
+#define __TEXTURE_IMAGE_CACHE_H__
+
+#include "General/ListenerAnnouncer.h"
+#include "Graphics/SImage/SImage.h"
+#include <wx/thread.h>
+#include <map>
+#include <set>
+
+class ArchiveEntry;
+class Archive;
+class CTexture;
+class Palette8bit;
+
+class TextureImageCache : public Listener
+{
+public:
+	struct stats_t
+	{
+		unsigned	hits;
+		unsigned	misses;
+		unsigned	count;
+		unsigned	size;
+
+		stats_t() { hits = misses = count = size = 0; }
+	};
+
+private:
+	struct item_t
+	{
+		SImage*		image;
+		unsigned	size;
+		unsigned	last_used;
+		Archive*	archive;	// Archive a cached patch entry is in (the entry may be deleted)
+
+		item_t() { image = NULL; size = last_used = 0; archive = NULL; }
+	};
+
+	struct composite_key_t
+	{
+		CTexture*	texture;
+		Archive*	parent;
+		uint32_t	palette;	// Hash of palette colours
+		bool		rgba;
+
+		bool operator<(const composite_key_t& other) const
+		{
+			if (texture != other.texture) return texture < other.texture;
+			if (parent != other.parent) return parent < other.parent;
+			if (palette != other.palette) return palette < other.palette;
+			return rgba < other.rgba;
+		}
+	};
+
+	typedef std::map<ArchiveEntry*, item_t>		PatchMap;
+	typedef std::map<composite_key_t, item_t>	CompositeMap;
+
+	PatchMap			patches;
+	CompositeMap		composites;
+	std::set<Archive*>	archives;		// Archives being listened to
+	stats_t				patch_stats;
+	stats_t				composite_stats;
+	unsigned			use_count;
+	wxMutex				mutex;
+
+	static TextureImageCache*	instance;
+
+	bool	canCache(Archive* archive);
+	void	addItem(item_t& item, SImage& image, stats_t& stats);
+	void	removePatch(ArchiveEntry* entry);
+	void	removeArchivePatches(Archive* archive);
+	void	clearComposites();
+	void	limitSize();
+
+	static uint32_t	paletteHash(Palette8bit* pal);
+
+public:
+	TextureImageCache();
+	~TextureImageCache();
+
+	static TextureImageCache*	getInstance()
+	{
+		if (!instance)
+			instance = new TextureImageCache();
+
+		return instance;
+	}
+
+	bool	loadPatch(SImage& image, ArchiveEntry* entry);
+	bool	loadTexture(SImage& image, CTexture* texture, Archive* parent = NULL, Palette8bit* pal = NULL, bool force_rgba = false);
+	void	clear();
+
+	stats_t	patchStats() { return patch_stats; }
+	stats_t	compositeStats() { return composite_stats; }
+
+	void	onAnnouncement(Announcer* announcer, string event_name, MemChunk& event_data);
+};
+
+// Define for less cumbersome TextureImageCache::getInstance()
+#define theTextureImageCache TextureImageCache::getInstance()
+
+#endif//__TEXTURE_IMAGE_CACHE_H__
@@ -48,9 +48,17 @@ CVAR(Float, col_match_b, 1.0, CVAR_SAVE)
 CVAR(Float, col_match_h, 1.0, CVAR_SAVE)
 CVAR(Float, col_match_s, 1.0, CVAR_SAVE)
 CVAR(Float, col_match_l, 1.0, CVAR_SAVE)
+CVAR(Int, col_match_cache_bits, 8, CVAR_SAVE)	// Nearest colour cache precision (bits per channel, 0 = no cache)
 EXTERN_CVAR(Float, col_greyscale_r);
 EXTERN_CVAR(Float, col_greyscale_g);
 EXTERN_CVAR(Float, col_greyscale_b);
+EXTERN_CVAR(Float, col_cie_kl);
+EXTERN_CVAR(Float, col_cie_k1);
+EXTERN_CVAR(Float, col_cie_k2);
+EXTERN_CVAR(Float, col_cie_kc);
+EXTERN_CVAR(Float, col_cie_kh);
+EXTERN_CVAR(Float, col_cie_tristim_x);
+EXTERN_CVAR(Float, col_cie_tristim_z);
 
 
 /*******************************************************************
@@ -99,6 +107,10 @@ bool Palette8bit::loadMem(MemChunk& mc)
 		// Read RGB value
 		if (mc.read(rgb, 3))
 		{
+			// Nearest colour lookups are no longer valid if the colour changed
+			if (colours[c].r != rgb[0] || colours[c].g != rgb[1] || colours[c].b != rgb[2])
+				clearMatchCache();
+
 			// Set colour in palette
 			colours[c].set(rgb[0], rgb[1], rgb[2], 255);
 			colours_lab[c] = Misc::rgbToLab((double)rgb[0]/255.0, (double)rgb[1]/255.0, (double)rgb[2]/255.0);
@@ -127,6 +139,10 @@ bool Palette8bit::loadMem(const uint8_t* data, uint32_t size)
 	int c = 0;
 	for (size_t a = 0; a < size; a += 3)
 	{
+		// Nearest colour lookups are no longer valid if the colour changed
+		if (colours[c].r != data[a] || colours[c].g != data[a+1] || colours[c].b != data[a+2])
+			clearMatchCache();
+
 		// Set colour in palette
 		colours[c].set(data[a], data[a+1], data[a+2], 255);
 		colours_lab[c] = Misc::rgbToLab((double)data[a]/255.0, (double)data[a+1]/255.0, (double)data[a+2]/255.0);
@@ -404,6 +420,9 @@ bool Palette8bit::loadFile(string filename, int format)
  *******************************************************************/
 void Palette8bit::setColour(uint8_t index, rgba_t col)
 {
+	if (!colours[index].equals(col))
+		clearMatchCache();
+
 	colours[index].set(col);
 	colours_lab[index] = Misc::rgbToLab(col.dr(), col.dg(), col.db());
 	colours_hsl[index] = Misc::rgbToHsl(col.dr(), col.dg(), col.db());
@@ -414,6 +433,9 @@ void Palette8bit::setColour(uint8_t index, rgba_t col)
  *******************************************************************/
 void Palette8bit::setColourR(uint8_t index, uint8_t val)
 {
+	if (colours[index].r != val)
+		clearMatchCache();
+
 	colours[index].r = val;
 	colours_lab[index] = Misc::rgbToLab(colours[index].dr(), colours[index].dg(), colours[index].db());
 	colours_hsl[index] = Misc::rgbToHsl(colours[index].dr(), colours[index].dg(), colours[index].db());
@@ -424,6 +446,9 @@ void Palette8bit::setColourR(uint8_t index, uint8_t val)
  *******************************************************************/
 void Palette8bit::setColourG(uint8_t index, uint8_t val)
 {
+	if (colours[index].g != val)
+		clearMatchCache();
+
 	colours[index].g = val;
 	colours_lab[index] = Misc::rgbToLab(colours[index].dr(), colours[index].dg(), colours[index].db());
 	colours_hsl[index] = Misc::rgbToHsl(colours[index].dr(), colours[index].dg(), colours[index].db());
@@ -434,6 +459,9 @@ void Palette8bit::setColourG(uint8_t index, uint8_t val)
  *******************************************************************/
 void Palette8bit::setColourB(uint8_t index, uint8_t val)
 {
+	if (colours[index].b != val)
+		clearMatchCache();
+
 	colours[index].b = val;
 	colours_lab[index] = Misc::rgbToLab(colours[index].dr(), colours[index].dg(), colours[index].db());
 	colours_hsl[index] = Misc::rgbToHsl(colours[index].dr(), colours[index].dg(), colours[index].db());
@@ -508,19 +536,17 @@ double Palette8bit::colourDiff(rgba_t& rgb, hsl_t& hsl, lab_t& lab, int index, i
 	return (d1*d1)+(d2*d2)+(d3*d3);
 }
 
-/* Palette8bit::nearestColour
+/* Palette8bit::findNearestColour
  * Returns the index of the closest colour in the palette to [colour]
+ * using colour matching mode [match], checking every colour
  *******************************************************************/
-short Palette8bit::nearestColour(rgba_t colour, int match)
+short Palette8bit::findNearestColour(rgba_t colour, int match)
 {
 	double min_d = 999999;
 	short index = 0;
 	hsl_t chsl = Misc::rgbToHsl(colour);
 	lab_t clab = Misc::rgbToLab(colour);
 
-	if (match == MATCH_DEFAULT && col_match >= MATCH_OLD && col_match < MATCH_STOP)
-		match = col_match;
-
 	double delta;
 	for (short a = 0; a < 256; a++)
 	{
@@ -539,6 +565,113 @@ short Palette8bit::nearestColour(rgba_t colour, int match)
 	return index;
 }
 
+/* Palette8bit::nearestColour
+ * Returns the index of the closest colour in the palette to [colour].
+ *
+ * Results are cached per matching mode in a lookup table over RGB
+ * space, so converting images only compares each distinct colour
+ * against the palette once. The cache is cleared when the palette
+ * colours, match weights or CIE settings change. If col_match_cache_bits is less
+ * than 8, colours are grouped into cells of that precision (each
+ * cell uses the match for its centre colour), trading accuracy for
+ * fewer lookups
+ *******************************************************************/
+short Palette8bit::nearestColour(rgba_t colour, int match)
+{
+	if (match == MATCH_DEFAULT && col_match >= MATCH_OLD && col_match < MATCH_STOP)
+		match = col_match;
+
+	// No cache
+	int bits = col_match_cache_bits;
+	if (bits <= 0 || match < 0 || match >= MATCH_STOP)
+		return findNearestColour(colour, match);
+	if (bits < 4) bits = 4;
+	if (bits > 8) bits = 8;
+
+	// Get the settings used by the match mode
+	float settings[7] = { 0, 0, 0, 0, 0, 0, 0 };
+	if (match == MATCH_RGB)
+	{
+		settings[0] = col_match_r;
+		settings[1] = col_match_g;
+		settings[2] = col_match_b;
+	}
+	else if (match == MATCH_HSL)
+	{
+		settings[0] = col_match_h;
+		settings[1] = col_match_s;
+		settings[2] = col_match_l;
+	}
+	else if (match == MATCH_C76 || match == MATCH_C94 || match == MATCH_C2K)
+	{
+		// Colours are converted to Lab using the tristimulus values
+		settings[0] = col_cie_tristim_x;
+		settings[1] = col_cie_tristim_z;
+		if (match != MATCH_C76)
+		{
+			settings[2] = col_cie_kl;
+			settings[3] = col_cie_k1;
+			settings[4] = col_cie_k2;
+			settings[5] = col_cie_kc;
+			settings[6] = col_cie_kh;
+		}
+	}
+
+	// Clear the cache if its settings have changed
+	match_cache_t& cache = match_cache[match];
+	bool changed = (cache.bits != bits);
+	for (unsigned a = 0; a < 7; a++)
+	{
+		if (cache.settings[a] != settings[a])
+			changed = true;
+	}
+	if (changed)
+	{
+		cache.blocks.clear();
+		cache.bits = bits;
+		for (unsigned a = 0; a < 7; a++)
+			cache.settings[a] = settings[a];
+	}
+
+	// Get cache entry for the colour
+	int shift = 8 - bits;
+	unsigned key = ((colour.r >> shift) << (bits * 2)) | ((colour.g >> shift) << bits) | (colour.b >> shift);
+	if (cache.blocks.empty())
+		cache.blocks.resize(((1 << (bits * 3)) + 4095) / 4096);
+	vector<short>& block = cache.blocks[key >> 12];
+	if (block.empty())
+		block.assign(4096, -1);
+	short& index = block[key & 4095];
+
+	// Find nearest colour if it isn't cached yet
+	if (index < 0)
+	{
+		rgba_t cell = colour;
+		if (shift > 0)
+		{
+			int centre = 1 << (shift - 1);
+			cell.r = ((colour.r >> shift) << shift) + centre;
+			cell.g = ((colour.g >> shift) << shift) + centre;
+			cell.b = ((colour.b >> shift) << shift) + centre;
+		}
+		index = findNearestColour(cell, match);
+	}
+
+	return index;
+}
+
+/* Palette8bit::clearMatchCache
+ * Clears all cached nearest colour lookups
+ *******************************************************************/
+void Palette8bit::clearMatchCache()
+{
+	for (unsigned a = 0; a < MATCH_STOP; a++)
+	{
+		if (!match_cache[a].blocks.empty())
+			match_cache[a].blocks.clear();
+	}
+}
+
 /* Palette8bit::countColours
  * Returns the number of unique colors in a palette
  *******************************************************************/
@@ -839,10 +972,8 @@ void Palette8bit::invert(int start, int end)
 	// Inverts all colours in the range
 	for (int i = start; i <= end; ++i)
 	{
-		colours[i].r = 255 - colours[i].r;
-		colours[i].g = 255 - colours[i].g;
-		colours[i].b = 255 - colours[i].b;
-		setColour(i, colours[i]);	// Just to update the HSL values
+		rgba_t ncol(255 - colours[i].r, 255 - colours[i].g, 255 - colours[i].b, colours[i].a, colours[i].blend);
+		setColour(i, ncol);
 	}
 }
 
@@ -13,6 +13,8 @@ private:
 	short	index_trans;
 
 	double	colourDiff(rgba_t& rgb, hsl_t& hsl, lab_t& lab, int index, int match);
+	short	findNearestColour(rgba_t colour, int match);
+	void	clearMatchCache();
 
 public:
 	enum PaletteFormats
@@ -35,6 +37,20 @@ public:
 	    MATCH_STOP,
 	};
 
+private:
+	// Nearest colour lookup cache for one colour matching mode, lazily
+	// filled in blocks of 4096 colours (see nearestColour)
+	struct match_cache_t
+	{
+		vector< vector<short> >	blocks;
+		int						bits;
+		float					settings[7];	// Match weights/CIE settings the cache was filled with
+
+		match_cache_t() { bits = 0; for (unsigned a = 0; a < 7; a++) settings[a] = 0; }
+	};
+	match_cache_t	match_cache[MATCH_STOP];
+
+public:
 	Palette8bit();
 	~Palette8bit();
 
@@ -724,7 +724,8 @@ bool SImage::convertPaletted(Palette8bit* pal_target, Palette8bit* pal_current)
 	// Clear current image data (but not mask)
 	clearData(false);
 
-	// Do conversion
+	// Do conversion (colours are matched against [pal_target] rather than
+	// the copy, so its nearest colour cache is kept between conversions)
 	data = new uint8_t[width * height];
 	unsigned i = 0;
 	rgba_t col;
@@ -733,7 +734,7 @@ bool SImage::convertPaletted(Palette8bit* pal_target, Palette8bit* pal_current)
 		col.r = rgba_data[i++];
 		col.g = rgba_data[i++];
 		col.b = rgba_data[i++];
-		data[a] = palette.nearestColour(col);
+		data[a] = pal_target->nearestColour(col);
 		i++;	// Skip alpha
 	}
 
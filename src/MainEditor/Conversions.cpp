@@ -781,7 +781,7 @@ bool Conversions::rmidToMidi(MemChunk& in, MemChunk& out)
  *******************************************************************/
 bool Conversions::addImfHeader(MemChunk& in, MemChunk& out)
 {
-	if (in.getSize() == 0)
+	if (in.getSize() < 2)
 		return false;
 
 	uint32_t newsize = in.getSize() + 9;
@@ -795,24 +795,13 @@ bool Conversions::addImfHeader(MemChunk& in, MemChunk& out)
 	else newsize += 4;
 
 	out.reSize(newsize, false);
-	out[0] = 'A'; out[1] = 'D'; out[2] = 'L'; out[3] = 'I'; out[4] = 'B';
-	out[5] = 1; out[6] = 0; out[7] = 0; out[8] = 1;
+	uint8_t header[13] = { 'A', 'D', 'L', 'I', 'B', 1, 0, 0, 1, 0, 0, 0, 0 };
 	if (in[0] | in[1])
 	{
-		out[9] = in[0]; out[10] = in[1]; out[11] = 0; out[12] = 0;
-	}
-	else
-	{
-		out[9] = 0; out[10] = 0; out[11] = 0; out[12] = 0;
-	}
-	out.seek(13, SEEK_SET);
-	in.seek(start, SEEK_SET);
-	//size_t size = MIN(in.getSize() - start, newsize - 13);
-	//return in.readMC(out, size);
-	for (size_t i = 0; ((i + start < in.getSize()) && (13 + i < newsize)); ++i)
-	{
-		out[13 + i] = in[i+start];
+		header[9] = in[0]; header[10] = in[1];
 	}
+	out.write(header, 13, 0);
+	out.write(in.getData() + start, MIN(in.getSize() - start, newsize - 13));
 	return true;
 }
 
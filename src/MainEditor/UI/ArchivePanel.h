@@ -190,6 +190,11 @@ public:
 	{
 		return swapData();
 	}
+
+	unsigned dataSize()
+	{
+		return data.getSize();
+	}
 };
 
 #endif //__ARCHIVEPANEL_H__
@@ -37,6 +37,7 @@
 #include "General/Misc.h"
 #include "General/ResourceManager.h"
 #include "Graphics/CTexture/CTexture.h"
+#include "Graphics/CTexture/TextureImageCache.h"
 #include "Graphics/CTexture/TextureXList.h"
 #include "Graphics/SImage/SImage.h"
 #include "MainEditor/MainWindow.h"
@@ -80,7 +81,7 @@ bool PatchBrowserItem::loadImage()
 
 		// Load entry to image, if it exists
 		if (entry)
-			Misc::loadImageFromEntry(&img, entry);
+			theTextureImageCache->loadPatch(img, entry);
 		else
 			return false;
 	}
@@ -93,7 +94,7 @@ bool PatchBrowserItem::loadImage()
 
 		// Load texture to image, if it exists
 		if (tex)
-			tex->toImage(img, archive, parent->getPalette());
+			theTextureImageCache->loadTexture(img, tex, archive, parent->getPalette());
 		else
 			return false;
 	}
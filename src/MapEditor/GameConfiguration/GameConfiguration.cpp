@@ -39,6 +39,7 @@
 #include "Archive/ArchiveManager.h"
 #include "MapEditor/SLADEMap/SLADEMap.h"
 #include "GenLineSpecial.h"
+#include "MainApp.h"
 #include <wx/textfile.h>
 #include <wx/filename.h>
 #include <wx/dir.h>
@@ -1074,6 +1075,8 @@ bool GameConfiguration::readConfiguration(string& cfg, string source, uint8_t fo
 		setDefaults();
 		action_specials.clear();
 		thing_types.clear();
+		action_special_lookup.clear();
+		thing_type_lookup.clear();
 		flags_thing.clear();
 		flags_line.clear();
 		sector_types.clear();
@@ -1395,9 +1398,30 @@ bool GameConfiguration::readConfiguration(string& cfg, string source, uint8_t fo
 			wxLogMessage("Warning: Unexpected game configuration section \"%s\", skipping", node->getName());
 	}
 
+	// Definitions won't change (apart from DECORATE), build lookups
+	buildLookups();
+
 	return true;
 }
 
+/* GameConfiguration::buildLookups
+ * Rebuilds the thing type and action special lookups used by
+ * thingType and actionSpecial. Must be called after any thing types
+ * or action specials are added
+ *******************************************************************/
+void GameConfiguration::buildLookups()
+{
+	action_special_lookup.clear();
+	for (ASpecialMap::iterator i = action_specials.begin(); i != action_specials.end(); ++i)
+		action_special_lookup.add(i->first, i->second.special);
+	action_special_lookup.build();
+
+	thing_type_lookup.clear();
+	for (ThingTypeMap::iterator i = thing_types.begin(); i != thing_types.end(); ++i)
+		thing_type_lookup.add(i->first, i->second.type);
+	thing_type_lookup.build();
+}
+
 /* GameConfiguration::openConfig
  * Opens the full game configuration [game]+[port], either from the
  * user dir or program resource
@@ -1532,10 +1556,10 @@ bool GameConfiguration::openConfig(string game, string port, uint8_t format)
  *******************************************************************/
 ActionSpecial* GameConfiguration::actionSpecial(unsigned id)
 {
-	as_t& as = action_specials[id];
-	if (as.special)
+	ActionSpecial* special = action_special_lookup.get(id);
+	if (special)
 	{
-		return as.special;
+		return special;
 	}
 	else if (boom && id >= 0x2f80)
 	{
@@ -1561,8 +1585,9 @@ string GameConfiguration::actionSpecialName(int special)
 	else if (special == 0)
 		return "None";
 
-	if (action_specials[special].special)
-		return action_specials[special].special->getName();
+	ActionSpecial* as = action_special_lookup.get(special);
+	if (as)
+		return as->getName();
 	else if (special >= 0x2F80 && boom)
 		return BoomGenLineSpecial::parseLineType(special);
 	else
@@ -1598,9 +1623,9 @@ vector<as_t> GameConfiguration::allActionSpecials()
  *******************************************************************/
 ThingType* GameConfiguration::thingType(unsigned type)
 {
-	tt_t& ttype = thing_types[type];
-	if (ttype.type)
-		return ttype.type;
+	ThingType* ttype = thing_type_lookup.get(type);
+	if (ttype)
+		return ttype;
 	else
 		return &ttype_unknown;
 }
@@ -2526,6 +2551,9 @@ bool GameConfiguration::parseDecorateDefs(Archive* archive)
 	//tempfile.Write(full_defs);
 	//tempfile.Close();
 
+	// Add new thing types to lookup
+	buildLookups();
+
 	return true;
 }
 
@@ -3461,7 +3489,8 @@ void GameConfiguration::dumpActionSpecials()
 
 	while (i != action_specials.end())
 	{
-		wxLogMessage("Action special %d = %s", i->first, i->second.special->stringDesc());
+		if (i->second.special)
+			wxLogMessage("Action special %d = %s", i->first, i->second.special->stringDesc());
 		i++;
 	}
 }
@@ -3475,11 +3504,64 @@ void GameConfiguration::dumpThingTypes()
 
 	while (i != thing_types.end())
 	{
-		wxLogMessage("Thing type %d = %s", i->first, i->second.type->stringDesc());
+		if (i->second.type)
+			wxLogMessage("Thing type %d = %s", i->first, i->second.type->stringDesc());
 		i++;
 	}
 }
 
+/* GameConfiguration::benchmarkThingTypes
+ * Times looking up thing types for [n_things] things (in the same
+ * way as the map renderer does for each thing every frame) for
+ * [frames] frames, using thingType and the thing type hash map
+ *******************************************************************/
+void GameConfiguration::benchmarkThingTypes(unsigned n_things, unsigned frames)
+{
+	vector<tt_t> types = allThingTypes();
+	if (types.empty())
+	{
+		wxLogMessage("No thing types defined, open a game configuration first");
+		return;
+	}
+
+	// Build list of thing types, around 1 in 10 unknown
+	vector<unsigned> things;
+	for (unsigned a = 0; a < n_things; a++)
+	{
+		if (a % 10 == 9)
+			things.push_back(30000 + a);
+		else
+			things.push_back(types[(a * 7) % types.size()].number);
+	}
+
+	// Lookup
+	long start = theApp->runTimer();
+	int total_lookup = 0;
+	for (unsigned f = 0; f < frames; f++)
+	{
+		for (unsigned a = 0; a < things.size(); a++)
+			total_lookup += thingType(things[a])->getRadius();
+	}
+	long time_lookup = theApp->runTimer() - start;
+
+	// Hash map (without adding missing types, unlike the old thingType)
+	start = theApp->runTimer();
+	int total_map = 0;
+	for (unsigned f = 0; f < frames; f++)
+	{
+		for (unsigned a = 0; a < things.size(); a++)
+		{
+			ThingTypeMap::iterator i = thing_types.find(things[a]);
+			ThingType* tt = (i != thing_types.end() && i->second.type) ? i->second.type : &ttype_unknown;
+			total_map += tt->getRadius();
+		}
+	}
+	long time_map = theApp->runTimer() - start;
+
+	wxLogMessage("%d things x %d frames: lookup %ldms, hash map %ldms%s", n_things, frames, time_lookup, time_map,
+	             total_lookup == total_map ? "" : " (results differ!)");
+}
+
 /* GameConfiguration::dumpValidMapNames
  * Dumps all defined map names to the log
  *******************************************************************/
@@ -3570,3 +3652,22 @@ CONSOLE_COMMAND(dumpthingtypes, 0, false)
 {
 	theGameConfiguration->dumpThingTypes();
 }
+
+/* Console Command - "bench_thingtypes"
+ * Benchmarks thing type lookups for the map renderer's per-frame
+ * thing loop. Args are number of things (default 10000) and number
+ * of frames (default 100)
+ *******************************************************************/
+CONSOLE_COMMAND(bench_thingtypes, 0, false)
+{
+	long n_things = 10000;
+	long frames = 100;
+	if (args.size() > 0)
+		args[0].ToLong(&n_things);
+	if (args.size() > 1)
+		args[1].ToLong(&frames);
+	if (n_things < 1) n_things = 10000;
+	if (frames < 1) frames = 100;
+
+	theGameConfiguration->benchmarkThingTypes(n_things, frames);
+}
@@ -87,6 +87,69 @@ struct sectype_t
 	sectype_t(int type, string name) { this->type = type; this->name = name; }
 };
 
+// Read-only lookup of definitions (thing types, action specials) by id,
+// built once all definitions have been read. Ids up to the highest id
+// below DENSE_MAX are looked up directly in an array, any others by
+// binary search. Looking up an id never modifies the lookup
+template<class T> class DefinitionLookup
+{
+private:
+	vector<T*>							dense;
+	vector<std::pair<unsigned, T*> >	sparse;
+
+	static const unsigned DENSE_MAX = 65536;
+
+public:
+	void clear()
+	{
+		dense.clear();
+		sparse.clear();
+	}
+
+	void add(unsigned id, T* def)
+	{
+		if (def)
+			sparse.push_back(std::make_pair(id, def));
+	}
+
+	// Builds the lookup from the definitions added since it was cleared
+	void build()
+	{
+		std::sort(sparse.begin(), sparse.end());
+
+		// Move ids in range to the dense array
+		unsigned n_dense = 0;
+		while (n_dense < sparse.size() && sparse[n_dense].first < DENSE_MAX)
+			n_dense++;
+		dense.assign(n_dense > 0 ? sparse[n_dense - 1].first + 1 : 0, NULL);
+		for (unsigned a = 0; a < n_dense; a++)
+			dense[sparse[a].first] = sparse[a].second;
+		sparse.erase(sparse.begin(), sparse.begin() + n_dense);
+	}
+
+	T* get(unsigned id) const
+	{
+		if (id < dense.size())
+			return dense[id];
+
+		// Binary search sparse ids
+		unsigned lo = 0;
+		unsigned hi = sparse.size();
+		while (lo < hi)
+		{
+			unsigned mid = (lo + hi) / 2;
+			if (sparse[mid].first < id)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo < sparse.size() && sparse[lo].first == id)
+			return sparse[lo].second;
+
+		return NULL;
+	}
+};
+
 WX_DECLARE_HASH_MAP(int, as_t, wxIntegerHash, wxIntegerEqual, ASpecialMap);
 WX_DECLARE_HASH_MAP(int, tt_t, wxIntegerHash, wxIntegerEqual, ThingTypeMap);
 WX_DECLARE_STRING_HASH_MAP(udmfp_t, UDMFPropMap);
@@ -112,6 +175,8 @@ private:
 	ActionSpecial		as_generalized_s;	// Dummy for Boom generalized switched specials
 	ActionSpecial		as_generalized_m;	// Dummy for Boom generalized manual specials
 	ThingTypeMap		thing_types;		// Thing types
+	DefinitionLookup<ActionSpecial>	action_special_lookup;	// Action specials by id (see buildLookups)
+	DefinitionLookup<ThingType>		thing_type_lookup;		// Thing types by id (see buildLookups)
 	vector<ThingType*>	tt_group_defaults;	// Thing type group defaults
 	ThingType			ttype_unknown;		// Default thing type
 	bool				any_map_name;		// Allow any map name
@@ -249,6 +314,7 @@ public:
 	void	readUDMFProperties(ParseTreeNode* node, UDMFPropMap& plist);
 	void	readGameSection(ParseTreeNode* node_game, bool port_section = false);
 	bool	readConfiguration(string& cfg, string source = "", uint8_t format = MAP_UNKNOWN, bool ignore_game = false, bool clear = true);
+	void	buildLookups();
 	bool	openConfig(string game, string port = "", uint8_t format = MAP_UNKNOWN);
 	//bool	openEmbeddedConfig(ArchiveEntry* entry);
 	//bool	removeEmbeddedConfig(string name);
@@ -325,6 +391,7 @@ public:
 	// Testing
 	void	dumpActionSpecials();
 	void	dumpThingTypes();
+	void	benchmarkThingTypes(unsigned n_things, unsigned frames);
 	void	dumpValidMapNames();
 	void	dumpUDMFProperties();
 };
@@ -38,7 +38,356 @@
 #include "UI/Dialogs/ThingTypeBrowser.h"
 #include "Utility/MathStuff.h"
 #include "SectorBuilder.h"
+#include "General/Console/Console.h"
 #include <SFML/System.hpp>
+#include <cfloat>
+
+
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+// If true, the pairwise checks test every pair of objects rather than
+// only candidate pairs from a MapCheckGrid (see m_check_compare below)
+bool mapcheck_brute_force = false;
+
+
+/*******************************************************************
+ * MAPCHECKGRID CLASS
+ *******************************************************************
+ * A uniform grid broad-phase used by the pairwise checks (intersecting
+ * lines, overlapping lines/things). Each object is given a bounding
+ * box, and only pairs of objects whose (closed) boxes share a grid
+ * cell are returned as candidates to be tested properly.
+ *
+ * Boxes touching at an edge are still candidates, so any pair the
+ * exact tests would report is always a candidate. Candidates are
+ * returned in ascending index order, so testing them gives the same
+ * results in the same order as testing every pair
+ */
+class MapCheckGrid
+{
+private:
+	static const unsigned MAX_DIM = 2048;
+
+	struct mcg_box_t
+	{
+		double	x1, y1, x2, y2;
+		uint8_t	state;	// 0 = not included, 1 = in grid, 2 = unbounded (candidate for everything)
+	};
+
+	vector<mcg_box_t>			boxes;
+	vector<vector<unsigned> >	cells;
+	vector<unsigned>			unbounded;
+	vector<unsigned>			stamps;
+	unsigned					stamp;
+	double						origin_x;
+	double						origin_y;
+	double						cell_size;
+	unsigned					cols;
+	unsigned					rows;
+
+	unsigned cellCoord(double pos, double origin, unsigned max)
+	{
+		double c = floor((pos - origin) / cell_size);
+		if (c < 0)
+			return 0;
+		if (c >= max)
+			return max - 1;
+		return (unsigned)c;
+	}
+
+public:
+	MapCheckGrid() { stamp = 0; cell_size = 1; cols = rows = 0; origin_x = origin_y = 0; }
+
+	/* MapCheckGrid::add
+	 * Adds an object with the bounding box [x1,y1]-[x2,y2]. Objects
+	 * must be added in index order, and build called after all have
+	 * been added
+	 *******************************************************************/
+	void add(double x1, double y1, double x2, double y2)
+	{
+		mcg_box_t box;
+		box.x1 = MIN(x1, x2);
+		box.y1 = MIN(y1, y2);
+		box.x2 = MAX(x1, x2);
+		box.y2 = MAX(y1, y2);
+
+		// Anything without a proper box (eg. NaN or infinite coordinates)
+		// is tested against everything, as the brute force check would
+		box.state = 1;
+		if (!(x1 - x1 == 0 && y1 - y1 == 0 && x2 - x2 == 0 && y2 - y2 == 0) ||
+			!(box.x2 - box.x1 <= DBL_MAX && box.y2 - box.y1 <= DBL_MAX))
+			box.state = 2;
+
+		boxes.push_back(box);
+	}
+
+	/* MapCheckGrid::addUnbounded
+	 * Adds an object that has no bounding box, it will be a candidate
+	 * for every other object
+	 *******************************************************************/
+	void addUnbounded()
+	{
+		mcg_box_t box;
+		box.x1 = box.y1 = box.x2 = box.y2 = 0;
+		box.state = 2;
+		boxes.push_back(box);
+	}
+
+	/* MapCheckGrid::skip
+	 * Adds an object that shouldn't be checked against anything (it
+	 * will never be a candidate)
+	 *******************************************************************/
+	void skip()
+	{
+		mcg_box_t box;
+		box.x1 = box.y1 = box.x2 = box.y2 = 0;
+		box.state = 0;
+		boxes.push_back(box);
+	}
+
+	/* MapCheckGrid::build
+	 * Builds the grid from all added objects
+	 *******************************************************************/
+	void build()
+	{
+		cells.clear();
+		unbounded.clear();
+		stamps.assign(boxes.size(), 0);
+		stamp = 0;
+
+		// Get bounds and average object size
+		bool first = true;
+		double min_x = 0, min_y = 0, max_x = 0, max_y = 0, total = 0;
+		unsigned count = 0;
+		for (unsigned a = 0; a < boxes.size(); a++)
+		{
+			mcg_box_t& box = boxes[a];
+			if (box.state == 2)
+				unbounded.push_back(a);
+			if (box.state != 1)
+				continue;
+
+			if (first)
+			{
+				min_x = box.x1;
+				min_y = box.y1;
+				max_x = box.x2;
+				max_y = box.y2;
+				first = false;
+			}
+			else
+			{
+				min_x = MIN(min_x, box.x1);
+				min_y = MIN(min_y, box.y1);
+				max_x = MAX(max_x, box.x2);
+				max_y = MAX(max_y, box.y2);
+			}
+			total += MAX(box.x2 - box.x1, box.y2 - box.y1);
+			count++;
+		}
+
+		if (count == 0 || mapcheck_brute_force)
+			return;
+
+		// Cells are (roughly) big enough for the average object, but
+		// no smaller than needed for a couple of objects per cell
+		double width = max_x - min_x;
+		double height = max_y - min_y;
+		cell_size = MAX(total / count, sqrt(width * height / count) * 1.5);
+		if (!(cell_size > 0))
+			cell_size = MAX(MAX(width, height), 1.0);
+		if (!(cell_size <= DBL_MAX))
+			cell_size = DBL_MAX;
+		origin_x = min_x;
+		origin_y = min_y;
+
+		// Limit grid size
+		double limit = MIN((double)MAX_DIM * MAX_DIM, count * 4.0 + 16);
+		while (cell_size < DBL_MAX && (floor(width / cell_size) + 1) * (floor(height / cell_size) + 1) > limit)
+			cell_size = (cell_size > DBL_MAX * 0.5) ? DBL_MAX : cell_size * 2;
+		cols = (unsigned)MIN(floor(width / cell_size) + 1, (double)MAX_DIM);
+		rows = (unsigned)MIN(floor(height / cell_size) + 1, (double)MAX_DIM);
+
+		// Add objects to all cells their box touches
+		cells.resize(cols * rows);
+		for (unsigned a = 0; a < boxes.size(); a++)
+		{
+			mcg_box_t& box = boxes[a];
+			if (box.state != 1)
+				continue;
+
+			unsigned cx2 = cellCoord(box.x2, origin_x, cols);
+			unsigned cy2 = cellCoord(box.y2, origin_y, rows);
+			for (unsigned cy = cellCoord(box.y1, origin_y, rows); cy <= cy2; cy++)
+			{
+				for (unsigned cx = cellCoord(box.x1, origin_x, cols); cx <= cx2; cx++)
+					cells[cy * cols + cx].push_back(a);
+			}
+		}
+	}
+
+	/* MapCheckGrid::getCandidates
+	 * Sets [list] to all objects after [index] that could possibly
+	 * overlap or intersect it, in ascending order
+	 *******************************************************************/
+	void getCandidates(unsigned index, vector<unsigned>& list)
+	{
+		list.clear();
+		if (index >= boxes.size() || boxes[index].state == 0)
+			return;
+
+		// Everything if brute force or unbounded
+		mcg_box_t& box = boxes[index];
+		if (mapcheck_brute_force || box.state == 2 || cells.empty())
+		{
+			for (unsigned a = index + 1; a < boxes.size(); a++)
+			{
+				if (boxes[a].state != 0)
+					list.push_back(a);
+			}
+			return;
+		}
+
+		// Objects sharing a cell, each only once
+		stamp++;
+		unsigned cx2 = cellCoord(box.x2, origin_x, cols);
+		unsigned cy2 = cellCoord(box.y2, origin_y, rows);
+		for (unsigned cy = cellCoord(box.y1, origin_y, rows); cy <= cy2; cy++)
+		{
+			for (unsigned cx = cellCoord(box.x1, origin_x, cols); cx <= cx2; cx++)
+			{
+				vector<unsigned>& cell = cells[cy * cols + cx];
+				for (unsigned a = 0; a < cell.size(); a++)
+				{
+					unsigned other = cell[a];
+					if (other <= index || stamps[other] == stamp)
+						continue;
+
+					// Check the boxes actually overlap (or touch)
+					mcg_box_t& obox = boxes[other];
+					if (obox.x2 < box.x1 || obox.x1 > box.x2 || obox.y2 < box.y1 || obox.y1 > box.y2)
+						continue;
+
+					stamps[other] = stamp;
+					list.push_back(other);
+				}
+			}
+		}
+
+		// Unbounded objects
+		for (unsigned a = 0; a < unbounded.size(); a++)
+		{
+			if (unbounded[a] > index)
+				list.push_back(unbounded[a]);
+		}
+
+		std::sort(list.begin(), list.end());
+	}
+};
+
+
+/*******************************************************************
+ * CHECKEDOBJECTS CLASS
+ *******************************************************************
+ * Keeps track of which objects of a type were in the map the last time
+ * a check was run, so objects that have been added (or restored by an
+ * undo) since can be found when re-checking
+ */
+class CheckedObjects
+{
+private:
+	vector<bool>	ids;
+
+public:
+	void update(SLADEMap* map, uint8_t type)
+	{
+		ids.clear();
+		MapObject* object;
+		for (unsigned a = 0; (object = map->getObject(type, a)); a++)
+		{
+			if (object->getId() >= ids.size())
+				ids.resize(object->getId() + 1, false);
+			ids[object->getId()] = true;
+		}
+	}
+
+	bool isNew(MapObject* object)
+	{
+		return object->getId() >= ids.size() || !ids[object->getId()];
+	}
+};
+
+
+/*******************************************************************
+ * MAPCHECK HELPER FUNCTIONS
+ *******************************************************************/
+
+/* objectInMap
+ * Returns true if [object] is (still) in [map]
+ *******************************************************************/
+bool objectInMap(SLADEMap* map, MapObject* object)
+{
+	return map->getObject(object->getObjType(), object->getIndex()) == object;
+}
+
+/* objectModified
+ * Returns true if [object] is new or has been modified since [since]
+ *******************************************************************/
+bool objectModified(MapObject* object, long since, CheckedObjects& checked)
+{
+	return object->modifiedTime() >= since || checked.isNew(object);
+}
+
+/* lineModified
+ * Returns true if [line], its vertices or sides (and sectors if
+ * [sectors] is true) are new or have been modified since [since]
+ *******************************************************************/
+bool lineModified(MapLine* line, long since, CheckedObjects& checked, bool sectors)
+{
+	if (objectModified(line, since, checked))
+		return true;
+	if ((line->v1() && line->v1()->modifiedTime() >= since) || (line->v2() && line->v2()->modifiedTime() >= since))
+		return true;
+	if ((line->s1() && line->s1()->modifiedTime() >= since) || (line->s2() && line->s2()->modifiedTime() >= since))
+		return true;
+	if (sectors)
+	{
+		if ((line->frontSector() && line->frontSector()->modifiedTime() >= since) ||
+			(line->backSector() && line->backSector()->modifiedTime() >= since))
+			return true;
+	}
+
+	return false;
+}
+
+/* problemOrder
+ * Returns the order that problems for [objects] should be listed in,
+ * by object index (problems for the same object keep their order)
+ *******************************************************************/
+template<class T> vector<unsigned> problemOrder(vector<T*>& objects)
+{
+	vector<std::pair<unsigned, unsigned> > sorted;
+	for (unsigned a = 0; a < objects.size(); a++)
+		sorted.push_back(std::make_pair((unsigned)objects[a]->getIndex(), a));
+	std::sort(sorted.begin(), sorted.end());
+
+	vector<unsigned> order;
+	for (unsigned a = 0; a < sorted.size(); a++)
+		order.push_back(sorted[a].second);
+
+	return order;
+}
+
+/* reorderProblems
+ * Reorders [list] by [order] (from problemOrder)
+ *******************************************************************/
+template<class T> void reorderProblems(vector<T>& list, vector<unsigned>& order)
+{
+	vector<T> copy(list);
+	for (unsigned a = 0; a < order.size(); a++)
+		list[a] = copy[order[a]];
+}
 
 
 /*******************************************************************
@@ -51,74 +400,114 @@ class MissingTextureCheck : public MapCheck
 private:
 	vector<MapLine*>	lines;
 	vector<int>			parts;
+	CheckedObjects		checked;
 
 public:
 	MissingTextureCheck(SLADEMap* map) : MapCheck(map) {}
 
-	void doCheck()
+	void checkLine(MapLine* line)
 	{
-		for (unsigned a = 0; a < map->nLines(); a++)
-		{
-			// Check what textures the line needs
-			MapLine* line = map->getLine(a);
-			MapSide* side1 = line->s1();
-			MapSide* side2 = line->s2();
-			int needs = line->needsTexture();
+		// Check what textures the line needs
+		MapSide* side1 = line->s1();
+		MapSide* side2 = line->s2();
+		int needs = line->needsTexture();
 
-			// Check for missing textures (front side)
-			if (side1)
+		// Check for missing textures (front side)
+		if (side1)
+		{
+			// Upper
+			if ((needs & TEX_FRONT_UPPER) > 0 && side1->stringProperty("texturetop") == "-")
 			{
-				// Upper
-				if ((needs & TEX_FRONT_UPPER) > 0 && side1->stringProperty("texturetop") == "-")
-				{
-					lines.push_back(line);
-					parts.push_back(TEX_FRONT_UPPER);
-				}
+				lines.push_back(line);
+				parts.push_back(TEX_FRONT_UPPER);
+			}
 
-				// Middle
-				if ((needs & TEX_FRONT_MIDDLE) > 0 && side1->stringProperty("texturemiddle") == "-")
-				{
-					lines.push_back(line);
-					parts.push_back(TEX_FRONT_MIDDLE);
-				}
+			// Middle
+			if ((needs & TEX_FRONT_MIDDLE) > 0 && side1->stringProperty("texturemiddle") == "-")
+			{
+				lines.push_back(line);
+				parts.push_back(TEX_FRONT_MIDDLE);
+			}
 
-				// Lower
-				if ((needs & TEX_FRONT_LOWER) > 0 && side1->stringProperty("texturebottom") == "-")
-				{
-					lines.push_back(line);
-					parts.push_back(TEX_FRONT_LOWER);
-				}
+			// Lower
+			if ((needs & TEX_FRONT_LOWER) > 0 && side1->stringProperty("texturebottom") == "-")
+			{
+				lines.push_back(line);
+				parts.push_back(TEX_FRONT_LOWER);
 			}
+		}
 
-			// Check for missing textures (back side)
-			if (side2)
+		// Check for missing textures (back side)
+		if (side2)
+		{
+			// Upper
+			if ((needs & TEX_BACK_UPPER) > 0 && side2->stringProperty("texturetop") == "-")
 			{
-				// Upper
-				if ((needs & TEX_BACK_UPPER) > 0 && side2->stringProperty("texturetop") == "-")
-				{
-					lines.push_back(line);
-					parts.push_back(TEX_BACK_UPPER);
-				}
+				lines.push_back(line);
+				parts.push_back(TEX_BACK_UPPER);
+			}
 
-				// Middle
-				if ((needs & TEX_BACK_MIDDLE) > 0 && side2->stringProperty("texturemiddle") == "-")
-				{
-					lines.push_back(line);
-					parts.push_back(TEX_BACK_MIDDLE);
-				}
+			// Middle
+			if ((needs & TEX_BACK_MIDDLE) > 0 && side2->stringProperty("texturemiddle") == "-")
+			{
+				lines.push_back(line);
+				parts.push_back(TEX_BACK_MIDDLE);
+			}
 
-				// Lower
-				if ((needs & TEX_BACK_LOWER) > 0 && side2->stringProperty("texturebottom") == "-")
-				{
-					lines.push_back(line);
-					parts.push_back(TEX_BACK_LOWER);
-				}
+			// Lower
+			if ((needs & TEX_BACK_LOWER) > 0 && side2->stringProperty("texturebottom") == "-")
+			{
+				lines.push_back(line);
+				parts.push_back(TEX_BACK_LOWER);
 			}
 		}
+	}
+
+	void doCheck()
+	{
+		lines.clear();
+		parts.clear();
+		for (unsigned a = 0; a < map->nLines(); a++)
+			checkLine(map->getLine(a));
+		checked.update(map, MOBJ_LINE);
 
 		LOG_MESSAGE(3, "Missing Texture Check: %lu missing textures", parts.size());
 	}
 
+	bool recheck(long since)
+	{
+		// Remove problems for modified or removed lines
+		for (unsigned a = 0; a < lines.size(); a++)
+		{
+			if (!objectInMap(map, lines[a]) || lineModified(lines[a], since, checked, true))
+			{
+				lines.erase(lines.begin() + a);
+				parts.erase(parts.begin() + a);
+				a--;
+			}
+		}
+
+		// Check modified and new lines
+		for (unsigned a = 0; a < map->nLines(); a++)
+		{
+			if (lineModified(map->getLine(a), since, checked, true))
+				checkLine(map->getLine(a));
+		}
+		checked.update(map, MOBJ_LINE);
+
+		// Sort problems by line
+		vector<unsigned> order = problemOrder(lines);
+		reorderProblems(lines, order);
+		reorderProblems(parts, order);
+
+		return true;
+	}
+
+	bool isThreadSafe()
+	{
+		return true;
+	}
+
 	unsigned nProblems()
 	{
 		return lines.size();
@@ -233,26 +622,64 @@ class SpecialTagsCheck : public MapCheck
 {
 private:
 	vector<MapLine*>	lines;
+	CheckedObjects		checked;
 
 public:
 	SpecialTagsCheck(SLADEMap* map) : MapCheck(map) {}
 
+	void checkLine(MapLine* line)
+	{
+		// Get special and tag
+		int special = line->intProperty("special");
+		int tag = line->intProperty("arg0");
+
+		// Get action special
+		ActionSpecial* as = theGameConfiguration->actionSpecial(special);
+		int tagged = as->needsTag();
+
+		// Check if tag is required but not set
+		if (tagged != AS_TT_NO && tagged != AS_TT_SECTOR_BACK && tagged != AS_TT_SECTOR_OR_BACK && tag == 0)
+			lines.push_back(line);
+	}
+
 	void doCheck()
 	{
+		lines.clear();
 		for (unsigned a = 0; a < map->nLines(); a++)
-		{
-			// Get special and tag
-			int special = map->getLine(a)->intProperty("special");
-			int tag = map->getLine(a)->intProperty("arg0");
+			checkLine(map->getLine(a));
+		checked.update(map, MOBJ_LINE);
+	}
 
-			// Get action special
-			ActionSpecial* as = theGameConfiguration->actionSpecial(special);
-			int tagged = as->needsTag();
+	bool recheck(long since)
+	{
+		// Remove problems for modified or removed lines
+		for (unsigned a = 0; a < lines.size(); a++)
+		{
+			if (!objectInMap(map, lines[a]) || objectModified(lines[a], since, checked))
+			{
+				lines.erase(lines.begin() + a);
+				a--;
+			}
+		}
 
-			// Check if tag is required but not set
-			if (tagged != AS_TT_NO && tagged != AS_TT_SECTOR_BACK && tagged != AS_TT_SECTOR_OR_BACK && tag == 0)
-				lines.push_back(map->getLine(a));
+		// Check modified and new lines
+		for (unsigned a = 0; a < map->nLines(); a++)
+		{
+			if (objectModified(map->getLine(a), since, checked))
+				checkLine(map->getLine(a));
 		}
+		checked.update(map, MOBJ_LINE);
+
+		// Sort problems by line
+		vector<unsigned> order = problemOrder(lines);
+		reorderProblems(lines, order);
+
+		return true;
+	}
+
+	bool usesResources()
+	{
+		return true;
 	}
 
 	unsigned nProblems()
@@ -336,15 +763,29 @@ public:
 		// Clear existing intersections
 		intersections.clear();
 
+		// Build grid of line bounding boxes (lines can only intersect if
+		// their boxes overlap)
+		MapCheckGrid grid;
+		for (unsigned a = 0; a < lines.size(); a++)
+		{
+			if (lines[a]->v1() && lines[a]->v2())
+				grid.add(lines[a]->x1(), lines[a]->y1(), lines[a]->x2(), lines[a]->y2());
+			else
+				grid.addUnbounded();
+		}
+		grid.build();
+
 		// Go through lines
+		vector<unsigned> candidates;
 		for (unsigned a = 0; a < lines.size(); a++)
 		{
 			line1 = lines[a];
 
-			// Go through uncompared lines
-			for (unsigned b = a + 1; b < lines.size(); b++)
+			// Go through uncompared lines that could intersect
+			grid.getCandidates(a, candidates);
+			for (unsigned b = 0; b < candidates.size(); b++)
 			{
-				line2 = lines[b];
+				line2 = lines[candidates[b]];
 
 				// Check intersection
 				if (map->linesIntersect(line1, line2, x, y))
@@ -364,6 +805,11 @@ public:
 		checkIntersections(all_lines);
 	}
 
+	bool isThreadSafe()
+	{
+		return true;
+	}
+
 	unsigned nProblems()
 	{
 		return intersections.size();
@@ -477,15 +923,32 @@ public:
 
 	void doCheck()
 	{
+		overlaps.clear();
+
+		// Build grid of line bounding boxes (lines sharing both vertices
+		// have the same box)
+		MapCheckGrid grid;
+		for (unsigned a = 0; a < map->nLines(); a++)
+		{
+			MapLine* line = map->getLine(a);
+			if (line->v1() && line->v2())
+				grid.add(line->x1(), line->y1(), line->x2(), line->y2());
+			else
+				grid.addUnbounded();
+		}
+		grid.build();
+
 		// Go through lines
+		vector<unsigned> candidates;
 		for (unsigned a = 0; a < map->nLines(); a++)
 		{
 			MapLine* line1 = map->getLine(a);
 
-			// Go through uncompared lines
-			for (unsigned b = a + 1; b < map->nLines(); b++)
+			// Go through uncompared lines with overlapping boxes
+			grid.getCandidates(a, candidates);
+			for (unsigned b = 0; b < candidates.size(); b++)
 			{
-				MapLine* line2 = map->getLine(b);
+				MapLine* line2 = map->getLine(candidates[b]);
 
 				// Check for overlap (both vertices shared)
 				if ((line1->v1() == line2->v1() && line1->v2() == line2->v2()) ||
@@ -495,6 +958,11 @@ public:
 		}
 	}
 
+	bool isThreadSafe()
+	{
+		return true;
+	}
+
 	unsigned nProblems()
 	{
 		return overlaps.size();
@@ -591,35 +1059,55 @@ public:
 
 	void doCheck()
 	{
-		ThingType* tt1, *tt2;
+		MapThing* thing1, *thing2;
 		double r1, r2;
+		overlaps.clear();
 
-		// Go through things
+		// Get thing radii, and build grid of thing boxes (things that
+		// have no radius or aren't solid are ignored)
+		vector<double> radii;
+		MapCheckGrid grid;
 		for (unsigned a = 0; a < map->nThings(); a++)
 		{
-			MapThing* thing1 = map->getThing(a);
-			tt1 = theGameConfiguration->thingType(thing1->getType());
-			r1 = tt1->getRadius() - 1;
+			MapThing* thing = map->getThing(a);
+			ThingType* tt = theGameConfiguration->thingType(thing->getType());
+			double r = tt->getRadius() - 1;
+			radii.push_back(r);
 
-			// Ignore if no radius
-			if (r1 < 0 || !tt1->isSolid())
-				continue;
+			if (r < 0 || !tt->isSolid())
+				grid.skip();
+			else
+				grid.add(thing->xPos() - r, thing->yPos() - r, thing->xPos() + r, thing->yPos() + r);
+		}
+		grid.build();
 
-			// Go through uncompared things
-			int map_format = map->currentFormat();
-			bool udmf_zdoom = (map_format == MAP_UDMF && S_CMPNOCASE(theGameConfiguration->udmfNamespace(), "zdoom"));
-			int min_skill = udmf_zdoom ? 1 : 2;
-			int max_skill = udmf_zdoom ? 17 : 5;
-			int max_class = udmf_zdoom ? 17 : 4;
+		int map_format = map->currentFormat();
+		bool udmf_zdoom = (map_format == MAP_UDMF && S_CMPNOCASE(theGameConfiguration->udmfNamespace(), "zdoom"));
+		int min_skill = udmf_zdoom ? 1 : 2;
+		int max_skill = udmf_zdoom ? 17 : 5;
+		int max_class = udmf_zdoom ? 17 : 4;
 
-			for (unsigned b = a + 1; b < map->nThings(); b++)
+		// Go through things
+		vector<unsigned> candidates;
+		for (unsigned a = 0; a < map->nThings(); a++)
+		{
+			thing1 = map->getThing(a);
+			r1 = radii[a];
+
+			// Go through uncompared things that could overlap
+			// (ignored things never have any candidates)
+			grid.getCandidates(a, candidates);
+			for (unsigned b = 0; b < candidates.size(); b++)
 			{
-				MapThing* thing2 = map->getThing(b);
-				tt2 = theGameConfiguration->thingType(thing2->getType());
-				r2 = tt2->getRadius() - 1;
+				thing2 = map->getThing(candidates[b]);
+				r2 = radii[candidates[b]];
 
-				// Ignore if no radius
-				if (r2 < 0 || !tt2->isSolid())
+				// Check x non-overlap
+				if (thing2->xPos() + r2 < thing1->xPos() - r1 || thing2->xPos() - r2 > thing1->xPos() + r1)
+					continue;
+
+				// Check y non-overlap
+				if (thing2->yPos() + r2 < thing1->yPos() - r1 || thing2->yPos() - r2 > thing1->yPos() + r1)
 					continue;
 
 				// Check flags
@@ -670,20 +1158,17 @@ public:
 				if (!shareflag)
 					continue;
 
-				// Check x non-overlap
-				if (thing2->xPos() + r2 < thing1->xPos() - r1 || thing2->xPos() - r2 > thing1->xPos() + r1)
-					continue;
-
-				// Check y non-overlap
-				if (thing2->yPos() + r2 < thing1->yPos() - r1 || thing2->yPos() - r2 > thing1->yPos() + r1)
-					continue;
-
 				// Overlap detected
 				overlaps.push_back(thing_overlap_t(thing1, thing2));
 			}
 		}
 	}
 
+	bool usesResources()
+	{
+		return true;
+	}
+
 	unsigned nProblems()
 	{
 		return overlaps.size();
@@ -771,6 +1256,7 @@ private:
 	MapTextureManager*	texman;
 	vector<MapLine*>	lines;
 	vector<int>			parts;
+	CheckedObjects		checked;
 
 public:
 	UnknownTexturesCheck(SLADEMap* map, MapTextureManager* texman) : MapCheck(map)
@@ -778,75 +1264,115 @@ public:
 		this->texman = texman;
 	}
 
-	void doCheck()
+	void checkLine(MapLine* line, bool mixed)
 	{
-		bool mixed = theGameConfiguration->mixTexFlats();
-
-		// Go through lines
-		for (unsigned a = 0; a < map->nLines(); a++)
+		// Check front side textures
+		if (line->s1())
 		{
-			MapLine* line = map->getLine(a);
+			// Get textures
+			string upper = line->s1()->stringProperty("texturetop");
+			string middle = line->s1()->stringProperty("texturemiddle");
+			string lower = line->s1()->stringProperty("texturebottom");
 
-			// Check front side textures
-			if (line->s1())
+			// Upper
+			if (upper != "-" && texman->getTexture(upper, mixed) == &(GLTexture::missingTex()))
 			{
-				// Get textures
-				string upper = line->s1()->stringProperty("texturetop");
-				string middle = line->s1()->stringProperty("texturemiddle");
-				string lower = line->s1()->stringProperty("texturebottom");
+				lines.push_back(line);
+				parts.push_back(TEX_FRONT_UPPER);
+			}
 
-				// Upper
-				if (upper != "-" && texman->getTexture(upper, mixed) == &(GLTexture::missingTex()))
-				{
-					lines.push_back(line);
-					parts.push_back(TEX_FRONT_UPPER);
-				}
+			// Middle
+			if (middle != "-" && texman->getTexture(middle, mixed) == &(GLTexture::missingTex()))
+			{
+				lines.push_back(line);
+				parts.push_back(TEX_FRONT_MIDDLE);
+			}
 
-				// Middle
-				if (middle != "-" && texman->getTexture(middle, mixed) == &(GLTexture::missingTex()))
-				{
-					lines.push_back(line);
-					parts.push_back(TEX_FRONT_MIDDLE);
-				}
+			// Lower
+			if (lower != "-" && texman->getTexture(lower, mixed) == &(GLTexture::missingTex()))
+			{
+				lines.push_back(line);
+				parts.push_back(TEX_FRONT_LOWER);
+			}
+		}
 
-				// Lower
-				if (lower != "-" && texman->getTexture(lower, mixed) == &(GLTexture::missingTex()))
-				{
-					lines.push_back(line);
-					parts.push_back(TEX_FRONT_LOWER);
-				}
+		// Check back side textures
+		if (line->s2())
+		{
+			// Get textures
+			string upper = line->s2()->stringProperty("texturetop");
+			string middle = line->s2()->stringProperty("texturemiddle");
+			string lower = line->s2()->stringProperty("texturebottom");
+
+			// Upper
+			if (upper != "-" && texman->getTexture(upper, mixed) == &(GLTexture::missingTex()))
+			{
+				lines.push_back(line);
+				parts.push_back(TEX_BACK_UPPER);
 			}
 
-			// Check back side textures
-			if (line->s2())
+			// Middle
+			if (middle != "-" && texman->getTexture(middle, mixed) == &(GLTexture::missingTex()))
 			{
-				// Get textures
-				string upper = line->s2()->stringProperty("texturetop");
-				string middle = line->s2()->stringProperty("texturemiddle");
-				string lower = line->s2()->stringProperty("texturebottom");
+				lines.push_back(line);
+				parts.push_back(TEX_BACK_MIDDLE);
+			}
 
-				// Upper
-				if (upper != "-" && texman->getTexture(upper, mixed) == &(GLTexture::missingTex()))
-				{
-					lines.push_back(line);
-					parts.push_back(TEX_BACK_UPPER);
-				}
+			// Lower
+			if (lower != "-" && texman->getTexture(lower, mixed) == &(GLTexture::missingTex()))
+			{
+				lines.push_back(line);
+				parts.push_back(TEX_BACK_LOWER);
+			}
+		}
+	}
 
-				// Middle
-				if (middle != "-" && texman->getTexture(middle, mixed) == &(GLTexture::missingTex()))
-				{
-					lines.push_back(line);
-					parts.push_back(TEX_BACK_MIDDLE);
-				}
+	void doCheck()
+	{
+		bool mixed = theGameConfiguration->mixTexFlats();
 
-				// Lower
-				if (lower != "-" && texman->getTexture(lower, mixed) == &(GLTexture::missingTex()))
-				{
-					lines.push_back(line);
-					parts.push_back(TEX_BACK_LOWER);
-				}
+		// Go through lines
+		lines.clear();
+		parts.clear();
+		for (unsigned a = 0; a < map->nLines(); a++)
+			checkLine(map->getLine(a), mixed);
+		checked.update(map, MOBJ_LINE);
+	}
+
+	bool recheck(long since)
+	{
+		bool mixed = theGameConfiguration->mixTexFlats();
+
+		// Remove problems for modified or removed lines
+		for (unsigned a = 0; a < lines.size(); a++)
+		{
+			if (!objectInMap(map, lines[a]) || lineModified(lines[a], since, checked, false))
+			{
+				lines.erase(lines.begin() + a);
+				parts.erase(parts.begin() + a);
+				a--;
 			}
 		}
+
+		// Check modified and new lines
+		for (unsigned a = 0; a < map->nLines(); a++)
+		{
+			if (lineModified(map->getLine(a), since, checked, false))
+				checkLine(map->getLine(a), mixed);
+		}
+		checked.update(map, MOBJ_LINE);
+
+		// Sort problems by line
+		vector<unsigned> order = problemOrder(lines);
+		reorderProblems(lines, order);
+		reorderProblems(parts, order);
+
+		return true;
+	}
+
+	bool usesResources()
+	{
+		return true;
 	}
 
 	unsigned nProblems()
@@ -972,6 +1498,7 @@ private:
 	MapTextureManager*	texman;
 	vector<MapSector*>	sectors;
 	vector<bool>		floor;
+	CheckedObjects		checked;
 
 public:
 	UnknownFlatsCheck(SLADEMap* map, MapTextureManager* texman) : MapCheck(map)
@@ -979,27 +1506,69 @@ public:
 		this->texman = texman;
 	}
 
+	void checkSector(MapSector* sector, bool mixed)
+	{
+		// Check floor texture
+		if (texman->getFlat(sector->getFloorTex(), mixed) == &(GLTexture::missingTex()))
+		{
+			sectors.push_back(sector);
+			floor.push_back(true);
+		}
+
+		// Check ceiling texture
+		if (texman->getFlat(sector->getCeilingTex(), mixed) == &(GLTexture::missingTex()))
+		{
+			sectors.push_back(sector);
+			floor.push_back(false);
+		}
+	}
+
 	virtual void doCheck()
 	{
 		bool mixed = theGameConfiguration->mixTexFlats();
 
 		// Go through sectors
+		sectors.clear();
+		floor.clear();
 		for (unsigned a = 0; a < map->nSectors(); a++)
+			checkSector(map->getSector(a), mixed);
+		checked.update(map, MOBJ_SECTOR);
+	}
+
+	virtual bool recheck(long since)
+	{
+		bool mixed = theGameConfiguration->mixTexFlats();
+
+		// Remove problems for modified or removed sectors
+		for (unsigned a = 0; a < sectors.size(); a++)
 		{
-			// Check floor texture
-			if (texman->getFlat(map->getSector(a)->getFloorTex(), mixed) == &(GLTexture::missingTex()))
+			if (!objectInMap(map, sectors[a]) || objectModified(sectors[a], since, checked))
 			{
-				sectors.push_back(map->getSector(a));
-				floor.push_back(true);
+				sectors.erase(sectors.begin() + a);
+				floor.erase(floor.begin() + a);
+				a--;
 			}
+		}
 
-			// Check ceiling texture
-			if (texman->getFlat(map->getSector(a)->getCeilingTex(), mixed) == &(GLTexture::missingTex()))
-			{
-				sectors.push_back(map->getSector(a));
-				floor.push_back(false);
-			}
+		// Check modified and new sectors
+		for (unsigned a = 0; a < map->nSectors(); a++)
+		{
+			if (objectModified(map->getSector(a), since, checked))
+				checkSector(map->getSector(a), mixed);
 		}
+		checked.update(map, MOBJ_SECTOR);
+
+		// Sort problems by sector
+		vector<unsigned> order = problemOrder(sectors);
+		reorderProblems(sectors, order);
+		reorderProblems(floor, order);
+
+		return true;
+	}
+
+	virtual bool usesResources()
+	{
+		return true;
 	}
 
 	virtual unsigned nProblems()
@@ -1084,18 +1653,56 @@ class UnknownThingTypesCheck : public MapCheck
 {
 private:
 	vector<MapThing*>	things;
+	CheckedObjects		checked;
 
 public:
 	UnknownThingTypesCheck(SLADEMap* map) : MapCheck(map) {}
 
+	void checkThing(MapThing* thing)
+	{
+		ThingType* tt = theGameConfiguration->thingType(thing->getType());
+		if (tt->getName() == "Unknown")
+			things.push_back(thing);
+	}
+
 	virtual void doCheck()
 	{
+		things.clear();
 		for (unsigned a = 0; a < map->nThings(); a++)
+			checkThing(map->getThing(a));
+		checked.update(map, MOBJ_THING);
+	}
+
+	virtual bool recheck(long since)
+	{
+		// Remove problems for modified or removed things
+		for (unsigned a = 0; a < things.size(); a++)
 		{
-			ThingType* tt = theGameConfiguration->thingType(map->getThing(a)->getType());
-			if (tt->getName() == "Unknown")
-				things.push_back(map->getThing(a));
+			if (!objectInMap(map, things[a]) || objectModified(things[a], since, checked))
+			{
+				things.erase(things.begin() + a);
+				a--;
+			}
 		}
+
+		// Check modified and new things
+		for (unsigned a = 0; a < map->nThings(); a++)
+		{
+			if (objectModified(map->getThing(a), since, checked))
+				checkThing(map->getThing(a));
+		}
+		checked.update(map, MOBJ_THING);
+
+		// Sort problems by thing
+		vector<unsigned> order = problemOrder(things);
+		reorderProblems(things, order);
+
+		return true;
+	}
+
+	virtual bool usesResources()
+	{
+		return true;
 	}
 
 	virtual unsigned nProblems()
@@ -1167,16 +1774,17 @@ class StuckThingsCheck : public MapCheck
 private:
 	vector<MapLine*> lines;
 	vector<MapThing*> things;
+	vector<MapLine*> check_lines;
+	CheckedObjects checked_things;
+	CheckedObjects checked_lines;
 
 public:
 	StuckThingsCheck(SLADEMap* map) : MapCheck(map) {}
 
-	void doCheck()
+	void getCheckLines()
 	{
-		double radius;
-
 		// Get list of lines to check
-		vector<MapLine*> check_lines;
+		check_lines.clear();
 		MapLine* line;
 		for (unsigned a = 0; a < map->nLines(); a++)
 		{
@@ -1188,34 +1796,93 @@ public:
 
 			check_lines.push_back(line);
 		}
+	}
+
+	void checkThing(MapThing* thing)
+	{
+		ThingType* tt = theGameConfiguration->thingType(thing->getType());
+
+		// Skip if not a solid thing
+		if (!tt->isSolid())
+			return;
+
+		double radius = tt->getRadius() - 1;
+		frect_t bbox(thing->xPos(), thing->yPos(), radius * 2, radius * 2, 1);
+
+		// Go through lines
+		for (unsigned b = 0; b < check_lines.size(); b++)
+		{
+			MapLine* line = check_lines[b];
+
+			// Check intersection
+			if (MathStuff::boxLineIntersect(bbox, line->seg()))
+			{
+				things.push_back(thing);
+				lines.push_back(line);
+				break;
+			}
+		}
+	}
+
+	void doCheck()
+	{
+		lines.clear();
+		things.clear();
+		getCheckLines();
 
 		// Go through things
 		for (unsigned a = 0; a < map->nThings(); a++)
-		{
-			MapThing* thing = map->getThing(a);
-			ThingType* tt = theGameConfiguration->thingType(thing->getType());
+			checkThing(map->getThing(a));
 
-			// Skip if not a solid thing
-			if (!tt->isSolid())
-				continue;
+		checked_things.update(map, MOBJ_THING);
+		checked_lines.update(map, MOBJ_LINE);
+	}
 
-			radius = tt->getRadius() - 1;
-			frect_t bbox(thing->xPos(), thing->yPos(), radius * 2, radius * 2, 1);
+	bool recheck(long since)
+	{
+		// Any change to lines could affect any thing, so only things can
+		// be re-checked on their own
+		for (unsigned a = 0; a < map->nLines(); a++)
+		{
+			if (lineModified(map->getLine(a), since, checked_lines, false))
+				return false;
+		}
+		for (unsigned a = 0; a < check_lines.size(); a++)
+		{
+			if (!objectInMap(map, check_lines[a]))
+				return false;
+		}
 
-			// Go through lines
-			for (unsigned b = 0; b < check_lines.size(); b++)
+		// Remove problems for modified or removed things
+		for (unsigned a = 0; a < things.size(); a++)
+		{
+			if (!objectInMap(map, things[a]) || objectModified(things[a], since, checked_things))
 			{
-				line = check_lines[b];
-
-				// Check intersection
-				if (MathStuff::boxLineIntersect(bbox, line->seg()))
-				{
-					things.push_back(thing);
-					lines.push_back(line);
-					break;
-				}
+				things.erase(things.begin() + a);
+				lines.erase(lines.begin() + a);
+				a--;
 			}
 		}
+
+		// Check modified and new things
+		for (unsigned a = 0; a < map->nThings(); a++)
+		{
+			if (objectModified(map->getThing(a), since, checked_things))
+				checkThing(map->getThing(a));
+		}
+		checked_things.update(map, MOBJ_THING);
+
+		// Sort problems by thing
+		vector<unsigned> order = problemOrder(things);
+		reorderProblems(things, order);
+		reorderProblems(lines, order);
+
+		return true;
+	}
+
+	bool usesResources()
+	{
+		return true;
 	}
 
 	unsigned nProblems()
@@ -1327,6 +1994,7 @@ public:
 	void doCheck()
 	{
 		// Go through map lines
+		invalid_refs.clear();
 		for (unsigned a = 0; a < map->nLines(); a++)
 			checkLine(map->getLine(a));
 	}
@@ -1463,6 +2131,16 @@ public:
 		}
 	}
 
+	bool isThreadSafe()
+	{
+		return true;
+	}
+
+	bool usesResources()
+	{
+		return true;
+	}
+
 	unsigned nProblems()
 	{
 		return lines.size();
@@ -1652,3 +2330,132 @@ MapCheck* MapCheck::invalidLineCheck(SLADEMap* map)
 {
 	return new InvalidLineCheck(map);
 }
+
+
+/*******************************************************************
+ * CONSOLE COMMANDS
+ *******************************************************************/
+
+/* compareCheck
+ * Runs the check created by [create] on [map] with and without the
+ * grid broad-phase, logs the time taken for each and returns true if
+ * both gave identical results
+ *******************************************************************/
+bool compareCheck(SLADEMap* map, MapCheck* (*create)(SLADEMap*), string name)
+{
+	vector<string> results[2];
+	long times[2];
+	for (unsigned a = 0; a < 2; a++)
+	{
+		mapcheck_brute_force = (a == 1);
+		MapCheck* check = create(map);
+		long start = theApp->runTimer();
+		check->doCheck();
+		times[a] = theApp->runTimer() - start;
+
+		for (unsigned p = 0; p < check->nProblems(); p++)
+			results[a].push_back(check->problemDesc(p));
+		delete check;
+	}
+	mapcheck_brute_force = false;
+
+	bool same = (results[0] == results[1]);
+	wxLogMessage("%s: grid %ldms, brute force %ldms, %d problems - %s", name, times[0], times[1],
+	             (int)results[1].size(), same ? "identical" : "DIFFERENT");
+	if (!same)
+	{
+		for (unsigned a = 0; a < results[0].size() || a < results[1].size(); a++)
+		{
+			string r1 = a < results[0].size() ? results[0][a] : "";
+			string r2 = a < results[1].size() ? results[1][a] : "";
+			if (r1 != r2)
+			{
+				wxLogMessage("First difference at %d: \"%s\" / \"%s\"", a, r1, r2);
+				break;
+			}
+		}
+	}
+
+	return same;
+}
+
+/* Console command: m_check_compare
+ * Generates random maps and checks that the intersecting/overlapping
+ * line and thing checks give the same results using the grid
+ * broad-phase as they do testing every pair
+ *******************************************************************/
+CONSOLE_COMMAND(m_check_compare, 0, false)
+{
+	long num_lines = 5000;
+	long num_things = 2000;
+	long num_maps = 3;
+	if (args.size() > 0)
+		args[0].ToLong(&num_lines);
+	if (args.size() > 1)
+		args[1].ToLong(&num_things);
+	if (args.size() > 2)
+		args[2].ToLong(&num_maps);
+	if (num_lines < 0 || num_lines > 200000)
+		num_lines = 5000;
+	if (num_things < 0 || num_things > 200000)
+		num_things = 2000;
+	if (num_maps < 1)
+		num_maps = 1;
+
+	// Some common (usually solid) thing types
+	int types[] = { 1, 9, 30, 2035, 2028, 3001, 3004 };
+
+	unsigned failed = 0;
+	for (long m = 0; m < num_maps; m++)
+	{
+		// Same maps every time
+		srand(m + 1);
+
+		// Spread things out so there are some, but not too many, problems
+		int size = (int)sqrt((double)(num_lines + num_things)) * 64 + 256;
+
+		SLADEMap map;
+		for (long a = 0; a < num_lines; a++)
+		{
+			// Every so often duplicate an existing line, possibly flipped
+			// (if there are any yet, zero-length lines aren't created)
+			if (map.nLines() > 0 && rand() % 20 == 0)
+			{
+				MapLine* line = map.getLine(rand() % map.nLines());
+				if (rand() % 2)
+					map.createLine(line->v1(), line->v2(), true);
+				else
+					map.createLine(line->v2(), line->v1(), true);
+				continue;
+			}
+
+			// Mostly short lines, with the odd long one
+			int x = rand() % size;
+			int y = rand() % size;
+			int length = (rand() % 50 == 0) ? size / 2 : 256;
+			MapVertex* v1 = map.createVertex(x, y);
+			MapVertex* v2 = map.createVertex(x + rand() % length - length / 2, y + rand() % length - length / 2);
+			if (v1 != v2)
+				map.createLine(v1, v2, true);
+		}
+		for (long a = 0; a < num_things; a++)
+		{
+			MapThing* thing = map.createThing(rand() % size, rand() % size);
+			thing->setIntProperty("type", types[rand() % 7]);
+			thing->setIntProperty("flags", rand() % 32);
+		}
+
+		wxLogMessage("Map %ld: %d lines, %d things", m + 1, (int)map.nLines(), (int)map.nThings());
+		if (!compareCheck(&map, MapCheck::intersectingLineCheck, "Intersecting lines"))
+			failed++;
+		if (!compareCheck(&map, MapCheck::overlappingLineCheck, "Overlapping lines"))
+			failed++;
+		if (!compareCheck(&map, MapCheck::overlappingThingCheck, "Overlapping things"))
+			failed++;
+	}
+
+	if (failed > 0)
+		wxLogMessage("%d check(s) gave different results", failed);
+	else
+		wxLogMessage("All checks gave identical results");
+}
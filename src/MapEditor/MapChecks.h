@@ -7,6 +7,17 @@ class MapTextureManager;
 class MapObject;
 class MapEditor;
 
+// A check for a particular kind of problem in a map. doCheck runs the
+// check over the whole map (clearing any previous results).
+//
+// Checks that only read object geometry/references (no properties,
+// game configuration or textures) can return true from isThreadSafe, and
+// may be run on a worker thread alongside other checks. Checks that can
+// re-check just the objects modified since a previous run implement
+// recheck, otherwise it returns false and doCheck should be used.
+// Checks whose results depend on resources or the game configuration
+// return true from usesResources, and are fully checked again after
+// either has changed
 class MapCheck
 {
 protected:
@@ -23,6 +34,9 @@ public:
 	virtual MapObject*	getObject(unsigned index) = 0;
 	virtual string		progressText() { return "Checking..."; }
 	virtual string		fixText(unsigned fix_type, unsigned index) { return ""; }
+	virtual bool		isThreadSafe() { return false; }
+	virtual bool		recheck(long since) { return false; }
+	virtual bool		usesResources() { return false; }
 
 	static MapCheck*	missingTextureCheck(SLADEMap* map);
 	static MapCheck*	specialTagCheck(SLADEMap* map);
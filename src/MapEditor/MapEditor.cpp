@@ -66,6 +66,17 @@ EXTERN_CVAR(Bool, shapedraw_lockratio)
 
 #pragma region UNDO STEPS
 
+/* backupSize
+ * Returns the approximate memory used by [backup]
+ *******************************************************************/
+unsigned backupSize(mobj_backup_t* backup)
+{
+	unsigned size = sizeof(mobj_backup_t);
+	size += backup->properties.allProperties().size() * sizeof(MobjPropertyList::prop_t);
+	size += backup->props_internal.allProperties().size() * sizeof(MobjPropertyList::prop_t);
+	return size;
+}
+
 /*******************************************************************
  * PROPERTYCHANGEUS CLASS
  *******************************************************************
@@ -112,6 +123,11 @@ public:
 
 		return true;
 	}
+
+	unsigned dataSize()
+	{
+		return backupSize(backup);
+	}
 };
 
 /*******************************************************************
@@ -122,264 +138,70 @@ public:
 class MapObjectCreateDeleteUS : public UndoStep
 {
 private:
-	//vector<mobj_cd_t>	objects;
-
-	vector<unsigned>	vertices;
-	vector<unsigned>	lines;
-	vector<unsigned>	sides;
-	vector<unsigned>	sectors;
-	vector<unsigned>	things;
+	vector<mobj_cd_t>	objects;
+	bool				geometry_changed;
 
 public:
-	MapObjectCreateDeleteUS()
+	MapObjectCreateDeleteUS() : geometry_changed(false)
 	{
-		SLADEMap* map = UndoRedo::currentMap();
-		map->getObjectIdList(MOBJ_VERTEX, vertices);
-		map->getObjectIdList(MOBJ_LINE, lines);
-		map->getObjectIdList(MOBJ_SIDE, sides);
-		map->getObjectIdList(MOBJ_SECTOR, sectors);
-		map->getObjectIdList(MOBJ_THING, things);
+		// Start recording objects created/deleted
+		UndoRedo::currentMap()->recordCreatedDeleted(true);
 	}
 
 	~MapObjectCreateDeleteUS() {}
 
-	bool isValid(vector<unsigned>& list)
+	void updateGeometry()
 	{
-		return !(list.size() == 1 && list[0] == 0);
-	}
-
-	void swapLists()
-	{
-		// Backup
-		vector<unsigned> vertices;
-		vector<unsigned> lines;
-		vector<unsigned> sides;
-		vector<unsigned> sectors;
-		vector<unsigned> things;
-		SLADEMap* map = UndoRedo::currentMap();
-		if (isValid(this->vertices))	map->getObjectIdList(MOBJ_VERTEX, vertices);
-		if (isValid(this->lines))		map->getObjectIdList(MOBJ_LINE, lines);
-		if (isValid(this->sides))		map->getObjectIdList(MOBJ_SIDE, sides);
-		if (isValid(this->sectors))		map->getObjectIdList(MOBJ_SECTOR, sectors);
-		if (isValid(this->things))		map->getObjectIdList(MOBJ_THING, things);
-
-		// Restore
-		if (isValid(this->vertices))
-		{
-			map->restoreObjectIdList(MOBJ_VERTEX, this->vertices);
-			this->vertices = vertices;
-			map->updateGeometryInfo(0);
-		}
-		if (isValid(this->lines))
-		{
-			map->restoreObjectIdList(MOBJ_LINE, this->lines);
-			this->lines = lines;
-			map->updateGeometryInfo(0);
-		}
-		if (isValid(this->sides))
-		{
-			map->restoreObjectIdList(MOBJ_SIDE, this->sides);
-			this->sides = sides;
-		}
-		if (isValid(this->sectors))
-		{
-			map->restoreObjectIdList(MOBJ_SECTOR, this->sectors);
-			this->sectors = sectors;
-		}
-		if (isValid(this->things))
-		{
-			map->restoreObjectIdList(MOBJ_THING, this->things);
-			this->things = things;
-		}
+		// Vertices or lines added/removed, update geometry info
+		if (geometry_changed)
+			UndoRedo::currentMap()->updateGeometryInfo(0);
 	}
 
 	bool doUndo()
 	{
-		swapLists();
+		UndoRedo::currentMap()->undoCreatedDeleted(objects);
+		updateGeometry();
 		return true;
 	}
 
 	bool doRedo()
 	{
-		swapLists();
+		UndoRedo::currentMap()->redoCreatedDeleted(objects);
+		updateGeometry();
 		return true;
 	}
 
 	void checkChanges()
 	{
+		// Get objects created/deleted since the step began
+		// (in the order they were created/deleted)
 		SLADEMap* map = UndoRedo::currentMap();
+		map->getCreatedDeleted(objects);
+		map->recordCreatedDeleted(false);
 
-		// Check vertices changed
-		bool vertices_changed = false;
-		if (map->nVertices() != vertices.size())
-			vertices_changed = true;
-		else
-			for (unsigned a = 0; a < map->nVertices(); a++)
-				if (map->getVertex(a)->getId() != vertices[a])
-				{
-					vertices_changed = true;
-					break;
-				}
-		if (!vertices_changed)
-		{
-			// No change, clear
-			vertices.clear();
-			vertices.push_back(0);
-			LOG_MESSAGE(3, "MapObjectCreateDeleteUS: No vertices added/deleted");
-		}
-
-		// Check lines changed
-		bool lines_changed = false;
-		if (map->nLines() != lines.size())
-			lines_changed = true;
-		else
-			for (unsigned a = 0; a < map->nLines(); a++)
-				if (map->getLine(a)->getId() != lines[a])
-				{
-					lines_changed = true;
-					break;
-				}
-		if (!lines_changed)
-		{
-			// No change, clear
-			lines.clear();
-			lines.push_back(0);
-			LOG_MESSAGE(3, "MapObjectCreateDeleteUS: No lines added/deleted");
-		}
-
-		// Check sides changed
-		bool sides_changed = false;
-		if (map->nSides() != sides.size())
-			sides_changed = true;
-		else
-			for (unsigned a = 0; a < map->nSides(); a++)
-				if (map->getSide(a)->getId() != sides[a])
-				{
-					sides_changed = true;
-					break;
-				}
-		if (!sides_changed)
-		{
-			// No change, clear
-			sides.clear();
-			sides.push_back(0);
-			LOG_MESSAGE(3, "MapObjectCreateDeleteUS: No sides added/deleted");
-		}
-
-		// Check sectors changed
-		bool sectors_changed = false;
-		if (map->nSectors() != sectors.size())
-			sectors_changed = true;
-		else
-			for (unsigned a = 0; a < map->nSectors(); a++)
-				if (map->getSector(a)->getId() != sectors[a])
-				{
-					sectors_changed = true;
-					break;
-				}
-		if (!sectors_changed)
+		for (unsigned a = 0; a < objects.size(); a++)
 		{
-			// No change, clear
-			sectors.clear();
-			sectors.push_back(0);
-			LOG_MESSAGE(3, "MapObjectCreateDeleteUS: No sectors added/deleted");
+			if (objects[a].type == MOBJ_VERTEX || objects[a].type == MOBJ_LINE)
+			{
+				geometry_changed = true;
+				break;
+			}
 		}
 
-		// Check things changed
-		bool things_changed = false;
-		if (map->nThings() != things.size())
-			things_changed = true;
-		else
-			for (unsigned a = 0; a < map->nThings(); a++)
-				if (map->getThing(a)->getId() != things[a])
-				{
-					things_changed = true;
-					break;
-				}
-		if (!things_changed)
-		{
-			// No change, clear
-			things.clear();
-			things.push_back(0);
-			LOG_MESSAGE(3, "MapObjectCreateDeleteUS: No things added/deleted");
-		}
+		if (objects.empty())
+			LOG_MESSAGE(3, "MapObjectCreateDeleteUS: No objects added/deleted");
 	}
 
 	bool isOk()
 	{
 		// Check for any changes at all
-		if (vertices.size() == 1 && vertices[0] == 0 &&
-			lines.size() == 1 && lines[0] == 0 &&
-			sides.size() == 1 && sides[0] == 0 &&
-			sectors.size() == 1 && sectors[0] == 0 &&
-			things.size() == 1 && things[0] == 0)
-			return false;
-
-		return true;
+		return !objects.empty();
 	}
 
-	//MapObjectCreateDeleteUS()
-	//{
-	//	// Get recently created and deleted object ids from map
-	//	// (in the order they were created/deleted)
-	//	vector<mobj_cd_t>& cd_objects = UndoRedo::currentMap()->createdDeletedObjectIds();
-	//	for (unsigned a = 0; a < cd_objects.size(); a++)
-	//		objects.push_back(cd_objects[a]);
-
-	//	if (Global::log_verbosity >= 4)
-	//	{
-	//		string ids;
-	//		for (unsigned a = 0; a < cd_objects.size(); a++)
-	//		{
-	//			if (cd_objects[a].created)
-	//				ids += S_FMT("%d, ", cd_objects[a].id);
-	//		}
-	//		LOG_MESSAGE(4, "Created: %s", ids);
-
-	//		ids = "";
-	//		for (unsigned a = 0; a < cd_objects.size(); a++)
-	//		{
-	//			if (!cd_objects[a].created)
-	//				ids += S_FMT("%d, ", cd_objects[a].id);
-	//		}
-	//		LOG_MESSAGE(4, "Deleted: %s", ids);
-	//	}
-	//}
-
-	//~MapObjectCreateDeleteUS() {}
-
-	//bool doUndo()
-	//{
-	//	// Undo creation/deletion
-	//	for (int a = objects.size() - 1; a >= 0; a--)
-	//	{
-	//		if (objects[a].created)
-	//			UndoRedo::currentMap()->removeObjectById(objects[a].id);
-	//		else
-	//			UndoRedo::currentMap()->restoreObjectById(objects[a].id);
-	//	}
-
-	//	return true;
-	//}
-
-	//bool doRedo()
-	//{
-	//	// Redo creation/deletion
-	//	for (unsigned a = 0; a < objects.size(); a++)
-	//	{
-	//		if (!objects[a].created)
-	//			UndoRedo::currentMap()->removeObjectById(objects[a].id);
-	//		else
-	//			UndoRedo::currentMap()->restoreObjectById(objects[a].id);
-	//	}
-
-	//	return true;
-	//}
-
-	//bool isOk()
-	//{
-	//	return !objects.empty();
-	//}
+	unsigned dataSize()
+	{
+		return objects.size() * sizeof(mobj_cd_t);
+	}
 };
 
 
@@ -459,6 +281,14 @@ public:
 	{
 		return !backups.empty();
 	}
+
+	unsigned dataSize()
+	{
+		unsigned size = 0;
+		for (unsigned a = 0; a < backups.size(); a++)
+			size += backupSize(backups[a]);
+		return size;
+	}
 };
 
 #pragma endregion
@@ -5536,6 +5366,15 @@ CONSOLE_COMMAND(m_test_sector, 0, false)
 		map.sectorAt(map.getThing(a)->point());
 	long ms = clock.getElapsedTime().asMilliseconds();
 	wxLogMessage("Took %ldms", ms);
+
+	// Batched
+	vector<fpoint2_t> points;
+	for (unsigned a = 0; a < map.nThings(); a++)
+		points.push_back(map.getThing(a)->point());
+	clock.restart();
+	map.sectorsAt(points);
+	ms = clock.getElapsedTime().asMilliseconds();
+	wxLogMessage("Batched took %ldms", ms);
 }
 
 CONSOLE_COMMAND(m_test_mobj_backup, 0, false)
@@ -5618,6 +5457,44 @@ CONSOLE_COMMAND(mobj_info, 1, false)
 	}
 }
 
+/* Console Command - "mobj_prop_memory"
+ * Reports approximate memory used by the properties of all objects
+ * in the current map, and how much they would use if each property
+ * stored its own copy of its name rather than a key
+ *******************************************************************/
+CONSOLE_COMMAND(mobj_prop_memory, 0, false)
+{
+	SLADEMap& map = theMapEditor->mapEditor().getMap();
+	unsigned counts[] = { map.nVertices(), map.nLines(), map.nSides(), map.nSectors(), map.nThings() };
+	uint8_t types[] = { MOBJ_VERTEX, MOBJ_LINE, MOBJ_SIDE, MOBJ_SECTOR, MOBJ_THING };
+
+	double n_props = 0;
+	double slots = 0;
+	double name_chars = 0;
+	for (unsigned t = 0; t < 5; t++)
+	{
+		for (unsigned a = 0; a < counts[t]; a++)
+		{
+			vector<MobjPropertyList::prop_t>& props = map.getObject(types[t], a)->props().allProperties();
+			n_props += props.size();
+			slots += props.capacity();
+			for (unsigned b = 0; b < props.size(); b++)
+				name_chars += props[b].name().length() + 1;
+		}
+	}
+
+	// Key table
+	double table = 0;
+	for (unsigned a = 0; a < MobjPropertyList::nKeys(); a++)
+		table += sizeof(string) + sizeof(unsigned) * 2 + (MobjPropertyList::keyName(a).length() + 1) * sizeof(wxChar) * 2;
+
+	double now = slots * sizeof(MobjPropertyList::prop_t) + table;
+	double before = slots * (sizeof(string) + sizeof(Property)) + name_chars * sizeof(wxChar);
+	theConsole->logMessage(S_FMT("%.0f properties, %d property names", n_props, MobjPropertyList::nKeys()));
+	theConsole->logMessage(S_FMT("Keyed: %.2fMB (%.2fMB key table), with names: %.2fMB (excluding string values)",
+	                             now / 1048576, table / 1048576, before / 1048576));
+}
+
 //CONSOLE_COMMAND(m_test_save, 1, false) {
 //	vector<ArchiveEntry*> entries;
 //	theMapEditor->mapEditor().getMap().writeDoomMap(entries);
@@ -32,6 +32,7 @@
 #include "MapTextureManager.h"
 #include "General/ResourceManager.h"
 #include "Graphics/CTexture/CTexture.h"
+#include "Graphics/CTexture/TextureImageCache.h"
 #include "MainEditor/MainWindow.h"
 #include "Archive/ArchiveManager.h"
 #include "MapEditorWindow.h"
@@ -176,7 +177,7 @@ GLTexture* MapTextureManager::getTexture(string name, bool mixed)
 	{
 		textypefound = TEXTYPE_WALLTEXTURE;
 		SImage image;
-		if (ctex->toImage(image, archive, palette))
+		if (theTextureImageCache->loadTexture(image, ctex, archive, palette))
 		{
 			mtex.texture = new GLTexture(false);
 			mtex.texture->setFilter(filter);
@@ -333,12 +334,12 @@ GLTexture* MapTextureManager::getSprite(string name, string translation, string
 	if (entry)
 	{
 		found = true;
-		Misc::loadImageFromEntry(&image, entry);
+		theTextureImageCache->loadPatch(image, entry);
 	}
 	else  	// Try composite textures then
 	{
 		CTexture* ctex = theResourceManager->getTexture(name, archive);
-		if (ctex && ctex->toImage(image, archive, this->palette))
+		if (ctex && theTextureImageCache->loadTexture(image, ctex, archive, this->palette))
 			found = true;
 	}
 
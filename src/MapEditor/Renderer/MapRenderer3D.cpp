@@ -93,6 +93,12 @@ MapRenderer3D::MapRenderer3D(SLADEMap* map)
 	this->flat_last = 0;
 	this->render_hilight = true;
 	this->render_selection = true;
+	this->vis_n_lines = 0;
+	this->vis_built_time = 0;
+	this->vis_geometry_time = 0;
+	this->view_fovy = 90.0f;
+	this->view_aspect = 1.0f;
+	this->thing_max_halfwidth = 0;
 
 	// Build skybox circle
 	buildSkyCircle();
@@ -145,6 +151,13 @@ void MapRenderer3D::refresh()
 {
 	// Clear any existing map data
 	dist_sectors.clear();
+	vis_boxes.clear();
+	vis_nodes.clear();
+	vis_order.clear();
+	vis_sectors.clear();
+	vis_lines.clear();
+	vis_n_lines = 0;
+	thing_max_halfwidth = 0;
 	if (quads)
 	{
 		delete quads;
@@ -430,6 +443,8 @@ void MapRenderer3D::setupView(int width, int height)
 	// Calculate aspect ratio
 	float aspect = (1.6f / 1.333333f) * ((float)width / (float)height);
 	float fovy = 2 * MathStuff::radToDeg(atan(tan(MathStuff::degToRad(90) / 2) / aspect));
+	view_fovy = fovy;
+	view_aspect = aspect;
 
 	// Setup projection
 	glMatrixMode(GL_PROJECTION);
@@ -1948,6 +1963,10 @@ void MapRenderer3D::updateThing(unsigned index, MapThing* thing)
 	// Adjust height by sprite Y offset if needed
 	things[index].z += theMapEditor->textureManager().getVerticalOffset(things[index].type->getSprite());
 
+	// Update widest sprite
+	if (!(things[index].flags & ICON) && things[index].sprite->getWidth() * 0.5 > thing_max_halfwidth)
+		thing_max_halfwidth = things[index].sprite->getWidth() * 0.5;
+
 	things[index].updated_time = theApp->runTimer();
 }
 
@@ -2350,72 +2369,341 @@ void MapRenderer3D::updateWallsVBO()
 {
 }
 
-/* MapRenderer3D::quickVisDiscard
- * Runs a quick check of all sector bounding boxes against the
- * current view to hide any that are outside it
+/* MapRenderer3D::updateVisTree
+ * Updates the bounds of any sectors that changed since the sector
+ * BVH was last updated, and rebuilds or refits the BVH as needed
  *******************************************************************/
-void MapRenderer3D::quickVisDiscard()
+void MapRenderer3D::updateVisTree()
 {
-	// Create sector distance array if needed
-	if (dist_sectors.size() != map->nSectors())
-		dist_sectors.resize(map->nSectors());
+	unsigned n_sectors = map->nSectors();
+	bool rebuild = (vis_order.size() != n_sectors || map->geometryUpdated() > vis_geometry_time);
+	bool refit = rebuild;
+	vis_boxes.resize(n_sectors);
 
-	// Go through all sectors
-	fpoint2_t cam = cam_position.get2d();
-	double min_dist, dist;
-	fseg2_t strafe(cam, cam + cam_strafe.get2d());
-	for (unsigned a = 0; a < map->nSectors(); a++)
+	// Update sector bounds
+	for (unsigned a = 0; a < n_sectors; a++)
+	{
+		MapSector* sector = map->getSector(a);
+		bbox_t bbox = sector->boundingBox();
+		if (!rebuild && sector->geometryUpdatedTime() < vis_built_time)
+			continue;
+
+		// x/y from the sector bbox
+		vis_box_t& box = vis_boxes[a];
+		box.min[0] = bbox.min.x;
+		box.min[1] = bbox.min.y;
+		box.max[0] = bbox.max.x;
+		box.max[1] = bbox.max.y;
+
+		// z from the floor and ceiling planes (which are lowest/highest
+		// at the bbox corners, if sloped)
+		plane_t planes[2] = { sector->getFloorPlane(), sector->getCeilingPlane() };
+		box.min[2] = box.max[2] = planes[0].height_at(bbox.min.x, bbox.min.y);
+		for (unsigned p = 0; p < 2; p++)
+		{
+			for (unsigned c = 0; c < 4; c++)
+			{
+				float z = planes[p].height_at((c & 1) ? bbox.max.x : bbox.min.x, (c & 2) ? bbox.max.y : bbox.min.y);
+				box.min[2] = MIN(box.min[2], z);
+				box.max[2] = MAX(box.max[2], z);
+			}
+		}
+
+		refit = true;
+	}
+
+	if (rebuild)
 	{
-		// Get sector bbox
-		bbox_t bbox = map->getSector(a)->boundingBox();
+		buildVisTree();
+		vis_geometry_time = map->geometryUpdated();
+	}
+
+	// Update node bounds (children always come after their parent)
+	if (refit)
+	{
+		for (int n = (int)vis_nodes.size() - 1; n >= 0; n--)
+		{
+			vis_node_t& node = vis_nodes[n];
+			if (node.child >= 0)
+			{
+				node.box = vis_nodes[node.child].box;
+				vis_box_t& box2 = vis_nodes[node.child + 1].box;
+				for (unsigned a = 0; a < 3; a++)
+				{
+					node.box.min[a] = MIN(node.box.min[a], box2.min[a]);
+					node.box.max[a] = MAX(node.box.max[a], box2.max[a]);
+				}
+			}
+			else if (node.count > 0)
+			{
+				node.box = vis_boxes[vis_order[node.first]];
+				for (unsigned s = 1; s < node.count; s++)
+				{
+					vis_box_t& box2 = vis_boxes[vis_order[node.first + s]];
+					for (unsigned a = 0; a < 3; a++)
+					{
+						node.box.min[a] = MIN(node.box.min[a], box2.min[a]);
+						node.box.max[a] = MAX(node.box.max[a], box2.max[a]);
+					}
+				}
+			}
+		}
 
-		// Init to visible
-		dist_sectors[a] = 0.0f;
+		vis_built_time = theApp->runTimer();
+	}
+}
 
-		// Check if within bbox
-		if (bbox.contains(cam))
+/* MapRenderer3D::buildVisTree
+ * Builds the sector BVH, splitting sectors at the median of their
+ * centres along the widest axis until each leaf has at most 4
+ * sectors. Node bounds are set afterwards in updateVisTree
+ *******************************************************************/
+void MapRenderer3D::buildVisTree()
+{
+	// Init
+	unsigned n_sectors = map->nSectors();
+	vis_nodes.clear();
+	vis_order.resize(n_sectors);
+	for (unsigned a = 0; a < n_sectors; a++)
+		vis_order[a] = a;
+
+	// Add root node
+	vis_node_t root;
+	root.child = -1;
+	root.first = 0;
+	root.count = n_sectors;
+	vis_nodes.push_back(root);
+
+	// Split nodes (new nodes are added to the end, so get split in turn)
+	vector< std::pair<float, unsigned> > split;
+	for (unsigned n = 0; n < vis_nodes.size(); n++)
+	{
+		unsigned first = vis_nodes[n].first;
+		unsigned count = vis_nodes[n].count;
+		if (count <= 4)
 			continue;
 
-		// Check side of camera
-		if (cam_pitch > -0.9 && cam_pitch < 0.9)
+		// Get the widest axis of the sector centres
+		float cmin[2] = { 0, 0 };
+		float cmax[2] = { 0, 0 };
+		for (unsigned a = 0; a < count; a++)
 		{
-			if (MathStuff::lineSide(bbox.min, strafe) > 0 &&
-			        MathStuff::lineSide(fpoint2_t(bbox.max.x, bbox.min.y), strafe) > 0 &&
-			        MathStuff::lineSide(bbox.max, strafe) > 0 &&
-			        MathStuff::lineSide(fpoint2_t(bbox.min.x, bbox.max.y), strafe) > 0)
+			vis_box_t& box = vis_boxes[vis_order[first + a]];
+			for (unsigned axis = 0; axis < 2; axis++)
 			{
-				// Behind camera, invisible
-				dist_sectors[a] = -1.0f;
-				continue;
+				float centre = (box.min[axis] + box.max[axis]) * 0.5f;
+				if (a == 0 || centre < cmin[axis]) cmin[axis] = centre;
+				if (a == 0 || centre > cmax[axis]) cmax[axis] = centre;
 			}
 		}
+		unsigned axis = (cmax[0] - cmin[0] >= cmax[1] - cmin[1]) ? 0 : 1;
 
-		// Check distance to bbox
-		if (render_max_dist > 0)
+		// Split at the median
+		split.clear();
+		for (unsigned a = 0; a < count; a++)
 		{
-			min_dist = 9999999;
-			dist = MathStuff::distanceToLine(cam, bbox.left_side());
-			if (dist < min_dist) min_dist = dist;
-			dist = MathStuff::distanceToLine(cam, bbox.top_side());
-			if (dist < min_dist) min_dist = dist;
-			dist = MathStuff::distanceToLine(cam, bbox.right_side());
-			if (dist < min_dist) min_dist = dist;
-			dist = MathStuff::distanceToLine(cam, bbox.bottom_side());
-			if (dist < min_dist) min_dist = dist;
+			vis_box_t& box = vis_boxes[vis_order[first + a]];
+			split.push_back(std::make_pair((box.min[axis] + box.max[axis]) * 0.5f, vis_order[first + a]));
+		}
+		unsigned half = count / 2;
+		std::nth_element(split.begin(), split.begin() + half, split.end());
+		for (unsigned a = 0; a < count; a++)
+			vis_order[first + a] = split[a].second;
+
+		// Add child nodes
+		vis_node_t child;
+		child.child = -1;
+		child.first = first;
+		child.count = half;
+		vis_nodes[n].child = vis_nodes.size();
+		vis_nodes.push_back(child);
+		child.first = first + half;
+		child.count = count - half;
+		vis_nodes.push_back(child);
+	}
+}
+
+/* MapRenderer3D::updateFrustum
+ * Calculates the (side) planes of the view frustum, as set up in
+ * setupView, for the current camera
+ *******************************************************************/
+void MapRenderer3D::updateFrustum()
+{
+	fpoint3_t up = cam_strafe.cross(cam_dir3d).normalized();
+	double tan_v = tan(MathStuff::degToRad(view_fovy) * 0.5);
+	double tan_h = tan_v * view_aspect;
+
+	// Plane normals point into the frustum
+	frustum[0].normal = cam_strafe + cam_dir3d * tan_h;
+	frustum[1].normal = (cam_strafe * -1) + cam_dir3d * tan_h;
+	frustum[2].normal = up + cam_dir3d * tan_v;
+	frustum[3].normal = (up * -1) + cam_dir3d * tan_v;
+	for (unsigned a = 0; a < 4; a++)
+		frustum[a].dist = -frustum[a].normal.dot(cam_position);
+}
+
+/* MapRenderer3D::frustumTest
+ * Checks the box [min]-[max] against the view frustum. Returns -1 if
+ * it is completely outside, 1 if completely inside and 0 otherwise
+ *******************************************************************/
+int MapRenderer3D::frustumTest(float* min, float* max)
+{
+	int result = 1;
+	for (unsigned a = 0; a < 4; a++)
+	{
+		fpoint3_t& normal = frustum[a].normal;
+
+		// Outside if the corner furthest along the plane normal is behind it
+		fpoint3_t far_corner(
+			normal.x >= 0 ? max[0] : min[0],
+			normal.y >= 0 ? max[1] : min[1],
+			normal.z >= 0 ? max[2] : min[2]);
+		if (normal.dot(far_corner) + frustum[a].dist < 0)
+			return -1;
+
+		// Partially inside if the nearest corner is behind it
+		fpoint3_t near_corner(
+			normal.x >= 0 ? min[0] : max[0],
+			normal.y >= 0 ? min[1] : max[1],
+			normal.z >= 0 ? min[2] : max[2]);
+		if (normal.dot(near_corner) + frustum[a].dist < 0)
+			result = 0;
+	}
+
+	return result;
+}
 
-			dist_sectors[a] = dist;
+// Returns the 2d distance from [point] to the box [min]-[max] (0 if
+// the point is within it)
+double visBoxDistance(fpoint2_t point, float* min, float* max)
+{
+	double dx = 0;
+	double dy = 0;
+	if (point.x < min[0]) dx = min[0] - point.x;
+	else if (point.x > max[0]) dx = point.x - max[0];
+	if (point.y < min[1]) dy = min[1] - point.y;
+	else if (point.y > max[1]) dy = point.y - max[1];
+
+	return sqrt(dx*dx + dy*dy);
+}
+
+/* MapRenderer3D::quickVisDiscard
+ * Finds sectors that are in the current view by checking the sector
+ * BVH against the view frustum and max render distance, and sets
+ * all lines that are part of them to visible
+ *******************************************************************/
+void MapRenderer3D::quickVisDiscard()
+{
+	unsigned n_sectors = map->nSectors();
+
+	// Reset visibility info if the map structures changed size
+	if (dist_sectors.size() != n_sectors)
+	{
+		dist_sectors.assign(n_sectors, -1.0f);
+		vis_sectors.clear();
+	}
+	if (vis_n_lines != lines.size())
+	{
+		for (unsigned a = 0; a < lines.size(); a++)
+			lines[a].visible = false;
+		vis_lines.clear();
+		vis_n_lines = lines.size();
+	}
+
+	// Hide everything that was visible last time
+	for (unsigned a = 0; a < vis_sectors.size(); a++)
+		dist_sectors[vis_sectors[a]] = -1.0f;
+	for (unsigned a = 0; a < vis_lines.size(); a++)
+		lines[vis_lines[a]].visible = false;
+	vis_sectors.clear();
+	vis_lines.clear();
+
+	if (n_sectors == 0)
+		return;
+
+	// Update sector BVH and view frustum
+	updateVisTree();
+	updateFrustum();
+
+	// Go through the sector BVH, skipping any nodes outside the view
+	fpoint2_t cam = cam_position.get2d();
+	vector<unsigned> nodes;
+	nodes.push_back(0);
+	while (!nodes.empty())
+	{
+		vis_node_t& node = vis_nodes[nodes.back()];
+		nodes.pop_back();
+
+		// Check if the camera is within the node (x/y), anything containing
+		// the camera is always visible
+		bool cam_within = (cam.x >= node.box.min[0] && cam.x <= node.box.max[0] &&
+							cam.y >= node.box.min[1] && cam.y <= node.box.max[1]);
+
+		// Check node distance and frustum
+		int in_view = 0;
+		if (!cam_within)
+		{
+			if (render_max_dist > 0 && visBoxDistance(cam, node.box.min, node.box.max) > render_max_dist)
+				continue;
+
+			in_view = frustumTest(node.box.min, node.box.max);
+			if (in_view < 0)
+				continue;
+		}
+
+		// Check children if the node is only partially in view
+		if (node.child >= 0 && in_view == 0)
+		{
+			nodes.push_back(node.child);
+			nodes.push_back(node.child + 1);
+			continue;
+		}
+
+		// Otherwise, check the node's sectors (all nodes cover a
+		// contiguous range of vis_order)
+		for (unsigned a = node.first; a < node.first + node.count; a++)
+		{
+			unsigned index = vis_order[a];
+			vis_box_t& box = vis_boxes[index];
+			double dist = 0;
+
+			// Check if within bbox
+			if (cam.x < box.min[0] || cam.x > box.max[0] || cam.y < box.min[1] || cam.y > box.max[1])
+			{
+				// Check frustum (if the node was entirely within it, so is the sector)
+				if (in_view == 0 && frustumTest(box.min, box.max) < 0)
+					continue;
+
+				// Check distance to bbox
+				if (render_max_dist > 0)
+				{
+					dist = visBoxDistance(cam, box.min, box.max);
+					if (dist > render_max_dist)
+						continue;
+				}
+			}
+
+			dist_sectors[index] = dist;
+			vis_sectors.push_back(index);
 		}
 	}
+	std::sort(vis_sectors.begin(), vis_sectors.end());
 
-	// Set all lines that are part of invisible sectors to invisible
-	for (unsigned a = 0; a < map->nSides(); a++)
+	// Set all lines that are part of visible sectors to visible
+	for (unsigned a = 0; a < vis_sectors.size(); a++)
 	{
-		dist = dist_sectors[map->getSide(a)->getSector()->getIndex()];
-		if (dist < 0 || (render_max_dist > 0 && dist > render_max_dist))
-			lines[map->getSide(a)->getParentLine()->getIndex()].visible = false;
-		else
-			lines[map->getSide(a)->getParentLine()->getIndex()].visible = true;
+		vector<MapSide*>& sides = map->getSector(vis_sectors[a])->connectedSides();
+		for (unsigned s = 0; s < sides.size(); s++)
+		{
+			unsigned line = sides[s]->getParentLine()->getIndex();
+			if (line < lines.size() && !lines[line].visible)
+			{
+				lines[line].visible = true;
+				vis_lines.push_back(line);
+			}
+		}
 	}
+	std::sort(vis_lines.begin(), vis_lines.end());
 }
 
 /* MapRenderer3D::calcDistFade
@@ -2450,14 +2738,11 @@ void MapRenderer3D::checkVisibleQuads()
 	unsigned updates = 0;
 	bool update = false;
 	fseg2_t strafe(cam_position.get2d(), (cam_position + cam_strafe).get2d());
-	for (unsigned a = 0; a < lines.size(); a++)
+	for (unsigned v = 0; v < vis_lines.size(); v++)
 	{
+		unsigned a = vis_lines[v];
 		line = map->getLine(a);
 
-		// Skip if not visible
-		if (!lines[a].visible)
-			continue;
-
 		// Check side of camera
 		if (cam_pitch > -0.9 && cam_pitch < 0.9)
 		{
@@ -2532,8 +2817,9 @@ void MapRenderer3D::checkVisibleFlats()
 	n_flats = 0;
 	float alpha;
 	fpoint2_t cam = cam_position.get2d();
-	for (unsigned a = 0; a < map->nSectors(); a++)
+	for (unsigned v = 0; v < vis_sectors.size(); v++)
 	{
+		unsigned a = vis_sectors[v];
 		sector = map->getSector(a);
 
 		// Skip if invisible
@@ -2570,8 +2856,10 @@ void MapRenderer3D::checkVisibleFlats()
 		// Add floor flat
 		flats[n_flats++] = &(floors[a]);
 	}
-	for (unsigned a = 0; a < map->nSectors(); a++)
+	for (unsigned v = 0; v < vis_sectors.size(); v++)
 	{
+		unsigned a = vis_sectors[v];
+
 		// Skip if invisible
 		if (dist_sectors[a] < 0)
 			continue;
@@ -2581,185 +2869,310 @@ void MapRenderer3D::checkVisibleFlats()
 	}
 }
 
-/* MapRenderer3D::determineHilight
- * Finds the closest wall/flat/thing to the camera along the view
- * vector
+/* MapRenderer3D::rayCheckLine
+ * Adds any wall quads of the line at [index] that the view vector
+ * passes through to [hits]
  *******************************************************************/
-selection_3d_t MapRenderer3D::determineHilight()
+void MapRenderer3D::rayCheckLine(unsigned index, vector<hit_3d_t>& hits)
 {
-	// Init
-	double min_dist = 9999999;
-	selection_3d_t current;
-	fseg2_t strafe(cam_position.get2d(), (cam_position + cam_strafe).get2d());
+	// Ignore if not visible
+	if (index >= lines.size() || !lines[index].visible)
+		return;
 
-	// Check for required map structures
-	if (!map || lines.size() != map->nLines() ||
-	        floors.size() != map->nSectors() ||
-	        things.size() != map->nThings())
-		return current;
+	MapLine* line = map->getLine(index);
 
-	// Check lines
-	double height, dist;
-	quad_3d_t* quad;
-	for (unsigned a = 0; a < map->nLines(); a++)
-	{
-		// Ignore if not visible
-		if (!lines[a].visible)
-			continue;
+	// Find (2d) distance to line
+	double dist = MathStuff::distanceRayLine(
+		cam_position.get2d(), (cam_position + cam_dir3d).get2d(),
+		line->point1(), line->point2());
 
-		MapLine* line = map->getLine(a);
+	// Ignore if no intersection
+	if (dist < 0)
+		return;
 
-		// Find (2d) distance to line
-		dist = MathStuff::distanceRayLine(
-			cam_position.get2d(), (cam_position + cam_dir3d).get2d(),
-			line->point1(), line->point2());
+	// Find quad intersect if any
+	fpoint3_t intersection = cam_position + cam_dir3d * dist;
+	for (unsigned q = 0; q < lines[index].quads.size(); q++)
+	{
+		quad_3d_t* quad = &lines[index].quads[q];
 
-		// Ignore if no intersection or something was closer
-		if (dist < 0 || dist >= min_dist)
+		// Check side of camera
+		if (MathStuff::lineSide(cam_position.get2d(), fseg2_t(quad->points[0].x, quad->points[0].y, quad->points[2].x, quad->points[2].y)) < 0)
 			continue;
 
-		// Find quad intersect if any
-		fpoint3_t intersection = cam_position + cam_dir3d * dist;
-		for (unsigned q = 0; q < lines[a].quads.size(); q++)
-		{
-			quad = &lines[a].quads[q];
-
-			// Check side of camera
-			if (MathStuff::lineSide(cam_position.get2d(), fseg2_t(quad->points[0].x, quad->points[0].y, quad->points[2].x, quad->points[2].y)) < 0)
-				continue;
-
-			// Check intersection height
-			// Need to handle slopes by finding the floor and ceiling height of
-			// the quad at the intersection point
-			fpoint2_t seg_left = fpoint2_t(quad->points[1].x, quad->points[1].y);
-			fpoint2_t seg_right = fpoint2_t(quad->points[2].x, quad->points[2].y);
-			double dist_along_segment =
-				(intersection.get2d() - seg_left).magnitude() /
-				(seg_right - seg_left).magnitude();
-			double top = quad->points[0].z + (quad->points[3].z - quad->points[0].z) * dist_along_segment;
-			double bottom = quad->points[1].z + (quad->points[2].z - quad->points[1].z) * dist_along_segment;
-			if (bottom <= intersection.z && intersection.z <= top)
-			{
-				// Determine selected item from quad flags
-
-				// Side index
-				if (quad->flags & BACK)
-					current.index = line->s2Index();
-				else
-					current.index = line->s1Index();
+		// Check intersection height
+		// Need to handle slopes by finding the floor and ceiling height of
+		// the quad at the intersection point
+		fpoint2_t seg_left = fpoint2_t(quad->points[1].x, quad->points[1].y);
+		fpoint2_t seg_right = fpoint2_t(quad->points[2].x, quad->points[2].y);
+		double dist_along_segment =
+			(intersection.get2d() - seg_left).magnitude() /
+			(seg_right - seg_left).magnitude();
+		double top = quad->points[0].z + (quad->points[3].z - quad->points[0].z) * dist_along_segment;
+		double bottom = quad->points[1].z + (quad->points[2].z - quad->points[1].z) * dist_along_segment;
+		if (bottom <= intersection.z && intersection.z <= top)
+		{
+			// Determine selected item from quad flags
+			selection_3d_t item;
+
+			// Side index
+			if (quad->flags & BACK)
+				item.index = line->s2Index();
+			else
+				item.index = line->s1Index();
 
-				// Side part
-				if (quad->flags & UPPER)
-					current.type = MapEditor::SEL_SIDE_TOP;
-				else if (quad->flags & LOWER)
-					current.type = MapEditor::SEL_SIDE_BOTTOM;
-				else
-					current.type = MapEditor::SEL_SIDE_MIDDLE;
+			// Side part
+			if (quad->flags & UPPER)
+				item.type = MapEditor::SEL_SIDE_TOP;
+			else if (quad->flags & LOWER)
+				item.type = MapEditor::SEL_SIDE_BOTTOM;
+			else
+				item.type = MapEditor::SEL_SIDE_MIDDLE;
 
-				min_dist = dist;
-			}
+			hits.push_back(hit_3d_t(item, dist));
 		}
 	}
+}
 
-	// Check sectors
-	for (unsigned a = 0; a < map->nSectors(); a++)
-	{
-		// Ignore if not visible
-		if (dist_sectors[a] < 0)
-			continue;
+/* MapRenderer3D::rayCheckSector
+ * Adds the floor and/or ceiling of the sector at [index] to [hits]
+ * if the view vector passes through them
+ *******************************************************************/
+void MapRenderer3D::rayCheckSector(unsigned index, vector<hit_3d_t>& hits)
+{
+	// Ignore if not visible
+	if (index >= dist_sectors.size() || dist_sectors[index] < 0)
+		return;
 
-		// Check distance to floor plane
-		dist = MathStuff::distanceRayPlane(cam_position, cam_dir3d, floors[a].plane);
-		if (dist >= 0 && dist < min_dist)
+	// Check distance to floor plane
+	double dist = MathStuff::distanceRayPlane(cam_position, cam_dir3d, floors[index].plane);
+	if (dist >= 0)
+	{
+		// Check if on the correct side of the plane
+		if (cam_position.z > floors[index].plane.height_at(cam_position.x, cam_position.y))
 		{
-			// Check if on the correct side of the plane
-			if (cam_position.z > floors[a].plane.height_at(cam_position.x, cam_position.y))
-			{
-				// Check if intersection is within sector
-				if (map->getSector(a)->isWithin((cam_position + cam_dir3d * dist).get2d()))
-				{
-					current.index = a;
-					current.type = MapEditor::SEL_FLOOR;
-					min_dist = dist;
-				}
-			}
+			// Check if intersection is within sector
+			if (map->getSector(index)->isWithin((cam_position + cam_dir3d * dist).get2d()))
+				hits.push_back(hit_3d_t(selection_3d_t(index, MapEditor::SEL_FLOOR), dist));
 		}
+	}
 
-		// Check distance to ceiling plane
-		dist = MathStuff::distanceRayPlane(cam_position, cam_dir3d, ceilings[a].plane);
-		if (dist >= 0 && dist < min_dist)
+	// Check distance to ceiling plane
+	dist = MathStuff::distanceRayPlane(cam_position, cam_dir3d, ceilings[index].plane);
+	if (dist >= 0)
+	{
+		// Check if on the correct side of the plane
+		if (cam_position.z < ceilings[index].plane.height_at(cam_position.x, cam_position.y))
 		{
-			// Check if on the correct side of the plane
-			if (cam_position.z < ceilings[a].plane.height_at(cam_position.x, cam_position.y))
-			{
-				// Check if intersection is within sector
-				if (map->getSector(a)->isWithin((cam_position + cam_dir3d * dist).get2d()))
-				{
-					current.index = a;
-					current.type = MapEditor::SEL_CEILING;
-					min_dist = dist;
-				}
-			}
+			// Check if intersection is within sector
+			if (map->getSector(index)->isWithin((cam_position + cam_dir3d * dist).get2d()))
+				hits.push_back(hit_3d_t(selection_3d_t(index, MapEditor::SEL_CEILING), dist));
 		}
 	}
+}
 
-	// Update item distance
-	if (min_dist >= 9999999 || min_dist < 0)
-		item_dist = -1;
-	else
-		item_dist = MathStuff::round(min_dist);
+/* MapRenderer3D::rayCheckThing
+ * Adds the thing at [index] to [hits] if the view vector passes
+ * through its sprite
+ *******************************************************************/
+void MapRenderer3D::rayCheckThing(unsigned index, vector<hit_3d_t>& hits)
+{
+	// Ignore if no sprite
+	if (!things[index].sprite)
+		return;
 
-	// Check things (if visible)
-	if (render_3d_things == 0)
-		return current;
-	double halfwidth, theight;
-	for (unsigned a = 0; a < map->nThings(); a++)
-	{
-		// Ignore if no sprite
-		if (!things[a].sprite)
-			continue;
+	// Ignore if not visible
+	MapThing* thing = map->getThing(index);
+	fseg2_t strafe(cam_position.get2d(), (cam_position + cam_strafe).get2d());
+	if (MathStuff::lineSide(thing->point(), strafe) > 0)
+		return;
 
-		// Ignore if not visible
-		MapThing* thing = map->getThing(a);
-		if (MathStuff::lineSide(thing->point(), strafe) > 0)
-			continue;
+	// Ignore if not shown
+	if (!things[index].type->isDecoration() && render_3d_things == 2)
+		return;
 
-		// Ignore if not shown
-		if (!things[a].type->isDecoration() && render_3d_things == 2)
-			continue;
+	// Find distance to thing sprite
+	double halfwidth = things[index].sprite->getWidth() * 0.5;
+	if (things[index].flags & ICON)
+		halfwidth = render_thing_icon_size*0.5;
+	double dist = MathStuff::distanceRayLine(
+		cam_position.get2d(), (cam_position + cam_dir3d).get2d(),
+		thing->point() - cam_strafe.get2d() * halfwidth, thing->point() + cam_strafe.get2d() * halfwidth);
 
-		// Find distance to thing sprite
-		halfwidth = things[a].sprite->getWidth() * 0.5;
-		if (things[a].flags & ICON)
-			halfwidth = render_thing_icon_size*0.5;
-		dist = MathStuff::distanceRayLine(
-			cam_position.get2d(), (cam_position + cam_dir3d).get2d(),
-			thing->point() - cam_strafe.get2d() * halfwidth, thing->point() + cam_strafe.get2d() * halfwidth);
+	// Ignore if no intersection
+	if (dist < 0)
+		return;
 
-		// Ignore if no intersection or something was closer
-		if (dist < 0 || dist >= min_dist)
-			continue;
+	// Check intersection height
+	double theight = things[index].sprite->getHeight();
+	double height = cam_position.z + cam_dir3d.z*dist;
+	if (things[index].flags & ICON)
+		theight = render_thing_icon_size;
+	if (height >= things[index].z && height <= things[index].z + theight)
+		hits.push_back(hit_3d_t(selection_3d_t(index, MapEditor::SEL_THING), dist));
+}
 
-		// Check intersection height
-		theight = things[a].sprite->getHeight();
-		height = cam_position.z + cam_dir3d.z*dist;
-		if (things[a].flags & ICON)
-			theight = render_thing_icon_size;
-		if (height >= things[a].z && height <= things[a].z + theight)
+// Sorts ray hits by distance. Walls come before flats and flats before
+// things at equal distances, then lower indices first
+bool sortRayHits(const MapRenderer3D::hit_3d_t& left, const MapRenderer3D::hit_3d_t& right)
+{
+	if (left.dist != right.dist)
+		return left.dist < right.dist;
+
+	int rank_left = left.item.type <= MapEditor::SEL_SIDE_BOTTOM ? 0 : (left.item.type == MapEditor::SEL_THING ? 2 : 1);
+	int rank_right = right.item.type <= MapEditor::SEL_SIDE_BOTTOM ? 0 : (right.item.type == MapEditor::SEL_THING ? 2 : 1);
+	if (rank_left != rank_right)
+		return rank_left < rank_right;
+
+	return left.item.index < right.item.index;
+}
+
+/* MapRenderer3D::getRayHits
+ * Adds all walls/flats/things the view vector passes through to
+ * [hits], sorted by distance from the camera. If [nearest_only] is
+ * true, stops looking once the closest hit is known (there may
+ * still be more than one hit in the list, the first is the closest).
+ *
+ * Only the map blocks (see MapBlockmap) the view vector passes
+ * through are checked, so this is independent of map size
+ *******************************************************************/
+void MapRenderer3D::getRayHits(vector<hit_3d_t>& hits, bool nearest_only)
+{
+	// Check for required map structures
+	if (!map || lines.size() != map->nLines() ||
+	        floors.size() != map->nSectors() ||
+	        things.size() != map->nThings())
+		return;
+
+	// Get area to check (things can extend outside the map by their sprite width)
+	double margin = MAX(thing_max_halfwidth, render_thing_icon_size * 0.5);
+	bbox_t bbox;
+	if (!vis_nodes.empty())
+	{
+		vis_box_t& root = vis_nodes[0].box;
+		bbox.min.set(root.min[0], root.min[1]);
+		bbox.max.set(root.max[0], root.max[1]);
+	}
+	else
+		bbox = map->getMapBBox();
+	int bx_min = MapBlockmap::blockCoord(bbox.min.x - margin);
+	int bx_max = MapBlockmap::blockCoord(bbox.max.x + margin);
+	int by_min = MapBlockmap::blockCoord(bbox.min.y - margin);
+	int by_max = MapBlockmap::blockCoord(bbox.max.y + margin);
+
+	// Setup ray (2d), distances are in the same units as the 3d view
+	// vector so they can be compared with hit distances
+	double size = MapBlockmap::BLOCK_SIZE;
+	double inf = 1e30;
+	fpoint2_t origin = cam_position.get2d();
+	fpoint2_t dir = cam_dir3d.get2d();
+	int bx = MapBlockmap::blockCoord(origin.x);
+	int by = MapBlockmap::blockCoord(origin.y);
+	int step_x = (dir.x > 0) ? 1 : -1;
+	int step_y = (dir.y > 0) ? 1 : -1;
+	double next_x = inf;
+	double next_y = inf;
+	double delta_x = inf;
+	double delta_y = inf;
+	if (dir.x != 0)
+	{
+		next_x = ((bx + (step_x > 0 ? 1 : 0)) * size - origin.x) / dir.x;
+		delta_x = size / fabs(dir.x);
+	}
+	if (dir.y != 0)
+	{
+		next_y = ((by + (step_y > 0 ? 1 : 0)) * size - origin.y) / dir.y;
+		delta_y = size / fabs(dir.y);
+	}
+
+	// Go through each block along the ray
+	MapBlockmap& blockmap = map->getBlockmap();
+	vector<MapObject*> objects;
+	unsigned n_hits = hits.size();
+	double min_dist = inf;
+	bool first = true;
+	while (true)
+	{
+		double block_exit = MIN(next_x, next_y);
+
+		// Check lines and sectors in the block (each is only checked once)
+		double cx = (bx + 0.5) * size;
+		double cy = (by + 0.5) * size;
+		objects.clear();
+		blockmap.getObjects(MOBJ_LINE, cx, cy, cx, cy, objects, first);
+		blockmap.getObjects(MOBJ_SECTOR, cx, cy, cx, cy, objects, false);
+
+		// Check things in and around the block (a sprite can extend into
+		// neighbouring blocks)
+		if (render_3d_things > 0)
+			blockmap.getObjects(MOBJ_THING, cx - size*0.5 - margin, cy - size*0.5 - margin,
+								cx + size*0.5 + margin, cy + size*0.5 + margin, objects, false);
+		first = false;
+
+		for (unsigned a = 0; a < objects.size(); a++)
+		{
+			uint8_t type = objects[a]->getObjType();
+			if (type == MOBJ_LINE)
+				rayCheckLine(objects[a]->getIndex(), hits);
+			else if (type == MOBJ_SECTOR)
+				rayCheckSector(objects[a]->getIndex(), hits);
+			else
+				rayCheckThing(objects[a]->getIndex(), hits);
+		}
+		for (unsigned a = n_hits; a < hits.size(); a++)
+		{
+			if (hits[a].dist < min_dist)
+				min_dist = hits[a].dist;
+		}
+		n_hits = hits.size();
+
+		// Anything hit within this block is closer than anything in the
+		// blocks after it
+		if (nearest_only && min_dist <= block_exit)
+			break;
+
+		// Next block
+		if (block_exit >= inf)
+			break;
+		if (next_x < next_y)
+		{
+			bx += step_x;
+			next_x += delta_x;
+		}
+		else
 		{
-			current.index = a;
-			current.type = MapEditor::SEL_THING;
-			min_dist = dist;
+			by += step_y;
+			next_y += delta_y;
 		}
+
+		// Stop once outside the map, heading away from it
+		if ((dir.x > 0 && bx > bx_max) || (dir.x < 0 && bx < bx_min) ||
+		        (dir.y > 0 && by > by_max) || (dir.y < 0 && by < by_min))
+			break;
 	}
 
+	std::sort(hits.begin(), hits.end(), sortRayHits);
+}
+
+/* MapRenderer3D::determineHilight
+ * Finds the closest wall/flat/thing to the camera along the view
+ * vector
+ *******************************************************************/
+selection_3d_t MapRenderer3D::determineHilight()
+{
+	// Get closest ray hit
+	vector<hit_3d_t> hits;
+	getRayHits(hits, true);
+
 	// Update item distance
-	if (min_dist >= 9999999 || min_dist < 0)
+	if (hits.empty())
+	{
 		item_dist = -1;
-	else
-		item_dist = MathStuff::round(min_dist);
+		return selection_3d_t();
+	}
+	item_dist = MathStuff::round(hits[0].dist);
 
-	return current;
+	return hits[0].item;
 }
 
 /* MapRenderer3D::renderHilight
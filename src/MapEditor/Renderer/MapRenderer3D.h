@@ -55,6 +55,13 @@ public:
 			flags = 0;
 		}
 	};
+	struct hit_3d_t
+	{
+		selection_3d_t	item;
+		double			dist;
+
+		hit_3d_t(selection_3d_t item, double dist) { this->item = item; this->dist = dist; }
+	};
 	struct line_3d_t
 	{
 		vector<quad_3d_t>	quads;
@@ -176,12 +183,20 @@ public:
 	void	updateWallsVBO();
 
 	// Visibility checking
+	void	updateVisTree();
+	void	buildVisTree();
+	void	updateFrustum();
+	int		frustumTest(float* min, float* max);
 	void	quickVisDiscard();
 	float	calcDistFade(double distance, double max = -1);
 	void	checkVisibleQuads();
 	void	checkVisibleFlats();
 
 	// Hilight
+	void			rayCheckLine(unsigned index, vector<hit_3d_t>& hits);
+	void			rayCheckSector(unsigned index, vector<hit_3d_t>& hits);
+	void			rayCheckThing(unsigned index, vector<hit_3d_t>& hits);
+	void			getRayHits(vector<hit_3d_t>& hits, bool nearest_only = false);
 	selection_3d_t	determineHilight();
 	void			renderHilight(selection_3d_t hilight, float alpha = 1.0f);
 
@@ -203,7 +218,36 @@ private:
 	float		fog_depth_last;
 
 	// Visibility
-	vector<float>	dist_sectors;
+	struct vis_box_t
+	{
+		float	min[3];
+		float	max[3];
+	};
+	struct vis_node_t
+	{
+		vis_box_t	box;
+		int			child;	// First child node (second is child + 1), -1 if leaf
+		unsigned	first;	// Leaf sectors range in vis_order
+		unsigned	count;
+	};
+	struct vis_plane_t
+	{
+		fpoint3_t	normal;
+		double		dist;
+	};
+	vector<float>		dist_sectors;
+	vector<vis_box_t>	vis_boxes;		// Bounds of each sector
+	vector<vis_node_t>	vis_nodes;		// BVH of sector bounds, root first
+	vector<unsigned>	vis_order;		// Sector indices, grouped by leaf node
+	vector<unsigned>	vis_sectors;	// Sectors visible this frame
+	vector<unsigned>	vis_lines;		// Lines visible this frame
+	unsigned			vis_n_lines;
+	long				vis_built_time;
+	long				vis_geometry_time;
+	vis_plane_t			frustum[4];
+	float				view_fovy;
+	float				view_aspect;
+	float				thing_max_halfwidth;	// Widest thing sprite (for ray hit checks)
 
 	// Camera
 	fpoint3_t	cam_position;
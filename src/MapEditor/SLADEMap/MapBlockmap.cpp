@@ -0,0 +1,381 @@
+
+/*******************************************************************
+ * SLADE - It's a Doom Editor
+ * Copyright (C) 2008-2014 Simon Judd
+ *
+ * Email:       sirjuddington@gmail.com
+ * Web:         http://slade.mancubus.net
+ * Filename:    MapBlockmap.cpp
+ * Description: MapBlockmap class, a spatial index of map objects
+ *              used to speed up hit-testing and other geometry
+ *              queries on large maps
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *******************************************************************/
+
+
+/*******************************************************************
+ * INCLUDES
+ *******************************************************************/
+#include "Main.h"
+#include "MapBlockmap.h"
+#include "MapVertex.h"
+#include "MapLine.h"
+#include "MapSector.h"
+#include "MapThing.h"
+
+
+/*******************************************************************
+ * MAPBLOCKMAP CLASS FUNCTIONS
+ *******************************************************************/
+
+/* MapBlockmap::MapBlockmap
+ * MapBlockmap class constructor
+ *******************************************************************/
+MapBlockmap::MapBlockmap()
+{
+	// Init variables
+	query_stamp = 0;
+	for (unsigned a = 0; a <= MOBJ_THING; a++)
+		counts[a] = 0;
+}
+
+/* MapBlockmap::~MapBlockmap
+ * MapBlockmap class destructor
+ *******************************************************************/
+MapBlockmap::~MapBlockmap()
+{
+}
+
+/* MapBlockmap::getRecord
+ * Returns the blockmap record for [object], creating it if needed
+ *******************************************************************/
+MapBlockmap::mb_record_t& MapBlockmap::getRecord(MapObject* object)
+{
+	unsigned id = object->getId();
+	if (id >= records.size())
+		records.resize(id + 1);
+
+	return records[id];
+}
+
+/* MapBlockmap::addToBlock
+ * Adds [object] to the block at [bx,by]
+ *******************************************************************/
+void MapBlockmap::addToBlock(MapObject* object, mb_record_t& record, int bx, int by)
+{
+	unsigned key = blockKey(bx, by);
+	blocks[key].objects[object->getObjType()].push_back(object);
+	record.blocks.push_back(key);
+}
+
+/* MapBlockmap::link
+ * Adds [object] to all blocks it currently touches
+ *******************************************************************/
+void MapBlockmap::link(MapObject* object)
+{
+	mb_record_t& record = getRecord(object);
+	uint8_t type = object->getObjType();
+
+	// Vertex
+	if (type == MOBJ_VERTEX)
+	{
+		MapVertex* vertex = (MapVertex*)object;
+		addToBlock(object, record, blockCoord(vertex->xPos()), blockCoord(vertex->yPos()));
+	}
+
+	// Thing
+	else if (type == MOBJ_THING)
+	{
+		MapThing* thing = (MapThing*)object;
+		addToBlock(object, record, blockCoord(thing->xPos()), blockCoord(thing->yPos()));
+	}
+
+	// Line (every block the line passes through)
+	else if (type == MOBJ_LINE)
+	{
+		MapLine* line = (MapLine*)object;
+		if (!line->v1() || !line->v2())
+			return;
+
+		// Get line points, left to right
+		double x1 = line->x1();
+		double y1 = line->y1();
+		double x2 = line->x2();
+		double y2 = line->y2();
+		if (x1 > x2)
+		{
+			std::swap(x1, x2);
+			std::swap(y1, y2);
+		}
+
+		// Go through each column of blocks the line spans
+		int bx1 = blockCoord(x1);
+		int bx2 = blockCoord(x2);
+		for (int bx = bx1; bx <= bx2; bx++)
+		{
+			// Get the part of the line within this column
+			double cx1 = (bx == bx1) ? x1 : (double)bx * BLOCK_SIZE;
+			double cx2 = (bx == bx2) ? x2 : (double)(bx + 1) * BLOCK_SIZE;
+			double cy1 = y1;
+			double cy2 = y2;
+			if (x2 > x1)
+			{
+				cy1 = y1 + (cx1 - x1) * (y2 - y1) / (x2 - x1);
+				cy2 = y1 + (cx2 - x1) * (y2 - y1) / (x2 - x1);
+			}
+
+			// Add to each block in the column that the line part spans
+			int by1 = blockCoord(MIN(cy1, cy2));
+			int by2 = blockCoord(MAX(cy1, cy2));
+			for (int by = by1; by <= by2; by++)
+				addToBlock(object, record, bx, by);
+		}
+	}
+
+	// Sector (every block the sector bbox covers)
+	else if (type == MOBJ_SECTOR)
+	{
+		bbox_t bbox = ((MapSector*)object)->boundingBox();
+		int bx1 = blockCoord(bbox.min.x);
+		int bx2 = blockCoord(bbox.max.x);
+		int by1 = blockCoord(bbox.min.y);
+		int by2 = blockCoord(bbox.max.y);
+		for (int bx = bx1; bx <= bx2; bx++)
+		{
+			for (int by = by1; by <= by2; by++)
+				addToBlock(object, record, bx, by);
+		}
+	}
+}
+
+/* MapBlockmap::unlink
+ * Removes [object] from all blocks it was last linked into
+ *******************************************************************/
+void MapBlockmap::unlink(MapObject* object)
+{
+	mb_record_t& record = getRecord(object);
+	uint8_t type = object->getObjType();
+
+	for (unsigned a = 0; a < record.blocks.size(); a++)
+	{
+		std::map<unsigned, mb_block_t>::iterator i = blocks.find(record.blocks[a]);
+		if (i == blocks.end())
+			continue;
+
+		// Remove from block (order within a block doesn't matter)
+		vector<MapObject*>& list = i->second.objects[type];
+		for (unsigned b = 0; b < list.size(); b++)
+		{
+			if (list[b] == object)
+			{
+				list[b] = list.back();
+				list.pop_back();
+				break;
+			}
+		}
+
+		// Remove the block if it's now empty
+		bool empty = true;
+		for (unsigned t = 0; t <= MOBJ_THING; t++)
+		{
+			if (!i->second.objects[t].empty())
+			{
+				empty = false;
+				break;
+			}
+		}
+		if (empty)
+			blocks.erase(i);
+	}
+
+	record.blocks.clear();
+}
+
+/* MapBlockmap::clear
+ * Removes all objects from the blockmap
+ *******************************************************************/
+void MapBlockmap::clear()
+{
+	blocks.clear();
+	records.clear();
+	pending.clear();
+	for (unsigned a = 0; a <= MOBJ_THING; a++)
+		counts[a] = 0;
+}
+
+/* MapBlockmap::addObject
+ * Adds [object] to the blockmap. It will be linked into the blocks
+ * it touches on the next call to processPending
+ *******************************************************************/
+void MapBlockmap::addObject(MapObject* object)
+{
+	uint8_t type = object->getObjType();
+	if (type > MOBJ_THING || type == MOBJ_SIDE)
+		return;
+
+	mb_record_t& record = getRecord(object);
+	if (record.indexed)
+		return;
+
+	record.indexed = true;
+	counts[type]++;
+	updateObject(object);
+}
+
+/* MapBlockmap::removeObject
+ * Removes [object] from the blockmap
+ *******************************************************************/
+void MapBlockmap::removeObject(MapObject* object)
+{
+	mb_record_t& record = getRecord(object);
+	if (!record.indexed)
+		return;
+
+	unlink(object);
+	record.indexed = false;
+	counts[object->getObjType()]--;
+}
+
+/* MapBlockmap::updateObject
+ * Flags [object] as having changed shape or position, so it is
+ * re-linked on the next call to processPending. Does nothing if the
+ * object isn't in the blockmap
+ *******************************************************************/
+void MapBlockmap::updateObject(MapObject* object)
+{
+	mb_record_t& record = getRecord(object);
+	if (!record.indexed || record.pending)
+		return;
+
+	record.pending = true;
+	pending.push_back(object);
+}
+
+/* MapBlockmap::processPending
+ * Re-links all objects flagged as changed since the last call
+ *******************************************************************/
+void MapBlockmap::processPending()
+{
+	for (unsigned a = 0; a < pending.size(); a++)
+	{
+		mb_record_t& record = getRecord(pending[a]);
+		record.pending = false;
+
+		// Skip if removed since it was flagged
+		if (!record.indexed)
+			continue;
+
+		unlink(pending[a]);
+		link(pending[a]);
+	}
+
+	pending.clear();
+}
+
+/* MapBlockmap::getObjects
+ * Adds all objects of [type] in blocks touching the rectangle
+ * [x1,y1]-[x2,y2] to [list], each object is only added once. If
+ * [new_query] is false, objects added by previous calls (since the
+ * last new query) are not added again. Note that this is a broad
+ * check, objects in [list] are not necessarily within the rectangle
+ * themselves
+ *******************************************************************/
+void MapBlockmap::getObjects(uint8_t type, double x1, double y1, double x2, double y2, vector<MapObject*>& list, bool new_query)
+{
+	if (type > MOBJ_THING)
+		return;
+
+	int bx1 = blockCoord(MIN(x1, x2));
+	int bx2 = blockCoord(MAX(x1, x2));
+	int by1 = blockCoord(MIN(y1, y2));
+	int by2 = blockCoord(MAX(y1, y2));
+
+	// Objects spanning multiple blocks are only added once per query
+	if (new_query)
+		query_stamp++;
+
+	// If the rectangle covers more blocks than currently exist, it's
+	// quicker to go through the existing blocks instead
+	double n_blocks = (double)(bx2 - bx1 + 1) * (double)(by2 - by1 + 1);
+	if (n_blocks > blocks.size())
+	{
+		std::map<unsigned, mb_block_t>::iterator i;
+		for (i = blocks.begin(); i != blocks.end(); i++)
+		{
+			int bx = (int16_t)(i->first & 0xFFFF);
+			int by = (int16_t)(i->first >> 16);
+			if (bx < bx1 || bx > bx2 || by < by1 || by > by2)
+				continue;
+
+			vector<MapObject*>& objects = i->second.objects[type];
+			for (unsigned a = 0; a < objects.size(); a++)
+			{
+				mb_record_t& record = records[objects[a]->getId()];
+				if (record.query != query_stamp)
+				{
+					record.query = query_stamp;
+					list.push_back(objects[a]);
+				}
+			}
+		}
+
+		return;
+	}
+
+	for (int bx = bx1; bx <= bx2; bx++)
+	{
+		for (int by = by1; by <= by2; by++)
+		{
+			std::map<unsigned, mb_block_t>::iterator i = blocks.find(blockKey(bx, by));
+			if (i == blocks.end())
+				continue;
+
+			vector<MapObject*>& objects = i->second.objects[type];
+			for (unsigned a = 0; a < objects.size(); a++)
+			{
+				mb_record_t& record = records[objects[a]->getId()];
+				if (record.query != query_stamp)
+				{
+					record.query = query_stamp;
+					list.push_back(objects[a]);
+				}
+			}
+		}
+	}
+}
+
+
+/*******************************************************************
+ * MAPBLOCKMAP CLASS STATIC FUNCTIONS
+ *******************************************************************/
+
+/* MapBlockmap::blockCoord (static)
+ * Returns the block column/row containing map coordinate [pos].
+ * Coordinates too far out are clamped to the outermost blocks, which
+ * still gives correct (if slower) results for anything out there
+ *******************************************************************/
+int MapBlockmap::blockCoord(double pos)
+{
+	double block = floor(pos / BLOCK_SIZE);
+	if (block < -32768)
+		return -32768;
+	if (block > 32767)
+		return 32767;
+	if (block != block)	// NaN
+		return 0;
+
+	return (int)block;
+}
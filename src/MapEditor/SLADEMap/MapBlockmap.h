@@ -0,0 +1,67 @@
+
+#ifndef __MAP_BLOCKMAP_H__
+#define __MAP_BLOCKMAP_H__
+
+#include "MapObject.h"
+
+// A uniform grid of square blocks over the map, each listing the vertices,
+// lines, sectors and things that touch it (vertices and things are in a
+// single block, lines in every block they pass through and sectors in
+// every block their bounding box covers).
+//
+// Objects are added/removed as they are created/deleted. When an object
+// changes shape or position it is flagged with updateObject, and is
+// re-linked into the correct blocks the next time processPending is called
+class MapBlockmap
+{
+public:
+	static const int BLOCK_SIZE = 128;
+
+private:
+	struct mb_block_t
+	{
+		vector<MapObject*>	objects[MOBJ_THING + 1];
+	};
+
+	struct mb_record_t
+	{
+		vector<unsigned>	blocks;
+		unsigned			query;
+		bool				indexed;
+		bool				pending;
+
+		mb_record_t() { query = 0; indexed = false; pending = false; }
+	};
+
+	std::map<unsigned, mb_block_t>	blocks;
+	vector<mb_record_t>				records;
+	vector<MapObject*>				pending;
+	unsigned						counts[MOBJ_THING + 1];
+	unsigned						query_stamp;
+
+	mb_record_t&	getRecord(MapObject* object);
+	void			addToBlock(MapObject* object, mb_record_t& record, int bx, int by);
+	void			link(MapObject* object);
+	void			unlink(MapObject* object);
+
+	static unsigned	blockKey(int bx, int by) { return (unsigned)(bx & 0xFFFF) | ((unsigned)(by & 0xFFFF) << 16); }
+
+public:
+	MapBlockmap();
+	~MapBlockmap();
+
+	unsigned	nIndexed(uint8_t type) { return type <= MOBJ_THING ? counts[type] : 0; }
+	unsigned	nBlocks() { return blocks.size(); }
+
+	void	clear();
+	void	addObject(MapObject* object);
+	void	removeObject(MapObject* object);
+	void	updateObject(MapObject* object);
+	void	processPending();
+
+	void	getObjects(uint8_t type, double x1, double y1, double x2, double y2, vector<MapObject*>& list, bool new_query = true);
+
+	static int	blockCoord(double pos);
+};
+
+#endif//__MAP_BLOCKMAP_H__
@@ -673,6 +673,10 @@ void MapLine::resetInternals()
 		s2->resetPolygon();
 		s2->resetBBox();
 	}
+
+	// Update position in map blockmap
+	if (parent_map)
+		parent_map->updateBlockmap(this);
 }
 
 /* MapLine::flip
@@ -151,8 +151,9 @@ void MapObject::copy(MapObject* c)
 bool MapObject::boolProperty(string key)
 {
 	// If the property exists already, return it
-	if (properties[key].hasValue())
-		return properties[key].getBoolValue();
+	Property* value = properties.getProperty(key);
+	if (value && value->hasValue())
+		return value->getBoolValue();
 
 	// Otherwise check the game configuration for a default value
 	else
@@ -171,8 +172,9 @@ bool MapObject::boolProperty(string key)
 int MapObject::intProperty(string key)
 {
 	// If the property exists already, return it
-	if (properties[key].hasValue())
-		return properties[key].getIntValue();
+	Property* value = properties.getProperty(key);
+	if (value && value->hasValue())
+		return value->getIntValue();
 
 	// Otherwise check the game configuration for a default value
 	else
@@ -191,8 +193,9 @@ int MapObject::intProperty(string key)
 double MapObject::floatProperty(string key)
 {
 	// If the property exists already, return it
-	if (properties[key].hasValue())
-		return properties[key].getFloatValue();
+	Property* value = properties.getProperty(key);
+	if (value && value->hasValue())
+		return value->getFloatValue();
 
 	// Otherwise check the game configuration for a default value
 	else
@@ -211,8 +214,9 @@ double MapObject::floatProperty(string key)
 string MapObject::stringProperty(string key)
 {
 	// If the property exists already, return it
-	if (properties[key].hasValue())
-		return properties[key].getStringValue();
+	Property* value = properties.getProperty(key);
+	if (value && value->hasValue())
+		return value->getStringValue();
 
 	// Otherwise check the game configuration for a default value
 	else
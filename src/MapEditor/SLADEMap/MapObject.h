@@ -61,7 +61,7 @@ public:
 	void		setModified();
 
 	MobjPropertyList&	props()				{ return properties; }
-	bool				hasProp(string key)	{ return properties[key].hasValue(); }
+	bool				hasProp(string key)	{ Property* p = properties.getProperty(key); return p && p->hasValue(); }
 
 	// Generic property modification
 	virtual bool	boolProperty(string key);
@@ -43,6 +43,12 @@
 // Number of radians in the unit circle
 const double TAU = M_PI * 2;
 
+// Sectors with fewer sides than this don't use a line grid in isWithin
+const unsigned LINE_GRID_MIN_SIDES = 16;
+
+// Maximum number of line grid cells across or down a sector
+const int LINE_GRID_MAX_CELLS = 64;
+
 
 /*******************************************************************
  * MAPSECTOR CLASS FUNCTIONS
@@ -286,6 +292,20 @@ void MapSector::updateBBox()
 	setGeometryUpdated();
 }
 
+/* MapSector::resetBBox
+ * Invalidates the sector's bounding box so it is recalculated next
+ * time it's needed
+ *******************************************************************/
+void MapSector::resetBBox()
+{
+	bbox.reset();
+	line_grid.clear();
+
+	// Sector extents may have changed, update blockmap
+	if (parent_map)
+		parent_map->updateBlockmap(this);
+}
+
 /* MapSector::boundingBox
  * Returns the sector bounding box
  *******************************************************************/
@@ -312,39 +332,192 @@ Polygon2D* MapSector::getPolygon()
 	return &polygon;
 }
 
-/* MapSector::isWithin
- * Returns true if the point is inside the sector
+/* MapSector::buildLineGrid
+ * Builds the grid of sector lines used by nearestLine, with roughly
+ * one cell for each connected side
  *******************************************************************/
-bool MapSector::isWithin(fpoint2_t point)
+void MapSector::buildLineGrid()
 {
-	// Check with bbox first
-	if (!boundingBox().contains(point))
-		return false;
+	line_grid.clear();
+
+	// Setup grid to cover the sector bbox
+	bbox_t bb = boundingBox();
+	double bw = MAX(bb.width(), 1.0);
+	double bh = MAX(bb.height(), 1.0);
+	double cell_size = sqrt((bw * bh) / connected_sides.size());
+	line_grid.x = bb.min.x;
+	line_grid.y = bb.min.y;
+	line_grid.width = MIN((int)ceil(bw / cell_size), LINE_GRID_MAX_CELLS);
+	line_grid.height = MIN((int)ceil(bh / cell_size), LINE_GRID_MAX_CELLS);
+	line_grid.width = MAX(line_grid.width, 1);
+	line_grid.height = MAX(line_grid.height, 1);
+	line_grid.cell_width = bw / line_grid.width;
+	line_grid.cell_height = bh / line_grid.height;
+	line_grid.cells.resize(line_grid.width * line_grid.height);
+
+	// Add each side to the cells its line passes through
+	for (unsigned a = 0; a < connected_sides.size(); a++)
+	{
+		MapLine* line = connected_sides[a]->getParentLine();
+		if (!line)
+			continue;
+
+		// Get line points in grid space, left to right
+		double x1 = (line->x1() - line_grid.x) / line_grid.cell_width;
+		double y1 = (line->y1() - line_grid.y) / line_grid.cell_height;
+		double x2 = (line->x2() - line_grid.x) / line_grid.cell_width;
+		double y2 = (line->y2() - line_grid.y) / line_grid.cell_height;
+		if (x1 > x2)
+		{
+			std::swap(x1, x2);
+			std::swap(y1, y2);
+		}
 
-	// Find nearest line in the sector
+		// Go through each grid column the line spans
+		int cx1 = MAX((int)floor(x1), 0);
+		int cx2 = MIN((int)floor(x2), line_grid.width - 1);
+		for (int cx = cx1; cx <= cx2; cx++)
+		{
+			// Get the part of the line within this column
+			double lx1 = (cx == cx1) ? x1 : cx;
+			double lx2 = (cx == cx2) ? x2 : cx + 1;
+			double ly1 = y1;
+			double ly2 = y2;
+			if (x2 > x1)
+			{
+				ly1 = y1 + (lx1 - x1) * (y2 - y1) / (x2 - x1);
+				ly2 = y1 + (lx2 - x1) * (y2 - y1) / (x2 - x1);
+			}
+
+			int cy1 = MAX((int)floor(MIN(ly1, ly2)), 0);
+			int cy2 = MIN((int)floor(MAX(ly1, ly2)), line_grid.height - 1);
+			for (int cy = cy1; cy <= cy2; cy++)
+				line_grid.cells[cy * line_grid.width + cx].push_back(a);
+		}
+	}
+
+	line_grid.n_sides = connected_sides.size();
+	line_grid.updated_time = geometry_updated;
+}
+
+/* MapSector::updateLineGrid
+ * (Re)builds the line grid if the sector is large enough to use one
+ * and its geometry has changed since the grid was last built
+ *******************************************************************/
+void MapSector::updateLineGrid()
+{
+	if (connected_sides.size() < LINE_GRID_MIN_SIDES)
+		return;
+
+	boundingBox();
+	if (line_grid.updated_time != geometry_updated || line_grid.n_sides != connected_sides.size())
+		buildLineGrid();
+}
+
+/* MapSector::nearestLine
+ * Returns the sector line nearest to [point], or NULL if the sector
+ * has no lines. If multiple lines are equally near, the one first in
+ * the connected sides list is returned. For large sectors the line
+ * grid is used, which is (re)built here first if needed
+ *******************************************************************/
+MapLine* MapSector::nearestLine(fpoint2_t point)
+{
 	double dist;
 	double min_dist = 999999;
-	MapLine* nline = NULL;
-	for (unsigned a = 0; a < connected_sides.size(); a++)
+	int nearest = -1;
+
+	// Small sector, just check all lines
+	if (connected_sides.size() < LINE_GRID_MIN_SIDES)
 	{
-		// Calculate distance to line
-		//if (connected_sides[a] == NULL) {
-		//	LOG_MESSAGE(3, "Warning: connected side #%i is a NULL pointer!", a);
-		//	continue;
-		//} else if (connected_sides[a]->getParentLine() == NULL) {
-		//	LOG_MESSAGE(3, "Warning: connected side #%i has a NULL pointer parent line!", connected_sides[a]->getIndex());
-		//	continue;
-		//}
-		dist = connected_sides[a]->getParentLine()->distanceTo(point);
+		for (unsigned a = 0; a < connected_sides.size(); a++)
+		{
+			// Calculate distance to line
+			dist = connected_sides[a]->getParentLine()->distanceTo(point);
+
+			// Check distance
+			if (dist < min_dist)
+			{
+				nearest = a;
+				min_dist = dist;
+			}
+		}
 
-		// Check distance
-		if (dist < min_dist)
+		return nearest >= 0 ? connected_sides[nearest]->getParentLine() : NULL;
+	}
+
+	// Rebuild the line grid if the sector geometry changed since it was built
+	updateLineGrid();
+
+	// Get the grid cell containing the point
+	int cx = (int)floor((point.x - line_grid.x) / line_grid.cell_width);
+	int cy = (int)floor((point.y - line_grid.y) / line_grid.cell_height);
+	cx = MAX(0, MIN(cx, line_grid.width - 1));
+	cy = MAX(0, MIN(cy, line_grid.height - 1));
+
+	// Check rings of cells outward from the point's cell, until the
+	// nearest line found is nearer than anything in the next ring can be
+	int max_ring = MAX(MAX(cx, line_grid.width - 1 - cx), MAX(cy, line_grid.height - 1 - cy));
+	for (int ring = 0; ring <= max_ring; ring++)
+	{
+		if (ring > 0 && nearest >= 0)
 		{
-			nline = connected_sides[a]->getParentLine();
-			min_dist = dist;
+			// Get the distance from the point to the nearest edge of this ring
+			double edge = point.x - (line_grid.x + (cx - ring + 1) * line_grid.cell_width);
+			edge = MIN(edge, line_grid.x + (cx + ring) * line_grid.cell_width - point.x);
+			edge = MIN(edge, point.y - (line_grid.y + (cy - ring + 1) * line_grid.cell_height));
+			edge = MIN(edge, line_grid.y + (cy + ring) * line_grid.cell_height - point.y);
+			if (edge > min_dist)
+				break;
+		}
+
+		for (int y = cy - ring; y <= cy + ring; y++)
+		{
+			if (y < 0 || y >= line_grid.height)
+				continue;
+
+			for (int x = cx - ring; x <= cx + ring; x++)
+			{
+				// Only cells on the edge of the ring
+				if (x < 0 || x >= line_grid.width)
+					continue;
+				if (y != cy - ring && y != cy + ring && x != cx - ring && x != cx + ring)
+					continue;
+
+				vector<unsigned>& cell = line_grid.cells[y * line_grid.width + x];
+				for (unsigned a = 0; a < cell.size(); a++)
+				{
+					int side = cell[a];
+					dist = connected_sides[side]->getParentLine()->distanceTo(point);
+
+					// Check distance (ties go to the first side in the list)
+					if (dist < min_dist || (dist == min_dist && side < nearest))
+					{
+						nearest = side;
+						min_dist = dist;
+					}
+				}
+			}
 		}
 	}
 
+	return nearest >= 0 ? connected_sides[nearest]->getParentLine() : NULL;
+}
+
+/* MapSector::isWithin
+ * Returns true if the point is inside the sector. Note that for
+ * sectors with many lines, this builds and keeps the sector's line
+ * grid if it doesn't exist or is out of date (see nearestLine), so it
+ * isn't safe to call for the same sector from multiple threads
+ *******************************************************************/
+bool MapSector::isWithin(fpoint2_t point)
+{
+	// Check with bbox first
+	if (!boundingBox().contains(point))
+		return false;
+
+	// Find nearest line in the sector
+	MapLine* nline = nearestLine(point);
+
 	// No nearest (shouldn't happen)
 	if (!nline)
 		return false;
@@ -676,7 +849,7 @@ void MapSector::connectSide(MapSide* side)
 	setModified();
 	connected_sides.push_back(side);
 	poly_needsupdate = true;
-	bbox.reset();
+	resetBBox();
 	setGeometryUpdated();
 }
 
@@ -696,7 +869,7 @@ void MapSector::disconnectSide(MapSide* side)
 	}
 
 	poly_needsupdate = true;
-	bbox.reset();
+	resetBBox();
 	setGeometryUpdated();
 }
 
@@ -737,6 +910,6 @@ void MapSector::readBackup(mobj_backup_t* backup)
 
 	// Update geometry info
 	poly_needsupdate = true;
-	bbox.reset();
+	resetBBox();
 	setGeometryUpdated();
 }
@@ -32,6 +32,35 @@ struct doom64sector_t
 	uint16_t	flags;
 };
 
+// A grid over a sector's bbox, listing the (indices of the) connected
+// sides whose lines pass through each cell. Used to find the nearest
+// sector line to a point without checking every line. Built on demand
+// (by the first point query after the sector geometry changes)
+struct sector_line_grid_t
+{
+	double						x;
+	double						y;
+	double						cell_width;
+	double						cell_height;
+	int							width;
+	int							height;
+	unsigned					n_sides;
+	long						updated_time;
+	vector< vector<unsigned> >	cells;
+
+	sector_line_grid_t() { clear(); }
+
+	void clear()
+	{
+		x = y = 0;
+		cell_width = cell_height = 1;
+		width = height = 0;
+		n_sides = 0;
+		updated_time = -1;
+		cells.clear();
+	}
+};
+
 enum PlaneType
 {
 	FLOOR_PLANE,
@@ -55,6 +84,7 @@ private:
 	// Internal info
 	vector<MapSide*>	connected_sides;
 	bbox_t				bbox;
+	sector_line_grid_t	line_grid;
 	Polygon2D			polygon;
 	bool				poly_needsupdate;
 	long				geometry_updated;
@@ -63,6 +93,8 @@ private:
 	plane_t				plane_ceiling;
 
 	void		setGeometryUpdated();
+	void		buildLineGrid();
+	MapLine*	nearestLine(fpoint2_t point);
 
 public:
 	MapSector(SLADEMap* parent = NULL);
@@ -107,7 +139,7 @@ public:
 	void	setPlane(plane_t plane);
 
 	fpoint2_t			getPoint(uint8_t point);
-	void				resetBBox() { bbox.reset(); }
+	void				resetBBox();
 	bbox_t				boundingBox();
 	vector<MapSide*>&	connectedSides() { return connected_sides; }
 	void				resetPolygon() { poly_needsupdate = true; }
@@ -127,6 +159,7 @@ public:
 	void	disconnectSide(MapSide* side);
 
 	void	updateBBox();
+	void	updateLineGrid();
 
 	void	writeBackup(mobj_backup_t* backup);
 	void	readBackup(mobj_backup_t* backup);
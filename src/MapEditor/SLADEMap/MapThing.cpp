@@ -29,6 +29,7 @@
  *******************************************************************/
 #include "Main.h"
 #include "MapThing.h"
+#include "SLADEMap.h"
 #include "MainApp.h"
 
 
@@ -125,10 +126,17 @@ void MapThing::setIntProperty(string key, int value)
 
 	if (key == "type")
 		type = value;
-	else if (key == "x")
-		x = value;
-	else if (key == "y")
-		y = value;
+	else if (key == "x" || key == "y")
+	{
+		if (key == "x")
+			x = value;
+		else
+			y = value;
+
+		// Position changed, update blockmap
+		if (parent_map)
+			parent_map->updateBlockmap(this);
+	}
 	else if (key == "angle")
 		angle = value;
 	else
@@ -149,6 +157,10 @@ void MapThing::setFloatProperty(string key, double value)
 		y = value;
 	else
 		return MapObject::setFloatProperty(key, value);
+
+	// Position changed, update blockmap
+	if (parent_map)
+		parent_map->updateBlockmap(this);
 }
 
 /* MapThing::copy
@@ -166,6 +178,8 @@ void MapThing::copy(MapObject* c)
 	this->y = thing->y;
 	this->type = thing->type;
 	this->angle = thing->angle;
+	if (parent_map)
+		parent_map->updateBlockmap(this);
 
 	// Other properties
 	MapObject::copy(c);
@@ -232,6 +246,8 @@ void MapThing::readBackup(mobj_backup_t* backup)
 	// Position
 	x = backup->props_internal["x"].getFloatValue();
 	y = backup->props_internal["y"].getFloatValue();
+	if (parent_map)
+		parent_map->updateBlockmap(this);
 
 	// Angle
 	angle = backup->props_internal["angle"].getIntValue();
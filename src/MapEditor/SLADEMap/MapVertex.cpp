@@ -30,6 +30,7 @@
 #include "Main.h"
 #include "MapVertex.h"
 #include "MapLine.h"
+#include "SLADEMap.h"
 #include "MainApp.h"
 
 
@@ -130,6 +131,10 @@ void MapVertex::setIntProperty(string key, int value)
 	}
 	else
 		return MapObject::setIntProperty(key, value);
+
+	// Position changed, update blockmap
+	if (parent_map)
+		parent_map->updateBlockmap(this);
 }
 
 /* MapVertex::setFloatProperty
@@ -146,6 +151,10 @@ void MapVertex::setFloatProperty(string key, double value)
 		y = value;
 	else
 		return MapObject::setFloatProperty(key, value);
+
+	// Position changed, update blockmap
+	if (parent_map)
+		parent_map->updateBlockmap(this);
 }
 
 /* MapVertex::connectLine
@@ -200,4 +209,8 @@ void MapVertex::readBackup(mobj_backup_t* backup)
 	// Position
 	x = backup->props_internal["x"].getFloatValue();
 	y = backup->props_internal["y"].getFloatValue();
+
+	// Update blockmap
+	if (parent_map)
+		parent_map->updateBlockmap(this);
 }
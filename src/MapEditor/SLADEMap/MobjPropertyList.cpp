@@ -6,7 +6,8 @@
  * Web:         http://slade.mancubus.net
  * Filename:    MobjPropertyList.cpp
  * Description: A special version of the PropertyList class that
- *              uses a vector rather than a map to store properties
+ *              uses a vector rather than a map to store properties,
+ *              and global integer keys rather than property names
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License
@@ -29,6 +30,142 @@
  *******************************************************************/
 #include "Main.h"
 #include "MobjPropertyList.h"
+#include <wx/thread.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+#define KEY_BLOCK_SIZE	1024
+#define KEY_MAX_BLOCKS	4096
+
+// Key names are kept in fixed-size blocks so they never move once
+// added, and can be read by key without locking (block pointers are
+// published with mobjStoreRelease and read with mobjLoadAcquire)
+string*			mobj_key_blocks[KEY_MAX_BLOCKS];
+unsigned		mobj_n_keys = 0;
+wxMutex			mobj_key_mutex;
+string			mobj_key_invalid;
+
+// Open-addressed hash table from name to key (+1, 0 is an empty slot),
+// also read without locking. Slots are only ever set once, and when
+// the table gets half full it is replaced by a larger copy (old tables
+// are never freed, since they may still be being read). Slots and the
+// table pointer are also published/read with release/acquire ordering
+struct mobj_key_table_t
+{
+	unsigned	size;	// Always a power of 2
+	unsigned*	slots;
+};
+mobj_key_table_t*	mobj_key_table = NULL;
+
+
+/*******************************************************************
+ * MOBJPROPERTYLIST KEY TABLE FUNCTIONS
+ *******************************************************************/
+
+/* mobjLoadAcquire
+ * Returns the value at [ptr], with acquire ordering (anything written
+ * before the value was stored by mobjStoreRelease is visible after)
+ *******************************************************************/
+unsigned mobjLoadAcquire(unsigned* ptr)
+{
+#ifdef _MSC_VER
+	return (unsigned)_InterlockedCompareExchange((long volatile*)ptr, 0, 0);
+#else
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+template<typename T> T* mobjLoadAcquire(T** ptr)
+{
+#ifdef _MSC_VER
+	return (T*)_InterlockedCompareExchangePointer((void* volatile*)ptr, NULL, NULL);
+#else
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/* mobjStoreRelease
+ * Sets the value at [ptr] to [value], with release ordering (anything
+ * written before is visible to a thread reading [value] with
+ * mobjLoadAcquire)
+ *******************************************************************/
+void mobjStoreRelease(unsigned* ptr, unsigned value)
+{
+#ifdef _MSC_VER
+	_InterlockedExchange((long volatile*)ptr, (long)value);
+#else
+	__atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif
+}
+template<typename T> void mobjStoreRelease(T** ptr, T* value)
+{
+#ifdef _MSC_VER
+	_InterlockedExchangePointer((void* volatile*)ptr, value);
+#else
+	__atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/* mobjKeyHash
+ * Returns the hash of property name [key]
+ *******************************************************************/
+unsigned mobjKeyHash(const string& key)
+{
+	// FNV-1a
+	unsigned hash = 2166136261U;
+	for (string::const_iterator i = key.begin(); i != key.end(); ++i)
+		hash = (hash ^ (unsigned)(wchar_t)*i) * 16777619U;
+
+	return hash;
+}
+
+/* mobjKeyTableInsert
+ * Sets the first free slot for [key] in [table]. The name of [key]
+ * must already be in the key blocks
+ *******************************************************************/
+void mobjKeyTableInsert(mobj_key_table_t* table, unsigned key)
+{
+	unsigned mask = table->size - 1;
+	unsigned slot = mobjKeyHash(MobjPropertyList::keyName(key)) & mask;
+	while (mobjLoadAcquire(&table->slots[slot]) != 0)
+		slot = (slot + 1) & mask;
+
+	mobjStoreRelease(&table->slots[slot], key + 1);
+}
+
+/* mobjKeyTableAdd
+ * Adds [key] (the most recently added key) to the lookup table,
+ * making it visible to MobjPropertyList::findKey. Must be called with
+ * mobj_key_mutex locked
+ *******************************************************************/
+void mobjKeyTableAdd(unsigned key)
+{
+	mobj_key_table_t* table = mobj_key_table;
+
+	// Room in the current table (the key name is visible to any thread
+	// that reads the slot, since the slot is stored with release ordering)
+	if (table && (key + 1) * 2 <= table->size)
+	{
+		mobjKeyTableInsert(table, key);
+		return;
+	}
+
+	// Otherwise build a larger table with all keys
+	mobj_key_table_t* ntable = new mobj_key_table_t();
+	ntable->size = table ? table->size * 2 : 256;
+	ntable->slots = new unsigned[ntable->size];
+	for (unsigned a = 0; a < ntable->size; a++)
+		ntable->slots[a] = 0;
+	for (unsigned a = 0; a <= key; a++)
+		mobjKeyTableInsert(ntable, a);
+
+	// Publish it once it is complete
+	mobjStoreRelease(&mobj_key_table, ntable);
+}
 
 
 /*******************************************************************
@@ -49,31 +186,55 @@ MobjPropertyList::~MobjPropertyList()
 {
 }
 
-/* MobjPropertyList::propertyExists
- * Returns true if a property with the given name exists, false
- * otherwise
+/* MobjPropertyList::getProperty
+ * Returns the property with [key], or NULL if it doesn't exist.
+ * Unlike operator[], this never adds a property to the list
  *******************************************************************/
-bool MobjPropertyList::propertyExists(string key)
+Property* MobjPropertyList::getProperty(unsigned key)
 {
 	for (unsigned a = 0; a < properties.size(); ++a)
 	{
-		if (properties[a].name == key)
-			return true;
+		if (properties[a].key == key)
+			return &properties[a].value;
 	}
 
-	return false;
+	return NULL;
+}
+
+/* MobjPropertyList::getProperty
+ * Returns the property named [key], or NULL if it doesn't exist
+ *******************************************************************/
+Property* MobjPropertyList::getProperty(const string& key)
+{
+	int id = findKey(key);
+	if (id < 0)
+		return NULL;
+
+	return getProperty((unsigned)id);
+}
+
+/* MobjPropertyList::propertyExists
+ * Returns true if a property with the given name exists, false
+ * otherwise
+ *******************************************************************/
+bool MobjPropertyList::propertyExists(const string& key)
+{
+	return getProperty(key) != NULL;
 }
 
 /* MobjPropertyList::removeProperty
  * Removes a property value, returns true if [key] was removed
  * or false if key didn't exist
  *******************************************************************/
-bool MobjPropertyList::removeProperty(string key)
+bool MobjPropertyList::removeProperty(const string& key)
 {
-	//return properties.erase(key) > 0;
+	int id = findKey(key);
+	if (id < 0)
+		return false;
+
 	for (unsigned a = 0; a < properties.size(); ++a)
 	{
-		if (properties[a].name == key)
+		if (properties[a].key == (unsigned)id)
 		{
 			properties[a] = properties.back();
 			properties.pop_back();
@@ -89,20 +250,17 @@ bool MobjPropertyList::removeProperty(string key)
  *******************************************************************/
 void MobjPropertyList::copyTo(MobjPropertyList& list)
 {
-	// Clear given list
-	list.clear();
-
-	for (unsigned a = 0; a < properties.size(); ++a)
-		list.properties.push_back(prop_t(properties[a].name, properties[a].value));
+	// Keys are shared, so this is just a copy of the (key, value) list
+	list.properties = properties;
 }
 
 /* MobjPropertyList::addFlag
  * Adds a 'flag' property [key]
  *******************************************************************/
-void MobjPropertyList::addFlag(string key)
+void MobjPropertyList::addFlag(const string& key)
 {
 	Property flag;
-	properties.push_back(prop_t(key, flag));
+	properties.push_back(prop_t(internKey(key), flag));
 }
 
 /* MobjPropertyList::toString
@@ -120,17 +278,98 @@ string MobjPropertyList::toString(bool condensed)
 			continue;
 
 		// Add "key = value;\n" to the return string
-		string key = properties[a].name;
+		const string& key = keyName(properties[a].key);
 		string val = properties[a].value.getStringValue();
 
 		if (properties[a].value.getType() == PROP_STRING)
 			val = "\"" + val + "\"";
 
-		if (condensed)
-			ret += key + "=" + val + ";\n";
-		else
-			ret += key + " = " + val + ";\n";
+		ret += key;
+		ret += condensed ? "=" : " = ";
+		ret += val;
+		ret += ";\n";
 	}
 
 	return ret;
 }
+
+/* MobjPropertyList::internKey
+ * Returns the key for the property name [key], adding it to the key
+ * table if it isn't there already
+ *******************************************************************/
+unsigned MobjPropertyList::internKey(const string& key)
+{
+	// Check if it already exists (without locking)
+	int id = findKey(key);
+	if (id >= 0)
+		return id;
+
+	wxMutexLocker lock(mobj_key_mutex);
+
+	// Check again now locked, in case another thread just added it
+	id = findKey(key);
+	if (id >= 0)
+		return id;
+
+	// Table full (shouldn't ever happen)
+	if (mobj_n_keys >= KEY_BLOCK_SIZE * KEY_MAX_BLOCKS)
+	{
+		wxLogMessage("Error: Too many map object property names, can't add \"%s\"", key);
+		return 0;
+	}
+
+	// Add to table
+	unsigned block = mobj_n_keys / KEY_BLOCK_SIZE;
+	if (!mobj_key_blocks[block])
+		mobjStoreRelease(&mobj_key_blocks[block], new string[KEY_BLOCK_SIZE]);
+	mobj_key_blocks[block][mobj_n_keys % KEY_BLOCK_SIZE] = key;
+	mobjKeyTableAdd(mobj_n_keys);
+
+	return mobj_n_keys++;
+}
+
+/* MobjPropertyList::findKey
+ * Returns the key for the property name [key], or -1 if no property
+ * with that name has been added to any list. Doesn't lock, so this
+ * can be called from multiple threads without contention
+ *******************************************************************/
+int MobjPropertyList::findKey(const string& key)
+{
+	mobj_key_table_t* table = mobjLoadAcquire(&mobj_key_table);
+	if (!table)
+		return -1;
+
+	unsigned mask = table->size - 1;
+	for (unsigned slot = mobjKeyHash(key) & mask;; slot = (slot + 1) & mask)
+	{
+		unsigned value = mobjLoadAcquire(&table->slots[slot]);
+		if (value == 0)
+			return -1;
+		if (keyName(value - 1) == key)
+			return value - 1;
+	}
+}
+
+/* MobjPropertyList::keyName
+ * Returns the property name for [key]
+ *******************************************************************/
+const string& MobjPropertyList::keyName(unsigned key)
+{
+	if (key >= KEY_BLOCK_SIZE * KEY_MAX_BLOCKS)
+		return mobj_key_invalid;
+
+	string* block = mobjLoadAcquire(&mobj_key_blocks[key / KEY_BLOCK_SIZE]);
+	if (!block)
+		return mobj_key_invalid;
+
+	return block[key % KEY_BLOCK_SIZE];
+}
+
+/* MobjPropertyList::nKeys
+ * Returns the number of property names in the key table
+ *******************************************************************/
+unsigned MobjPropertyList::nKeys()
+{
+	wxMutexLocker lock(mobj_key_mutex);
+	return mobj_n_keys;
+}
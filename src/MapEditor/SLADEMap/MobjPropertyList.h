@@ -1,4 +1,3 @@
-
 #ifndef __MOBJ_PROPERTY_LIST_H__
 #define __MOBJ_PROPERTY_LIST_H__
 
@@ -7,46 +6,55 @@
 class MobjPropertyList
 {
 public:
+	// Property names are interned in a global table, each property
+	// only stores the index of its name ('key') in the table
 	struct prop_t
 	{
-		string		name;
+		unsigned	key;
 		Property	value;
 
-		prop_t(string name) { this->name = name; }
-		prop_t(string name, Property value)
-		{
-			this->name = name;
-			this->value = value;
-		}
+		prop_t(unsigned key) { this->key = key; }
+		prop_t(unsigned key, const Property& value) : key(key), value(value) {}
+
+		const string&	name() const { return MobjPropertyList::keyName(key); }
 	};
 
 	MobjPropertyList();
 	~MobjPropertyList();
 
-	// Operator for direct access to hash map
-	Property& operator[](string key)
+	// Operators for direct access to properties (adds the property if it doesn't exist)
+	Property& operator[](unsigned key)
 	{
 		for (unsigned a = 0; a < properties.size(); ++a)
 		{
-			if (properties[a].name == key)
+			if (properties[a].key == key)
 				return properties[a].value;
 		}
 
 		properties.push_back(prop_t(key));
 		return properties.back().value;
 	}
+	Property& operator[](const string& key) { return operator[](internKey(key)); }
 
 	vector<prop_t>&	allProperties() { return properties; }
 
-	void	clear() { properties.clear(); }
-	bool	propertyExists(string key);
-	bool	removeProperty(string key);
-	void	copyTo(MobjPropertyList& list);
-	void	addFlag(string key);
-	bool	isEmpty() { return properties.empty(); }
+	void		clear() { properties.clear(); }
+	Property*	getProperty(unsigned key);
+	Property*	getProperty(const string& key);
+	bool		propertyExists(const string& key);
+	bool		removeProperty(const string& key);
+	void		copyTo(MobjPropertyList& list);
+	void		addFlag(const string& key);
+	bool		isEmpty() { return properties.empty(); }
 
 	string	toString(bool condensed = false);
 
+	// Key table
+	static unsigned			internKey(const string& key);
+	static int				findKey(const string& key);
+	static const string&	keyName(unsigned key);
+	static unsigned			nKeys();
+
 private:
 	vector<prop_t>	properties;
 };
@@ -30,6 +30,7 @@
 #include "Main.h"
 #include "SLADEMap.h"
 #include "Utility/Parser.h"
+#include "UDMFReader.h"
 #include "Utility/MathStuff.h"
 #include "General/ResourceManager.h"
 #include "MapEditor/GameConfiguration/GameConfiguration.h"
@@ -39,12 +40,171 @@
 #include "General/UndoRedo.h"
 #include "MapEditor/SectorBuilder.h"
 #include "UI/SplashWindow.h"
+#include "General/Console/Console.h"
+#include "Utility/ParallelJob.h"
 #include <locale.h>
 #include <wx/colour.h>
 
 #define IDEQ(x) (((x) != 0) && ((x) == id))
 
 
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+CVAR(Int, map_udmf_write_threads, 0, CVAR_SAVE)	// 0 = one per CPU
+
+
+/*******************************************************************
+ * SLADEMAP HELPER FUNCTIONS
+ *******************************************************************/
+
+/* udmfWriteUInt
+ * Appends [value] as decimal text to [out]
+ *******************************************************************/
+void udmfWriteUInt(std::string& out, uint64_t value)
+{
+	char buf[24];
+	unsigned pos = sizeof(buf);
+	do
+	{
+		buf[--pos] = '0' + (value % 10);
+		value /= 10;
+	}
+	while (value > 0);
+
+	out.append(buf + pos, sizeof(buf) - pos);
+}
+
+/* udmfWriteInt
+ * Appends [value] as decimal text to [out] (same as %d)
+ *******************************************************************/
+void udmfWriteInt(std::string& out, int value)
+{
+	if (value < 0)
+	{
+		out += '-';
+		udmfWriteUInt(out, (uint64_t)(-(int64_t)value));
+	}
+	else
+		udmfWriteUInt(out, value);
+}
+
+/* udmfWriteFloat
+ * Appends [value] to [out] with [decimals] decimal places (0-6),
+ * giving exactly the same text as %.<decimals>f in the C locale.
+ * Values that can't be rounded exactly this way (very large, or too
+ * close to halfway between two results) are formatted with snprintf
+ *******************************************************************/
+void udmfWriteFloat(std::string& out, double value, int decimals)
+{
+	static const uint64_t scales[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+	uint64_t scale = scales[decimals];
+
+	// The error in the scaled value is at most ~1e-7 below 1e9, so it
+	// rounds the same as the exact value unless it's within 1e-6 of .5
+	double scaled = fabs(value) * scale;
+	if (scaled < 1e9)
+	{
+		double whole = floor(scaled);
+		double frac = scaled - whole;
+		if (fabs(frac - 0.5) > 1e-6)
+		{
+			uint64_t n = (uint64_t)whole + (frac > 0.5 ? 1 : 0);
+
+			// Sign (printf keeps it for negative values that round to 0)
+			uint64_t bits;
+			memcpy(&bits, &value, 8);
+			if (bits >> 63)
+				out += '-';
+
+			udmfWriteUInt(out, n / scale);
+			if (decimals > 0)
+			{
+				char buf[8];
+				uint64_t f = n % scale;
+				for (int a = decimals - 1; a >= 0; a--)
+				{
+					buf[a] = '0' + (f % 10);
+					f /= 10;
+				}
+				out += '.';
+				out.append(buf, decimals);
+			}
+			return;
+		}
+	}
+
+	char buf[512];
+	snprintf(buf, 512, "%.*f", decimals, value);
+	out += buf;
+}
+
+/* udmfWriteString
+ * Appends [value] to [out] as utf-8
+ *******************************************************************/
+void udmfWriteString(std::string& out, const string& value)
+{
+	wxCharBuffer utf8 = value.ToUTF8();
+	if (utf8.data())
+		out.append(utf8.data(), utf8.length());
+}
+
+
+/*******************************************************************
+ * UDMFWRITEJOB CLASS
+ *******************************************************************
+ * Writes the UDMF definitions of a range of map objects of a single
+ * type to a buffer, for each of a number of ranges in parallel
+ */
+class UDMFWriteJob : public ParallelJob
+{
+public:
+	struct range_t
+	{
+		uint8_t		type;
+		unsigned	start;
+		unsigned	end;
+	};
+
+	SLADEMap*			map;
+	vector<range_t>		ranges;
+	vector<std::string>	output;
+
+	UDMFWriteJob(SLADEMap* map)
+	{
+		this->map = map;
+	}
+
+	// Splits [count] objects of [type] into ranges
+	void add(uint8_t type, unsigned count)
+	{
+		for (unsigned a = 0; a < count; a += 1024)
+		{
+			range_t range;
+			range.type = type;
+			range.start = a;
+			range.end = MIN(a + 1024, count);
+			ranges.push_back(range);
+		}
+	}
+
+	void process(unsigned index)
+	{
+		range_t& range = ranges[index];
+		std::string& out = output[index];
+		out.reserve((range.end - range.start) * 128);
+		for (unsigned a = range.start; a < range.end; a++)
+			map->writeUDMFObject(range.type, a, out);
+	}
+
+	void run(unsigned threads)
+	{
+		output.resize(ranges.size());
+		ParallelJob::run(ranges.size(), threads, 1);
+	}
+};
+
+
 /*******************************************************************
  * SLADEMAP CLASS FUNCTIONS
  *******************************************************************/
@@ -57,6 +217,8 @@ SLADEMap::SLADEMap()
 	// Init variables
 	this->geometry_updated = 0;
 	this->position_frac = false;
+	this->blockmap_rebuild = true;
+	this->record_created_deleted = false;
 
 	// Object id 0 is always null
 	all_objects.push_back(mobj_holder_t(NULL, false));
@@ -202,7 +364,8 @@ void SLADEMap::addMapObject(MapObject* object)
 {
 	all_objects.push_back(mobj_holder_t(object, true));
 	object->id = all_objects.size() - 1;
-	created_deleted_objects.push_back(mobj_cd_t(object->id, true));
+	if (record_created_deleted)
+		created_deleted_objects.push_back(mobj_cd_t(object->id, true, object->type));
 }
 
 /* SLADEMap::removeMapObject
@@ -212,7 +375,204 @@ void SLADEMap::addMapObject(MapObject* object)
 void SLADEMap::removeMapObject(MapObject* object)
 {
 	all_objects[object->id].in_map = false;
-	created_deleted_objects.push_back(mobj_cd_t(object->id, false));
+	if (record_created_deleted)
+		created_deleted_objects.push_back(mobj_cd_t(object->id, false, object->type, object->index));
+}
+
+/* SLADEMap::recordCreatedDeleted
+ * Starts (or stops if [record] is false) recording objects created
+ * and deleted, for undo/redo. Clears any previously recorded objects
+ *******************************************************************/
+void SLADEMap::recordCreatedDeleted(bool record)
+{
+	record_created_deleted = record;
+	created_deleted_objects.clear();
+}
+
+/* SLADEMap::getCreatedDeleted
+ * Adds all objects created/deleted since recording began to [list],
+ * in the order they were created/deleted. Objects that were created
+ * but never actually added to the map are left out
+ *******************************************************************/
+void SLADEMap::getCreatedDeleted(vector<mobj_cd_t>& list)
+{
+	for (unsigned a = 0; a < created_deleted_objects.size(); a++)
+	{
+		mobj_cd_t& cd = created_deleted_objects[a];
+		if (cd.created)
+		{
+			// Check the object is in the map now, or was deleted later
+			// (objects are only deleted from the map's object lists)
+			MapObject* object = all_objects[cd.id].mobj;
+			bool added = (getObject(cd.type, object->index) == object);
+			for (unsigned b = a + 1; b < created_deleted_objects.size() && !added; b++)
+			{
+				if (created_deleted_objects[b].id == cd.id && !created_deleted_objects[b].created)
+					added = true;
+			}
+
+			if (!added)
+				continue;
+		}
+
+		list.push_back(cd);
+	}
+}
+
+/* SLADEMap::undoCreatedDeleted
+ * Reverts the object creations/deletions in [list] (from
+ * getCreatedDeleted), so each object list is exactly as it was before
+ * they happened
+ *******************************************************************/
+void SLADEMap::undoCreatedDeleted(vector<mobj_cd_t>& list)
+{
+	for (int a = (int)list.size() - 1; a >= 0; a--)
+		applyCreatedDeleted(list[a], true);
+
+	// Object lists changed outside of the create/remove functions
+	blockmap_rebuild = true;
+	geometry_updated = theApp->runTimer();
+	things_updated = theApp->runTimer();
+}
+
+/* SLADEMap::redoCreatedDeleted
+ * Re-applies the object creations/deletions in [list] (from
+ * getCreatedDeleted) after they were undone
+ *******************************************************************/
+void SLADEMap::redoCreatedDeleted(vector<mobj_cd_t>& list)
+{
+	for (unsigned a = 0; a < list.size(); a++)
+		applyCreatedDeleted(list[a], false);
+
+	blockmap_rebuild = true;
+	geometry_updated = theApp->runTimer();
+	things_updated = theApp->runTimer();
+}
+
+/* SLADEMap::applyCreatedDeleted
+ * Undoes or redoes (depending on [undo]) the object creation or
+ * deletion [cd]
+ *******************************************************************/
+void SLADEMap::applyCreatedDeleted(mobj_cd_t& cd, bool undo)
+{
+	if (cd.id >= all_objects.size() || !all_objects[cd.id].mobj)
+		return;
+
+	// Update 'in map' flag
+	all_objects[cd.id].in_map = (cd.created != undo);
+
+	// Update object list
+	switch (cd.type)
+	{
+	case MOBJ_VERTEX:	changeObjectList(vertices, cd, undo); break;
+	case MOBJ_LINE:		changeObjectList(lines, cd, undo); break;
+	case MOBJ_SIDE:		changeObjectList(sides, cd, undo); break;
+	case MOBJ_SECTOR:	changeObjectList(sectors, cd, undo); break;
+	case MOBJ_THING:	changeObjectList(things, cd, undo); break;
+	default: break;
+	}
+}
+
+/* SLADEMap::changeObjectList
+ * Adds/removes the object from [cd] to/from [list], the reverse of
+ * what happened when it was created/deleted if [undo] is true.
+ * Objects are created at the end of a list, and deleted by moving the
+ * last object into their place, so when undone/redone in order the
+ * lists end up in exactly the same order as they were
+ *******************************************************************/
+template<class T> void SLADEMap::changeObjectList(vector<T*>& list, mobj_cd_t& cd, bool undo)
+{
+	T* object = (T*)all_objects[cd.id].mobj;
+
+	// Add the object to the end of the list
+	if (cd.created != undo)
+	{
+		if (cd.created || cd.index >= list.size())
+		{
+			object->index = list.size();
+			list.push_back(object);
+		}
+
+		// Deleted from the middle of the list, move the object that
+		// replaced it back to the end
+		else
+		{
+			list.push_back(list[cd.index]);
+			list.back()->index = list.size() - 1;
+			list[cd.index] = object;
+			object->index = cd.index;
+		}
+
+		return;
+	}
+
+	// Remove the object
+	unsigned index = object->index;
+	if (index >= list.size() || list[index] != object)
+		return;
+
+	if (cd.created && index != list.size() - 1)
+	{
+		// Created objects should be last when undone in order, but just
+		// in case keep the order of everything else
+		list.erase(list.begin() + index);
+		for (unsigned a = index; a < list.size(); a++)
+			list[a]->index = a;
+	}
+	else
+	{
+		list[index] = list.back();
+		list[index]->index = index;
+		list.pop_back();
+	}
+}
+
+/* SLADEMap::updateBlockmap
+ * Flags [object] as moved or reshaped, so it is re-linked in the
+ * blockmap before the next geometry query. Should be called whenever
+ * a vertex/thing position, line vertex or sector bbox changes
+ *******************************************************************/
+void SLADEMap::updateBlockmap(MapObject* object)
+{
+	blockmap.updateObject(object);
+
+	// Lines connected to a vertex move with it
+	if (object->getObjType() == MOBJ_VERTEX)
+	{
+		MapVertex* vertex = (MapVertex*)object;
+		for (unsigned a = 0; a < vertex->connected_lines.size(); a++)
+			blockmap.updateObject(vertex->connected_lines[a]);
+	}
+}
+
+/* SLADEMap::refreshBlockmap
+ * Brings the blockmap up to date with the map. It is rebuilt fully if
+ * map objects were added outside of the create* functions (eg. when
+ * reading the map or restoring an undo state), otherwise only objects
+ * flagged as changed are re-linked
+ *******************************************************************/
+void SLADEMap::refreshBlockmap()
+{
+	if (blockmap_rebuild ||
+		blockmap.nIndexed(MOBJ_VERTEX) != vertices.size() ||
+		blockmap.nIndexed(MOBJ_LINE) != lines.size() ||
+		blockmap.nIndexed(MOBJ_SECTOR) != sectors.size() ||
+		blockmap.nIndexed(MOBJ_THING) != things.size())
+	{
+		blockmap.clear();
+		for (unsigned a = 0; a < vertices.size(); a++)
+			blockmap.addObject(vertices[a]);
+		for (unsigned a = 0; a < lines.size(); a++)
+			blockmap.addObject(lines[a]);
+		for (unsigned a = 0; a < sectors.size(); a++)
+			blockmap.addObject(sectors[a]);
+		for (unsigned a = 0; a < things.size(); a++)
+			blockmap.addObject(things[a]);
+
+		blockmap_rebuild = false;
+	}
+
+	blockmap.processPending();
 }
 
 /* SLADEMap::getObjectIdList
@@ -253,6 +613,9 @@ void SLADEMap::getObjectIdList(uint8_t type, vector<unsigned>& list)
  *******************************************************************/
 void SLADEMap::restoreObjectIdList(uint8_t type, vector<unsigned>& list)
 {
+	// Object lists are replaced outright, so rebuild the blockmap later
+	blockmap_rebuild = true;
+
 	if (type == MOBJ_VERTEX)
 	{
 		// Clear
@@ -1561,13 +1924,252 @@ bool SLADEMap::addLine(ParseTreeNode* def)
 bool SLADEMap::addSector(ParseTreeNode* def)
 {
 	// Check for required properties
-	ParseTreeNode* prop_ftex = (ParseTreeNode*)def->getChild("texturefloor");
-	ParseTreeNode* prop_ctex = (ParseTreeNode*)def->getChild("textureceiling");
-	if (!prop_ftex || !prop_ctex)
+	ParseTreeNode* prop_ftex = (ParseTreeNode*)def->getChild("texturefloor");
+	ParseTreeNode* prop_ctex = (ParseTreeNode*)def->getChild("textureceiling");
+	if (!prop_ftex || !prop_ctex)
+		return false;
+
+	// Create new sector
+	MapSector* ns = new MapSector(prop_ftex->getStringValue(), prop_ctex->getStringValue(), this);
+	usage_flat[ns->f_tex.Upper()] += 1;
+	usage_flat[ns->c_tex.Upper()] += 1;
+
+	// Set defaults
+	ns->setFloorHeight(0);
+	ns->setCeilingHeight(0);
+	ns->light = 160;
+	ns->special = 0;
+	ns->tag = 0;
+
+	// Add extra sector info
+	ParseTreeNode* prop = NULL;
+	for (unsigned a = 0; a < def->nChildren(); a++)
+	{
+		prop = (ParseTreeNode*)def->getChild(a);
+
+		// Skip required properties
+		if (prop == prop_ftex || prop == prop_ctex)
+			continue;
+
+		if (S_CMPNOCASE(prop->getName(), "heightfloor"))
+			ns->setFloorHeight(prop->getIntValue());
+		else if (S_CMPNOCASE(prop->getName(), "heightceiling"))
+			ns->setCeilingHeight(prop->getIntValue());
+		else if (S_CMPNOCASE(prop->getName(), "lightlevel"))
+			ns->light = prop->getIntValue();
+		else if (S_CMPNOCASE(prop->getName(), "special"))
+			ns->special = prop->getIntValue();
+		else if (S_CMPNOCASE(prop->getName(), "id"))
+			ns->tag = prop->getIntValue();
+		else
+			ns->properties[prop->getName()] = prop->getValue();
+	}
+
+	// Add sector to map
+	sectors.push_back(ns);
+
+	return true;
+}
+
+/* SLADEMap::addThing
+ * Adds a thing to the map from parsed UDMF thing definition [def]
+ *******************************************************************/
+bool SLADEMap::addThing(ParseTreeNode* def)
+{
+	// Check for required properties
+	ParseTreeNode* prop_x = (ParseTreeNode*)def->getChild("x");
+	ParseTreeNode* prop_y = (ParseTreeNode*)def->getChild("y");
+	ParseTreeNode* prop_type = (ParseTreeNode*)def->getChild("type");
+	if (!prop_x || !prop_y || !prop_type)
+		return false;
+
+	// Create new thing
+	MapThing* nt = new MapThing(prop_x->getFloatValue(), prop_y->getFloatValue(), prop_type->getIntValue(), this);
+
+	// Add extra thing info
+	ParseTreeNode* prop = NULL;
+	for (unsigned a = 0; a < def->nChildren(); a++)
+	{
+		prop = (ParseTreeNode*)def->getChild(a);
+
+		// Skip required properties
+		if (prop == prop_x || prop == prop_y || prop == prop_type)
+			continue;
+
+		// Builtin properties
+		if (S_CMPNOCASE(prop->getName(), "angle"))
+			nt->angle = prop->getIntValue();
+		else
+			nt->properties[prop->getName()] = prop->getValue();
+	}
+
+	// Add thing to map
+	things.push_back(nt);
+
+	return true;
+}
+
+/* SLADEMap::addVertex
+ * Adds a vertex to the map from UDMF vertex block [index] in [udmf]
+ *******************************************************************/
+bool SLADEMap::addVertex(UDMFReader& udmf, unsigned index)
+{
+	UDMFReader::udmf_block_t& block = udmf.getBlock(UDMFReader::KEY_VERTEX, index);
+
+	// Check for required properties
+	int prop_x = udmf.findProp(block, UDMFReader::KEY_X);
+	int prop_y = udmf.findProp(block, UDMFReader::KEY_Y);
+	if (prop_x < 0 || prop_y < 0)
+		return false;
+
+	// Create new vertex
+	MapVertex* nv = new MapVertex(udmf.getFloatValue(udmf.getProp(prop_x)), udmf.getFloatValue(udmf.getProp(prop_y)), this);
+
+	// Add extra vertex info
+	for (unsigned a = block.first; a < block.first + block.count; a++)
+	{
+		// Skip required properties
+		if ((int)a == prop_x || (int)a == prop_y)
+			continue;
+
+		UDMFReader::udmf_prop_t& prop = udmf.getProp(a);
+		nv->properties[udmf.propertyKey(prop.key)] = udmf.getValue(prop);
+	}
+
+	// Add vertex to map
+	vertices.push_back(nv);
+
+	return true;
+}
+
+/* SLADEMap::addSide
+ * Adds a side to the map from UDMF sidedef block [index] in [udmf]
+ *******************************************************************/
+bool SLADEMap::addSide(UDMFReader& udmf, unsigned index)
+{
+	UDMFReader::udmf_block_t& block = udmf.getBlock(UDMFReader::KEY_SIDEDEF, index);
+
+	// Check for required properties
+	int prop_sector = udmf.findProp(block, UDMFReader::KEY_SECTOR);
+	if (prop_sector < 0)
+		return false;
+
+	// Check sector index
+	int sector = udmf.getIntValue(udmf.getProp(prop_sector));
+	if (sector < 0 || sector >= (int)sectors.size())
+		return false;
+
+	// Create new side
+	MapSide* ns = new MapSide(sectors[sector], this);
+
+	// Set defaults
+	ns->offset_x = 0;
+	ns->offset_y = 0;
+	ns->tex_upper = "-";
+	ns->tex_middle = "-";
+	ns->tex_lower = "-";
+
+	// Add extra side info
+	for (unsigned a = block.first; a < block.first + block.count; a++)
+	{
+		// Skip required properties
+		if ((int)a == prop_sector)
+			continue;
+
+		UDMFReader::udmf_prop_t& prop = udmf.getProp(a);
+		switch (prop.ikey)
+		{
+		case UDMFReader::KEY_TEXTURETOP:	ns->tex_upper = udmf.getStringValue(prop); break;
+		case UDMFReader::KEY_TEXTUREMIDDLE:	ns->tex_middle = udmf.getStringValue(prop); break;
+		case UDMFReader::KEY_TEXTUREBOTTOM:	ns->tex_lower = udmf.getStringValue(prop); break;
+		case UDMFReader::KEY_OFFSETX:		ns->offset_x = udmf.getIntValue(prop); break;
+		case UDMFReader::KEY_OFFSETY:		ns->offset_y = udmf.getIntValue(prop); break;
+		default:							ns->properties[udmf.propertyKey(prop.key)] = udmf.getValue(prop); break;
+		}
+	}
+
+	// Update texture counts
+	usage_tex[ns->tex_upper.Upper()] += 1;
+	usage_tex[ns->tex_middle.Upper()] += 1;
+	usage_tex[ns->tex_lower.Upper()] += 1;
+
+	// Add side to map
+	sides.push_back(ns);
+
+	return true;
+}
+
+/* SLADEMap::addLine
+ * Adds a line to the map from UDMF linedef block [index] in [udmf]
+ *******************************************************************/
+bool SLADEMap::addLine(UDMFReader& udmf, unsigned index)
+{
+	UDMFReader::udmf_block_t& block = udmf.getBlock(UDMFReader::KEY_LINEDEF, index);
+
+	// Check for required properties
+	int prop_v1 = udmf.findProp(block, UDMFReader::KEY_V1);
+	int prop_v2 = udmf.findProp(block, UDMFReader::KEY_V2);
+	int prop_s1 = udmf.findProp(block, UDMFReader::KEY_SIDEFRONT);
+	if (prop_v1 < 0 || prop_v2 < 0 || prop_s1 < 0)
+		return false;
+
+	// Check indices
+	int v1 = udmf.getIntValue(udmf.getProp(prop_v1));
+	int v2 = udmf.getIntValue(udmf.getProp(prop_v2));
+	int s1 = udmf.getIntValue(udmf.getProp(prop_s1));
+	if (v1 < 0 || v1 >= (int)vertices.size())
+		return false;
+	if (v2 < 0 || v2 >= (int)vertices.size())
+		return false;
+	if (s1 < 0 || s1 >= (int)sides.size())
+		return false;
+
+	// Get second side if any
+	MapSide* side2 = NULL;
+	int prop_s2 = udmf.findProp(block, UDMFReader::KEY_SIDEBACK);
+	if (prop_s2 >= 0) side2 = getSide(udmf.getIntValue(udmf.getProp(prop_s2)));
+
+	// Create new line
+	MapLine* nl = new MapLine(vertices[v1], vertices[v2], sides[s1], side2, this);
+
+	// Set defaults
+	nl->special = 0;
+
+	// Add extra line info
+	for (unsigned a = block.first; a < block.first + block.count; a++)
+	{
+		// Skip required properties
+		if ((int)a == prop_v1 || (int)a == prop_v2 || (int)a == prop_s1 || (int)a == prop_s2)
+			continue;
+
+		UDMFReader::udmf_prop_t& prop = udmf.getProp(a);
+		if (prop.ikey == UDMFReader::KEY_SPECIAL)
+			nl->special = udmf.getIntValue(prop);
+		else
+			nl->properties[udmf.propertyKey(prop.key)] = udmf.getValue(prop);
+	}
+
+	// Add line to map
+	lines.push_back(nl);
+
+	return true;
+}
+
+/* SLADEMap::addSector
+ * Adds a sector to the map from UDMF sector block [index] in [udmf]
+ *******************************************************************/
+bool SLADEMap::addSector(UDMFReader& udmf, unsigned index)
+{
+	UDMFReader::udmf_block_t& block = udmf.getBlock(UDMFReader::KEY_SECTOR, index);
+
+	// Check for required properties
+	int prop_ftex = udmf.findProp(block, UDMFReader::KEY_TEXTUREFLOOR);
+	int prop_ctex = udmf.findProp(block, UDMFReader::KEY_TEXTURECEILING);
+	if (prop_ftex < 0 || prop_ctex < 0)
 		return false;
 
 	// Create new sector
-	MapSector* ns = new MapSector(prop_ftex->getStringValue(), prop_ctex->getStringValue(), this);
+	MapSector* ns = new MapSector(udmf.getStringValue(udmf.getProp(prop_ftex)), udmf.getStringValue(udmf.getProp(prop_ctex)), this);
 	usage_flat[ns->f_tex.Upper()] += 1;
 	usage_flat[ns->c_tex.Upper()] += 1;
 
@@ -1579,27 +2181,22 @@ bool SLADEMap::addSector(ParseTreeNode* def)
 	ns->tag = 0;
 
 	// Add extra sector info
-	ParseTreeNode* prop = NULL;
-	for (unsigned a = 0; a < def->nChildren(); a++)
+	for (unsigned a = block.first; a < block.first + block.count; a++)
 	{
-		prop = (ParseTreeNode*)def->getChild(a);
-
 		// Skip required properties
-		if (prop == prop_ftex || prop == prop_ctex)
+		if ((int)a == prop_ftex || (int)a == prop_ctex)
 			continue;
 
-		if (S_CMPNOCASE(prop->getName(), "heightfloor"))
-			ns->setFloorHeight(prop->getIntValue());
-		else if (S_CMPNOCASE(prop->getName(), "heightceiling"))
-			ns->setCeilingHeight(prop->getIntValue());
-		else if (S_CMPNOCASE(prop->getName(), "lightlevel"))
-			ns->light = prop->getIntValue();
-		else if (S_CMPNOCASE(prop->getName(), "special"))
-			ns->special = prop->getIntValue();
-		else if (S_CMPNOCASE(prop->getName(), "id"))
-			ns->tag = prop->getIntValue();
-		else
-			ns->properties[prop->getName()] = prop->getValue();
+		UDMFReader::udmf_prop_t& prop = udmf.getProp(a);
+		switch (prop.ikey)
+		{
+		case UDMFReader::KEY_HEIGHTFLOOR:	ns->setFloorHeight(udmf.getIntValue(prop)); break;
+		case UDMFReader::KEY_HEIGHTCEILING:	ns->setCeilingHeight(udmf.getIntValue(prop)); break;
+		case UDMFReader::KEY_LIGHTLEVEL:	ns->light = udmf.getIntValue(prop); break;
+		case UDMFReader::KEY_SPECIAL:		ns->special = udmf.getIntValue(prop); break;
+		case UDMFReader::KEY_ID:			ns->tag = udmf.getIntValue(prop); break;
+		default:							ns->properties[udmf.propertyKey(prop.key)] = udmf.getValue(prop); break;
+		}
 	}
 
 	// Add sector to map
@@ -1609,35 +2206,36 @@ bool SLADEMap::addSector(ParseTreeNode* def)
 }
 
 /* SLADEMap::addThing
- * Adds a thing to the map from parsed UDMF thing definition [def]
+ * Adds a thing to the map from UDMF thing block [index] in [udmf]
  *******************************************************************/
-bool SLADEMap::addThing(ParseTreeNode* def)
+bool SLADEMap::addThing(UDMFReader& udmf, unsigned index)
 {
+	UDMFReader::udmf_block_t& block = udmf.getBlock(UDMFReader::KEY_THING, index);
+
 	// Check for required properties
-	ParseTreeNode* prop_x = (ParseTreeNode*)def->getChild("x");
-	ParseTreeNode* prop_y = (ParseTreeNode*)def->getChild("y");
-	ParseTreeNode* prop_type = (ParseTreeNode*)def->getChild("type");
-	if (!prop_x || !prop_y || !prop_type)
+	int prop_x = udmf.findProp(block, UDMFReader::KEY_X);
+	int prop_y = udmf.findProp(block, UDMFReader::KEY_Y);
+	int prop_type = udmf.findProp(block, UDMFReader::KEY_TYPE);
+	if (prop_x < 0 || prop_y < 0 || prop_type < 0)
 		return false;
 
 	// Create new thing
-	MapThing* nt = new MapThing(prop_x->getFloatValue(), prop_y->getFloatValue(), prop_type->getIntValue(), this);
+	MapThing* nt = new MapThing(udmf.getFloatValue(udmf.getProp(prop_x)), udmf.getFloatValue(udmf.getProp(prop_y)),
+	                            udmf.getIntValue(udmf.getProp(prop_type)), this);
 
 	// Add extra thing info
-	ParseTreeNode* prop = NULL;
-	for (unsigned a = 0; a < def->nChildren(); a++)
+	for (unsigned a = block.first; a < block.first + block.count; a++)
 	{
-		prop = (ParseTreeNode*)def->getChild(a);
-
 		// Skip required properties
-		if (prop == prop_x || prop == prop_y || prop == prop_type)
+		if ((int)a == prop_x || (int)a == prop_y || (int)a == prop_type)
 			continue;
 
 		// Builtin properties
-		if (S_CMPNOCASE(prop->getName(), "angle"))
-			nt->angle = prop->getIntValue();
+		UDMFReader::udmf_prop_t& prop = udmf.getProp(a);
+		if (prop.ikey == UDMFReader::KEY_ANGLE)
+			nt->angle = udmf.getIntValue(prop);
 		else
-			nt->properties[prop->getName()] = prop->getValue();
+			nt->properties[udmf.propertyKey(prop.key)] = udmf.getValue(prop);
 	}
 
 	// Add thing to map
@@ -1646,19 +2244,85 @@ bool SLADEMap::addThing(ParseTreeNode* def)
 	return true;
 }
 
-/* SLADEMap::readDoomMap
- * Reads a UDMF format map using info in [map]
+/* SLADEMap::readUDMFText
+ * Creates map objects from UDMF text in [mc], using UDMFReader
+ * to read it in a single pass. Returns false if the text couldn't
+ * be parsed (in which case no map objects are created)
  *******************************************************************/
-bool SLADEMap::readUDMFMap(Archive::mapdesc_t map)
+bool SLADEMap::readUDMFText(MemChunk& mc)
 {
-	// Get TEXTMAP entry (will always be after the 'head' entry)
-	ArchiveEntry* textmap = map.head->nextEntry();
+	// --- Parse UDMF text ---
+	theSplashWindow->setProgressMessage("Parsing TEXTMAP");
+	theSplashWindow->setProgress(-100.0f);
+	UDMFReader udmf;
+	if (!udmf.parse(mc))
+		return false;
+	udmf_namespace = udmf.getNamespace();
+
+	// Now create map structures from parsed data, in the right order
+	// (verts->sectors->sides->lines->things), even if they aren't
+	// defined in that order
+
+	// Create vertices from parsed data
+	theSplashWindow->setProgressMessage("Reading Vertices");
+	unsigned count = udmf.nBlocks(UDMFReader::KEY_VERTEX);
+	for (unsigned a = 0; a < count; a++)
+	{
+		theSplashWindow->setProgress(((float)a / count) * 0.2f);
+		addVertex(udmf, a);
+	}
+
+	// Create sectors from parsed data
+	theSplashWindow->setProgressMessage("Reading Sectors");
+	count = udmf.nBlocks(UDMFReader::KEY_SECTOR);
+	for (unsigned a = 0; a < count; a++)
+	{
+		theSplashWindow->setProgress(0.2f + ((float)a / count) * 0.2f);
+		addSector(udmf, a);
+	}
+
+	// Create sides from parsed data
+	theSplashWindow->setProgressMessage("Reading Sides");
+	count = udmf.nBlocks(UDMFReader::KEY_SIDEDEF);
+	for (unsigned a = 0; a < count; a++)
+	{
+		theSplashWindow->setProgress(0.4f + ((float)a / count) * 0.2f);
+		addSide(udmf, a);
+	}
+
+	// Create lines from parsed data
+	theSplashWindow->setProgressMessage("Reading Lines");
+	count = udmf.nBlocks(UDMFReader::KEY_LINEDEF);
+	for (unsigned a = 0; a < count; a++)
+	{
+		theSplashWindow->setProgress(0.6f + ((float)a / count) * 0.2f);
+		addLine(udmf, a);
+	}
+
+	// Create things from parsed data
+	theSplashWindow->setProgressMessage("Reading Things");
+	count = udmf.nBlocks(UDMFReader::KEY_THING);
+	for (unsigned a = 0; a < count; a++)
+	{
+		theSplashWindow->setProgress(0.8f + ((float)a / count) * 0.2f);
+		addThing(udmf, a);
+	}
+
+	return true;
+}
 
+/* SLADEMap::readUDMFParseTree
+ * Creates map objects from UDMF text in [mc], using the generic
+ * Parser to build a parse tree of it first. This is slower and uses
+ * a lot more memory than readUDMFText, but is more lenient
+ *******************************************************************/
+bool SLADEMap::readUDMFParseTree(MemChunk& mc)
+{
 	// --- Parse UDMF text ---
 	theSplashWindow->setProgressMessage("Parsing TEXTMAP");
 	theSplashWindow->setProgress(-100.0f);
 	Parser parser;
-	if (!parser.parseText(textmap->getMCData()))
+	if (!parser.parseText(mc))
 		return false;
 
 	// --- Process parsed data ---
@@ -1752,6 +2416,31 @@ bool SLADEMap::readUDMFMap(Archive::mapdesc_t map)
 		addThing(defs_things[a]);
 	}
 
+	return true;
+}
+
+/* SLADEMap::readUDMFMap
+ * Reads a UDMF format map using info in [map]. If [use_parse_tree]
+ * is true, the generic Parser is used to read the TEXTMAP rather
+ * than UDMFReader
+ *******************************************************************/
+bool SLADEMap::readUDMFMap(Archive::mapdesc_t map, bool use_parse_tree)
+{
+	// Get TEXTMAP entry (will always be after the 'head' entry)
+	ArchiveEntry* textmap = map.head->nextEntry();
+
+	// Create map objects from the TEXTMAP. If UDMFReader can't parse it,
+	// try the generic parser which is more lenient
+	bool ok = false;
+	if (!use_parse_tree)
+	{
+		ok = readUDMFText(textmap->getMCData());
+		if (!ok)
+			wxLogMessage("Unable to read TEXTMAP directly, trying generic parser");
+	}
+	if (!ok && !readUDMFParseTree(textmap->getMCData()))
+		return false;
+
 	theSplashWindow->setProgressMessage("Init map data");
 
 	// Remove detached vertices
@@ -2330,165 +3019,256 @@ bool SLADEMap::writeDoom64Map(vector<ArchiveEntry*>& map_entries)
 	return true;
 }
 
-/* SLADEMap::writeUDMFMap
- * Writes map as UDMF format text to [textmap]
+/* SLADEMap::writeUDMFObject
+ * Appends the UDMF definition of the [type] object at [index] to
+ * [out]. This is called from multiple threads when writing a map, so
+ * it must not modify anything other than the object itself
  *******************************************************************/
-bool SLADEMap::writeUDMFMap(ArchiveEntry* textmap)
+void SLADEMap::writeUDMFObject(uint8_t type, unsigned index, std::string& out)
 {
-	// Check entry was given
-	if (!textmap)
-		return false;
-
-	// Open temp text file
-	wxFile tempfile(appPath("sladetemp.txt", DIR_TEMP), wxFile::write);
-
-	// Write map namespace
-	tempfile.Write("// Written by SLADE3\n");
-	tempfile.Write(S_FMT("namespace=\"%s\";\n", udmf_namespace));
+	MapObject* object = NULL;
 
-	//sf::Clock clock;
-
-	// Locale for float number format
-	setlocale(LC_NUMERIC, "C");
-
-	// Write things
-	string object_def;
-	for (unsigned a = 0; a < things.size(); a++)
+	// Thing
+	if (type == MOBJ_THING)
 	{
-		object_def = S_FMT("thing//#%u\n{\n", a);
+		MapThing* thing = things[index];
+		object = thing;
+		out += "thing//#";
+		udmfWriteUInt(out, index);
 
 		// Basic properties
-		object_def += S_FMT("x=%1.3f;\ny=%1.3f;\ntype=%d;\n", things[a]->x, things[a]->y, things[a]->type);
-		if (things[a]->angle != 0) object_def += S_FMT("angle=%d;\n", things[a]->angle);
-
-		// Remove internal 'flags' property if it exists
-		things[a]->props().removeProperty("flags");
-
-		// Other properties
-		if (!things[a]->properties.isEmpty())
+		out += "\n{\nx=";
+		udmfWriteFloat(out, thing->x, 3);
+		out += ";\ny=";
+		udmfWriteFloat(out, thing->y, 3);
+		out += ";\ntype=";
+		udmfWriteInt(out, thing->type);
+		out += ";\n";
+		if (thing->angle != 0)
 		{
-			theGameConfiguration->cleanObjectUDMFProps(things[a]);
-			object_def += things[a]->properties.toString(true);
+			out += "angle=";
+			udmfWriteInt(out, thing->angle);
+			out += ";\n";
 		}
 
-		object_def += "}\n\n";
-		tempfile.Write(object_def);
+		// Remove internal 'flags' property if it exists
+		thing->props().removeProperty("flags");
 	}
-	//wxLogMessage("Writing things took %dms", clock.getElapsedTime().asMilliseconds());
 
-	// Write lines
-	//clock.restart();
-	for (unsigned a = 0; a < lines.size(); a++)
+	// Line
+	else if (type == MOBJ_LINE)
 	{
-		object_def = S_FMT("linedef//#%u\n{\n", a);
+		MapLine* line = lines[index];
+		object = line;
+		out += "linedef//#";
+		udmfWriteUInt(out, index);
 
 		// Basic properties
-		object_def += S_FMT("v1=%d;\nv2=%d;\nsidefront=%d;\n", lines[a]->v1Index(), lines[a]->v2Index(), lines[a]->s1Index());
-		if (lines[a]->s2())
-			object_def += S_FMT("sideback=%d;\n", lines[a]->s2Index());
-		if (lines[a]->special != 0)
-			object_def += S_FMT("special=%d;\n", lines[a]->special);
-
-		// Remove internal 'flags' property if it exists
-		lines[a]->props().removeProperty("flags");
-
-		// Other properties
-		if (!lines[a]->properties.isEmpty())
+		out += "\n{\nv1=";
+		udmfWriteInt(out, line->v1Index());
+		out += ";\nv2=";
+		udmfWriteInt(out, line->v2Index());
+		out += ";\nsidefront=";
+		udmfWriteInt(out, line->s1Index());
+		out += ";\n";
+		if (line->s2())
+		{
+			out += "sideback=";
+			udmfWriteInt(out, line->s2Index());
+			out += ";\n";
+		}
+		if (line->special != 0)
 		{
-			theGameConfiguration->cleanObjectUDMFProps(lines[a]);
-			object_def += lines[a]->properties.toString(true);
+			out += "special=";
+			udmfWriteInt(out, line->special);
+			out += ";\n";
 		}
 
-		object_def += "}\n\n";
-		tempfile.Write(object_def);
+		// Remove internal 'flags' property if it exists
+		line->props().removeProperty("flags");
 	}
-	//wxLogMessage("Writing lines took %dms", clock.getElapsedTime().asMilliseconds());
 
-	// Write sides
-	//clock.restart();
-	for (unsigned a = 0; a < sides.size(); a++)
+	// Side
+	else if (type == MOBJ_SIDE)
 	{
-		object_def = S_FMT("sidedef//#%u\n{\n", a);
+		MapSide* side = sides[index];
+		object = side;
+		out += "sidedef//#";
+		udmfWriteUInt(out, index);
 
 		// Basic properties
-		object_def += S_FMT("sector=%u;\n", sides[a]->sector->getIndex());
-		if (sides[a]->tex_upper != "-")
-			object_def += S_FMT("texturetop=\"%s\";\n", sides[a]->tex_upper);
-		if (sides[a]->tex_middle != "-")
-			object_def += S_FMT("texturemiddle=\"%s\";\n", sides[a]->tex_middle);
-		if (sides[a]->tex_lower != "-")
-			object_def += S_FMT("texturebottom=\"%s\";\n", sides[a]->tex_lower);
-		if (sides[a]->offset_x != 0)
-			object_def += S_FMT("offsetx=%d;\n", sides[a]->offset_x);
-		if (sides[a]->offset_y != 0)
-			object_def += S_FMT("offsety=%d;\n", sides[a]->offset_y);
-
-		// Other properties
-		if (!sides[a]->properties.isEmpty())
+		out += "\n{\nsector=";
+		udmfWriteUInt(out, side->sector->getIndex());
+		out += ";\n";
+		if (side->tex_upper != "-")
 		{
-			theGameConfiguration->cleanObjectUDMFProps(sides[a]);
-			object_def += sides[a]->properties.toString(true);
+			out += "texturetop=\"";
+			udmfWriteString(out, side->tex_upper);
+			out += "\";\n";
+		}
+		if (side->tex_middle != "-")
+		{
+			out += "texturemiddle=\"";
+			udmfWriteString(out, side->tex_middle);
+			out += "\";\n";
+		}
+		if (side->tex_lower != "-")
+		{
+			out += "texturebottom=\"";
+			udmfWriteString(out, side->tex_lower);
+			out += "\";\n";
+		}
+		if (side->offset_x != 0)
+		{
+			out += "offsetx=";
+			udmfWriteInt(out, side->offset_x);
+			out += ";\n";
+		}
+		if (side->offset_y != 0)
+		{
+			out += "offsety=";
+			udmfWriteInt(out, side->offset_y);
+			out += ";\n";
 		}
-
-		object_def += "}\n\n";
-		tempfile.Write(object_def);
 	}
-	//wxLogMessage("Writing sides took %dms", clock.getElapsedTime().asMilliseconds());
 
-	// Write vertices
-	//clock.restart();
-	for (unsigned a = 0; a < vertices.size(); a++)
+	// Vertex
+	else if (type == MOBJ_VERTEX)
 	{
-		object_def = S_FMT("vertex//#%u\n{\n", a);
+		MapVertex* vertex = vertices[index];
+		object = vertex;
+		out += "vertex//#";
+		udmfWriteUInt(out, index);
 
 		// Basic properties
-		object_def += S_FMT("x=%1.3f;\ny=%1.3f;\n", vertices[a]->x, vertices[a]->y);
+		out += "\n{\nx=";
+		udmfWriteFloat(out, vertex->x, 3);
+		out += ";\ny=";
+		udmfWriteFloat(out, vertex->y, 3);
+		out += ";\n";
+	}
+
+	// Sector
+	else if (type == MOBJ_SECTOR)
+	{
+		MapSector* sector = sectors[index];
+		object = sector;
+		out += "sector//#";
+		udmfWriteUInt(out, index);
 
-		// Other properties
-		if (!vertices[a]->properties.isEmpty())
+		// Basic properties
+		out += "\n{\ntexturefloor=\"";
+		udmfWriteString(out, sector->f_tex);
+		out += "\";\ntextureceiling=\"";
+		udmfWriteString(out, sector->c_tex);
+		out += "\";\n";
+		if (sector->f_height != 0)
 		{
-			theGameConfiguration->cleanObjectUDMFProps(vertices[a]);
-			object_def += vertices[a]->properties.toString(true);
+			out += "heightfloor=";
+			udmfWriteInt(out, sector->f_height);
+			out += ";\n";
+		}
+		if (sector->c_height != 0)
+		{
+			out += "heightceiling=";
+			udmfWriteInt(out, sector->c_height);
+			out += ";\n";
+		}
+		if (sector->light != 160)
+		{
+			out += "lightlevel=";
+			udmfWriteInt(out, sector->light);
+			out += ";\n";
+		}
+		if (sector->special != 0)
+		{
+			out += "special=";
+			udmfWriteInt(out, sector->special);
+			out += ";\n";
+		}
+		if (sector->tag != 0)
+		{
+			out += "id=";
+			udmfWriteInt(out, sector->tag);
+			out += ";\n";
 		}
-
-		object_def += "}\n\n";
-		tempfile.Write(object_def);
 	}
-	//wxLogMessage("Writing vertices took %dms", clock.getElapsedTime().asMilliseconds());
 
-	// Write sectors
-	//clock.restart();
-	for (unsigned a = 0; a < sectors.size(); a++)
+	else
+		return;
+
+	// Other properties (same format as MobjPropertyList::toString)
+	if (!object->properties.isEmpty())
 	{
-		object_def = S_FMT("sector//#%u\n{\n", a);
+		theGameConfiguration->cleanObjectUDMFProps(object);
 
-		// Basic properties
-		object_def += S_FMT("texturefloor=\"%s\";\ntextureceiling=\"%s\";\n", sectors[a]->f_tex, sectors[a]->c_tex);
-		if (sectors[a]->f_height != 0) object_def += S_FMT("heightfloor=%d;\n", sectors[a]->f_height);
-		if (sectors[a]->c_height != 0) object_def += S_FMT("heightceiling=%d;\n", sectors[a]->c_height);
-		if (sectors[a]->light != 160) object_def += S_FMT("lightlevel=%d;\n", sectors[a]->light);
-		if (sectors[a]->special != 0) object_def += S_FMT("special=%d;\n", sectors[a]->special);
-		if (sectors[a]->tag != 0) object_def += S_FMT("id=%d;\n", sectors[a]->tag);
-
-		// Other properties
-		if (!sectors[a]->properties.isEmpty())
+		vector<MobjPropertyList::prop_t>& props = object->properties.allProperties();
+		for (unsigned a = 0; a < props.size(); a++)
 		{
-			theGameConfiguration->cleanObjectUDMFProps(sectors[a]);
-			object_def += sectors[a]->properties.toString(true);
-		}
+			Property& value = props[a].value;
+			if (!value.hasValue())
+				continue;
 
-		object_def += "}\n\n";
-		tempfile.Write(object_def);
+			udmfWriteString(out, MobjPropertyList::keyName(props[a].key));
+			out += '=';
+			switch (value.getType())
+			{
+			case PROP_BOOL:		out += value.getBoolValue() ? "true" : "false"; break;
+			case PROP_INT:		udmfWriteInt(out, value.getIntValue()); break;
+			case PROP_UINT:		udmfWriteInt(out, (int)value.getUnsignedValue()); break;
+			case PROP_FLOAT:	udmfWriteFloat(out, value.getFloatValue(), 6); break;
+			case PROP_STRING:
+				out += '"';
+				udmfWriteString(out, value.getStringValue());
+				out += '"';
+				break;
+			default:			udmfWriteString(out, value.getStringValue()); break;
+			}
+			out += ";\n";
+		}
 	}
-	//wxLogMessage("Writing sectors took %dms", clock.getElapsedTime().asMilliseconds());
 
-	// Close file
-	tempfile.Close();
+	out += "}\n\n";
+}
+
+/* SLADEMap::writeUDMFMap
+ * Writes map as UDMF format text to [textmap]. Object definitions
+ * are written to memory in parallel (see map_udmf_write_threads)
+ *******************************************************************/
+bool SLADEMap::writeUDMFMap(ArchiveEntry* textmap)
+{
+	// Check entry was given
+	if (!textmap)
+		return false;
 
-	// Load file to entry
-	textmap->importFile(appPath("sladetemp.txt", DIR_TEMP));
+	// Locale for float number format (only used for values that can't
+	// be formatted directly, see udmfWriteFloat)
+	setlocale(LC_NUMERIC, "C");
 
-	return true;
+	// Write map namespace
+	std::string header = "// Written by SLADE3\nnamespace=\"";
+	udmfWriteString(header, udmf_namespace);
+	header += "\";\n";
+
+	// Write object definitions, in order
+	UDMFWriteJob job(this);
+	job.add(MOBJ_THING, things.size());
+	job.add(MOBJ_LINE, lines.size());
+	job.add(MOBJ_SIDE, sides.size());
+	job.add(MOBJ_VERTEX, vertices.size());
+	job.add(MOBJ_SECTOR, sectors.size());
+	job.run(ParallelJob::numThreads(map_udmf_write_threads));
+
+	// Put it all together in the entry
+	size_t size = header.size();
+	for (unsigned a = 0; a < job.output.size(); a++)
+		size += job.output[a].size();
+	MemChunk mc(size);
+	mc.write(header.data(), header.size());
+	for (unsigned a = 0; a < job.output.size(); a++)
+		mc.write(job.output[a].data(), job.output[a].size());
+
+	return textmap->importMemChunk(mc);
 }
 
 /* SLADEMap::clearMap
@@ -2504,6 +3284,8 @@ void SLADEMap::clearMap()
 	vertices.clear();
 	sectors.clear();
 	things.clear();
+	blockmap.clear();
+	blockmap_rebuild = true;
 
 	// Clear map objects
 	for (unsigned a = 0; a < all_objects.size(); a++)
@@ -2604,6 +3386,7 @@ bool SLADEMap::removeVertex(unsigned index, bool merge_lines)
 
 	// Remove the vertex
 	removeMapObject(vertices[index]);
+	blockmap.removeObject(vertices[index]);
 	vertices[index] = vertices.back();
 	vertices[index]->index = index;
 	//vertices[index]->modified_time = theApp->runTimer();
@@ -2654,6 +3437,7 @@ bool SLADEMap::removeLine(unsigned index)
 
 	// Remove the line
 	removeMapObject(lines[index]);
+	blockmap.removeObject(lines[index]);
 	lines[index] = lines[lines.size()-1];
 	lines[index]->index = index;
 	//lines[index]->modified_time = theApp->runTimer();
@@ -2759,6 +3543,7 @@ bool SLADEMap::removeSector(unsigned index)
 
 	// Remove the sector
 	removeMapObject(sectors[index]);
+	blockmap.removeObject(sectors[index]);
 	sectors[index] = sectors.back();
 	sectors[index]->index = index;
 	//sectors[index]->modified_time = theApp->runTimer();
@@ -2790,6 +3575,7 @@ bool SLADEMap::removeThing(unsigned index)
 
 	// Remove the thing
 	removeMapObject(things[index]);
+	blockmap.removeObject(things[index]);
 	things[index] = things.back();
 	things[index]->index = index;
 	//things[index]->modified_time = theApp->runTimer();
@@ -2800,20 +3586,36 @@ bool SLADEMap::removeThing(unsigned index)
 	return true;
 }
 
+// Sorting function for map objects from the blockmap, so they are
+// checked in the same (index) order as when going through the whole map
+bool sortMapObjectIndex(MapObject* left, MapObject* right)
+{
+	return left->getIndex() < right->getIndex();
+}
+
 /* SLADEMap::nearestVertex
  * Returns the index of the vertex closest to the point, or -1 if none
  * found. Igonres any vertices further away than [min]
  *******************************************************************/
 int SLADEMap::nearestVertex(fpoint2_t point, double min)
 {
+	// Get vertices in blocks near the point. The search area is a bit
+	// bigger than [min] since the nearest vertex is picked by 'quick'
+	// distance below, any vertex outside it can't be within [min]
+	vector<MapObject*> near_vertices;
+	double range = min * 1.5;
+	refreshBlockmap();
+	blockmap.getObjects(MOBJ_VERTEX, point.x - range, point.y - range, point.x + range, point.y + range, near_vertices);
+	std::sort(near_vertices.begin(), near_vertices.end(), sortMapObjectIndex);
+
 	// Go through vertices
 	double min_dist = 999999999;
 	MapVertex* v = NULL;
 	double dist = 0;
 	int index = -1;
-	for (unsigned a = 0; a < vertices.size(); a++)
+	for (unsigned a = 0; a < near_vertices.size(); a++)
 	{
-		v = vertices[a];
+		v = (MapVertex*)near_vertices[a];
 
 		// Get 'quick' distance (no need to get real distance)
 		dist = point.taxicab_distance_to(v->point());
@@ -2821,7 +3623,7 @@ int SLADEMap::nearestVertex(fpoint2_t point, double min)
 		// Check if it's nearer than the previous nearest
 		if (dist < min_dist)
 		{
-			index = a;
+			index = v->index;
 			min_dist = dist;
 		}
 	}
@@ -2845,14 +3647,20 @@ int SLADEMap::nearestVertex(fpoint2_t point, double min)
  *******************************************************************/
 int SLADEMap::nearestLine(fpoint2_t point, double mindist)
 {
+	// Get lines passing through blocks within [mindist] of the point
+	vector<MapObject*> near_lines;
+	refreshBlockmap();
+	blockmap.getObjects(MOBJ_LINE, point.x - mindist, point.y - mindist, point.x + mindist, point.y + mindist, near_lines);
+	std::sort(near_lines.begin(), near_lines.end(), sortMapObjectIndex);
+
 	// Go through lines
 	double min_dist = mindist;
 	double dist = 0;
 	int index = -1;
 	MapLine* l;
-	for (unsigned a = 0; a < lines.size(); a++)
+	for (unsigned a = 0; a < near_lines.size(); a++)
 	{
-		l = lines[a];
+		l = (MapLine*)near_lines[a];
 
 		// Check with line bounding box first (since we have a minimum distance)
 		fseg2_t bbox = l->seg();
@@ -2866,7 +3674,7 @@ int SLADEMap::nearestLine(fpoint2_t point, double mindist)
 		// Check if it's nearer than the previous nearest
 		if (dist < min_dist && dist < mindist)
 		{
-			index = a;
+			index = l->index;
 			min_dist = dist;
 		}
 	}
@@ -2880,14 +3688,21 @@ int SLADEMap::nearestLine(fpoint2_t point, double mindist)
  *******************************************************************/
 int SLADEMap::nearestThing(fpoint2_t point, double min)
 {
+	// Get things in blocks near the point (see nearestVertex)
+	vector<MapObject*> near_things;
+	double range = min * 1.5;
+	refreshBlockmap();
+	blockmap.getObjects(MOBJ_THING, point.x - range, point.y - range, point.x + range, point.y + range, near_things);
+	std::sort(near_things.begin(), near_things.end(), sortMapObjectIndex);
+
 	// Go through things
 	double min_dist = 999999999;
 	MapThing* t = NULL;
 	double dist = 0;
 	int index = -1;
-	for (unsigned a = 0; a < things.size(); a++)
+	for (unsigned a = 0; a < near_things.size(); a++)
 	{
-		t = things[a];
+		t = (MapThing*)near_things[a];
 
 		// Get 'quick' distance (no need to get real distance)
 		dist = point.taxicab_distance_to(t->point());
@@ -2895,7 +3710,7 @@ int SLADEMap::nearestThing(fpoint2_t point, double min)
 		// Check if it's nearer than the previous nearest
 		if (dist < min_dist)
 		{
-			index = a;
+			index = t->index;
 			min_dist = dist;
 		}
 	}
@@ -2919,14 +3734,44 @@ int SLADEMap::nearestThing(fpoint2_t point, double min)
  *******************************************************************/
 vector<int> SLADEMap::nearestThingMulti(fpoint2_t point)
 {
-	// Go through things
 	vector<int> ret;
+	if (things.empty())
+		return ret;
+
+	// Get things in blocks around the point, widening the search until
+	// the nearest thing found is within the searched area (in which case
+	// no thing outside it can be nearer), or all things were found
+	vector<MapObject*> near_things;
+	double range = MapBlockmap::BLOCK_SIZE;
+	refreshBlockmap();
+	while (true)
+	{
+		near_things.clear();
+		blockmap.getObjects(MOBJ_THING, point.x - range, point.y - range, point.x + range, point.y + range, near_things);
+		if (near_things.size() >= things.size())
+			break;
+
+		double nearest = -1;
+		for (unsigned a = 0; a < near_things.size(); a++)
+		{
+			double dist = point.taxicab_distance_to(((MapThing*)near_things[a])->point());
+			if (nearest < 0 || dist < nearest)
+				nearest = dist;
+		}
+		if (nearest >= 0 && nearest <= range)
+			break;
+
+		range *= 2;
+	}
+	std::sort(near_things.begin(), near_things.end(), sortMapObjectIndex);
+
+	// Go through things
 	double min_dist = 999999999;
 	MapThing* t = NULL;
 	double dist = 0;
-	for (unsigned a = 0; a < things.size(); a++)
+	for (unsigned a = 0; a < near_things.size(); a++)
 	{
-		t = things[a];
+		t = (MapThing*)near_things[a];
 
 		// Get 'quick' distance (no need to get real distance)
 		dist = point.taxicab_distance_to(t->point());
@@ -2935,11 +3780,11 @@ vector<int> SLADEMap::nearestThingMulti(fpoint2_t point)
 		if (dist < min_dist)
 		{
 			ret.clear();
-			ret.push_back(a);
+			ret.push_back(t->index);
 			min_dist = dist;
 		}
 		else if (dist == min_dist)
-			ret.push_back(a);
+			ret.push_back(t->index);
 	}
 
 	return ret;
@@ -2951,18 +3796,91 @@ vector<int> SLADEMap::nearestThingMulti(fpoint2_t point)
  *******************************************************************/
 int SLADEMap::sectorAt(fpoint2_t point)
 {
+	// Get sectors with a bbox overlapping the point's block
+	vector<MapObject*> near_sectors;
+	refreshBlockmap();
+	blockmap.getObjects(MOBJ_SECTOR, point.x, point.y, point.x, point.y, near_sectors);
+	std::sort(near_sectors.begin(), near_sectors.end(), sortMapObjectIndex);
+
 	// Go through sectors
-	for (unsigned a = 0; a < sectors.size(); a++)
+	for (unsigned a = 0; a < near_sectors.size(); a++)
 	{
 		// Check if point is within sector
-		if (sectors[a]->isWithin(point))
-			return a;
+		if (((MapSector*)near_sectors[a])->isWithin(point))
+			return near_sectors[a]->index;
 	}
 
 	// Not within a sector
 	return -1;
 }
 
+// Point + blockmap block, for sorting points by block in sectorsAt
+struct block_point_t
+{
+	int			bx;
+	int			by;
+	unsigned	index;
+
+	bool operator<(const block_point_t& right) const
+	{
+		if (bx != right.bx)
+			return bx < right.bx;
+		if (by != right.by)
+			return by < right.by;
+		return index < right.index;
+	}
+};
+
+/* SLADEMap::sectorsAt
+ * Returns the index of the sector at each point in [points], the
+ * same as calling sectorAt for each point. Points are grouped by
+ * blockmap block, so the sectors to check are only looked up once for
+ * each block. Like sectorAt, this builds the line grid of any large
+ * sector checked (see MapSector::isWithin)
+ *******************************************************************/
+vector<int> SLADEMap::sectorsAt(vector<fpoint2_t>& points)
+{
+	vector<int> ret(points.size(), -1);
+
+	// Sort points by block
+	vector<block_point_t> sorted(points.size());
+	for (unsigned a = 0; a < points.size(); a++)
+	{
+		sorted[a].bx = MapBlockmap::blockCoord(points[a].x);
+		sorted[a].by = MapBlockmap::blockCoord(points[a].y);
+		sorted[a].index = a;
+	}
+	std::sort(sorted.begin(), sorted.end());
+
+	// Go through points
+	vector<MapObject*> near_sectors;
+	refreshBlockmap();
+	for (unsigned a = 0; a < sorted.size(); a++)
+	{
+		fpoint2_t& point = points[sorted[a].index];
+
+		// Get sectors with a bbox overlapping the block, if it's a new block
+		if (a == 0 || sorted[a].bx != sorted[a-1].bx || sorted[a].by != sorted[a-1].by)
+		{
+			near_sectors.clear();
+			blockmap.getObjects(MOBJ_SECTOR, point.x, point.y, point.x, point.y, near_sectors);
+			std::sort(near_sectors.begin(), near_sectors.end(), sortMapObjectIndex);
+		}
+
+		// Find first sector containing the point
+		for (unsigned s = 0; s < near_sectors.size(); s++)
+		{
+			if (((MapSector*)near_sectors[s])->isWithin(point))
+			{
+				ret[sorted[a].index] = near_sectors[s]->index;
+				break;
+			}
+		}
+	}
+
+	return ret;
+}
+
 /* SLADEMap::getMapBBox
  * Returns a bounding box for the entire map
  *******************************************************************/
@@ -2999,11 +3917,18 @@ bbox_t SLADEMap::getMapBBox()
  *******************************************************************/
 MapVertex* SLADEMap::vertexAt(double x, double y)
 {
-	// Go through all vertices
-	for (unsigned a = 0; a < vertices.size(); a++)
+	// Get vertices in the block at [x,y]
+	vector<MapObject*> near_vertices;
+	refreshBlockmap();
+	blockmap.getObjects(MOBJ_VERTEX, x, y, x, y, near_vertices);
+	std::sort(near_vertices.begin(), near_vertices.end(), sortMapObjectIndex);
+
+	// Go through vertices
+	for (unsigned a = 0; a < near_vertices.size(); a++)
 	{
-		if (vertices[a]->x == x && vertices[a]->y == y)
-			return vertices[a];
+		MapVertex* vertex = (MapVertex*)near_vertices[a];
+		if (vertex->x == x && vertex->y == y)
+			return vertex;
 	}
 
 	// No vertex at [x,y]
@@ -3158,6 +4083,30 @@ void SLADEMap::updateGeometryInfo(long modified_time)
 	}
 }
 
+/* SLADEMap::precalculateGeometry
+ * Calculates all geometry info that is otherwise calculated when it
+ * is first used (line vectors and lengths, sector bboxes and line
+ * grids, and the blockmap). After this, the map geometry can be read
+ * (including sectorAt etc.) from multiple threads at once, as long as
+ * the map isn't modified
+ *******************************************************************/
+void SLADEMap::precalculateGeometry()
+{
+	for (unsigned a = 0; a < lines.size(); a++)
+	{
+		lines[a]->frontVector();
+		lines[a]->getLength();
+	}
+
+	for (unsigned a = 0; a < sectors.size(); a++)
+	{
+		sectors[a]->boundingBox();
+		sectors[a]->updateLineGrid();
+	}
+
+	refreshBlockmap();
+}
+
 /* SLADEMap::linesIntersect
  * Returns true if [line1] and [line2] intersect. If an intersection
  * occurs, [x] and [y] are set to the intersection point
@@ -3349,18 +4298,26 @@ void SLADEMap::getThingsByIdInSectorTag(int id, int tag, vector<MapThing*>& list
 	if (id==0 && tag==0)
 		return;
 
-	// Find things with matching id contained in sector with matching tag
+	// Find things with matching id
+	vector<MapThing*> id_things;
+	vector<fpoint2_t> points;
 	for (unsigned a = 0; a < things.size(); a++)
 	{
 		if (things[a]->intProperty("id") == id)
 		{
-			int si = sectorAt(things[a]->point());
-			if (si > -1 && (unsigned)si < sectors.size() && sectors[si]->intProperty("id") == tag)
-			{
-				list.push_back(things[a]);
-			}
+			id_things.push_back(things[a]);
+			points.push_back(things[a]->point());
 		}
 	}
+
+	// Add those contained in sector with matching tag
+	vector<int> thing_sectors = sectorsAt(points);
+	for (unsigned a = 0; a < id_things.size(); a++)
+	{
+		int si = thing_sectors[a];
+		if (si > -1 && (unsigned)si < sectors.size() && sectors[si]->intProperty("id") == tag)
+			list.push_back(id_things[a]);
+	}
 }
 
 /* SLADEMap::getDragonTargets
@@ -4057,31 +5014,37 @@ MapVertex* SLADEMap::createVertex(double x, double y, double split_dist)
 	fpoint2_t point(x, y);
 
 	// First check that it won't overlap any other vertex
-	for (unsigned a = 0; a < vertices.size(); a++)
-	{
-		if (vertices[a]->x == x && vertices[a]->y == y)
-			return vertices[a];
-	}
+	MapVertex* existing = vertexAt(x, y);
+	if (existing)
+		return existing;
 
 	// Create the vertex
 	MapVertex* nv = new MapVertex(x, y, this);
 	nv->index = vertices.size();
 	vertices.push_back(nv);
+	blockmap.addObject(nv);
 
 	// Check if this vertex splits any lines (if needed)
 	if (split_dist >= 0)
 	{
-		unsigned nlines = lines.size();
-		for (unsigned a = 0; a < nlines; a++)
+		// Only lines in nearby blocks can be within [split_dist]
+		vector<MapObject*> near_lines;
+		refreshBlockmap();
+		blockmap.getObjects(MOBJ_LINE, x - split_dist, y - split_dist, x + split_dist, y + split_dist, near_lines);
+		std::sort(near_lines.begin(), near_lines.end(), sortMapObjectIndex);
+
+		for (unsigned a = 0; a < near_lines.size(); a++)
 		{
+			MapLine* line = (MapLine*)near_lines[a];
+
 			// Skip line if it shares the vertex
-			if (lines[a]->v1() == nv || lines[a]->v2() == nv)
+			if (line->v1() == nv || line->v2() == nv)
 				continue;
 
-			if (lines[a]->distanceTo(point) < split_dist)
+			if (line->distanceTo(point) < split_dist)
 			{
-				//wxLogMessage("Vertex at (%1.2f,%1.2f) splits line %d", x, y, a);
-				splitLine(lines[a], nv);
+				//wxLogMessage("Vertex at (%1.2f,%1.2f) splits line %d", x, y, line->index);
+				splitLine(line, nv);
 			}
 		}
 	}
@@ -4153,6 +5116,7 @@ MapLine* SLADEMap::createLine(MapVertex* vertex1, MapVertex* vertex2, bool force
 	// Connect line to vertices
 	vertex1->connectLine(nl);
 	vertex2->connectLine(nl);
+	blockmap.addObject(nl);
 
 	// Set geometry age
 	geometry_updated = theApp->runTimer();
@@ -4176,6 +5140,7 @@ MapThing* SLADEMap::createThing(double x, double y)
 
 	// Add to things
 	things.push_back(nt);
+	blockmap.addObject(nt);
 	things_updated = theApp->runTimer();
 
 	return nt;
@@ -4194,6 +5159,7 @@ MapSector* SLADEMap::createSector()
 
 	// Add to sectors
 	sectors.push_back(ns);
+	blockmap.addObject(ns);
 
 	return ns;
 }
@@ -4237,6 +5203,7 @@ void SLADEMap::moveVertex(unsigned vertex, double nx, double ny)
 	v->setModified();
 	v->x = nx;
 	v->y = ny;
+	updateBlockmap(v);
 
 	// Reset all attached lines' geometry info
 	for (unsigned a = 0; a < v->connected_lines.size(); a++)
@@ -4270,6 +5237,7 @@ void SLADEMap::mergeVertices(unsigned vertex1, unsigned vertex2)
 			line->vertex1 = v1;
 			line->length = -1;
 			v1->connectLine(line);
+			blockmap.updateObject(line);
 		}
 
 		// Change second vertex if needed
@@ -4279,6 +5247,7 @@ void SLADEMap::mergeVertices(unsigned vertex1, unsigned vertex2)
 			line->vertex2 = v1;
 			line->length = -1;
 			v1->connectLine(line);
+			blockmap.updateObject(line);
 		}
 
 		if (line->vertex1 == v1 && line->vertex2 == v1)
@@ -4288,6 +5257,7 @@ void SLADEMap::mergeVertices(unsigned vertex1, unsigned vertex2)
 	// Delete the vertex
 	LOG_MESSAGE(4, "Merging vertices %u and %u (removing %u)", vertex1, vertex2, vertex2);
 	removeMapObject(v2);
+	blockmap.removeObject(v2);
 	vertices[vertex2] = vertices.back();
 	vertices[vertex2]->index = vertex2;
 	vertices.pop_back();
@@ -4349,6 +5319,7 @@ MapLine* SLADEMap::splitLine(MapLine* l, MapVertex* v)
 	l->vertex2 = v;
 	v->connectLine(l);
 	l->length = -1;
+	blockmap.updateObject(l);
 
 	// Create and add new sides
 	MapSide* s1 = NULL;
@@ -4402,6 +5373,7 @@ MapLine* SLADEMap::splitLine(MapLine* l, MapVertex* v)
 	nl->index = lines.size();
 	nl->setModified();
 	lines.push_back(nl);
+	blockmap.addObject(nl);
 
 	// Update x-offsets
 	int xoff1 = l->intProperty("side1.offsetx");
@@ -4428,6 +5400,7 @@ void SLADEMap::moveThing(unsigned thing, double nx, double ny)
 	t->setModified();
 	t->x = nx;
 	t->y = ny;
+	blockmap.updateObject(t);
 }
 
 /* SLADEMap::splitLinesAt
@@ -5278,7 +6251,10 @@ void SLADEMap::rebuildConnectedSides()
 {
 	// Clear sector connected sides lists
 	for (unsigned a = 0; a < sectors.size(); a++)
+	{
 		sectors[a]->connected_sides.clear();
+		sectors[a]->resetBBox();
+	}
 
 	// Connect sides to their sectors
 	for (unsigned a = 0; a < sides.size(); a++)
@@ -5335,3 +6311,87 @@ int SLADEMap::thingTypeUsageCount(int type)
 {
 	return usage_thing_type[type];
 }
+
+
+/*******************************************************************
+ * CONSOLE COMMANDS
+ *******************************************************************/
+
+/* Console Command - "bench_udmf"
+ * Builds a synthetic UDMF map with the given number of (separate,
+ * square) sectors (10000 if not given), and reports how long it
+ * takes to read with UDMFReader and with the generic Parser
+ *******************************************************************/
+CONSOLE_COMMAND(bench_udmf, 0, false)
+{
+	long num_sectors = 10000;
+	if (args.size() > 0)
+		args[0].ToLong(&num_sectors);
+	if (num_sectors < 1 || num_sectors > 1000000)
+		num_sectors = 10000;
+
+	// Build the TEXTMAP, things first as SLADE writes them
+	string text = "namespace = \"zdoom\";\n";
+	for (long a = 0; a < num_sectors; a++)
+		text += S_FMT("thing // %ld\n{\nx = %ld.000;\ny = %ld.000;\ntype = 3004;\nangle = 90;\nskill1 = true;\nskill2 = true;\n}\n", a, (a % 100) * 128 + 32, (a / 100) * 128 + 32);
+	for (long a = 0; a < num_sectors * 4; a++)
+		text += S_FMT("linedef // %ld\n{\nv1 = %ld;\nv2 = %ld;\nsidefront = %ld;\nblocking = true;\ncomment = \"Line %ld\";\n}\n", a, a, (a % 4 == 3) ? a - 3 : a + 1, a, a);
+	for (long a = 0; a < num_sectors * 4; a++)
+		text += S_FMT("sidedef // %ld\n{\nsector = %ld;\ntexturemiddle = \"STARTAN2\";\nscalex_mid = 1.5;\n}\n", a, a / 4);
+	for (long a = 0; a < num_sectors; a++)
+	{
+		long x = (a % 100) * 128;
+		long y = (a / 100) * 128;
+		text += S_FMT("vertex // %ld\n{\nx = %ld.000;\ny = %ld.000;\n}\n", a * 4, x, y);
+		text += S_FMT("vertex // %ld\n{\nx = %ld.000;\ny = %ld.000;\n}\n", a * 4 + 1, x, y + 64);
+		text += S_FMT("vertex // %ld\n{\nx = %ld.000;\ny = %ld.000;\n}\n", a * 4 + 2, x + 64, y + 64);
+		text += S_FMT("vertex // %ld\n{\nx = %ld.000;\ny = %ld.000;\n}\n", a * 4 + 3, x + 64, y);
+	}
+	for (long a = 0; a < num_sectors; a++)
+		text += S_FMT("sector // %ld\n{\ntexturefloor = \"FLOOR0_1\";\ntextureceiling = \"CEIL1_1\";\nheightceiling = 128;\nlightlevel = 192;\nid = %ld;\n}\n", a, a);
+
+	// Put it in a wad
+	WadArchive wad;
+	ArchiveEntry* head = wad.addNewEntry("MAP01");
+	ArchiveEntry* textmap = wad.addNewEntry("TEXTMAP");
+	textmap->importMem(CHR(text), text.Length());
+	Archive::mapdesc_t map;
+	map.name = "MAP01";
+	map.head = head;
+	map.end = wad.addNewEntry("ENDMAP");
+	map.format = MAP_UDMF;
+
+	// Read it both ways
+	for (unsigned a = 0; a < 2; a++)
+	{
+		bool parse_tree = (a == 1);
+		SLADEMap* smap = new SLADEMap();
+		long start = theApp->runTimer();
+		bool ok = smap->readUDMFMap(map, parse_tree);
+		long time = theApp->runTimer() - start;
+
+		if (ok)
+		{
+			// Count properties, to check both ways give the same result
+			unsigned n_props = 0;
+			for (unsigned b = 0; b < smap->nVertices(); b++)
+				n_props += smap->getVertex(b)->props().allProperties().size();
+			for (unsigned b = 0; b < smap->nLines(); b++)
+				n_props += smap->getLine(b)->props().allProperties().size();
+			for (unsigned b = 0; b < smap->nSides(); b++)
+				n_props += smap->getSide(b)->props().allProperties().size();
+			for (unsigned b = 0; b < smap->nSectors(); b++)
+				n_props += smap->getSector(b)->props().allProperties().size();
+			for (unsigned b = 0; b < smap->nThings(); b++)
+				n_props += smap->getThing(b)->props().allProperties().size();
+
+			wxLogMessage("%s: %ldms (%d vertices, %d lines, %d sides, %d sectors, %d things, %d extra properties)",
+			             parse_tree ? "Parser" : "UDMFReader", time, (int)smap->nVertices(), (int)smap->nLines(),
+			             (int)smap->nSides(), (int)smap->nSectors(), (int)smap->nThings(), n_props);
+		}
+		else
+			wxLogMessage("%s: Failed to read map", parse_tree ? "Parser" : "UDMFReader");
+
+		delete smap;
+	}
+}
@@ -7,6 +7,7 @@
 #include "MapSector.h"
 #include "MapVertex.h"
 #include "MapThing.h"
+#include "MapBlockmap.h"
 #include "Archive/Archive.h"
 #include "Utility/PropertyList/PropertyList.h"
 #include "MapEditor/MapSpecials.h"
@@ -30,18 +31,24 @@ struct mobj_cd_t
 {
 	unsigned	id;
 	bool		created;
+	uint8_t		type;
+	unsigned	index;	// Index the object was removed from (if deleted)
 
-	mobj_cd_t(unsigned id, bool created)
+	mobj_cd_t(unsigned id, bool created, uint8_t type = 0, unsigned index = 0)
 	{
 		this->id = id;
 		this->created = created;
+		this->type = type;
+		this->index = index;
 	}
 };
 
 class ParseTreeNode;
+class UDMFReader;
 class SLADEMap
 {
 	friend class MapEditor;
+	friend class UDMFWriteJob;
 private:
 	vector<MapLine*>	lines;
 	vector<MapSide*>	sides;
@@ -65,12 +72,23 @@ private:
 	vector<unsigned>		deleted_objects;
 	vector<unsigned>		created_objects;
 	vector<mobj_cd_t>		created_deleted_objects;
+	bool					record_created_deleted;
 
 	// The last time the map geometry was updated
 	long	geometry_updated;
 	// The last time the thing list was modified
 	long	things_updated;
 
+	// Spatial index for geometry queries
+	MapBlockmap	blockmap;
+	bool		blockmap_rebuild;
+
+	void	refreshBlockmap();
+
+	// Undo/redo of object creation/deletion
+	void						applyCreatedDeleted(mobj_cd_t& cd, bool undo);
+	template<class T> void		changeObjectList(vector<T*>& list, mobj_cd_t& cd, bool undo);
+
 	// Usage counts
 	std::map<string, int>	usage_tex;
 	std::map<string, int>	usage_flat;
@@ -130,6 +148,14 @@ private:
 	bool	addLine(ParseTreeNode* def);
 	bool	addSector(ParseTreeNode* def);
 	bool	addThing(ParseTreeNode* def);
+	bool	addVertex(UDMFReader& udmf, unsigned index);
+	bool	addSide(UDMFReader& udmf, unsigned index);
+	bool	addLine(UDMFReader& udmf, unsigned index);
+	bool	addSector(UDMFReader& udmf, unsigned index);
+	bool	addThing(UDMFReader& udmf, unsigned index);
+	bool	readUDMFText(MemChunk& mc);
+	bool	readUDMFParseTree(MemChunk& mc);
+	void	writeUDMFObject(uint8_t type, unsigned index, std::string& out);
 
 public:
 	SLADEMap();
@@ -170,14 +196,18 @@ public:
 	void				addMapObject(MapObject* object);
 	void				removeMapObject(MapObject* object);
 	MapObject*			getObjectById(unsigned id) { return all_objects[id].mobj; }
-	//void				restoreObjectById(unsigned id);
-	//void				removeObjectById(unsigned id);
-	//vector<mobj_cd_t>&	createdDeletedObjectIds() { return created_deleted_objects; }
-	//void				clearCreatedDeletedOjbectIds() { created_deleted_objects.clear(); }
+	void				recordCreatedDeleted(bool record);
+	void				getCreatedDeleted(vector<mobj_cd_t>& list);
+	void				undoCreatedDeleted(vector<mobj_cd_t>& list);
+	void				redoCreatedDeleted(vector<mobj_cd_t>& list);
 
 	void				getObjectIdList(uint8_t type, vector<unsigned>& list);
 	void				restoreObjectIdList(uint8_t type, vector<unsigned>& list);
 
+	// Blockmap
+	void				updateBlockmap(MapObject* object);
+	MapBlockmap&		getBlockmap() { refreshBlockmap(); return blockmap; }
+
 	void	refreshIndices();
 	bool	readMap(Archive::mapdesc_t map);
 	void	clearMap();
@@ -189,7 +219,7 @@ public:
 	bool	readDoomMap(Archive::mapdesc_t map);
 	bool	readHexenMap(Archive::mapdesc_t map);
 	bool	readDoom64Map(Archive::mapdesc_t map);
-	bool	readUDMFMap(Archive::mapdesc_t map);
+	bool	readUDMFMap(Archive::mapdesc_t map, bool use_parse_tree = false);
 
 	// Map saving
 	bool	writeDoomMap(vector<ArchiveEntry*>& map_entries);
@@ -215,11 +245,13 @@ public:
 	int					nearestThing(fpoint2_t point, double min = 64);
 	vector<int>			nearestThingMulti(fpoint2_t point);
 	int					sectorAt(fpoint2_t point);
+	vector<int>			sectorsAt(vector<fpoint2_t>& points);
 	bbox_t				getMapBBox();
 	MapVertex*			vertexAt(double x, double y);
 	vector<fpoint2_t>	cutLines(double x1, double y1, double x2, double y2);
 	MapVertex*			lineCrossVertex(double x1, double y1, double x2, double y2);
 	void				updateGeometryInfo(long modified_time);
+	void				precalculateGeometry();
 	bool				linesIntersect(MapLine* line1, MapLine* line2, double& x, double& y);
 	void				findSectorTextPoint(MapSector* sector);
 	void				initSectorPolygons();
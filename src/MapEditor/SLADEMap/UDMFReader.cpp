@@ -0,0 +1,602 @@
+
+/*******************************************************************
+ * SLADE - It's a Doom Editor
+ * Copyright (C) 2008-2014 Simon Judd
+ *
+ * Email:       sirjuddington@gmail.com
+ * Web:         http://slade.mancubus.net
+ * Filename:    UDMFReader.cpp
+ * Description: UDMFReader class, a fast single-pass tokenizer for
+ *              UDMF TEXTMAP data, used when opening UDMF maps
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *******************************************************************/
+
+
+/*******************************************************************
+ * INCLUDES
+ *******************************************************************/
+#include "Main.h"
+#include "UDMFReader.h"
+#include "MobjPropertyList.h"
+
+
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+// Builtin keys, in the same order as the UDMFReader::Keys enum
+const char* udmf_builtin_keys[] =
+{
+	"vertex", "linedef", "sidedef", "sector", "thing", "namespace",
+	"x", "y", "v1", "v2", "sidefront", "sideback", "special",
+	"texturetop", "texturemiddle", "texturebottom", "offsetx", "offsety",
+	"texturefloor", "textureceiling", "heightfloor", "heightceiling",
+	"lightlevel", "id", "type", "angle"
+};
+
+
+/*******************************************************************
+ * UDMFREADER HELPER FUNCTIONS
+ *******************************************************************/
+
+/* udmfIsSpecial
+ * Returns true if [c] ends an unquoted token (same special
+ * characters as the default Tokenizer)
+ *******************************************************************/
+bool udmfIsSpecial(char c)
+{
+	switch (c)
+	{
+	case ';': case ',': case ':': case '|': case '=': case '{': case '}': case '/':
+	case ' ': case '\t': case '\r': case '\n': case '"':
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* udmfIsWord
+ * Returns true if the [length] characters at [token] match the
+ * lowercase [word], ignoring case
+ *******************************************************************/
+bool udmfIsWord(const char* token, unsigned length, const char* word)
+{
+	for (unsigned a = 0; a < length; a++)
+	{
+		if (word[a] == 0 || tolower(token[a]) != word[a])
+			return false;
+	}
+
+	return word[length] == 0;
+}
+
+/* udmfIsDigit
+ * Returns true if [c] is a decimal digit
+ *******************************************************************/
+bool udmfIsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+
+/*******************************************************************
+ * UDMFREADER CLASS FUNCTIONS
+ *******************************************************************/
+
+/* UDMFReader::UDMFReader
+ * UDMFReader class constructor
+ *******************************************************************/
+UDMFReader::UDMFReader()
+{
+	// Init variables
+	data = NULL;
+	size = 0;
+	pos = 0;
+	line = 1;
+	key_table.assign(256, -1);
+
+	// Intern builtin keys first so they get the indices in the Keys enum
+	for (unsigned a = 0; a < KEY_BUILTIN_COUNT; a++)
+		internKey(udmf_builtin_keys[a], strlen(udmf_builtin_keys[a]));
+}
+
+/* UDMFReader::~UDMFReader
+ * UDMFReader class destructor
+ *******************************************************************/
+UDMFReader::~UDMFReader()
+{
+}
+
+/* UDMFReader::internKey
+ * Returns the index of the key [name] ([length] characters), adding
+ * it to the key list if it isn't there already
+ *******************************************************************/
+unsigned UDMFReader::internKey(const char* name, unsigned length)
+{
+	// Look for existing key
+	unsigned mask = key_table.size() - 1;
+	unsigned slot = hashKey(name, length) & mask;
+	while (key_table[slot] >= 0)
+	{
+		const std::string& raw = key_raw[key_table[slot]];
+		if (raw.size() == length && memcmp(raw.data(), name, length) == 0)
+			return key_table[slot];
+		slot = (slot + 1) & mask;
+	}
+
+	// Add new key
+	unsigned key = key_raw.size();
+	key_raw.push_back(std::string(name, length));
+	key_names.push_back(wxString::FromUTF8(name, length));
+	key_canonical.push_back(key);
+	key_table[slot] = key;
+	if (key_raw.size() * 2 > key_table.size())
+		rehashKeys(key_table.size() * 2);
+
+	// The canonical key is the lowercase version of the key
+	std::string lower = key_raw[key];
+	for (unsigned a = 0; a < lower.size(); a++)
+		lower[a] = tolower(lower[a]);
+	if (lower != key_raw[key])
+	{
+		unsigned canonical = internKey(lower.data(), lower.size());
+		key_canonical[key] = canonical;
+	}
+
+	return key;
+}
+
+/* UDMFReader::rehashKeys
+ * Rebuilds the key hash table with [table_size] slots (must be a
+ * power of 2)
+ *******************************************************************/
+void UDMFReader::rehashKeys(unsigned table_size)
+{
+	key_table.assign(table_size, -1);
+	unsigned mask = table_size - 1;
+	for (unsigned a = 0; a < key_raw.size(); a++)
+	{
+		unsigned slot = hashKey(key_raw[a].data(), key_raw[a].size()) & mask;
+		while (key_table[slot] >= 0)
+			slot = (slot + 1) & mask;
+		key_table[slot] = a;
+	}
+}
+
+/* UDMFReader::skipWhitespace
+ * Moves past any whitespace and comments. Returns false if the end
+ * of the text was reached
+ *******************************************************************/
+bool UDMFReader::skipWhitespace()
+{
+	while (pos < size)
+	{
+		char c = data[pos];
+
+		// Whitespace
+		if (c == ' ' || c == '\t' || c == '\r')
+			pos++;
+		else if (c == '\n')
+		{
+			line++;
+			pos++;
+		}
+
+		// Line comment (// or ##)
+		else if (pos + 1 < size && ((c == '/' && data[pos + 1] == '/') || (c == '#' && data[pos + 1] == '#')))
+		{
+			while (pos < size && data[pos] != '\n')
+				pos++;
+		}
+
+		// Multiline comment
+		else if (pos + 1 < size && c == '/' && data[pos + 1] == '*')
+		{
+			pos += 2;
+			while (pos < size && !(data[pos] == '*' && pos + 1 < size && data[pos + 1] == '/'))
+			{
+				if (data[pos] == '\n')
+					line++;
+				pos++;
+			}
+			pos += 2;
+		}
+
+		else
+			return true;
+	}
+
+	return false;
+}
+
+/* UDMFReader::readIdentifier
+ * Reads an identifier (block type or property key) at the current
+ * position, writing its position and length to [start] and [length].
+ * Returns false if there is no identifier here
+ *******************************************************************/
+bool UDMFReader::readIdentifier(unsigned& start, unsigned& length)
+{
+	start = pos;
+	while (pos < size && !udmfIsSpecial(data[pos]))
+		pos++;
+	length = pos - start;
+
+	return length > 0;
+}
+
+/* UDMFReader::readValue
+ * Reads a property value at the current position into [prop].
+ * Values are typed the same way as the generic Parser does.
+ * Returns false if there is no value here
+ *******************************************************************/
+bool UDMFReader::readValue(udmf_prop_t& prop)
+{
+	if (!skipWhitespace())
+		return false;
+
+	// Quoted string
+	if (data[pos] == '"')
+	{
+		unsigned start = ++pos;
+		while (pos < size && data[pos] != '"')
+		{
+			if (data[pos] == '\\')
+				pos++;
+			else if (data[pos] == '\n')
+				line++;
+			pos++;
+		}
+		if (pos >= size)
+			return false;
+
+		prop.type = VAL_STRING;
+		prop.value.str.start = start;
+		prop.value.str.length = pos - start;
+		pos++;	// Skip closing "
+		return true;
+	}
+
+	// Unquoted token
+	unsigned start, length;
+	if (!readIdentifier(start, length))
+		return false;
+	const char* token = data + start;
+
+	// Boolean
+	if (udmfIsWord(token, length, "true"))
+	{
+		prop.type = VAL_BOOL;
+		prop.value.i = 1;
+		return true;
+	}
+	if (udmfIsWord(token, length, "false"))
+	{
+		prop.type = VAL_BOOL;
+		prop.value.i = 0;
+		return true;
+	}
+
+	// Check for number
+	prop.type = VAL_WORD;
+	if (length < 64)
+	{
+		char buf[64];
+		memcpy(buf, token, length);
+		buf[length] = 0;
+
+		unsigned a = (buf[0] == '+' || buf[0] == '-') ? 1 : 0;
+		unsigned digits = a;
+		while (udmfIsDigit(buf[digits]))
+			digits++;
+
+		// Integer
+		if (digits > a && digits == length)
+		{
+			prop.type = VAL_INT;
+			prop.value.i = (int)strtol(buf, NULL, 10);
+		}
+
+		// Hex
+		else if (length > 2 && buf[0] == '0' && buf[1] == 'x' && strspn(buf + 2, "0123456789abcdefABCDEF") == length - 2)
+		{
+			prop.type = VAL_INT;
+			prop.value.i = (int)strtol(buf, NULL, 16);
+		}
+
+		// Floating point
+		else
+		{
+			// Digits are needed before the exponent, after the . if any
+			unsigned b = digits;
+			bool has_digits = (digits > a);
+			if (buf[b] == '.')
+			{
+				unsigned frac = ++b;
+				while (udmfIsDigit(buf[b]))
+					b++;
+				has_digits = (b > frac);
+			}
+			if (has_digits && (buf[b] == 'e' || buf[b] == 'E'))
+			{
+				unsigned e = b + 1;
+				if (buf[e] == '+' || buf[e] == '-')
+					e++;
+				unsigned exp = e;
+				while (udmfIsDigit(buf[e]))
+					e++;
+				if (e > exp)
+					b = e;
+			}
+			if (has_digits && b == length)
+			{
+				prop.type = VAL_FLOAT;
+				prop.value.f = strtod(buf, NULL);
+			}
+		}
+	}
+
+	// Anything else is an unquoted string
+	if (prop.type == VAL_WORD)
+	{
+		prop.value.str.start = start;
+		prop.value.str.length = length;
+	}
+
+	return true;
+}
+
+/* UDMFReader::expect
+ * Moves past the character [c], which should be the next thing in
+ * the text. Returns false if it isn't
+ *******************************************************************/
+bool UDMFReader::expect(char c)
+{
+	if (!skipWhitespace() || data[pos] != c)
+	{
+		if (pos < size)
+			error(S_FMT("Expected \"%c\", got \"%c\"", c, data[pos]));
+		else
+			error(S_FMT("Expected \"%c\", got end of text", c));
+		return false;
+	}
+
+	pos++;
+	return true;
+}
+
+/* UDMFReader::error
+ * Logs a parsing error [message] at the current line
+ *******************************************************************/
+void UDMFReader::error(string message)
+{
+	wxLogMessage("Parsing error: %s in %s (line %d)", message, source, line);
+}
+
+/* UDMFReader::parse
+ * Reads all blocks and properties from UDMF text in [mc]. Property
+ * values refer to the text, so [mc] must not be changed or freed
+ * while values are being read from this reader. Returns false if
+ * the text couldn't be parsed
+ *******************************************************************/
+bool UDMFReader::parse(MemChunk& mc, string source)
+{
+	clear();
+	data = (const char*)mc.getData();
+	size = mc.getSize();
+	pos = 0;
+	line = 1;
+	this->source = source;
+
+	// Most properties are on a line of their own
+	props.reserve(size / 16);
+
+	unsigned start, length;
+	udmf_prop_t prop;
+	while (skipWhitespace())
+	{
+		// Read block type/global property key
+		if (!readIdentifier(start, length))
+		{
+			error(S_FMT("Unexpected \"%c\"", data[pos]));
+			return false;
+		}
+		unsigned ikey = key_canonical[internKey(data + start, length)];
+
+		if (!skipWhitespace())
+		{
+			error("Unexpected end of text");
+			return false;
+		}
+
+		// Global property (namespace)
+		if (data[pos] == '=')
+		{
+			pos++;
+			if (!readValue(prop))
+			{
+				error("Expected value");
+				return false;
+			}
+			if (!expect(';'))
+				return false;
+
+			if (ikey == KEY_NAMESPACE)
+				udmf_namespace = getStringValue(prop);
+
+			continue;
+		}
+
+		// Block
+		if (!expect('{'))
+			return false;
+		udmf_block_t block;
+		block.first = props.size();
+		while (true)
+		{
+			if (!skipWhitespace())
+			{
+				error("Unexpected end of text within block");
+				return false;
+			}
+
+			// End of block
+			if (data[pos] == '}')
+			{
+				pos++;
+				break;
+			}
+
+			// Property
+			if (!readIdentifier(start, length))
+			{
+				error(S_FMT("Unexpected \"%c\"", data[pos]));
+				return false;
+			}
+			prop.key = internKey(data + start, length);
+			prop.ikey = key_canonical[prop.key];
+			if (!expect('='))
+				return false;
+			if (!readValue(prop))
+			{
+				error("Expected value");
+				return false;
+			}
+			if (!expect(';'))
+				return false;
+
+			props.push_back(prop);
+		}
+		block.count = props.size() - block.first;
+
+		// Keep known blocks only
+		if (ikey <= KEY_THING)
+			blocks[ikey].push_back(block);
+		else
+			props.resize(block.first);
+	}
+
+	return true;
+}
+
+/* UDMFReader::clear
+ * Clears all parsed data (interned keys are kept)
+ *******************************************************************/
+void UDMFReader::clear()
+{
+	props.clear();
+	for (unsigned a = 0; a <= KEY_THING; a++)
+		blocks[a].clear();
+	udmf_namespace.Clear();
+}
+
+/* UDMFReader::propertyKey
+ * Returns the MobjPropertyList key for [key], so properties can be
+ * added to map objects without looking up the name every time
+ *******************************************************************/
+unsigned UDMFReader::propertyKey(unsigned key)
+{
+	if (key_mobj.size() < key_names.size())
+		key_mobj.resize(key_names.size(), -1);
+
+	if (key_mobj[key] < 0)
+		key_mobj[key] = MobjPropertyList::internKey(key_names[key]);
+
+	return key_mobj[key];
+}
+
+/* UDMFReader::findProp
+ * Returns the index of the first property in [block] with canonical
+ * key [ikey], or -1 if there isn't one
+ *******************************************************************/
+int UDMFReader::findProp(udmf_block_t& block, unsigned ikey)
+{
+	for (unsigned a = block.first; a < block.first + block.count; a++)
+	{
+		if (props[a].ikey == ikey)
+			return a;
+	}
+
+	return -1;
+}
+
+/* UDMFReader::getValue
+ * Returns the value of [prop] as a Property
+ *******************************************************************/
+Property UDMFReader::getValue(udmf_prop_t& prop)
+{
+	switch (prop.type)
+	{
+	case VAL_BOOL:	return Property(prop.value.i != 0);
+	case VAL_INT:	return Property(prop.value.i);
+	case VAL_FLOAT:	return Property(prop.value.f);
+	default:		return Property(getStringValue(prop));
+	}
+}
+
+/* UDMFReader::getStringValue
+ * Returns the value of [prop] as a string
+ *******************************************************************/
+string UDMFReader::getStringValue(udmf_prop_t& prop)
+{
+	if (prop.type != VAL_STRING && prop.type != VAL_WORD)
+		return getValue(prop).getStringValue();
+
+	// Plain ascii with no escapes can be converted directly
+	const char* str = data + prop.value.str.start;
+	unsigned length = prop.value.str.length;
+	bool simple = true;
+	for (unsigned a = 0; a < length; a++)
+	{
+		if (str[a] == '\\' || (uint8_t)str[a] >= 0x80)
+		{
+			simple = false;
+			break;
+		}
+	}
+	if (simple)
+		return wxString::FromAscii(str, length);
+
+	// Otherwise build it a character at a time as the Tokenizer does
+	string value;
+	for (unsigned a = 0; a < length; a++)
+	{
+		if (str[a] == '\\' && a + 1 < length)
+			a++;
+		value += str[a];
+	}
+
+	return value;
+}
+
+
+/*******************************************************************
+ * UDMFREADER CLASS STATIC FUNCTIONS
+ *******************************************************************/
+
+/* UDMFReader::hashKey (static)
+ * Returns a hash of the key [name] ([length] characters)
+ *******************************************************************/
+uint32_t UDMFReader::hashKey(const char* name, unsigned length)
+{
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (unsigned a = 0; a < length; a++)
+	{
+		hash ^= (uint8_t)name[a];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
@@ -0,0 +1,132 @@
+
+#ifndef __UDMF_READER_H__
+#define __UDMF_READER_H__
+
+#include "Utility/PropertyList/Property.h"
+
+// A single-pass reader for UDMF TEXTMAP data. The text is tokenized
+// straight from the given data into flat lists of blocks and their
+// properties, without building a ParseTree. Property keys are interned,
+// each distinct key is stored once and referred to by index, and keys
+// that only differ by case share the same 'canonical' key index.
+//
+// Keys for the builtin properties and block types are interned first,
+// so their canonical indices are the values in the Keys enum
+class UDMFReader
+{
+public:
+	enum Keys
+	{
+		// Block types
+		KEY_VERTEX = 0,
+		KEY_LINEDEF,
+		KEY_SIDEDEF,
+		KEY_SECTOR,		// Also the sidedef sector property
+		KEY_THING,
+		KEY_NAMESPACE,
+
+		// Properties
+		KEY_X,
+		KEY_Y,
+		KEY_V1,
+		KEY_V2,
+		KEY_SIDEFRONT,
+		KEY_SIDEBACK,
+		KEY_SPECIAL,
+		KEY_TEXTURETOP,
+		KEY_TEXTUREMIDDLE,
+		KEY_TEXTUREBOTTOM,
+		KEY_OFFSETX,
+		KEY_OFFSETY,
+		KEY_TEXTUREFLOOR,
+		KEY_TEXTURECEILING,
+		KEY_HEIGHTFLOOR,
+		KEY_HEIGHTCEILING,
+		KEY_LIGHTLEVEL,
+		KEY_ID,
+		KEY_TYPE,
+		KEY_ANGLE,
+
+		KEY_BUILTIN_COUNT
+	};
+
+	enum ValueTypes
+	{
+		VAL_STRING = 0,	// Quoted string
+		VAL_WORD,		// Unquoted string (not a number or boolean)
+		VAL_BOOL,
+		VAL_INT,
+		VAL_FLOAT
+	};
+
+	struct udmf_prop_t
+	{
+		unsigned	key;
+		unsigned	ikey;		// Canonical (case-insensitive) key
+		uint8_t		type;
+		union
+		{
+			int		i;
+			double	f;
+			struct { uint32_t start, length; } str;
+		} value;
+	};
+
+	struct udmf_block_t
+	{
+		unsigned	first;		// Index of first property
+		unsigned	count;		// Number of properties
+	};
+
+private:
+	const char*				data;
+	unsigned				size;
+	unsigned				pos;
+	unsigned				line;
+	string					source;
+
+	// Interned keys
+	vector<std::string>		key_raw;
+	vector<string>			key_names;
+	vector<unsigned>		key_canonical;
+	vector<int>				key_table;		// Hash table of key indices (-1 = empty)
+	vector<int>				key_mobj;		// MobjPropertyList keys (-1 = not looked up yet)
+
+	// Parsed data
+	vector<udmf_prop_t>		props;
+	vector<udmf_block_t>	blocks[KEY_THING + 1];
+	string					udmf_namespace;
+
+	unsigned	internKey(const char* name, unsigned length);
+	void		rehashKeys(unsigned table_size);
+	bool		skipWhitespace();
+	bool		readIdentifier(unsigned& start, unsigned& length);
+	bool		readValue(udmf_prop_t& prop);
+	bool		expect(char c);
+	void		error(string message);
+
+	static uint32_t	hashKey(const char* name, unsigned length);
+
+public:
+	UDMFReader();
+	~UDMFReader();
+
+	bool	parse(MemChunk& mc, string source = "TEXTMAP");
+	void	clear();
+
+	string			getNamespace() { return udmf_namespace; }
+	unsigned		nBlocks(unsigned type) { return type <= KEY_THING ? blocks[type].size() : 0; }
+	udmf_block_t&	getBlock(unsigned type, unsigned index) { return blocks[type][index]; }
+	udmf_prop_t&	getProp(unsigned index) { return props[index]; }
+	unsigned		nKeys() { return key_names.size(); }
+	const string&	keyName(unsigned key) { return key_names[key]; }
+	unsigned		propertyKey(unsigned key);
+
+	Property	getValue(udmf_prop_t& prop);
+	string		getStringValue(udmf_prop_t& prop);
+	int			getIntValue(udmf_prop_t& prop) { return (prop.type == VAL_INT || prop.type == VAL_BOOL) ? prop.value.i : getValue(prop).getIntValue(); }
+	double		getFloatValue(udmf_prop_t& prop) { return prop.type == VAL_FLOAT ? prop.value.f : getValue(prop).getFloatValue(); }
+	int			findProp(udmf_block_t& block, unsigned ikey);
+};
+
+#endif//__UDMF_READER_H__
@@ -32,11 +32,13 @@
  *******************************************************************/
 #include "Main.h"
 #include "MapChecksPanel.h"
+#include "General/ResourceManager.h"
 #include "MapEditor/GameConfiguration/GameConfiguration.h"
 #include "MapEditor/MapChecks.h"
 #include "MapEditor/MapEditorWindow.h"
 #include "MapEditor/SLADEMap/SLADEMap.h"
 #include "Utility/SFileDialog.h"
+#include "Utility/ParallelJob.h"
 #include <wx/button.h>
 #include <wx/checkbox.h>
 #include <wx/gbsizer.h>
@@ -44,6 +46,89 @@
 #include <wx/stattext.h>
 
 
+/*******************************************************************
+ * VARIABLES
+ *******************************************************************/
+CVAR(Int, map_check_threads, 0, CVAR_SAVE)
+
+
+/*******************************************************************
+ * MAPCHECKJOB CLASS
+ *******************************************************************
+ * Runs a number of (thread-safe) map checks concurrently, one check
+ * per item. If a check's [since] is zero or more, checks that support
+ * it only re-check objects modified since then
+ */
+class MapCheckJob : public ParallelJob
+{
+private:
+	vector<MapCheck*>	checks;
+	vector<long>		since;
+	vector<long>		times;
+	vector<bool>		incremental;
+
+public:
+	void addCheck(MapCheck* check, long since)
+	{
+		checks.push_back(check);
+		this->since.push_back(since);
+		times.push_back(0);
+		incremental.push_back(false);
+	}
+
+	unsigned	nChecks() { return checks.size(); }
+	long		checkTime(unsigned index) { return times[index]; }
+	bool		wasIncremental(unsigned index) { return incremental[index]; }
+
+	void process(unsigned index)
+	{
+		long start = theApp->runTimer();
+		incremental[index] = runCheck(checks[index], since[index]);
+		times[index] = theApp->runTimer() - start;
+	}
+
+	/* MapCheckJob::runCheck (static)
+	 * Runs [check], only re-checking objects modified since [since] if
+	 * possible. Returns true if the check was only re-checked
+	 *******************************************************************/
+	static bool runCheck(MapCheck* check, long since)
+	{
+		if (since >= 0 && check->recheck(since))
+			return true;
+
+		check->doCheck();
+		return false;
+	}
+};
+
+
+/*******************************************************************
+ * MAPCHECKTHREAD CLASS
+ *******************************************************************
+ * A joinable thread that runs a MapCheckJob in the background while
+ * the remaining (not thread-safe) checks are run on the main thread
+ */
+class MapCheckThread : public wxThread
+{
+private:
+	MapCheckJob*	job;
+	unsigned		threads;
+
+public:
+	MapCheckThread(MapCheckJob* job, unsigned threads) : wxThread(wxTHREAD_JOINABLE)
+	{
+		this->job = job;
+		this->threads = threads;
+	}
+
+	ExitCode Entry()
+	{
+		job->run(job->nChecks(), threads, 1);
+		return 0;
+	}
+};
+
+
 /*******************************************************************
  * MAPCHECKSPANEL CLASS FUNCTIONS
  *******************************************************************/
@@ -55,6 +140,12 @@ MapChecksPanel::MapChecksPanel(wxWindow* parent, SLADEMap* map) : wxPanel(parent
 {
 	// Init
 	this->map = map;
+	active_selection = 0;
+	last_check_time = -1;
+	resources_changed = false;
+
+	// Listen for resource changes (checks using them need a full re-check)
+	listenTo(theResourceManager);
 
 	// Setup sizer
 	wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
@@ -178,6 +269,122 @@ void MapChecksPanel::updateStatusText(string text)
 	Refresh();
 }
 
+/* MapChecksPanel::selectedChecks
+ * Returns a bit mask of the currently selected checks
+ *******************************************************************/
+unsigned MapChecksPanel::selectedChecks()
+{
+	wxCheckBox* boxes[] =
+	{
+		cb_missing_tex, cb_special_tags, cb_intersecting, cb_overlapping,
+		cb_unknown_tex, cb_unknown_flats, cb_unknown_things, cb_overlapping_things,
+		cb_stuck_things, cb_sector_refs, cb_invalid_lines
+	};
+
+	unsigned selected = 0;
+	for (unsigned a = 0; a < 11; a++)
+	{
+		if (boxes[a]->GetValue())
+			selected |= (1 << a);
+	}
+
+	return selected;
+}
+
+/* MapChecksPanel::runChecks
+ * Runs all active checks. Thread-safe checks are run concurrently on
+ * worker threads while the rest are run (in order) on this thread.
+ * If [since] is zero or more, checks only re-check objects modified
+ * since then where possible (unless they use resources or the game
+ * configuration, and either has changed since the last check)
+ *******************************************************************/
+void MapChecksPanel::runChecks(long since)
+{
+	// Check if resources or the game configuration have changed
+	string config = theGameConfiguration->currentGame() + ":" + theGameConfiguration->currentPort();
+	bool resources_modified = resources_changed || config != last_check_config;
+	resources_changed = false;
+	last_check_config = config;
+	vector<long> check_since(active_checks.size(), since);
+	for (unsigned a = 0; a < active_checks.size(); a++)
+	{
+		if (resources_modified && active_checks[a]->usesResources())
+			check_since[a] = -1;
+	}
+
+	check_times.assign(active_checks.size(), 0);
+	check_incremental.assign(active_checks.size(), false);
+
+	// Split thread-safe checks off to run in the background
+	MapCheckJob job;
+	vector<unsigned> job_checks;
+	unsigned threads = ParallelJob::numThreads(map_check_threads);
+	if (threads > 1)
+	{
+		for (unsigned a = 0; a < active_checks.size(); a++)
+		{
+			if (active_checks[a]->isThreadSafe())
+			{
+				job.addCheck(active_checks[a], check_since[a]);
+				job_checks.push_back(a);
+			}
+		}
+	}
+
+	// Geometry info (line vectors, sector bboxes and line grids, the
+	// blockmap) is otherwise calculated on first use, make sure that all
+	// happens here rather than while the background checks are reading
+	// the map. Other than that, the map isn't modified while checks are
+	// running, and UI events aren't processed until the background
+	// checks have finished (so the map can't be edited)
+	MapCheckThread* thread = NULL;
+	if (job.nChecks() > 0)
+	{
+		updateStatusText("Running checks...");
+		map->precalculateGeometry();
+
+		thread = new MapCheckThread(&job, threads - 1);
+		if (thread->Create() != wxTHREAD_NO_ERROR || thread->Run() != wxTHREAD_NO_ERROR)
+		{
+			delete thread;
+			thread = NULL;
+		}
+	}
+
+	// Run the remaining checks (or all if the thread couldn't be started)
+	unsigned next_job = 0;
+	for (unsigned a = 0; a < active_checks.size(); a++)
+	{
+		if (thread && next_job < job_checks.size() && job_checks[next_job] == a)
+		{
+			next_job++;
+			continue;
+		}
+
+		if (thread)
+			label_status->SetLabel(active_checks[a]->progressText());
+		else
+			updateStatusText(active_checks[a]->progressText());
+		long start = theApp->runTimer();
+		check_incremental[a] = MapCheckJob::runCheck(active_checks[a], check_since[a]);
+		check_times[a] = theApp->runTimer() - start;
+	}
+
+	// Wait for background checks
+	if (thread)
+	{
+		label_status->SetLabel("Waiting for remaining checks...");
+		thread->Wait();
+		delete thread;
+
+		for (unsigned a = 0; a < job_checks.size(); a++)
+		{
+			check_times[job_checks[a]] = job.checkTime(a);
+			check_incremental[job_checks[a]] = job.wasIncremental(a);
+		}
+	}
+}
+
 /* MapChecksPanel::showCheckItem
  * Shows the selected problem on the map view and sets up fix buttons
  *******************************************************************/
@@ -293,11 +500,24 @@ void MapChecksPanel::reset()
 	for (unsigned a = 0; a < active_checks.size(); a++)
 		delete active_checks[a];
 	active_checks.clear();
+	active_selection = 0;
+	last_check_time = -1;
 
 	refreshList();
 	lb_errors->Show(true);
 }
 
+/* MapChecksPanel::onAnnouncement
+ * Called when an announcement is recieved from the resource manager
+ *******************************************************************/
+void MapChecksPanel::onAnnouncement(Announcer* announcer, string event_name, MemChunk& event_data)
+{
+	// Checks using resources can't just re-check modified objects
+	// once the resources have changed
+	if (announcer == theResourceManager && event_name == "resources_updated")
+		resources_changed = true;
+}
+
 
 /*******************************************************************
  * MAPCHECKSPANEL CLASS EVENTS
@@ -319,59 +539,80 @@ void MapChecksPanel::onBtnCheck(wxCommandEvent& e)
 	btn_export->Enable(false);
 	check_items.clear();
 
-	// Clear previous checks
-	for (unsigned a = 0; a < active_checks.size(); a++)
-		delete active_checks[a];
-	active_checks.clear();
-
-	// Setup checks
-	if (cb_missing_tex->GetValue())
-		active_checks.push_back(MapCheck::missingTextureCheck(map));
-	if (cb_special_tags->GetValue())
-		active_checks.push_back(MapCheck::specialTagCheck(map));
-	if (cb_intersecting->GetValue())
-		active_checks.push_back(MapCheck::intersectingLineCheck(map));
-	if (cb_overlapping->GetValue())
-		active_checks.push_back(MapCheck::overlappingLineCheck(map));
-	if (cb_unknown_tex->GetValue())
-		active_checks.push_back(MapCheck::unknownTextureCheck(map, texman));
-	if (cb_unknown_flats->GetValue())
-		active_checks.push_back(MapCheck::unknownFlatCheck(map, texman));
-	if (cb_unknown_things->GetValue())
-		active_checks.push_back(MapCheck::unknownThingTypeCheck(map));
-	if (cb_overlapping_things->GetValue())
-		active_checks.push_back(MapCheck::overlappingThingCheck(map));
-	if (cb_stuck_things->GetValue())
-		active_checks.push_back(MapCheck::stuckThingsCheck(map));
-	if (cb_sector_refs->GetValue())
-		active_checks.push_back(MapCheck::sectorReferenceCheck(map));
-	if (cb_invalid_lines->GetValue())
-		active_checks.push_back(MapCheck::invalidLineCheck(map));
+	// If the same checks are selected as last time, keep them and only
+	// re-check objects modified since then
+	unsigned selection = selectedChecks();
+	long since = -1;
+	if (selection == active_selection && last_check_time >= 0)
+		since = last_check_time;
+	else
+	{
+		// Clear previous checks
+		for (unsigned a = 0; a < active_checks.size(); a++)
+			delete active_checks[a];
+		active_checks.clear();
+
+		// Setup checks
+		if (cb_missing_tex->GetValue())
+			active_checks.push_back(MapCheck::missingTextureCheck(map));
+		if (cb_special_tags->GetValue())
+			active_checks.push_back(MapCheck::specialTagCheck(map));
+		if (cb_intersecting->GetValue())
+			active_checks.push_back(MapCheck::intersectingLineCheck(map));
+		if (cb_overlapping->GetValue())
+			active_checks.push_back(MapCheck::overlappingLineCheck(map));
+		if (cb_unknown_tex->GetValue())
+			active_checks.push_back(MapCheck::unknownTextureCheck(map, texman));
+		if (cb_unknown_flats->GetValue())
+			active_checks.push_back(MapCheck::unknownFlatCheck(map, texman));
+		if (cb_unknown_things->GetValue())
+			active_checks.push_back(MapCheck::unknownThingTypeCheck(map));
+		if (cb_overlapping_things->GetValue())
+			active_checks.push_back(MapCheck::overlappingThingCheck(map));
+		if (cb_stuck_things->GetValue())
+			active_checks.push_back(MapCheck::stuckThingsCheck(map));
+		if (cb_sector_refs->GetValue())
+			active_checks.push_back(MapCheck::sectorReferenceCheck(map));
+		if (cb_invalid_lines->GetValue())
+			active_checks.push_back(MapCheck::invalidLineCheck(map));
+	}
+	active_selection = selection;
 
 	// Run checks
+	long start = theApp->runTimer();
+	last_check_time = start;
+	runChecks(since);
+	long total_time = theApp->runTimer() - start;
+
+	// Add results to list, and log the time each check took
+	string timing;
 	for (unsigned a = 0; a < active_checks.size(); a++)
 	{
-		// Check
-		updateStatusText(active_checks[a]->progressText());
-		active_checks[a]->doCheck();
-
-		// Add results to list
 		for (unsigned b = 0; b < active_checks[a]->nProblems(); b++)
 		{
 			lb_errors->Append(active_checks[a]->problemDesc(b));
 			check_items.push_back(check_item_t(active_checks[a], b));
 		}
+
+		string desc = active_checks[a]->progressText();
+		desc.Replace("Checking", "Check", false);
+		desc.Replace("...", "");
+		string line = S_FMT("%s: %ldms%s (%d problems)", desc, check_times[a], check_incremental[a] ? " (modified objects only)" : "",
+		                    (int)active_checks[a]->nProblems());
+		LOG_MESSAGE(1, "Map check - %s", line);
+		timing += line + "\n";
 	}
+	label_status->SetToolTip(timing.Trim());
 
 	lb_errors->Show(true);
 
 	if (lb_errors->GetCount() > 0)
 	{
-		updateStatusText(S_FMT("%d problems found", lb_errors->GetCount()));
+		updateStatusText(S_FMT("%d problems found (%ldms)", lb_errors->GetCount(), total_time));
 		btn_export->Enable(true);
 	}
 	else
-		updateStatusText("No problems found");
+		updateStatusText(S_FMT("No problems found (%ldms)", total_time));
 }
 
 /* MapChecksPanel::onListBoxItem
@@ -3,16 +3,23 @@
 #define __MAP_CHECKS_DIALOG_H__
 
 #include "UI/WxBasicControls.h"
+#include "General/ListenerAnnouncer.h"
 #include <wx/panel.h>
 
 class SLADEMap;
 class MapCheck;
 class wxListBox;
-class MapChecksPanel : public wxPanel
+class MapChecksPanel : public wxPanel, Listener
 {
 private:
 	SLADEMap*					map;
 	vector<MapCheck*>	active_checks;
+	vector<long>		check_times;
+	vector<bool>		check_incremental;
+	unsigned			active_selection;
+	long				last_check_time;
+	bool				resources_changed;	// Resources were changed since the last check
+	string				last_check_config;	// Game configuration used for the last check
 
 	wxCheckBox*		cb_missing_tex;
 	wxCheckBox*		cb_special_tags;
@@ -50,10 +57,14 @@ public:
 	~MapChecksPanel();
 
 	void	updateStatusText(string text);
+	unsigned	selectedChecks();
+	void	runChecks(long since);
 	void	showCheckItem(unsigned index);
 	void	refreshList();
 	void	reset();
 
+	void	onAnnouncement(Announcer* announcer, string event_name, MemChunk& event_data);
+
 	// Events
 	void	onBtnCheck(wxCommandEvent& e);
 	void	onListBoxItem(wxCommandEvent& e);
@@ -65,6 +65,94 @@ wxDEFINE_EVENT(EVT_AEL_DIR_CHANGED, wxCommandEvent);
 EXTERN_CVAR(Bool, list_font_monospace)
 
 
+/*******************************************************************
+ * ENTRY NAME FILTER
+ *******************************************************************/
+
+/* elist_filter_term_t
+ * A name filter term, 'compiled' once per filter so that entry names
+ * can be checked quickly
+ *******************************************************************/
+struct elist_filter_term_t
+{
+	string	pattern;		// Lowercase, without spaces, with * added to the end
+	string	prefix;			// The pattern up to the first wildcard
+	bool	prefix_only;	// True if the pattern is just [prefix]*
+
+	elist_filter_term_t(string term)
+	{
+		// Remove spaces
+		term.Replace(" ", "");
+
+		// Set to lowercase and add * to the end
+		if (!term.IsEmpty())
+			term = term.Lower() + "*";
+
+		pattern = term;
+		size_t wildcard = pattern.find_first_of("*?");
+		prefix = (wildcard == string::npos) ? pattern : pattern.Left(wildcard);
+		prefix_only = (wildcard != string::npos && wildcard == pattern.length() - 1);
+	}
+};
+
+/* elistMatchWildcard
+ * Returns true if [name] matches [pattern], where * in the pattern
+ * matches any number of characters and ? matches any single character
+ * (same as wxString::Matches)
+ *******************************************************************/
+bool elistMatchWildcard(const wchar_t* name, const wchar_t* pattern)
+{
+	const wchar_t* star = NULL;
+	const wchar_t* retry = NULL;
+	while (*name)
+	{
+		if (*pattern == '*')
+		{
+			// Remember the star, initially matching nothing
+			star = pattern++;
+			retry = name;
+		}
+		else if (*pattern == '?' || *pattern == *name)
+		{
+			pattern++;
+			name++;
+		}
+		else if (star)
+		{
+			// Mismatch, let the last star match one more character
+			pattern = star + 1;
+			name = ++retry;
+		}
+		else
+			return false;
+	}
+
+	// Any remaining stars match nothing
+	while (*pattern == '*')
+		pattern++;
+
+	return *pattern == 0;
+}
+
+/* elistMatchFilter
+ * Returns true if [name] (lowercase) matches any of [terms]
+ *******************************************************************/
+bool elistMatchFilter(const string& name, const vector<elist_filter_term_t>& terms)
+{
+	for (unsigned a = 0; a < terms.size(); a++)
+	{
+		const elist_filter_term_t& term = terms[a];
+		if (!name.StartsWith(term.prefix))
+			continue;
+
+		if (term.prefix_only || elistMatchWildcard(name.wc_str(), term.pattern.wc_str()))
+			return true;
+	}
+
+	return false;
+}
+
+
 /*******************************************************************
  * ARCHIVEENTRYLIST CLASS FUNCTIONS
  *******************************************************************/
@@ -81,6 +169,8 @@ EXTERN_CVAR(Bool, list_font_monospace)
 	show_dir_back = false;
 	undo_manager = NULL;
 	entries_update = true;
+	filter_dir = NULL;
+	filter_prev_dirs = false;
 
 	// Create dummy 'up folder' entry
 	entry_dir_back = new ArchiveEntry();
@@ -278,6 +368,7 @@ void ArchiveEntryList::setArchive(Archive* archive)
 
 		// Open root directory
 		current_dir = archive->getRoot();
+		filter_dir = NULL;
 		applyFilter();
 		updateList();
 	}
@@ -414,17 +505,46 @@ void ArchiveEntryList::filterList(string filter, string category)
 }
 
 /* ArchiveEntryList::applyFilter
- * Applies the current filter(s) to the list
+ * Applies the current filter(s) to the list. If the filter text was
+ * only extended since the last time (with the same category and
+ * directory), only the currently listed items are checked again
  *******************************************************************/
 void ArchiveEntryList::applyFilter()
 {
-	// Clear current filter list
-	items.clear();
+	// Check if the current items can just be narrowed down: extending the last
+	// name filter term can only remove matches (unless it was empty, since an
+	// empty term doesn't get * added)
+	bool narrow = false;
+	if (filter_dir == current_dir && !filter_prev_text.IsEmpty() &&
+	        filter_category == filter_prev_category && elist_filter_dirs == filter_prev_dirs &&
+	        filter_text.StartsWith(filter_prev_text) && !filter_text.Mid(filter_prev_text.length()).Contains(","))
+	{
+		string last_term = filter_prev_text.AfterLast(',');
+		last_term.Replace(" ", "");
+		narrow = !last_term.IsEmpty();
+	}
+
+	// Get lowercase names of all items in the directory if needed
+	if (filter_dir != current_dir)
+	{
+		filter_names.clear();
+		ArchiveEntry* entry = getEntry(0, false);
+		while (entry)
+		{
+			filter_names.push_back(entry->getName().Lower());
+			entry = getEntry(filter_names.size(), false);
+		}
+		filter_dir = current_dir;
+	}
+	filter_prev_text = filter_text;
+	filter_prev_category = filter_category;
+	filter_prev_dirs = elist_filter_dirs;
 
 	// Check if any filters were given
 	if (filter_text.IsEmpty() && filter_category.IsEmpty())
 	{
 		// No filter, just refresh the list
+		items.clear();
 		unsigned count = current_dir->numEntries() + current_dir->nChildren();
 		for (unsigned a = 0; a < count; a++)
 			items.push_back(a);
@@ -433,65 +553,45 @@ void ArchiveEntryList::applyFilter()
 		return;
 	}
 
-	// Filter by category
-	unsigned index = 0;
-	ArchiveEntry* entry = getEntry(index, false);
-	while (entry)
+	// Compile name filter terms (split by ,)
+	vector<elist_filter_term_t> terms;
+	if (!filter_text.IsEmpty())
 	{
-		if (filter_category.IsEmpty() || entry->getType() == EntryType::folderType())
-			items.push_back(index);	// If no category specified, just add all entries to the filter
-		else
-		{
-			// Check for category match
-			if (S_CMPNOCASE(entry->getType()->getCategory(), filter_category))
-				items.push_back(index);
-		}
-
-		entry = getEntry(++index, false);
+		wxArrayString split = wxSplit(filter_text, ',');
+		for (unsigned a = 0; a < split.size(); a++)
+			terms.push_back(elist_filter_term_t(split[a]));
 	}
 
-	// Now filter by name if needed
-	if (!filter_text.IsEmpty())
+	// Get items to check (the current items, or everything in the directory)
+	vector<long> check;
+	if (narrow)
+		check.swap(items);
+	else
 	{
-		// Split filter by ,
-		wxArrayString terms = wxSplit(filter_text, ',');
-
-		// Process filter strings
-		for (unsigned a = 0; a < terms.size(); a++)
-		{
-			// Remove spaces
-			terms[a].Replace(" ", "");
-
-			// Set to lowercase and add * to the end
-			if (!terms[a].IsEmpty()) terms[a] = terms[a].Lower() + "*";
-		}
+		for (unsigned a = 0; a < filter_names.size(); a++)
+			check.push_back(a);
+	}
+	items.clear();
 
-		// Go through filtered list
-		for (unsigned a = 0; a < items.size(); a++)
-		{
-			entry = getEntry(items[a], false);
+	// Filter items
+	for (unsigned a = 0; a < check.size(); a++)
+	{
+		long index = check[a];
+		ArchiveEntry* entry = getEntry(index, false);
+		if (!entry)
+			continue;
+		bool folder = (entry->getType() == EntryType::folderType());
 
-			// Don't filter folders if !elist_filter_dirs
-			if (!elist_filter_dirs && entry->getType() == EntryType::folderType())
-				continue;
+		// Filter by category
+		if (!filter_category.IsEmpty() && !folder && !S_CMPNOCASE(entry->getType()->getCategory(), filter_category))
+			continue;
 
-			// Check for name match with filter
-			bool match = false;
-			for (unsigned b = 0; b < terms.size(); b++)
-			{
-				if (entry == entry_dir_back || entry->getName().Lower().Matches(terms[b]))
-				{
-					match = true;
-					continue;
-				}
-			}
-			if (match)
-				continue;
+		// Filter by name (folders are only filtered if elist_filter_dirs is set)
+		if (!terms.empty() && entry != entry_dir_back && (elist_filter_dirs || !folder) &&
+		        !elistMatchFilter(filter_names[index], terms))
+			continue;
 
-			// No match, remove from filtered list
-			items.erase(items.begin() + a);
-			a--;
-		}
+		items.push_back(index);
 	}
 
 	// Update the list
@@ -826,6 +926,10 @@ void ArchiveEntryList::labelEdited(int col, int index, string new_label)
  *******************************************************************/
 void ArchiveEntryList::onAnnouncement(Announcer* announcer, string event_name, MemChunk& event_data)
 {
+	// Entry names/indices may have changed
+	if (announcer == archive)
+		filter_dir = NULL;
+
 	if (entries_update && announcer == archive && event_name != "closed")
 	{
 		//updateList();
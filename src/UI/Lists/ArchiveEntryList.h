@@ -25,6 +25,13 @@ private:
 	int					col_type;
 	bool				entries_update;
 
+	// Filter state (see applyFilter)
+	ArchiveTreeNode*	filter_dir;			// Directory filter_names are for (NULL if out of date)
+	vector<string>		filter_names;		// Lowercase names of all items in filter_dir
+	string				filter_prev_text;	// The filter the current items were filtered with
+	string				filter_prev_category;
+	bool				filter_prev_dirs;
+
 	int	entrySize(long index);
 
 protected:
@@ -40,7 +47,7 @@ public:
 	ArchiveTreeNode*	getCurrentDir() { return current_dir; }
 
 	bool	showDirBack() { return show_dir_back; }
-	void	showDirBack(bool db) { show_dir_back = db; }
+	void	showDirBack(bool db) { show_dir_back = db; filter_dir = NULL; }
 
 	void	setArchive(Archive* archive);
 	void	setUndoManager(UndoManager* manager) { undo_manager = manager; }
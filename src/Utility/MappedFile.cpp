@@ -0,0 +1,159 @@
+
+/*******************************************************************
+ * SLADE - It's a Doom Editor
+ * Copyright (C) 2008-2014 Simon Judd
+ *
+ * Email:       sirjuddington@gmail.com
+ * Web:         http://slade.mancubus.net
+ * Filename:    MappedFile.cpp
+ * Description: MappedFile class, a reference counted memory mapping
+ *              of a file on disk. Archives use it as a backing store
+ *              so unmodified entry data can be viewed directly from
+ *              the file without being read into memory first.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *******************************************************************/
+
+
+/*******************************************************************
+ * INCLUDES
+ *******************************************************************/
+#include "Main.h"
+#include "MappedFile.h"
+
+#ifdef __WXMSW__
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+/*******************************************************************
+ * MAPPEDFILE CLASS FUNCTIONS
+ *******************************************************************/
+
+/* MappedFile::MappedFile
+ * MappedFile class constructor (private, use MappedFile::open)
+ *******************************************************************/
+MappedFile::MappedFile(string filename)
+{
+	// Init variables
+	this->filename = filename;
+	this->data = NULL;
+	this->size = 0;
+	this->refs = 1;
+}
+
+/* MappedFile::~MappedFile
+ * MappedFile class destructor
+ *******************************************************************/
+MappedFile::~MappedFile()
+{
+	// Unmap the file
+	if (data)
+	{
+#ifdef __WXMSW__
+		UnmapViewOfFile(data);
+#else
+		munmap(data, size);
+#endif
+	}
+}
+
+/* MappedFile::release
+ * Releases a reference to the mapping, the mapping is deleted when
+ * no references remain
+ *******************************************************************/
+void MappedFile::release()
+{
+	if (wxAtomicDec(refs) == 0)
+		delete this;
+}
+
+
+/*******************************************************************
+ * MAPPEDFILE CLASS STATIC FUNCTIONS
+ *******************************************************************/
+
+/* MappedFile::open (static)
+ * Maps [filename] into memory. The mapping is read-only, so any
+ * (accidental) write to the mapped data faults. Returns the new
+ * mapping with a single reference held by the caller, or NULL if the
+ * file couldn't be mapped (empty, too large, or an OS failure)
+ *******************************************************************/
+MappedFile* MappedFile::open(string filename)
+{
+	uint8_t* data = NULL;
+	uint32_t size = 0;
+
+#ifdef __WXMSW__
+	// Open the file
+	HANDLE file = CreateFileW(filename.wc_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	// Check size (MemChunks are limited to 32bit sizes)
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0 || file_size.QuadPart > 0xFFFFFFFFLL)
+	{
+		CloseHandle(file);
+		return NULL;
+	}
+	size = (uint32_t)file_size.QuadPart;
+
+	// Map it (the view keeps the mapping alive, so the handles can be closed straight away)
+	HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping)
+	{
+		data = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+#else
+	// Open the file
+	int fd = ::open(filename.fn_str(), O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	// Check size (MemChunks are limited to 32bit sizes)
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0 || (uint64_t)info.st_size > 0xFFFFFFFFULL)
+	{
+		close(fd);
+		return NULL;
+	}
+	size = (uint32_t)info.st_size;
+
+	// Map it (the mapping stays valid after the descriptor is closed)
+	void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapped != MAP_FAILED)
+		data = (uint8_t*)mapped;
+	close(fd);
+#endif
+
+	if (!data)
+	{
+		LOG_MESSAGE(1, "MappedFile::open: Unable to map file %s", filename);
+		return NULL;
+	}
+
+	MappedFile* mf = new MappedFile(filename);
+	mf->data = data;
+	mf->size = size;
+	return mf;
+}
@@ -0,0 +1,36 @@
+
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <wx/atomic.h>
+
+// A read-only memory mapping of a file on disk (MemChunks viewing it
+// must detach before writing, see MemChunk::detach).
+// MappedFiles are reference counted, MemChunks that view the mapping
+// hold a reference so the mapping lives as long as any view of it.
+// References can be added and released from any thread
+class MappedFile
+{
+private:
+	string		filename;
+	uint8_t*	data;
+	uint32_t	size;
+	wxAtomicInt	refs;
+
+	MappedFile(string filename);
+
+public:
+	~MappedFile();
+
+	string		getFilename() { return filename; }
+	uint8_t*	getData() { return data; }
+	uint32_t	getSize() { return size; }
+	bool		contains(const uint8_t* ptr) { return ptr >= data && ptr < data + size; }
+
+	void	addRef() { wxAtomicInc(refs); }
+	void	release();
+
+	static MappedFile*	open(string filename);
+};
+
+#endif//__MAPPED_FILE_H__
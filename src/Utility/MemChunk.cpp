@@ -30,6 +30,7 @@
  *******************************************************************/
 #include "Main.h"
 #include "MemChunk.h"
+#include "MappedFile.h"
 #include "General/Misc.h"
 #include <wx/log.h>
 
@@ -46,6 +47,7 @@ MemChunk::MemChunk(uint32_t size)
 	// Init variables
 	this->size = size;
 	this->cur_ptr = 0;
+	this->mapping = NULL;
 
 	// If a size is specified, allocate that much memory
 	if (size)
@@ -63,6 +65,7 @@ MemChunk::MemChunk(const uint8_t* data, uint32_t size)
 	this->cur_ptr = 0;
 	this->data = NULL;
 	this->size = size;
+	this->mapping = NULL;
 
 	// Load given data
 	importMem(data, size);
@@ -74,8 +77,7 @@ MemChunk::MemChunk(const uint8_t* data, uint32_t size)
 MemChunk::~MemChunk()
 {
 	// Free memory
-	if (data)
-		delete[] data;
+	freeData();
 }
 
 /* MemChunk::hasData
@@ -97,8 +99,7 @@ bool MemChunk::clear()
 {
 	if (hasData())
 	{
-		delete[] data;
-		data = NULL;
+		freeData();
 		size = 0;
 		cur_ptr = 0;
 		return true;
@@ -128,8 +129,8 @@ bool MemChunk::reSize(uint32_t new_size, bool preserve_data)
 	// Preserve existing data if specified
 	if (preserve_data)
 	{
-		memcpy(ndata, data, size * sizeof(uint8_t));
-		delete[] data;
+		memcpy(ndata, data, MIN(size, new_size) * sizeof(uint8_t));
+		freeData();
 		data = ndata;
 	}
 	else
@@ -268,6 +269,85 @@ bool MemChunk::importMem(const uint8_t* start, uint32_t len)
 	return true;
 }
 
+/* MemChunk::importMapped
+ * Sets the MemChunk to view [len] bytes at [offset] within the mapped
+ * [file], rather than copying the data. The view is read-only, any
+ * write to the MemChunk will first copy the viewed data into memory
+ * (see MemChunk::detach)
+ * Returns false if the given range is outside the mapping
+ *******************************************************************/
+bool MemChunk::importMapped(MappedFile* file, uint32_t offset, uint32_t len)
+{
+	// Check parameters
+	if (!file || offset > file->getSize() || len > file->getSize() - offset)
+		return false;
+
+	// Keep the mapping alive while this MemChunk views it
+	// (done first in case [file] is the mapping this chunk already views)
+	file->addRef();
+
+	// Clear current data if it exists
+	clear();
+
+	// Setup the view
+	cur_ptr = 0;
+	size = len;
+	if (size > 0)
+	{
+		data = file->getData() + offset;
+		mapping = file;
+	}
+	else
+		file->release();
+
+	return true;
+}
+
+/* MemChunk::importView
+ * Sets the MemChunk to view [len] bytes starting from [start] in
+ * [mc]. If [mc] is itself a mapped file view, this chunk will view
+ * the same mapping without copying any data, otherwise the data is
+ * copied as with importMem
+ *******************************************************************/
+bool MemChunk::importView(MemChunk& mc, uint32_t start, uint32_t len)
+{
+	// Check parameters
+	if (start > mc.size || len > mc.size - start)
+		return false;
+
+	if (mc.mapping)
+	{
+		uint32_t offset = (uint32_t)(mc.data - mc.mapping->getData());
+		return importMapped(mc.mapping, offset + start, len);
+	}
+	else
+		return importMem(mc.data + start, len);
+}
+
+/* MemChunk::detach
+ * If the MemChunk is a view into a mapped file, copies the viewed
+ * data into memory owned by this MemChunk so it can be modified.
+ * Returns false if the copy couldn't be allocated
+ *******************************************************************/
+bool MemChunk::detach()
+{
+	// Nothing to do if not a view
+	if (!mapping)
+		return true;
+
+	// Copy viewed data
+	uint8_t* ndata = allocData(size, false);
+	if (!ndata)
+		return false;
+	memcpy(ndata, data, size);
+
+	// Release the mapping
+	freeData();
+	data = ndata;
+
+	return true;
+}
+
 /* MemChunk::exportFile
  * Writes the MemChunk data to a new file of [filename], starting
  * from [start] to [start+size]. If [size] is 0, writes from [start]
@@ -339,7 +419,14 @@ bool MemChunk::write(const void* data, uint32_t size)
 	// If we're trying to write past the end of the memory chunk,
 	// resize it so we can write at this point
 	if (cur_ptr + size > this->size)
-		reSize(cur_ptr + size, true);
+	{
+		if (!reSize(cur_ptr + size, true))
+			return false;
+	}
+
+	// Never write into a mapped file view
+	else if (mapping && !detach())
+		return false;
 
 	// Write the data and move to the byte after what was written
 	memcpy(this->data + cur_ptr, data, size);
@@ -456,6 +543,10 @@ bool MemChunk::fillData(uint8_t val)
 	if (!hasData())
 		return false;
 
+	// Don't write into a mapped file view
+	if (mapping && !detach())
+		return false;
+
 	// Fill data with value
 	memset(data, val, size);
 
@@ -476,6 +567,23 @@ uint32_t MemChunk::crc()
 }
 
 
+/* MemChunk::freeData
+ * Frees the MemChunk's data, or releases the mapping it views.
+ * Doesn't update the size or position
+ *******************************************************************/
+void MemChunk::freeData()
+{
+	if (mapping)
+	{
+		mapping->release();
+		mapping = NULL;
+	}
+	else if (data)
+		delete[] data;
+
+	data = NULL;
+}
+
 /* MemChunk::allocData
  * Allocates [size] bytes of data and returns it, or NULL if the
  * allocation failed. If [set_data] is true, the MemChunk data will
@@ -1,27 +1,35 @@
 
 #pragma once
 
+class MappedFile;
+
 class MemChunk
 {
 protected:
 	uint8_t*	data;
 	uint32_t	cur_ptr;
 	uint32_t	size;
+	MappedFile*	mapping;	// If set, data is a view into this mapped file rather than owned memory
 
 	uint8_t*	allocData(uint32_t size, bool set_data = true);
+	void		freeData();
 
 public:
 	MemChunk(uint32_t size = 0);
 	MemChunk(const uint8_t* data, uint32_t size);
 	~MemChunk();
 
-	uint8_t& operator[](int a) { return data[a]; }
+	// Read-only, since the data may be a shared view into a mapped file
+	// (use write to modify data, which detaches the view first)
+	const uint8_t& operator[](int a) { return data[a]; }
 
 	// Accessors
 	const uint8_t*	getData() { return data; }
 	uint32_t		getSize() { return size; }
 
 	bool hasData();
+	bool isMapped() { return mapping != NULL; }
+	MappedFile*	getMapping() { return mapping; }
 
 	bool clear();
 	bool reSize(uint32_t new_size, bool preserve_data = true);
@@ -30,6 +38,9 @@ public:
 	bool	importFile(string filename, uint32_t offset = 0, uint32_t len = 0);
 	bool	importFileStream(wxFile& file, uint32_t len = 0);
 	bool	importMem(const uint8_t* start, uint32_t len);
+	bool	importMapped(MappedFile* file, uint32_t offset, uint32_t len);
+	bool	importView(MemChunk& mc, uint32_t start, uint32_t len);
+	bool	detach();
 
 	// Data export
 	bool	exportFile(string filename, uint32_t start = 0, uint32_t size = 0);
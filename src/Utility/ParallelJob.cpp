@@ -0,0 +1,190 @@
+
+/*******************************************************************
+ * SLADE - It's a Doom Editor
+ * Copyright (C) 2008-2014 Simon Judd
+ *
+ * Email:       sirjuddington@gmail.com
+ * Web:         http://slade.mancubus.net
+ * Filename:    ParallelJob.cpp
+ * Description: ParallelJob class, splits a job made up of independent
+ *              items across a number of worker threads. The calling
+ *              thread takes part in the work and is the only thread
+ *              that reports progress
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *******************************************************************/
+
+
+/*******************************************************************
+ * INCLUDES
+ *******************************************************************/
+#include "Main.h"
+#include "ParallelJob.h"
+
+
+/*******************************************************************
+ * PARALLELJOBTHREAD CLASS
+ *******************************************************************
+ * A joinable worker thread that processes batches of a ParallelJob
+ * until there are none left
+ */
+class ParallelJobThread : public wxThread
+{
+private:
+	ParallelJob*	job;
+
+public:
+	ParallelJobThread(ParallelJob* job) : wxThread(wxTHREAD_JOINABLE)
+	{
+		this->job = job;
+	}
+
+	ExitCode Entry()
+	{
+		job->work(false);
+		return 0;
+	}
+};
+
+
+/*******************************************************************
+ * PARALLELJOB CLASS FUNCTIONS
+ *******************************************************************/
+
+/* ParallelJob::ParallelJob
+ * ParallelJob class constructor
+ *******************************************************************/
+ParallelJob::ParallelJob()
+{
+	// Init variables
+	count = 0;
+	next = 0;
+	done = 0;
+	batch_size = 1;
+}
+
+/* ParallelJob::~ParallelJob
+ * ParallelJob class destructor
+ *******************************************************************/
+ParallelJob::~ParallelJob()
+{
+}
+
+/* ParallelJob::nextBatch
+ * Claims the next batch of items to process, writing its index range
+ * to [start] and [end]. Returns false if there are no items left
+ *******************************************************************/
+bool ParallelJob::nextBatch(unsigned& start, unsigned& end)
+{
+	wxMutexLocker lock(mutex);
+
+	if (next >= count)
+		return false;
+
+	start = next;
+	end = MIN(next + batch_size, count);
+	next = end;
+
+	return true;
+}
+
+/* ParallelJob::work
+ * Processes batches of items until none are left. If
+ * [report_progress] is true, progress() is called after each batch
+ *******************************************************************/
+void ParallelJob::work(bool report_progress)
+{
+	unsigned start, end;
+	while (nextBatch(start, end))
+	{
+		for (unsigned a = start; a < end; a++)
+			process(a);
+
+		// Update done count
+		unsigned total_done;
+		{
+			wxMutexLocker lock(mutex);
+			done += (end - start);
+			total_done = done;
+		}
+
+		if (report_progress)
+			progress(total_done, count);
+	}
+}
+
+/* ParallelJob::run
+ * Processes [count] items using up to [threads] threads (including
+ * the calling thread, 0 means one per CPU). Items are handed out in
+ * batches of [batch_size]. Returns once all items are processed
+ *******************************************************************/
+void ParallelJob::run(unsigned count, unsigned threads, unsigned batch_size)
+{
+	// Init job
+	this->count = count;
+	this->batch_size = MAX(batch_size, 1u);
+	next = 0;
+	done = 0;
+
+	// No point in having more threads than batches
+	if (threads == 0)
+		threads = numThreads(0);
+	unsigned batches = (count + this->batch_size - 1) / this->batch_size;
+	if (threads > batches)
+		threads = batches;
+
+	// Start worker threads (if any fail to start, the remaining work
+	// is simply shared between the threads that did)
+	vector<ParallelJobThread*> workers;
+	for (unsigned a = 1; a < threads; a++)
+	{
+		ParallelJobThread* thread = new ParallelJobThread(this);
+		if (thread->Create() != wxTHREAD_NO_ERROR || thread->Run() != wxTHREAD_NO_ERROR)
+		{
+			delete thread;
+			break;
+		}
+		workers.push_back(thread);
+	}
+
+	// Do work on this thread too
+	work(true);
+
+	// Wait for workers to finish
+	for (unsigned a = 0; a < workers.size(); a++)
+	{
+		workers[a]->Wait();
+		delete workers[a];
+	}
+}
+
+
+/*******************************************************************
+ * PARALLELJOB CLASS STATIC FUNCTIONS
+ *******************************************************************/
+
+/* ParallelJob::numThreads (static)
+ * Returns the number of threads to use for a job given a [requested]
+ * thread count (eg. from a cvar), where anything below 1 means one
+ * thread per CPU
+ *******************************************************************/
+unsigned ParallelJob::numThreads(int requested)
+{
+	if (requested > 0)
+		return requested;
+
+	int cpus = wxThread::GetCPUCount();
+	return cpus > 0 ? cpus : 1;
+}
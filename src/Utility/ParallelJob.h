@@ -0,0 +1,36 @@
+
+#ifndef __PARALLEL_JOB_H__
+#define __PARALLEL_JOB_H__
+
+#include <wx/thread.h>
+
+// A job made up of a number of independent items that can be processed
+// concurrently. Subclasses implement process(), which is called once for
+// each item index from the calling thread and any worker threads.
+// process() must not touch anything shared with other items (or the UI),
+// results should be stored per-index and applied after run() returns
+class ParallelJob
+{
+private:
+	unsigned	count;
+	unsigned	next;
+	unsigned	done;
+	unsigned	batch_size;
+	wxMutex		mutex;
+
+	bool	nextBatch(unsigned& start, unsigned& end);
+
+public:
+	ParallelJob();
+	virtual ~ParallelJob();
+
+	virtual void	process(unsigned index) = 0;
+	virtual void	progress(unsigned done, unsigned total) {}
+
+	void	run(unsigned count, unsigned threads = 0, unsigned batch_size = 32);
+	void	work(bool report_progress);
+
+	static unsigned	numThreads(int requested);
+};
+
+#endif//__PARALLEL_JOB_H__